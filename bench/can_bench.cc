@@ -0,0 +1,146 @@
+#include <can.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <variant>
+
+namespace {
+
+// Stand-in for a bxCAN mailbox, so that the cost of moving a message in and out of the registers can be compared
+// between the two message representations.
+struct Mailbox {
+    volatile std::uint32_t ir;
+    volatile std::uint32_t dtr;
+    volatile std::uint32_t dlr;
+    volatile std::uint32_t dhr;
+};
+
+void write_mailbox(Mailbox &mailbox, const can::Message &message) {
+    if (auto *standard = std::get_if<can::StandardIdentifier>(&message.identifier)) {
+        mailbox.ir = *standard << 21u;
+    } else {
+        mailbox.ir = (message.extended_id() << 3u) | can::RawMessage::k_ide_bit;
+    }
+    mailbox.dtr = message.length & 0xfu;
+    mailbox.dlr = (static_cast<std::uint32_t>(message.data[3]) << 24u) |
+                  (static_cast<std::uint32_t>(message.data[2]) << 16u) |
+                  (static_cast<std::uint32_t>(message.data[1]) << 8u) | message.data[0];
+    mailbox.dhr = (static_cast<std::uint32_t>(message.data[7]) << 24u) |
+                  (static_cast<std::uint32_t>(message.data[6]) << 16u) |
+                  (static_cast<std::uint32_t>(message.data[5]) << 8u) | message.data[4];
+}
+
+void write_mailbox(Mailbox &mailbox, const can::RawMessage &message) {
+    mailbox.ir = message.id_word;
+    mailbox.dtr = message.length & 0xfu;
+    mailbox.dlr = message.data_low;
+    mailbox.dhr = message.data_high;
+}
+
+can::Message read_message(const Mailbox &mailbox) {
+    const std::uint32_t ir = mailbox.ir;
+    const std::uint32_t dlr = mailbox.dlr;
+    const std::uint32_t dhr = mailbox.dhr;
+    can::Identifier identifier = can::StandardIdentifier(static_cast<std::uint16_t>(ir >> 21u));
+    if ((ir & can::RawMessage::k_ide_bit) != 0u) {
+        identifier = can::ExtendedIdentifier(ir >> 3u);
+    }
+    return {
+        .identifier = identifier,
+        .data{
+            static_cast<std::uint8_t>(dlr & 0xffu),
+            static_cast<std::uint8_t>((dlr >> 8u) & 0xffu),
+            static_cast<std::uint8_t>((dlr >> 16u) & 0xffu),
+            static_cast<std::uint8_t>((dlr >> 24u) & 0xffu),
+            static_cast<std::uint8_t>(dhr & 0xffu),
+            static_cast<std::uint8_t>((dhr >> 8u) & 0xffu),
+            static_cast<std::uint8_t>((dhr >> 16u) & 0xffu),
+            static_cast<std::uint8_t>((dhr >> 24u) & 0xffu),
+        },
+        .length = static_cast<std::uint8_t>(mailbox.dtr & 0xfu),
+    };
+}
+
+can::RawMessage read_raw_message(const Mailbox &mailbox) {
+    return {
+        .id_word = mailbox.ir,
+        .data_low = mailbox.dlr,
+        .data_high = mailbox.dhr,
+        .length = static_cast<std::uint8_t>(mailbox.dtr & 0xfu),
+    };
+}
+
+constexpr auto k_payload = std::to_array<std::uint8_t>({0x00, 0x00, 0x24, 0x5e, 0x00, 0x71, 0x01, 0x86});
+
+void BM_MessageTransmit(benchmark::State &state) {
+    Mailbox mailbox{};
+    const auto message = can::build_extended(0x2005, k_payload);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&message);
+        write_mailbox(mailbox, message);
+    }
+    state.counters["bytes"] = sizeof(can::Message);
+}
+BENCHMARK(BM_MessageTransmit);
+
+void BM_RawMessageTransmit(benchmark::State &state) {
+    Mailbox mailbox{};
+    const auto message = can::RawMessage::extended(0x2005, k_payload);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&message);
+        write_mailbox(mailbox, message);
+    }
+    state.counters["bytes"] = sizeof(can::RawMessage);
+}
+BENCHMARK(BM_RawMessageTransmit);
+
+void BM_MessageReceive(benchmark::State &state) {
+    Mailbox mailbox{};
+    write_mailbox(mailbox, can::RawMessage::extended(0x2005, k_payload));
+    for (auto _ : state) {
+        auto message = read_message(mailbox);
+        benchmark::DoNotOptimize(message);
+    }
+    state.counters["bytes"] = sizeof(can::Message);
+}
+BENCHMARK(BM_MessageReceive);
+
+void BM_RawMessageReceive(benchmark::State &state) {
+    Mailbox mailbox{};
+    write_mailbox(mailbox, can::RawMessage::extended(0x2005, k_payload));
+    for (auto _ : state) {
+        auto message = read_raw_message(mailbox);
+        benchmark::DoNotOptimize(message);
+    }
+    state.counters["bytes"] = sizeof(can::RawMessage);
+}
+BENCHMARK(BM_RawMessageReceive);
+
+void BM_MessageReadErpm(benchmark::State &state) {
+    const auto message = can::build_extended(0x2005, k_payload);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&message);
+        const auto id = message.extended_id() >> 8u;
+        const auto erpm = static_cast<std::int32_t>((message.data[0] << 24u) | (message.data[1] << 16u) |
+                                                    (message.data[2] << 8u) | message.data[3]);
+        benchmark::DoNotOptimize(id);
+        benchmark::DoNotOptimize(erpm);
+    }
+}
+BENCHMARK(BM_MessageReadErpm);
+
+void BM_RawMessageReadErpm(benchmark::State &state) {
+    const auto message = can::RawMessage::extended(0x2005, k_payload);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&message);
+        const auto id = message.extended_id() >> 8u;
+        const auto erpm = message.read_be<std::int32_t>(0);
+        benchmark::DoNotOptimize(id);
+        benchmark::DoNotOptimize(erpm);
+    }
+}
+BENCHMARK(BM_RawMessageReadErpm);
+
+} // namespace
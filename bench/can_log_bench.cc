@@ -0,0 +1,71 @@
+#include <can_log.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+constexpr std::size_t k_line_count = 100'000;
+
+// Builds a log of the five status packets of two inverters with changing values, interleaved with other traffic as on
+// the car.
+std::string make_log(bool asc) {
+    std::string log;
+    if (asc) {
+        log += "date Tue Jan 1 00:00:00 2026\nbase hex  timestamps absolute\n";
+    }
+    std::array<char, 128> line{};
+    for (std::size_t i = 0; i < k_line_count; i++) {
+        const auto time = static_cast<double>(i) * 0.0005;
+        const auto packet = static_cast<unsigned>(i % 6);
+        const auto id = packet < 5 ? (0x20u + packet) << 8u | (0x21u + static_cast<unsigned>(i / 6 % 2)) : 0x100u;
+        const auto value = static_cast<unsigned>(i * 37 % 65536);
+        const char *format = asc ? "%11.6f 1  %xx  Rx   d 8 %02x %02x 01 02 03 04 %02x 18\n"
+                                 : "(%.6f) can0 %08X#%02X%02X01020304%02X18\n";
+        const int length =
+            std::snprintf(line.data(), line.size(), format, time, id, value >> 8u, value & 0xffu, value & 0x7u);
+        log.append(line.data(), static_cast<std::size_t>(length));
+    }
+    return log;
+}
+
+void BM_CanLogRead(benchmark::State &state) {
+    const auto log = make_log(state.range(0) != 0);
+    for (auto _ : state) {
+        can_log::Reader reader(log);
+        std::size_t count = 0;
+        while (const auto record = reader.next()) {
+            benchmark::DoNotOptimize(record->message);
+            count++;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * log.size()));
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * k_line_count));
+}
+BENCHMARK(BM_CanLogRead)->ArgName("asc")->Arg(0)->Arg(1);
+
+// Reads and decodes a log into CSV, as the can-log tool does, but without writing it out.
+void BM_CanLogCsv(benchmark::State &state) {
+    const auto log = make_log(state.range(0) != 0);
+    std::string csv;
+    csv.reserve(log.size() * 2);
+    for (auto _ : state) {
+        csv.clear();
+        can_log::Reader reader(log);
+        while (const auto record = reader.next()) {
+            can_log::append_csv_row(csv, *record);
+        }
+        benchmark::DoNotOptimize(csv.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * log.size()));
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * k_line_count));
+}
+BENCHMARK(BM_CanLogCsv)->ArgName("asc")->Arg(0)->Arg(1);
+
+} // namespace
@@ -0,0 +1,100 @@
+#include <dti.hh>
+
+#include <can.hh>
+#include <util.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+namespace {
+
+// The hand-written decoder which the signal codec replaced, kept as a baseline.
+dti::GeneralData5 decode_general_data_5_by_hand(std::span<const std::uint8_t, 8> span) {
+    return dti::GeneralData5{
+        .throttle = static_cast<std::int8_t>(span[0]),
+        .brake = static_cast<std::int8_t>(span[1]),
+        .digital_pin_state = span[2],
+        .drive_enabled = span[3] != 0u,
+        .capacitor_temperature_limit_active = ((span[4] >> 0u) & 1u) != 0u,
+        .dc_current_limit_active = ((span[4] >> 1u) & 1u) != 0u,
+        .drive_enable_limit_active = ((span[4] >> 2u) & 1u) != 0u,
+        .igbt_acceleration_limit_active = ((span[4] >> 3u) & 1u) != 0u,
+        .igbt_temperature_limit_active = ((span[4] >> 4u) & 1u) != 0u,
+        .input_voltage_limit_active = ((span[4] >> 5u) & 1u) != 0u,
+        .motor_acceleration_temperature_limit_active = ((span[4] >> 6u) & 1u) != 0u,
+        .motor_temperature_limit_active = ((span[4] >> 7u) & 1u) != 0u,
+        .rpm_min_limit_active = ((span[5] >> 0u) & 1u) != 0u,
+        .rpm_max_limit_active = ((span[5] >> 1u) & 1u) != 0u,
+        .power_limit_active = ((span[5] >> 2u) & 1u) != 0u,
+        .can_map_version = span[7],
+    };
+}
+
+dti::GeneralData1 decode_general_data_1_by_hand(std::span<const std::uint8_t, 8> span) {
+    return dti::GeneralData1{
+        .erpm = util::read_be<std::int32_t>(span.subspan<0, 4>()),
+        .duty_cycle = util::read_be<std::int16_t>(span.subspan<4, 2>()),
+        .input_voltage = util::read_be<std::int16_t>(span.subspan<6, 2>()),
+    };
+}
+
+constexpr std::array<std::uint8_t, 8> k_data{0xff, 0xfe, 0x1d, 0xc0, 0x03, 0xe8, 0x02, 0x58};
+
+void BM_DtiGeneralData1ByHand(benchmark::State &state) {
+    auto data = k_data;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data);
+        benchmark::DoNotOptimize(decode_general_data_1_by_hand(data));
+    }
+}
+BENCHMARK(BM_DtiGeneralData1ByHand);
+
+void BM_DtiGeneralData1Codec(benchmark::State &state) {
+    auto data = k_data;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data);
+        benchmark::DoNotOptimize(dti::GeneralData1Codec::decode(data));
+    }
+}
+BENCHMARK(BM_DtiGeneralData1Codec);
+
+void BM_DtiGeneralData5ByHand(benchmark::State &state) {
+    auto data = k_data;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data);
+        benchmark::DoNotOptimize(decode_general_data_5_by_hand(data));
+    }
+}
+BENCHMARK(BM_DtiGeneralData5ByHand);
+
+void BM_DtiGeneralData5Codec(benchmark::State &state) {
+    auto data = k_data;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(data);
+        benchmark::DoNotOptimize(dti::GeneralData5Codec::decode(data));
+    }
+}
+BENCHMARK(BM_DtiGeneralData5Codec);
+
+// Decoding from the mailbox words skips unpacking the data bytes entirely.
+void BM_DtiGeneralData5CodecRaw(benchmark::State &state) {
+    auto message = can::RawMessage::standard(0x123, k_data);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(message);
+        benchmark::DoNotOptimize(dti::GeneralData5Codec::decode(message));
+    }
+}
+BENCHMARK(BM_DtiGeneralData5CodecRaw);
+
+void BM_DtiParsePacket(benchmark::State &state) {
+    const auto message = can::build_extended(dti::packet_identifier(dti::k_general_data_5_id, 1), k_data);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dti::parse_packet(message));
+    }
+}
+BENCHMARK(BM_DtiParsePacket);
+
+} // namespace
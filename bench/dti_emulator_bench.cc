@@ -0,0 +1,110 @@
+#include <dti_emulator.hh>
+
+#include <can.hh>
+#include <can_load.hh>
+#include <can_virtual.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace {
+
+constexpr std::uint32_t k_bitrate = 500'000;
+constexpr std::uint32_t k_bits_per_ms = k_bitrate / 1000;
+constexpr std::uint8_t k_node_id = 0x05;
+constexpr auto k_node_ids = std::to_array<std::uint8_t>({k_node_id});
+
+// Maximum age of the AC current used to detect the response, in microseconds.
+constexpr std::uint32_t k_max_age = 50'000;
+
+dti::Emulator *s_emulator = nullptr;
+dti::InverterTable *s_table = nullptr;
+can::VirtualBus *s_bus = nullptr;
+
+// Measures the host time taken to model one second of an emulated inverter.
+void BM_DtiEmulatorSecond(benchmark::State &state) {
+    dti::Emulator emulator({.node_id = k_node_id});
+    std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+    std::uint32_t now = 0;
+    emulator.on_frame(can::RawMessage::from_message(dti::build_set_relative_current(k_node_id, 500)), now);
+    for (auto _ : state) {
+        for (std::uint32_t i = 0; i < 1000; i++) {
+            benchmark::DoNotOptimize(emulator.poll(now++, frames));
+        }
+        // Keep the command alive so that the model doesn't settle into free-running.
+        emulator.on_frame(can::RawMessage::from_message(dti::build_set_relative_current(k_node_id, 500)), now);
+    }
+}
+BENCHMARK(BM_DtiEmulatorSecond);
+
+// Runs a control loop like the one on the apps board against an emulated inverter over a virtual bus, sending a
+// relative current command at the given period and tracking the inverter in an InverterTable. Each iteration steps
+// the throttle from zero to half and runs for one simulated second. Besides the host time per simulated second,
+// reports the time from the throttle step until the reported AC current reaches 90% of its target, and the bus
+// utilisation.
+void BM_DtiClosedLoop(benchmark::State &state) {
+    const auto command_period = static_cast<std::uint32_t>(state.range(0));
+    std::uint32_t latency = 0;
+    double utilisation = 0.0;
+    for (auto _ : state) {
+        can::VirtualBus bus(k_bitrate);
+        can::VirtualNode control_node(bus);
+        can::VirtualNode inverter_node(bus);
+        dti::Emulator emulator({.node_id = k_node_id});
+        dti::InverterTable table(k_node_ids, k_bitrate);
+        s_bus = &bus;
+        s_emulator = &emulator;
+        s_table = &table;
+
+        control_node.select();
+        if (!can::init(can::Port::B, can::Speed::_500, {.timestamps = true})) {
+            state.SkipWithError("CAN init failed");
+            break;
+        }
+        can::route_filter(0, 0, 0, 0);
+        can::set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t timestamp) {
+            s_table->update(message.to_message(), timestamp);
+        });
+        inverter_node.select();
+        if (!can::init(can::Port::B, can::Speed::_500, {.timestamps = true})) {
+            state.SkipWithError("CAN init failed");
+            break;
+        }
+        can::route_filter(0, 0, 0, 0);
+        can::set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t) {
+            s_emulator->on_frame(message, s_bus->now());
+        });
+
+        latency = 0;
+        std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+        for (std::uint32_t now = 0; now < 1000; now++) {
+            if (now % command_period == 0) {
+                control_node.select();
+                can::transmit(dti::build_set_relative_current(k_node_id, 500));
+            }
+            inverter_node.select();
+            can::transmit(emulator.poll(now, frames));
+
+            const auto begin = bus.time();
+            bus.run(16);
+            bus.idle(k_bits_per_ms - std::min<std::uint64_t>(bus.time() - begin, k_bits_per_ms));
+
+            const auto current = table[0].ac_current(static_cast<std::uint32_t>(bus.time()), k_max_age);
+            if (latency == 0 && current && *current >= 900) {
+                latency = now + 1;
+            }
+        }
+        utilisation = static_cast<double>(can::frame_bits(true, 8)) * bus.frame_count() /
+                      static_cast<double>(bus.time());
+    }
+    state.counters["latency_ms"] = latency;
+    state.counters["utilisation"] = utilisation;
+}
+BENCHMARK(BM_DtiClosedLoop)->Arg(10)->Arg(20)->Arg(50);
+
+} // namespace
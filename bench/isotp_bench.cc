@@ -0,0 +1,51 @@
+#include <isotp.hh>
+
+#include <can.hh>
+#include <can_load.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+constexpr isotp::Config k_client{.tx_id = 0x700, .rx_id = 0x708, .extended = false};
+constexpr isotp::Config k_server{.tx_id = 0x708, .rx_id = 0x700, .extended = false};
+
+// Transfers a message between two links connected back to back. Besides the processing cost per byte, reports the
+// fraction of the raw bus bit rate which is left for payload, which bounds the throughput achievable on a real bus.
+void BM_IsoTpLoopback(benchmark::State &state) {
+    const auto size = static_cast<std::size_t>(state.range(0));
+    std::array<std::uint8_t, isotp::k_max_payload_size> client_rx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> client_tx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> server_rx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> server_tx{};
+    isotp::Link client(k_client, client_rx, client_tx);
+    isotp::Link server(k_server, server_rx, server_tx);
+    std::array<std::uint8_t, isotp::k_max_payload_size> payload{};
+
+    std::size_t bus_bits = 0;
+    for (auto _ : state) {
+        bus_bits = 0;
+        client.send(std::span(payload).first(size), 0);
+        while (client.is_sending()) {
+            while (const auto frame = client.poll(0)) {
+                bus_bits += can::frame_bits(false, frame->length);
+                server.on_frame(*frame, 0);
+            }
+            while (const auto frame = server.poll(0)) {
+                bus_bits += can::frame_bits(false, frame->length);
+                client.on_frame(*frame, 0);
+            }
+        }
+        benchmark::DoNotOptimize(server.received());
+        server.release();
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * size));
+    state.counters["efficiency"] = static_cast<double>(size * 8) / static_cast<double>(bus_bits);
+}
+BENCHMARK(BM_IsoTpLoopback)->Arg(7)->Arg(58)->Arg(isotp::k_max_payload_size);
+
+} // namespace
@@ -0,0 +1,47 @@
+#include <throttle_curve.hh>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+namespace {
+
+constexpr std::uint16_t k_pressed_reading = 1200;
+constexpr std::uint16_t k_released_reading = 3400;
+constexpr throttle::CurveShape k_shape{.steepness = 10.0f, .midpoint = 0.5f};
+
+// The float formula which the table replaced, as the throttle update computed it from the ADC reading.
+void BM_ThrottleCurveFloat(benchmark::State &state) {
+    std::uint16_t reading = k_pressed_reading;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reading);
+        const std::int32_t x = reading - k_pressed_reading;
+        const float normalised = 1.0f - static_cast<float>(x) / (k_released_reading - k_pressed_reading);
+        benchmark::DoNotOptimize(throttle::reference_current(normalised, k_shape));
+        reading = reading == k_released_reading ? k_pressed_reading : reading + 1;
+    }
+}
+BENCHMARK(BM_ThrottleCurveFloat);
+
+void BM_ThrottleCurveTable(benchmark::State &state) {
+    static constexpr throttle::Curve curve(k_shape);
+    std::uint16_t reading = k_pressed_reading;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reading);
+        benchmark::DoNotOptimize(curve(throttle::pedal_position(reading, k_pressed_reading, k_released_reading)));
+        reading = reading == k_released_reading ? k_pressed_reading : reading + 1;
+    }
+}
+BENCHMARK(BM_ThrottleCurveTable);
+
+// Rebuilding the table after the shape is recalibrated, which happens in the main loop.
+void BM_ThrottleCurveBuild(benchmark::State &state) {
+    float steepness = k_shape.steepness;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(steepness);
+        benchmark::DoNotOptimize(throttle::Curve({.steepness = steepness, .midpoint = k_shape.midpoint}));
+    }
+}
+BENCHMARK(BM_ThrottleCurveBuild);
+
+} // namespace
@@ -1,47 +1,69 @@
 #include <can.hh>
+#include <can_dispatch.hh>
+#include <can_filter.hh>
+#include <can_health.hh>
+#include <can_load.hh>
+#include <can_scheduler.hh>
 #include <config.hh>
 #include <dti.hh>
+#include <dti_publisher.hh>
+#include <dti_state.hh>
 #include <hal.hh>
+#include <heartbeat.hh>
 #include <stm32f103xb.h>
+#include <throttle_curve.hh>
+#include <time_sync.hh>
+#include <xcp.hh>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <numeric>
+#include <span>
 #include <utility>
-#include <variant>
 
 namespace {
 
-class DtiState {
-    std::atomic<std::int32_t> m_erpm{};
-    std::atomic<std::int16_t> m_controller_temperature{};
-    std::atomic<std::int16_t> m_motor_temperature{};
-    std::atomic<bool> m_drive_enabled{};
+// Period of the main throttle update timer in milliseconds.
+constexpr std::uint32_t k_update_period = 10;
 
-public:
-    void operator()(const dti::GeneralData1 &gd1) { m_erpm.store(gd1.erpm, std::memory_order_relaxed); }
+// Maximum number of received CAN messages to handle per main loop iteration.
+constexpr std::size_t k_rx_batch_size = 8;
 
-    void operator()(const dti::GeneralData2 &) {}
-
-    void operator()(const dti::GeneralData3 &gd3) {
-        m_controller_temperature.store(gd3.controller_temperature, std::memory_order_relaxed);
-        m_motor_temperature.store(gd3.motor_temperature, std::memory_order_relaxed);
+// Periodic message classes sent through the deadline scheduler, with one throttle class per inverter in the order of
+// config::k_dti_can_ids.
+enum TxClassIndex : std::size_t {
+    k_throttle_class,
+    k_tx_class_count = k_throttle_class + config::k_dti_can_ids.size(),
+};
+constexpr auto k_tx_classes = [] {
+    std::array<can::TxClass, k_tx_class_count> classes{};
+    for (std::size_t i = 0; i < config::k_dti_can_ids.size(); i++) {
+        // Throttle commands are released by their publishers rather than periodically. A throttle command that is late
+        // is worthless; send the next one instead.
+        classes[k_throttle_class + i] = {.priority = 0, .period = 0, .deadline = k_update_period};
     }
+    return classes;
+}();
 
-    void operator()(const dti::GeneralData5 &gd5) {
-        m_drive_enabled.store(gd5.drive_enabled, std::memory_order_relaxed);
-    }
+// Maximum age of the ERPM used for the current preload, in microseconds. The inverter broadcasts it every 10 ms.
+constexpr std::uint32_t k_max_erpm_age = 50'000;
 
-    void operator()(const dti::UnknownMessageType &) {
-        // TODO: Log this as a warning.
-    }
+dti::InverterTable s_dti_table(config::k_dti_can_ids, config::k_can_bitrate);
 
-    std::int32_t erpm() const { return m_erpm.load(std::memory_order_relaxed); }
-    std::int16_t controller_temperature() const { return m_controller_temperature.load(std::memory_order_relaxed); }
-    std::int16_t motor_temperature() const { return m_motor_temperature.load(std::memory_order_relaxed); }
-    bool is_drive_enabled() const { return m_drive_enabled.load(std::memory_order_relaxed); }
-} s_dti_state;
+// Throttle commands are sent when the current moves by 1% or goes to zero, and otherwise only as a keepalive.
+constexpr dti::PublisherConfig<std::int16_t> k_throttle_publisher_config{
+    .threshold = 10,
+    .keepalive_period = config::k_dti_keepalive_period,
+};
+auto s_throttle_publishers = []<std::size_t... Is>(std::index_sequence<Is...>) {
+    return std::array{dti::CommandPublisher<std::int16_t>(&dti::build_set_relative_current, config::k_dti_can_ids[Is],
+                                                          k_throttle_publisher_config)...};
+}(std::make_index_sequence<config::k_dti_can_ids.size()>());
 
 struct CalibrationData {
     std::array<std::uint16_t, 100> ring_buffer{};
@@ -81,6 +103,104 @@ CalibrationData s_left_calibration;
 CalibrationData s_right_calibration;
 std::atomic<LedState> s_led_state{LedState::Off};
 std::atomic<State> s_state{State::CanOffline};
+std::atomic<std::uint32_t> s_uptime{0};
+
+// Age of the last received ERPM when the last throttle command was sent, in CAN time stamp ticks.
+std::atomic<std::uint32_t> s_throttle_data_age{0};
+std::atomic<std::uint32_t> s_max_throttle_data_age{0};
+
+// Throttle curve parameters, which can be calibrated over XCP: the steepness and midpoint of the sigmoid applied to the
+// normalised pedal position, and the current below which no current is requested.
+constexpr throttle::CurveShape k_default_throttle_shape{.steepness = 10.0f, .midpoint = 0.5f};
+float s_throttle_steepness = k_default_throttle_shape.steepness;
+float s_throttle_midpoint = k_default_throttle_shape.midpoint;
+std::uint16_t s_throttle_deadband = 20;
+
+// The throttle curve table in use by the throttle update and a spare which the main loop rebuilds when the shape
+// parameters are written. The throttle update interrupt preempts the main loop, so it never sees a half-built table.
+constexpr throttle::Curve k_default_throttle_curve(k_default_throttle_shape);
+std::array<throttle::Curve, 2> s_throttle_curves{k_default_throttle_curve, k_default_throttle_curve};
+std::atomic<std::size_t> s_throttle_curve_index{0};
+
+// The last throttle current requested, and the core clock cycles taken to calculate it, for measurement over XCP.
+std::uint16_t s_throttle_current = 0;
+std::atomic<std::uint32_t> s_throttle_curve_cycles{0};
+std::atomic<std::uint32_t> s_max_throttle_curve_cycles{0};
+
+// Variables which can be accessed over XCP, addressed by their index.
+constexpr auto k_xcp_variables = std::to_array<xcp::Variable>({
+    xcp::measurement(s_uptime),
+    xcp::measurement(s_adc_buffer[0]),
+    xcp::measurement(s_adc_buffer[1]),
+    xcp::measurement(s_throttle_current),
+    xcp::measurement(s_throttle_data_age),
+    xcp::parameter(s_throttle_steepness),
+    xcp::parameter(s_throttle_midpoint),
+    xcp::parameter(s_throttle_deadband),
+    xcp::measurement(s_throttle_curve_cycles),
+});
+
+// XCP event channel of the throttle update timer.
+constexpr std::uint16_t k_xcp_update_event = 0;
+
+xcp::Slave s_xcp({.command_id = config::k_apps_xcp_command_id, .response_id = config::k_apps_xcp_response_id},
+                 k_xcp_variables);
+
+// The APPS board is always powered with the inverter it commands, so it defines vehicle time for the other nodes.
+time_sync::Master s_time_sync({.tick_rate = config::k_can_bitrate});
+
+heartbeat::Sender s_heartbeat(config::k_apps_node_id, config::k_heartbeat_period);
+
+// Liveness of the BMS master, tracked from the main loop.
+constexpr auto k_heartbeat_peers = std::to_array<heartbeat::PeerConfig>({
+    {config::k_bms_master_node_id, config::k_heartbeat_period, config::k_heartbeat_timeout},
+});
+heartbeat::Monitor s_peer_monitor(k_heartbeat_peers, config::k_can_bitrate);
+
+can::MailboxDriver s_mailbox_driver;
+can::TxScheduler<can::MailboxDriver, k_tx_class_count> s_tx_scheduler(s_mailbox_driver, k_tx_classes, 0);
+
+void handle_dti_message(const can::RawMessage &message, std::uint32_t timestamp) {
+    s_dti_table.update(message.to_message(), timestamp);
+}
+
+void handle_xcp_command(const can::RawMessage &message, std::uint32_t) {
+    if (const auto response = s_xcp.on_frame(message)) {
+        can::transmit(*response);
+    }
+}
+
+void handle_heartbeat(const can::RawMessage &message, std::uint32_t timestamp) {
+    const auto *status = s_peer_monitor.status(config::k_bms_master_node_id);
+    const bool was_alive = status->liveness == heartbeat::Liveness::Alive;
+    s_peer_monitor.on_frame(message, timestamp, s_uptime.load(std::memory_order_relaxed));
+    if (!was_alive) {
+        hal::swd_printf("BMS master up, state %u\n", static_cast<unsigned>(status->heartbeat.state));
+    }
+}
+
+// Subscribes to a status packet from every node ID in the range spanned by the inverters. Frames from node IDs which
+// aren't in the table are dropped when they are routed.
+constexpr can::Subscription subscribe_dti(std::uint8_t fifo, std::uint32_t packet_id) {
+    const auto first = dti::packet_identifier(packet_id, std::ranges::min(config::k_dti_can_ids));
+    const auto last = dti::packet_identifier(packet_id, std::ranges::max(config::k_dti_can_ids));
+    return can::subscribe_extended_range(fifo, first, last, &handle_dti_message);
+}
+
+// Critical inverter status (ERPM used by the throttle, and drive enable) is routed to FIFO 0, which is handled in its
+// high priority IRQ, and the bulk temperature and current data, XCP commands and heartbeats to FIFO 1, which is
+// drained from the main loop. Each status packet is only ever updated from one of the two contexts.
+constexpr auto k_dispatch_table = can::make_dispatch_table(
+    subscribe_dti(0, dti::k_general_data_1_id),
+    subscribe_dti(0, dti::k_general_data_5_id),
+    subscribe_dti(1, dti::k_general_data_2_id),
+    subscribe_dti(1, dti::k_general_data_3_id),
+    can::subscribe_standard(1, config::k_apps_xcp_command_id, &handle_xcp_command),
+    can::subscribe_standard(1, heartbeat::k_base_id + config::k_bms_master_node_id, &handle_heartbeat));
+
+// Accept only the subscribed messages. Everything else is rejected in hardware.
+constexpr auto k_can_filters = can::plan_filters(k_dispatch_table.filter_rules());
+static_assert(k_can_filters.bank_count <= can::k_filter_bank_count, "CAN filter rules do not fit into 14 banks");
 
 const char *state_name(State state) {
     switch (state) {
@@ -98,6 +218,10 @@ const char *state_name(State state) {
     return "unknown";
 }
 
+heartbeat::State heartbeat_state(State state) {
+    return state == State::Running ? heartbeat::State::Operational : heartbeat::State::Initialising;
+}
+
 void set_led_state(LedState state) {
     if (s_led_state.exchange(state) == state) {
         return;
@@ -164,20 +288,37 @@ bool calibration_iteration() {
 }
 
 std::uint16_t calculate_current() {
-    // TODO: Use a lookup table.
-    std::int32_t x = s_adc_buffer[0] - s_left_calibration.min_value;
-    float normalised = static_cast<float>(x) / (s_left_calibration.max_value - s_left_calibration.min_value);
-    normalised = 1.0f - normalised;
-    float curve = 1.0f / (1.0f + std::exp(-10.0f * (normalised - 0.5f)));
-    auto current = static_cast<std::uint16_t>(curve * 1000.0f);
-    if (current < 20) {
-        return 0;
+    const auto position =
+        throttle::pedal_position(s_adc_buffer[0], s_left_calibration.min_value, s_left_calibration.max_value);
+    const auto current = s_throttle_curves[s_throttle_curve_index.load(std::memory_order_acquire)](position);
+    return current < s_throttle_deadband ? 0 : current;
+}
+
+// Rebuilds the throttle curve table if its shape parameters were written over XCP since it was last built. Building
+// takes soft floating point maths, so this runs in the main loop rather than the throttle update.
+void update_throttle_curve() {
+    const auto index = s_throttle_curve_index.load(std::memory_order_relaxed);
+    const auto &shape = s_throttle_curves[index].shape();
+    if (std::bit_cast<std::uint32_t>(shape.steepness) == std::bit_cast<std::uint32_t>(s_throttle_steepness) &&
+        std::bit_cast<std::uint32_t>(shape.midpoint) == std::bit_cast<std::uint32_t>(s_throttle_midpoint)) {
+        return;
     }
+    const throttle::CurveShape new_shape{.steepness = s_throttle_steepness, .midpoint = s_throttle_midpoint};
+    s_throttle_curves[1 - index] = throttle::Curve(new_shape);
+    s_throttle_curve_index.store(1 - index, std::memory_order_release);
+}
 
-    // Apply current preload if needed.
-    const auto rpm = s_dti_state.erpm() / config::k_erpm_factor;
-    if (rpm < 100) {
-        current = std::max(current, static_cast<std::uint16_t>(100 - rpm));
+// Applies the current preload for an inverter's motor if needed. Without a recent ERPM the motor speed is unknown, so
+// no preload is applied and the driver gets only what the pedal asks for.
+std::uint16_t apply_preload(std::uint16_t current, const dti::InverterState &inverter) {
+    if (current == 0) {
+        return 0;
+    }
+    if (const auto erpm = inverter.erpm(can::timestamp_now(), k_max_erpm_age)) {
+        const auto rpm = *erpm / config::k_erpm_factor;
+        if (rpm < 100) {
+            current = std::max(current, static_cast<std::uint16_t>(100 - rpm));
+        }
     }
     return current;
 }
@@ -200,28 +341,110 @@ extern "C" void EXTI15_10_IRQHandler() {
 extern "C" void TIM2_IRQHandler() {
     // Clear update interrupt flag.
     TIM2->SR = ~TIM_SR_UIF;
-    // TODO: Send proper status report over CAN.
+    // The state is reported over CAN in the heartbeat.
     hal::swd_printf("State: %s\n", state_name(s_state.load()));
+    if (const auto vehicle_time = s_time_sync.time(can::timestamp_now())) {
+        hal::swd_printf("Vehicle time: %u ms\n", static_cast<unsigned>(*vehicle_time / 1000));
+    }
+
+    // Report bus health once CAN is up.
+    if (s_state.load() != State::CanOffline) {
+        for (std::size_t i = 0; i < s_dti_table.size(); i++) {
+            const auto node_id = s_dti_table.node_ids()[i];
+            const auto &throttle_statistics = s_tx_scheduler.statistics(k_throttle_class + i);
+            hal::swd_printf("Inverter %u throttle sent: %u, missed: %u\n", node_id, throttle_statistics.sent_count,
+                            throttle_statistics.miss_count);
+            const auto &publisher_statistics = s_throttle_publishers[i].statistics();
+            const auto uptime = std::max(s_uptime.load(std::memory_order_relaxed), 1u);
+            hal::swd_printf("Inverter %u throttle suppressed: %u, saved: %u bit/s\n", node_id,
+                            publisher_statistics.suppressed_count,
+                            static_cast<unsigned>(static_cast<std::uint64_t>(publisher_statistics.saved_bits) * 1000u /
+                                                  uptime));
+            if (const auto age = s_dti_table[i].age(dti::k_general_data_1_id, can::timestamp_now())) {
+                hal::swd_printf("Inverter %u data age: %u us\n", node_id, static_cast<unsigned>(*age));
+            } else {
+                hal::swd_printf("No data from inverter %u\n", node_id);
+            }
+        }
+        hal::swd_printf("ERPM age at throttle: %u us, max %u us\n",
+                        static_cast<unsigned>(can::timestamp_to_us(s_throttle_data_age.load())),
+                        static_cast<unsigned>(can::timestamp_to_us(s_max_throttle_data_age.load())));
+        hal::swd_printf("Throttle curve: %u cycles, max %u cycles\n",
+                        static_cast<unsigned>(s_throttle_curve_cycles.load(std::memory_order_relaxed)),
+                        static_cast<unsigned>(s_max_throttle_curve_cycles.load(std::memory_order_relaxed)));
+
+        // Send all report pages as one burst. Only the DTI frames accepted by the filters and our own frames are seen
+        // by the load meter, so the load is a lower bound.
+        std::array<can::RawMessage, can::k_health_report_page_count + 1 + can::k_load_id_capacity> reports;
+        std::size_t report_count = 0;
+        const auto statistics = can::health_statistics();
+        for (std::uint8_t page = 0; page < can::k_health_report_page_count; page++) {
+            reports[report_count++] = can::build_health_report(config::k_apps_health_report_id, statistics, page);
+        }
+        const auto load = can::bus_load_statistics();
+        for (std::uint8_t page = 0; page <= load.rate_count; page++) {
+            reports[report_count++] = can::build_load_report(config::k_apps_load_report_id, load, page);
+        }
+        can::transmit(std::span<const can::RawMessage>(reports).first(report_count));
+    }
 }
 
 extern "C" void TIM3_IRQHandler() {
     // Clear update interrupt flag.
     TIM3->SR = ~TIM_SR_UIF;
+    const auto now = s_uptime.fetch_add(k_update_period, std::memory_order_relaxed) + k_update_period;
+
+    if (s_state.load() != State::CanOffline) {
+        can::update_bus_load(now);
+    }
 
     switch (s_state.load()) {
     case State::CanOffline:
         set_led_state(LedState::CanError);
 
         // Attempt to initialise CAN peripheral.
-        if (can::init(can::Port::B, can::Speed::_500)) {
-            // Route all DTI messages to FIFO 0.
-            can::route_filter(0, 0, 0x7feu, (config::k_dti_can_id << 3u) | 0b100u);
-
-            // Install FIFO message pending callback and enable IRQ with a high priority.
-            can::set_fifo_callback(0, [](const can::Message &message) {
-                std::visit(s_dti_state, dti::parse_packet(message));
-            });
+        // Bus-off recovery is delayed so that a persistent fault on this node doesn't keep disturbing the bus. A mailbox
+        // is kept for the throttle commands, so that bursts of telemetry can't hold them back past their deadline.
+        if (can::init(can::Port::B, config::k_can_speed,
+                      {.timestamps = true, .manual_bus_off_recovery = true, .reserve_mailbox = true})) {
+            // Route subscribed DTI messages to the FIFOs.
+            can::apply_filters(k_can_filters);
+
+            // Handle the critical FIFO straight from its high priority IRQ, so that the ERPM and drive enable don't
+            // wait behind the main loop, and drain the bulk FIFO from the main loop.
+            for (std::uint8_t fifo = 0; fifo < 2; fifo++) {
+                can::set_fifo_callback(fifo, [](const can::RawMessage &message, std::uint32_t timestamp) {
+                    k_dispatch_table.dispatch(message, timestamp);
+                });
+            }
+            can::set_fifo_deferred(1, true);
             hal::enable_irq(CAN1_RX0_IRQn, 2);
+            hal::enable_irq(CAN1_RX1_IRQn, 6);
+
+            // Measure how old the ERPM used for each throttle command is when the command hits the bus.
+            can::set_tx_callback([](const can::RawMessage &message, std::uint32_t timestamp) {
+                s_time_sync.on_transmit(message, timestamp);
+                if (!message.is_extended() ||
+                    dti::identifier_packet_id(message.extended_id()) != dti::k_set_relative_current_id) {
+                    return;
+                }
+                const auto *inverter = s_dti_table.find(dti::identifier_node_id(message.extended_id()));
+                const auto erpm_timestamp =
+                    inverter != nullptr ? inverter->timestamp(dti::k_general_data_1_id) : std::nullopt;
+                if (erpm_timestamp) {
+                    const auto age = timestamp - *erpm_timestamp;
+                    s_throttle_data_age.store(age, std::memory_order_relaxed);
+                    if (age > s_max_throttle_data_age.load(std::memory_order_relaxed)) {
+                        s_max_throttle_data_age.store(age, std::memory_order_relaxed);
+                    }
+                }
+            });
+
+            // Enable transmit mailbox empty IRQ for draining queued messages.
+            hal::enable_irq(USB_HP_CAN1_TX_IRQn, 2);
+
+            // Enable status change and error IRQ for health telemetry.
+            hal::enable_irq(CAN1_SCE_IRQn, 2);
 
             // Move to uncalibrated state.
             s_state.store(State::Uncalibrated);
@@ -245,12 +468,67 @@ extern "C" void TIM3_IRQHandler() {
         break;
     case State::Running:
         set_led_state(LedState::Off);
+        const auto start_cycles = hal::cycle_count();
         const auto current = calculate_current();
-        hal::swd_printf("Current: %u, ERPM: %d\n", current, s_dti_state.erpm());
-        can::transmit(dti::build_set_relative_current(config::k_dti_can_id, static_cast<std::int16_t>(current)));
+        const auto curve_cycles = hal::cycle_count() - start_cycles;
+        s_throttle_current = current;
+        s_throttle_curve_cycles.store(curve_cycles, std::memory_order_relaxed);
+        if (curve_cycles > s_max_throttle_curve_cycles.load(std::memory_order_relaxed)) {
+            s_max_throttle_curve_cycles.store(curve_cycles, std::memory_order_relaxed);
+        }
+        hal::swd_printf("Current: %u, ERPM: %d\n", current,
+                        s_dti_table[0].erpm(can::timestamp_now(), k_max_erpm_age).value_or(0));
+
+        // Each inverter gets its own preload, from the speed of its own motor, and is only sent a command when its
+        // current changes or is due a keepalive.
+        for (std::size_t i = 0; i < s_dti_table.size(); i++) {
+            const auto inverter_current = apply_preload(current, s_dti_table[i]);
+            if (const auto message =
+                    s_throttle_publishers[i].update(static_cast<std::int16_t>(inverter_current), now)) {
+                s_tx_scheduler.release(k_throttle_class + i, *message, now);
+            }
+        }
         break;
     }
 
+    // Stop commanding the inverters outside of the running state.
+    if (s_state.load() != State::Running) {
+        for (std::size_t i = 0; i < s_dti_table.size(); i++) {
+            s_tx_scheduler.clear(k_throttle_class + i);
+            s_throttle_publishers[i].reset();
+        }
+    }
+
+    // Send any due periodic messages.
+    if (s_state.load() != State::CanOffline) {
+        s_tx_scheduler.poll(now);
+
+        // A throttle command which missed its deadline is sent again on the next update rather than at the keepalive,
+        // since it may have been the one stopping the motor.
+        for (std::size_t i = 0; i < s_dti_table.size(); i++) {
+            if (s_tx_scheduler.take_missed(k_throttle_class + i)) {
+                s_throttle_publishers[i].resend();
+            }
+        }
+
+        // Send the heartbeat, with the detailed state for diagnostics.
+        const auto state = s_state.load();
+        if (const auto frame = s_heartbeat.poll(now, heartbeat_state(state), static_cast<std::uint16_t>(state))) {
+            can::transmit(*frame);
+        }
+
+        // Broadcast the vehicle time reference.
+        if (const auto frame = s_time_sync.poll(now)) {
+            can::transmit(*frame);
+        }
+
+        // Stream the DAQ lists bound to this tick, sampled after the throttle update so that they see this tick's
+        // values.
+        std::array<can::RawMessage, xcp::k_max_odt_count> daq_frames;
+        const auto daq_frame_count = s_xcp.sample(k_xcp_update_event, daq_frames);
+        can::transmit(std::span<const can::RawMessage>(daq_frames).first(daq_frame_count));
+    }
+
     // Queue next ADC read.
     hal::adc_start(ADC1);
 }
@@ -309,6 +587,25 @@ void app_main() {
     // TODO: Synchronise timers together.
 
     while (true) {
+        // Decode and handle any bulk messages received since the last iteration. Critical ones have already been
+        // handled in the FIFO 0 IRQ.
+        can::drain_fifo(1, k_rx_batch_size);
+
+        // Pick up any throttle curve recalibrated by the XCP commands just handled.
+        update_throttle_curve();
+
+        // Rejoin the bus after a bus-off event once the back-off delay has elapsed. This waits for the controller to
+        // enter initialisation mode, so it must run here rather than in the throttle update.
+        const auto uptime = s_uptime.load(std::memory_order_relaxed);
+        if (s_state.load() != State::CanOffline && can::poll_bus_off_recovery(uptime)) {
+            hal::swd_printf("CAN bus-off recovery\n");
+        }
+
+        // Check for a lost BMS master after the heartbeats have been handled.
+        if (s_peer_monitor.poll(uptime) != 0) {
+            hal::swd_printf("BMS master heartbeat lost\n");
+        }
+
         // TODO: WFI.
     }
 }
@@ -1,15 +1,21 @@
 #include <bms.hh>
 #include <can.hh>
+#include <can_filter.hh>
+#include <config.hh>
 #include <eeprom.hh>
 #include <hal.hh>
+#include <heartbeat.hh>
 #include <max_adc.hh>
 #include <stm32f103xb.h>
+#include <time_sync.hh>
 #include <util.hh>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cstdint>
+#include <utility>
 
 namespace {
 
@@ -86,6 +92,29 @@ hal::Gpio s_sck(hal::GpioPort::B, 13);
 hal::Gpio s_miso(hal::GpioPort::B, 14);
 
 std::array<std::uint32_t, static_cast<std::uint32_t>(LedState::Solid) * 2u> s_led_dma{};
+
+// Vehicle time, followed from the APPS board so that faults can be correlated with the rest of the car.
+constexpr time_sync::Config k_time_sync_config{.tick_rate = config::k_can_bitrate};
+time_sync::Slave s_time_sync(k_time_sync_config);
+
+// Period of the heartbeat tick in milliseconds.
+constexpr std::uint32_t k_tick_period = 10;
+
+// The heartbeat tick runs at the same priority as the CAN receive IRQ, so the monitor is only used from one context.
+heartbeat::Sender s_heartbeat(config::k_bms_master_node_id, config::k_heartbeat_period);
+constexpr auto k_heartbeat_peers = std::to_array<heartbeat::PeerConfig>({
+    {config::k_apps_node_id, config::k_heartbeat_period, config::k_heartbeat_timeout},
+});
+heartbeat::Monitor s_peer_monitor(k_heartbeat_peers, config::k_can_bitrate);
+std::uint32_t s_uptime = 0;
+
+// Error flags published by the main loop for the heartbeat.
+std::atomic<std::uint32_t> s_error_flags{0};
+
+constexpr auto k_can_filters = can::plan_filters(std::to_array<can::FilterRule>({
+    {0, false, k_time_sync_config.sync_id, k_time_sync_config.follow_up_id},
+    {0, false, heartbeat::k_base_id + config::k_apps_node_id, heartbeat::k_base_id + config::k_apps_node_id},
+}));
 LedState s_led_state{LedState::Off};
 
 LedState error_flags_to_led_state(bms::ErrorFlags flags) {
@@ -264,6 +293,23 @@ std::uint32_t sample_segments(std::span<Segment> segments) {
 
 } // namespace
 
+extern "C" void TIM2_IRQHandler() {
+    // Clear update interrupt flag.
+    TIM2->SR = ~TIM_SR_UIF;
+    s_uptime += k_tick_period;
+
+    // The error flags fit into the heartbeat detail field.
+    static_assert(util::to_underlying(bms::Error::Overtemperature) < 16);
+    const auto error_flags = s_error_flags.load(std::memory_order_relaxed);
+    const auto state = error_flags != 0 ? heartbeat::State::Fault : heartbeat::State::Operational;
+    if (const auto frame = s_heartbeat.poll(s_uptime, state, static_cast<std::uint16_t>(error_flags))) {
+        can::transmit(*frame);
+    }
+    if (s_peer_monitor.poll(s_uptime) != 0) {
+        hal::swd_printf("APPS heartbeat lost\n");
+    }
+}
+
 void app_main() {
     // Configure LED and 12 volt rail measurement pin.
     s_lv_reading.configure(hal::GpioInputMode::Analog);
@@ -324,8 +370,27 @@ void app_main() {
     bms::ErrorFlags error_flags;
 
     // Attempt to initialise the CAN peripheral on PB8 (RX) and PB9 (TX).
-    if (!can::init(can::Port::B, can::Speed::_500)) {
+    if (!can::init(can::Port::B, config::k_can_speed, {.timestamps = true})) {
         error_flags.set(bms::Error::BadCan);
+    } else {
+        can::apply_filters(k_can_filters);
+        can::set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t timestamp) {
+            s_time_sync.on_frame(message, timestamp);
+            s_peer_monitor.on_frame(message, timestamp, s_uptime);
+        });
+        hal::enable_irq(CAN1_RX0_IRQn, 2);
+
+        // Enable transmit mailbox empty IRQ so that a heartbeat queued behind busy mailboxes isn't held back until
+        // the next transmit.
+        hal::enable_irq(USB_HP_CAN1_TX_IRQn, 2);
+
+        // Configure 10 ms timer for the heartbeat.
+        RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+        TIM2->DIER |= TIM_DIER_UIE;
+        TIM2->PSC = 249;
+        TIM2->ARR = 2239;
+        TIM2->CR1 |= TIM_CR1_CEN;
+        hal::enable_irq(TIM2_IRQn, 2);
     }
 
     // Try to read the config from the EEPROM.
@@ -351,9 +416,20 @@ void app_main() {
     // TODO: Use a timer to record how old the segment data is, need to react within 250 ms.
 
     // Main state machine loop.
+    bool fault_reported = false;
     while (true) {
+        s_error_flags.store(error_flags, std::memory_order_relaxed);
+
         // Check if shutdown needed.
         if (error_flags.any_set()) {
+            // Stamp the first fault with vehicle time.
+            if (!std::exchange(fault_reported, true)) {
+                const auto now = can::timestamp_now();
+                if (const auto vehicle_time = s_time_sync.time(now); vehicle_time && s_time_sync.is_synchronised(now)) {
+                    hal::swd_printf("Fault at vehicle time %u ms\n", static_cast<unsigned>(*vehicle_time / 1000));
+                }
+            }
+
             // Disable charging and activate shutdown (active-low).
             hal::gpio_reset(s_charge_en, s_shutdown);
 
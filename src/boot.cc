@@ -0,0 +1,209 @@
+#include <boot.hh>
+
+#include <can.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace boot {
+namespace {
+
+constexpr std::uint32_t k_polynomial = 0x04c11db7;
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+std::uint32_t block_crc(std::span<const std::uint8_t> image, std::size_t index) {
+    std::array<std::uint8_t, k_block_size> block;
+    block.fill(k_erased_byte);
+    const auto data = image.subspan(index * k_block_size);
+    std::copy_n(data.begin(), std::min(data.size(), block.size()), block.begin());
+    return crc32(block);
+}
+
+} // namespace
+
+std::uint32_t crc32(std::span<const std::uint8_t> data) {
+    std::uint32_t crc = 0xffffffffu;
+    for (std::size_t i = 0; i < data.size(); i += 4) {
+        std::uint32_t word = 0;
+        for (std::size_t j = 0; j < 4 && i + j < data.size(); j++) {
+            word |= static_cast<std::uint32_t>(data[i + j]) << (j * 8);
+        }
+        crc ^= word;
+        for (std::size_t bit = 0; bit < 32; bit++) {
+            crc = (crc & 0x80000000u) != 0 ? (crc << 1u) ^ k_polynomial : crc << 1u;
+        }
+    }
+    return crc;
+}
+
+can::RawMessage Sender::build_command(Opcode opcode, std::span<const std::uint8_t> payload) const {
+    std::array<std::uint8_t, 8> data{static_cast<std::uint8_t>(opcode), m_node_id};
+    std::copy(payload.begin(), payload.end(), data.begin() + 2);
+    return can::RawMessage::standard(m_config.command_id, std::span(data).first(2 + payload.size()));
+}
+
+can::RawMessage Sender::build_frame() {
+    const auto frame = m_tx_frame++;
+    const auto block = m_tx_block;
+    if (m_tx_frame > frame_count(m_image.size(), block)) {
+        m_tx_block++;
+        m_tx_frame = 0;
+    }
+    if (frame == 0) {
+        const auto index = util::write_be(static_cast<std::uint16_t>(block));
+        const auto crc = util::write_be(block_crc(m_image, block));
+        return build_command(Opcode::Block, std::to_array({index[0], index[1], crc[0], crc[1], crc[2], crc[3]}));
+    }
+
+    // The last frame of an image may be short, but is padded to eight bytes like the block it belongs to.
+    std::array<std::uint8_t, 8> data;
+    data.fill(k_erased_byte);
+    const auto bytes = m_image.subspan(block * k_block_size + (frame - 1) * 8);
+    std::copy_n(bytes.begin(), std::min(bytes.size(), data.size()), data.begin());
+    return can::RawMessage::standard(static_cast<std::uint16_t>(m_config.data_id + frame - 1), data);
+}
+
+void Sender::retry(std::uint32_t now, State state) {
+    m_statistics.timeout_count++;
+    if (++m_retry_count > k_max_retry_count) {
+        fail(Status::Timeout);
+        return;
+    }
+    m_state = state;
+    m_time = now;
+}
+
+void Sender::fail(Status status) {
+    m_state = State::Failed;
+    m_status = status;
+}
+
+bool Sender::start(std::span<const std::uint8_t> image, std::uint32_t now) {
+    if (is_busy() || image.empty() || image.size() > k_max_image_size) {
+        return false;
+    }
+    m_image = image;
+    m_block_count = block_count(image.size());
+    m_acked = 0;
+    m_retry_count = 0;
+    m_status = Status::Ok;
+    m_state = State::SendStart;
+    m_time = now;
+    return true;
+}
+
+void Sender::on_frame(const can::RawMessage &message, std::uint32_t now) {
+    if (message.is_remote() || message.is_extended() || message.standard_id() != m_config.response_id ||
+        message.length < 3 || message.byte(1) != m_node_id) {
+        return;
+    }
+
+    switch (static_cast<Opcode>(message.byte(0))) {
+    case Opcode::Ready:
+        if (m_state != State::WaitReady) {
+            break;
+        }
+        if (const auto status = static_cast<Status>(message.byte(2)); status != Status::Ok) {
+            fail(status);
+            break;
+        }
+        m_state = State::SendBlocks;
+        m_tx_block = 0;
+        m_tx_frame = 0;
+        m_retry_count = 0;
+        m_time = now;
+        break;
+    case Opcode::Ack:
+        if (m_state == State::SendBlocks && message.length >= 4) {
+            const auto index = message.read_be<std::uint16_t>(2);
+            if (index >= m_acked && index < m_block_count) {
+                m_acked = index + 1u;
+                m_retry_count = 0;
+                m_time = now;
+            }
+        }
+        break;
+    case Opcode::Nack:
+        if (m_state == State::SendBlocks && message.length >= 5) {
+            m_statistics.nack_count++;
+            if (const auto status = static_cast<Status>(message.byte(4)); !is_retryable(status)) {
+                fail(status);
+                break;
+            }
+            const auto index = message.read_be<std::uint16_t>(2);
+            if (index >= m_acked && index < m_block_count) {
+                m_tx_block = index;
+                m_tx_frame = 0;
+                m_statistics.retransmit_count++;
+                m_time = now;
+            }
+        }
+        break;
+    case Opcode::Done:
+        if (m_state == State::WaitDone) {
+            if (const auto status = static_cast<Status>(message.byte(2)); status != Status::Ok) {
+                fail(status);
+            } else {
+                m_state = State::Done;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+std::optional<can::RawMessage> Sender::poll(std::uint32_t now) {
+    switch (m_state) {
+    case State::SendStart:
+        m_state = State::WaitReady;
+        m_time = now;
+        m_statistics.frame_count++;
+        return build_command(Opcode::Start, util::write_be(static_cast<std::uint32_t>(m_image.size())));
+    case State::WaitReady:
+        if (reached(now, m_time + m_config.erase_timeout)) {
+            retry(now, State::SendStart);
+        }
+        return std::nullopt;
+    case State::SendBlocks:
+        if (m_acked == m_block_count) {
+            m_state = State::SendFinish;
+            return poll(now);
+        }
+        if (reached(now, m_time + m_config.timeout)) {
+            // Nothing has been acknowledged for a while, so start again from the first unacknowledged block.
+            retry(now, State::SendBlocks);
+            m_tx_block = m_acked;
+            m_tx_frame = 0;
+            m_statistics.retransmit_count++;
+        }
+        if (m_state != State::SendBlocks || m_tx_block == m_block_count || m_tx_block >= m_acked + k_window_size) {
+            return std::nullopt;
+        }
+        m_time = now;
+        m_statistics.frame_count++;
+        return build_frame();
+    case State::SendFinish:
+        m_state = State::WaitDone;
+        m_time = now;
+        m_statistics.frame_count++;
+        return build_command(Opcode::Finish, util::write_be(crc32(m_image)));
+    case State::WaitDone:
+        if (reached(now, m_time + m_config.timeout)) {
+            retry(now, State::SendFinish);
+        }
+        return std::nullopt;
+    default:
+        return std::nullopt;
+    }
+}
+
+} // namespace boot
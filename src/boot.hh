@@ -0,0 +1,592 @@
+#pragma once
+
+#include <can.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace boot {
+
+/// Size of a block, which is one flash page of the STM32F103 medium density devices.
+constexpr std::size_t k_block_size = 1024;
+
+/// Number of data frames which carry a full block.
+constexpr std::size_t k_frames_per_block = k_block_size / 8;
+
+/// Largest image which can be transferred.
+constexpr std::size_t k_max_image_size = 64 * 1024;
+
+/// Number of blocks which may be in flight at once, which is also the number of block buffers held by the receiver.
+/// With two, the next block is received while the previous one is written to flash.
+constexpr std::size_t k_window_size = 2;
+
+/// Number of bytes written to flash per call to Receiver::poll. Programming a half word stalls the CPU for up to
+/// 70 us, so four half words take less time than the three frames the receive FIFO can hold at 1 Mbit/s.
+constexpr std::size_t k_program_chunk_size = 8;
+
+/// Number of times the sender repeats a command or retransmits blocks without progress before giving up.
+constexpr std::uint32_t k_max_retry_count = 5;
+
+/// Value of erased flash, which the last block is padded with.
+constexpr std::uint8_t k_erased_byte = 0xff;
+
+/// Value of ImageInfo::magic for a valid image.
+constexpr std::uint32_t k_image_magic = 0x544f4f42;
+
+/// First byte of every command and response frame.
+enum class Opcode : std::uint8_t {
+    /// [opcode, node, size (4)]: erases flash for an image of the given size.
+    Start = 0x01,
+
+    /// [opcode, node, index (2), crc (4)]: the block with the given index and CRC follows on the data identifiers.
+    Block = 0x02,
+
+    /// [opcode, node, crc (4)]: every block has been sent; the whole image has the given CRC.
+    Finish = 0x03,
+
+    /// [opcode, node, status, window size]: flash has been erased after a start command.
+    Ready = 0x81,
+
+    /// [opcode, node, index (2)]: every block up to and including the given index has been written to flash.
+    Ack = 0x82,
+
+    /// [opcode, node, index (2), status]: the given block was rejected, and every later block was discarded.
+    Nack = 0x83,
+
+    /// [opcode, node, status]: the image has been verified and marked as valid, or was rejected.
+    Done = 0x84,
+};
+
+/// An enum which represents the outcome of a request, as carried by Ready, Nack and Done responses.
+enum class Status : std::uint8_t {
+    Ok,
+    TooLarge,
+    EraseFailed,
+    MissingFrame,
+    CrcMismatch,
+    ProgramFailed,
+    ImageCrcMismatch,
+
+    /// Not sent on the bus; reported by the sender when the receiver stops responding.
+    Timeout,
+};
+
+/**
+ * @return true if the sender should retransmit from the rejected block; false if the transfer should be aborted
+ */
+constexpr bool is_retryable(Status status) {
+    return status == Status::MissingFrame || status == Status::CrcMismatch;
+}
+
+/// A struct which describes the CAN identifiers and timeouts shared by a sender and receiver. Every identifier is
+/// standard, and the defaults are of low priority so that other traffic on the bus isn't held up during a transfer.
+struct Config {
+    /// Identifier which the sender's commands are sent on.
+    std::uint16_t command_id{0x660};
+
+    /// Identifier which the receiver's responses are sent on.
+    std::uint16_t response_id{0x661};
+
+    /// First of k_frames_per_block consecutive identifiers which data frames are sent on, with frame i of a block on
+    /// data_id + i. Must be a multiple of k_frames_per_block so that the range fits into a single filter bank.
+    std::uint16_t data_id{0x680};
+
+    /// Time in milliseconds the sender waits for an acknowledgement before retransmitting.
+    std::uint32_t timeout{100};
+
+    /// Time in milliseconds the sender waits for flash to be erased after a start command.
+    std::uint32_t erase_timeout{5000};
+
+    /// Time in milliseconds of silence after which the receiver abandons a transfer.
+    std::uint32_t session_timeout{2000};
+};
+
+/// A struct which is stored alongside the image once it has been verified.
+struct ImageInfo {
+    std::uint32_t magic;
+    std::uint32_t size;
+    std::uint32_t crc;
+};
+
+/// Counters of a receiver.
+struct ReceiverStatistics {
+    std::uint32_t block_count;
+    std::uint32_t nack_count;
+
+    /// Transfers abandoned after session_timeout.
+    std::uint32_t timeout_count;
+};
+
+/// Counters of a sender.
+struct SenderStatistics {
+    std::uint32_t frame_count;
+
+    /// Blocks sent again after a negative acknowledgement or a timeout.
+    std::uint32_t retransmit_count;
+    std::uint32_t nack_count;
+    std::uint32_t timeout_count;
+};
+
+/**
+ * Computes the same CRC as hal::crc_compute in software, for use on the host: CRC-32 with the Ethernet polynomial fed
+ * most significant bit first with little endian words, with the last word zero padded and no final XOR.
+ *
+ * @param data the data buffer
+ */
+std::uint32_t crc32(std::span<const std::uint8_t> data);
+
+/**
+ * @return the number of blocks needed to hold an image of the given size
+ */
+constexpr std::size_t block_count(std::size_t image_size) {
+    return (image_size + k_block_size - 1) / k_block_size;
+}
+
+/**
+ * @return the number of data frames which carry the given block, which is fewer than k_frames_per_block only for the
+ * last block of an image
+ */
+constexpr std::size_t frame_count(std::size_t image_size, std::size_t index) {
+    const auto remaining = image_size - index * k_block_size;
+    return (std::min(remaining, k_block_size) + 7) / 8;
+}
+
+/// A concept for the flash memory interface used by Receiver, so that it can be driven by a fake on the host. Offsets
+/// are relative to the start of the image slot.
+template <typename T>
+concept FlashDriver = requires(T &flash, std::size_t index, std::size_t offset, std::span<const std::uint8_t> data,
+                               const ImageInfo &info) {
+    /// Size of the image slot, which may be smaller than k_max_image_size.
+    { flash.slot_size() } -> std::same_as<std::size_t>;
+    { flash.erase_page(index) } -> std::same_as<bool>;
+    { flash.program(offset, data) } -> std::same_as<bool>;
+
+    /// Contents of the whole image slot.
+    { flash.image() } -> std::same_as<std::span<const std::uint8_t>>;
+    { flash.crc(data) } -> std::same_as<std::uint32_t>;
+
+    /// Replaces the stored image information; a zero magic marks the image as invalid.
+    { flash.write_info(info) } -> std::same_as<bool>;
+};
+
+/**
+ * The flash side of the bootloader protocol. Flash for the whole image is erased up front, since erasing a page stalls
+ * the CPU for too long to keep up with the bus, after which each block is received into one of k_window_size buffers
+ * and written to flash a chunk at a time from poll while the next block arrives. A block is acknowledged once it has
+ * been written, which lets the sender reuse its buffer. A block which is missing a frame or fails its CRC is rejected
+ * along with every later block, and the sender goes back to it. The image information is invalidated by a start
+ * command and only written once the CRC of the whole image has been checked. All member functions must be called from
+ * the same context.
+ *
+ * @tparam Flash the flash memory interface
+ */
+template <FlashDriver Flash>
+class Receiver {
+    enum class State : std::uint8_t {
+        Idle,
+        Erasing,
+        Receiving,
+        Complete,
+    };
+
+    enum class BufferState : std::uint8_t {
+        Free,
+        Filling,
+        Full,
+    };
+
+    struct Buffer {
+        std::array<std::uint8_t, k_block_size> data;
+        std::uint16_t index;
+        std::uint32_t crc;
+        BufferState state;
+    };
+
+    Config m_config;
+    std::uint8_t m_node_id;
+    Flash &m_flash;
+    State m_state{State::Idle};
+    std::uint32_t m_time{0};
+    std::size_t m_image_size{0};
+    std::size_t m_block_count{0};
+    std::size_t m_erase_page{0};
+
+    // Block whose header is accepted next, and the next data frame of the block being filled.
+    std::size_t m_rx_block{0};
+    std::size_t m_rx_frame{0};
+    std::optional<std::size_t> m_filling;
+
+    // Block which is written to flash next, and the offset of the next chunk within it.
+    std::size_t m_program_block{0};
+    std::size_t m_program_offset{0};
+    std::optional<std::uint32_t> m_image_crc;
+
+    std::array<Buffer, k_window_size> m_buffers{};
+    util::SpscRing<can::RawMessage, 4> m_responses;
+    ReceiverStatistics m_statistics{};
+
+    void respond(Opcode opcode, std::span<const std::uint8_t> payload);
+    void reject(std::size_t index, Status status);
+    void start(std::size_t size, std::uint32_t now);
+    void accept_block(std::size_t index, std::uint32_t crc);
+    void accept_data(std::size_t frame, const can::RawMessage &message);
+    void finish(std::uint32_t crc);
+    void program_chunk();
+
+public:
+    /**
+     * @param config the identifiers and timeouts
+     * @param node_id the node identifier which commands must be addressed to
+     * @param flash the flash memory interface, which must outlive the receiver
+     */
+    Receiver(const Config &config, std::uint8_t node_id, Flash &flash)
+        : m_config(config), m_node_id(node_id), m_flash(flash) {}
+
+    /**
+     * Handles a received frame. Frames on other identifiers are ignored.
+     *
+     * @param message the received frame
+     * @param now the current time in milliseconds
+     */
+    void on_frame(const can::RawMessage &message, std::uint32_t now);
+
+    /**
+     * Erases or writes the next piece of flash, and returns the next response to send, if any.
+     *
+     * @param now the current time in milliseconds
+     * @return the response to send
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now);
+
+    /**
+     * @return true if no transfer has been started, or the last one was abandoned or failed
+     */
+    bool is_idle() const { return m_state == State::Idle; }
+
+    /**
+     * @return true if an image has been received, verified, and marked as valid
+     */
+    bool is_complete() const { return m_state == State::Complete; }
+
+    const ReceiverStatistics &statistics() const { return m_statistics; }
+};
+
+/**
+ * The host side of the bootloader protocol. Frames to send are pulled with poll, which allows the caller to only take
+ * as many frames as the transmit queue has room for. Frames must be sent in the order they are returned, so the
+ * transmit queue must be in ordered mode (see can::InitOptions::ordered). All member functions must be called from the
+ * same context.
+ */
+class Sender {
+    enum class State : std::uint8_t {
+        Idle,
+        SendStart,
+        WaitReady,
+        SendBlocks,
+        SendFinish,
+        WaitDone,
+        Done,
+        Failed,
+    };
+
+    Config m_config;
+    std::uint8_t m_node_id;
+    State m_state{State::Idle};
+    Status m_status{Status::Ok};
+    std::span<const std::uint8_t> m_image;
+    std::size_t m_block_count{0};
+
+    // Lowest block not yet acknowledged, the block being sent, and the next frame of it where zero is the header.
+    std::size_t m_acked{0};
+    std::size_t m_tx_block{0};
+    std::size_t m_tx_frame{0};
+
+    // Time of the last frame sent or of the last progress, whichever is later.
+    std::uint32_t m_time{0};
+    std::uint32_t m_retry_count{0};
+    SenderStatistics m_statistics{};
+
+    can::RawMessage build_command(Opcode opcode, std::span<const std::uint8_t> payload) const;
+    can::RawMessage build_frame();
+    void retry(std::uint32_t now, State state);
+    void fail(Status status);
+
+public:
+    /**
+     * @param config the identifiers and timeouts
+     * @param node_id the node identifier of the receiver
+     */
+    Sender(const Config &config, std::uint8_t node_id) : m_config(config), m_node_id(node_id) {}
+
+    /**
+     * Starts sending the given image. The image is not copied, so it must outlive the transfer.
+     *
+     * @param image the image, of at most k_max_image_size bytes
+     * @param now the current time in milliseconds
+     * @return true if the transfer was started; false if the sender is busy or the image is empty or too large
+     */
+    bool start(std::span<const std::uint8_t> image, std::uint32_t now);
+
+    /**
+     * Handles a received frame. Frames on other identifiers are ignored.
+     *
+     * @param message the received frame
+     * @param now the current time in milliseconds
+     */
+    void on_frame(const can::RawMessage &message, std::uint32_t now);
+
+    /**
+     * @param now the current time in milliseconds
+     * @return the next frame to send, if any
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now);
+
+    /**
+     * @return true if a transfer is in progress
+     */
+    bool is_busy() const { return m_state != State::Idle && m_state != State::Done && m_state != State::Failed; }
+
+    /**
+     * @return true if the last transfer was verified by the receiver
+     */
+    bool is_done() const { return m_state == State::Done; }
+
+    /**
+     * @return the reason the last transfer failed, or Status::Ok
+     */
+    Status status() const { return m_status; }
+
+    /**
+     * @return the number of bytes acknowledged as written to flash
+     */
+    std::size_t acked_size() const { return std::min(m_acked * k_block_size, m_image.size()); }
+
+    const SenderStatistics &statistics() const { return m_statistics; }
+};
+
+template <FlashDriver Flash>
+void Receiver<Flash>::respond(Opcode opcode, std::span<const std::uint8_t> payload) {
+    std::array<std::uint8_t, 8> data{static_cast<std::uint8_t>(opcode), m_node_id};
+    std::copy(payload.begin(), payload.end(), data.begin() + 2);
+    static_cast<void>(
+        m_responses.push(can::RawMessage::standard(m_config.response_id, std::span(data).first(2 + payload.size()))));
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::reject(std::size_t index, Status status) {
+    // Discard the rejected block and every later one, which the sender will send again.
+    for (auto &buffer : m_buffers) {
+        if (buffer.state != BufferState::Free && buffer.index >= index) {
+            buffer.state = BufferState::Free;
+        }
+    }
+    m_filling.reset();
+    m_rx_block = index;
+    m_statistics.nack_count++;
+    const auto bytes = util::write_be(static_cast<std::uint16_t>(index));
+    respond(Opcode::Nack, std::to_array<std::uint8_t>({bytes[0], bytes[1], static_cast<std::uint8_t>(status)}));
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::start(std::size_t size, std::uint32_t now) {
+    m_time = now;
+    if (size == 0 || size > std::min(k_max_image_size, m_flash.slot_size())) {
+        m_state = State::Idle;
+        respond(Opcode::Ready, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Status::TooLarge), 0}));
+        return;
+    }
+
+    // Invalidate the current image first so that an interrupted transfer never leaves a bootable mix of two images.
+    if (!m_flash.write_info({})) {
+        m_state = State::Idle;
+        respond(Opcode::Ready, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Status::EraseFailed), 0}));
+        return;
+    }
+    m_state = State::Erasing;
+    m_image_size = size;
+    m_block_count = block_count(size);
+    m_erase_page = 0;
+    m_rx_block = 0;
+    m_filling.reset();
+    m_program_block = 0;
+    m_program_offset = 0;
+    m_image_crc.reset();
+    for (auto &buffer : m_buffers) {
+        buffer.state = BufferState::Free;
+    }
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::accept_block(std::size_t index, std::uint32_t crc) {
+    if (m_filling && index != m_rx_block) {
+        // The header of a later block arrived before the last frame of the current one.
+        reject(m_rx_block, Status::MissingFrame);
+        return;
+    }
+    if (index < m_program_block) {
+        // A block already written, sent again after a lost acknowledgement or a timeout. Acknowledge it again.
+        const auto bytes = util::write_be(static_cast<std::uint16_t>(m_program_block - 1));
+        respond(Opcode::Ack, bytes);
+        return;
+    }
+    auto &buffer = m_buffers[index % k_window_size];
+    if (index != m_rx_block || index >= m_block_count || (buffer.state != BufferState::Free && !m_filling)) {
+        return;
+    }
+    buffer.index = static_cast<std::uint16_t>(index);
+    buffer.crc = crc;
+    buffer.state = BufferState::Filling;
+    std::fill(buffer.data.begin(), buffer.data.end(), k_erased_byte);
+    m_filling = index % k_window_size;
+    m_rx_frame = 0;
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::accept_data(std::size_t frame, const can::RawMessage &message) {
+    if (!m_filling) {
+        return;
+    }
+    auto &buffer = m_buffers[*m_filling];
+    if (frame != m_rx_frame || message.length != 8) {
+        reject(buffer.index, Status::MissingFrame);
+        return;
+    }
+    const auto data = message.data();
+    std::copy(data.begin(), data.end(), buffer.data.begin() + static_cast<std::ptrdiff_t>(frame * 8));
+    if (++m_rx_frame != frame_count(m_image_size, buffer.index)) {
+        return;
+    }
+
+    // The block is complete, so check it straight away to reject it before the sender gets any further.
+    m_filling.reset();
+    if (m_flash.crc(buffer.data) != buffer.crc) {
+        reject(buffer.index, Status::CrcMismatch);
+        return;
+    }
+    buffer.state = BufferState::Full;
+    m_rx_block++;
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::finish(std::uint32_t crc) {
+    if (m_state == State::Complete) {
+        // The sender didn't see the last response.
+        respond(Opcode::Done, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Status::Ok)}));
+        return;
+    }
+    if (m_rx_block != m_block_count) {
+        reject(m_rx_block, Status::MissingFrame);
+        return;
+    }
+    m_image_crc = crc;
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::program_chunk() {
+    auto &buffer = m_buffers[m_program_block % k_window_size];
+    if (buffer.state != BufferState::Full || buffer.index != m_program_block) {
+        return;
+    }
+
+    // Only write as far as the end of the image, rounded up to a whole chunk.
+    const auto remaining = m_image_size - m_program_block * k_block_size;
+    const auto length = std::min(k_block_size, (remaining + k_program_chunk_size - 1) & ~(k_program_chunk_size - 1));
+    const auto chunk = std::span<const std::uint8_t>(buffer.data).subspan(m_program_offset, k_program_chunk_size);
+    if (!m_flash.program(m_program_block * k_block_size + m_program_offset, chunk)) {
+        reject(m_program_block, Status::ProgramFailed);
+        m_state = State::Idle;
+        return;
+    }
+    m_program_offset += k_program_chunk_size;
+    if (m_program_offset < length) {
+        return;
+    }
+    buffer.state = BufferState::Free;
+    m_statistics.block_count++;
+    respond(Opcode::Ack, util::write_be(static_cast<std::uint16_t>(m_program_block)));
+    m_program_block++;
+    m_program_offset = 0;
+}
+
+template <FlashDriver Flash>
+void Receiver<Flash>::on_frame(const can::RawMessage &message, std::uint32_t now) {
+    if (message.is_remote() || message.is_extended()) {
+        return;
+    }
+    const auto id = message.standard_id();
+    if (id >= m_config.data_id && id < m_config.data_id + k_frames_per_block) {
+        if (m_state == State::Receiving) {
+            m_time = now;
+            accept_data(id - m_config.data_id, message);
+        }
+        return;
+    }
+    if (id != m_config.command_id || message.length < 2 || message.byte(1) != m_node_id) {
+        return;
+    }
+
+    switch (static_cast<Opcode>(message.byte(0))) {
+    case Opcode::Start:
+        if (message.length >= 6) {
+            start(message.read_be<std::uint32_t>(2), now);
+        }
+        break;
+    case Opcode::Block:
+        if (message.length >= 8 && m_state == State::Receiving) {
+            m_time = now;
+            accept_block(message.read_be<std::uint16_t>(2), message.read_be<std::uint32_t>(4));
+        }
+        break;
+    case Opcode::Finish:
+        if (message.length >= 6 && (m_state == State::Receiving || m_state == State::Complete)) {
+            m_time = now;
+            finish(message.read_be<std::uint32_t>(2));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+template <FlashDriver Flash>
+std::optional<can::RawMessage> Receiver<Flash>::poll(std::uint32_t now) {
+    if (m_state == State::Erasing) {
+        // One page per call, so that the caller can keep servicing the bus in between.
+        if (!m_flash.erase_page(m_erase_page)) {
+            m_state = State::Idle;
+            respond(Opcode::Ready, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Status::EraseFailed), 0}));
+        } else if (++m_erase_page == m_block_count) {
+            m_state = State::Receiving;
+            m_time = now;
+            respond(Opcode::Ready, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Status::Ok),
+                                                                static_cast<std::uint8_t>(k_window_size)}));
+        }
+    } else if (m_state == State::Receiving) {
+        program_chunk();
+        if (m_state == State::Receiving && m_image_crc && m_program_block == m_block_count) {
+            const auto crc = m_flash.crc(m_flash.image().first(m_image_size));
+            const bool valid = crc == *m_image_crc &&
+                               m_flash.write_info({k_image_magic, static_cast<std::uint32_t>(m_image_size), crc});
+            m_state = valid ? State::Complete : State::Idle;
+            const auto status = valid ? Status::Ok : Status::ImageCrcMismatch;
+            respond(Opcode::Done, std::to_array<std::uint8_t>({static_cast<std::uint8_t>(status)}));
+        } else if (static_cast<std::int32_t>(now - m_time) >= static_cast<std::int32_t>(m_config.session_timeout)) {
+            m_state = State::Idle;
+            m_statistics.timeout_count++;
+        }
+    }
+
+    can::RawMessage response;
+    if (m_responses.pop(response)) {
+        return response;
+    }
+    return std::nullopt;
+}
+
+} // namespace boot
@@ -0,0 +1,202 @@
+#include <boot.hh>
+#include <can.hh>
+#include <can_filter.hh>
+#include <config.hh>
+#include <hal.hh>
+#include <stm32f103xb.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#ifndef BOOT_NODE_ID
+#error "BOOT_NODE_ID must be defined"
+#endif
+
+namespace {
+
+// Flash layout. The bootloader occupies the start of flash, with the image information in its last page, and the
+// application image slot follows. Must match system/STM32F103C8TX_BOOT.ld and system/STM32F103C8TX_APP.ld.
+constexpr std::uint32_t k_flash_base = 0x08000000;
+constexpr std::uint32_t k_page_size = 1024;
+constexpr std::uint32_t k_bootloader_size = 16 * 1024;
+constexpr std::uint32_t k_info_address = k_flash_base + k_bootloader_size - k_page_size;
+constexpr std::uint32_t k_slot_address = k_flash_base + k_bootloader_size;
+static_assert(k_page_size == boot::k_block_size);
+
+// Time in milliseconds to listen for a start command before booting a valid application.
+constexpr std::uint32_t k_listen_time = 250;
+
+// Time in milliseconds to wait for the final response to be sent before booting a newly written application.
+constexpr std::uint32_t k_boot_delay = 10;
+
+constexpr boot::Config k_config{};
+
+constexpr auto k_can_filters = can::plan_filters(std::to_array<can::FilterRule>({
+    {0, false, k_config.command_id, k_config.command_id},
+    {0, false, k_config.data_id, k_config.data_id + boot::k_frames_per_block - 1},
+}));
+static_assert(k_config.data_id % boot::k_frames_per_block == 0);
+
+bool wait_flash() {
+    while ((FLASH->SR & FLASH_SR_BSY) != 0u) {
+    }
+    const bool ok = (FLASH->SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) == 0u;
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    return ok;
+}
+
+bool erase_page_at(std::uint32_t address) {
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = address;
+    FLASH->CR |= FLASH_CR_STRT;
+    const bool ok = wait_flash();
+    FLASH->CR &= ~FLASH_CR_PER;
+    return ok;
+}
+
+bool program_at(std::uint32_t address, std::span<const std::uint8_t> data) {
+    FLASH->CR |= FLASH_CR_PG;
+    bool ok = true;
+    for (std::size_t i = 0; ok && i < data.size(); i += 2) {
+        const auto high = i + 1 < data.size() ? data[i + 1] : boot::k_erased_byte;
+        *reinterpret_cast<volatile std::uint16_t *>(address + i) = static_cast<std::uint16_t>(data[i] | (high << 8u));
+        ok = wait_flash();
+    }
+    FLASH->CR &= ~FLASH_CR_PG;
+    return ok && std::equal(data.begin(), data.end(), reinterpret_cast<const std::uint8_t *>(address));
+}
+
+// The boot::FlashDriver for the on-chip flash.
+struct Flash {
+    Flash() {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+
+    std::size_t slot_size() {
+        // Many parts have more flash than the 64 KiB they are sold with, so use the size reported by the device.
+        const auto flash_size = *reinterpret_cast<const std::uint16_t *>(FLASHSIZE_BASE) * 1024u;
+        return std::min<std::size_t>(flash_size - k_bootloader_size, boot::k_max_image_size);
+    }
+
+    bool erase_page(std::size_t index) { return erase_page_at(k_slot_address + index * k_page_size); }
+    bool program(std::size_t offset, std::span<const std::uint8_t> data) {
+        return program_at(k_slot_address + offset, data);
+    }
+    std::span<const std::uint8_t> image() {
+        return {reinterpret_cast<const std::uint8_t *>(k_slot_address), slot_size()};
+    }
+    std::uint32_t crc(std::span<const std::uint8_t> data) { return hal::crc_compute(data); }
+
+    bool write_info(const boot::ImageInfo &info) {
+        const auto bytes = std::bit_cast<std::array<std::uint8_t, sizeof(info)>>(info);
+        return erase_page_at(k_info_address) && program_at(k_info_address, bytes);
+    }
+};
+
+const boot::ImageInfo &image_info() {
+    return *reinterpret_cast<const boot::ImageInfo *>(k_info_address);
+}
+
+bool is_image_valid() {
+    const auto &info = image_info();
+    if (info.magic != boot::k_image_magic || info.size == 0 || info.size > boot::k_max_image_size) {
+        return false;
+    }
+    return hal::crc_compute({reinterpret_cast<const std::uint8_t *>(k_slot_address), info.size}) == info.crc;
+}
+
+std::uint32_t uptime() {
+    // Extend the 16-bit millisecond count of TIM2, which must be read at least every 65 seconds.
+    static std::uint16_t s_last_count = 0;
+    static std::uint32_t s_uptime = 0;
+    const auto count = static_cast<std::uint16_t>(TIM2->CNT);
+    s_uptime += static_cast<std::uint16_t>(count - s_last_count);
+    s_last_count = count;
+    return s_uptime;
+}
+
+[[noreturn]] void start_application() {
+    __disable_irq();
+    for (auto &icer : NVIC->ICER) {
+        icer = 0xffffffffu;
+    }
+    for (auto &icpr : NVIC->ICPR) {
+        icpr = 0xffffffffu;
+    }
+
+    // Return the peripherals and clocks used here to their reset state, since the application expects to start from
+    // a reset.
+    RCC->APB1RSTR = RCC_APB1RSTR_CAN1RST | RCC_APB1RSTR_TIM2RST;
+    RCC->APB1RSTR = 0u;
+    RCC->APB1ENR &= ~(RCC_APB1ENR_CAN1EN | RCC_APB1ENR_TIM2EN);
+    RCC->CR |= RCC_CR_HSION;
+    hal::wait_equal(RCC->CR, RCC_CR_HSIRDY, RCC_CR_HSIRDY);
+    RCC->CFGR = 0u;
+    hal::wait_equal(RCC->CFGR, RCC_CFGR_SWS, RCC_CFGR_SWS_HSI);
+    RCC->CR &= ~(RCC_CR_PLLON | RCC_CR_HSEON);
+    FLASH->CR |= FLASH_CR_LOCK;
+
+    const auto *vectors = reinterpret_cast<const std::uint32_t *>(k_slot_address);
+    SCB->VTOR = k_slot_address;
+    __set_MSP(vectors[0]);
+    __enable_irq();
+    reinterpret_cast<void (*)()>(vectors[1])();
+    __builtin_unreachable();
+}
+
+Flash s_flash;
+boot::Receiver<Flash> s_receiver(k_config, BOOT_NODE_ID, s_flash);
+std::uint32_t s_now = 0;
+
+} // namespace
+
+void app_main() {
+    // Start a free-running 1 kHz counter. TIM2 is clocked at twice APB1.
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+    TIM2->PSC = 2 * hal::k_apb1_clock / 1000 - 1;
+    TIM2->ARR = 0xffffu;
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->CR1 |= TIM_CR1_CEN;
+
+    const bool image_valid = is_image_valid();
+    if (!can::init(can::Port::B, config::k_can_speed)) {
+        if (image_valid) {
+            start_application();
+        }
+        while (true) {
+        }
+    }
+    can::apply_filters(k_can_filters);
+    can::set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t) {
+        s_receiver.on_frame(message, s_now);
+    });
+    can::set_fifo_deferred(0, true);
+    hal::enable_irq(CAN1_RX0_IRQn, 2);
+    hal::enable_irq(USB_HP_CAN1_TX_IRQn, 2);
+
+    std::optional<std::uint32_t> complete_time;
+    while (true) {
+        s_now = uptime();
+        can::drain_fifo(0, 16);
+        if (const auto response = s_receiver.poll(s_now)) {
+            can::transmit(*response);
+        }
+
+        if (s_receiver.is_complete()) {
+            if (!complete_time) {
+                complete_time = s_now;
+            } else if (s_now - *complete_time >= k_boot_delay && is_image_valid()) {
+                start_application();
+            }
+        } else if (s_receiver.is_idle() && s_now >= k_listen_time && image_valid && image_info().magic != 0) {
+            // No transfer was started, or it was abandoned before the image information was invalidated.
+            start_application();
+        }
+    }
+}
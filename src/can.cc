@@ -1,10 +1,22 @@
 #include <can.hh>
 
+#include <can_filter.hh>
+#include <can_health.hh>
+#include <can_load.hh>
+#include <can_queue.hh>
+#include <can_timestamp.hh>
+#include <can_timing.hh>
 #include <hal.hh>
 #include <stm32f103xb.h>
+#include <util.hh>
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <optional>
+#include <span>
 #include <utility>
 
 namespace can {
@@ -13,17 +25,89 @@ namespace {
 // Allow 10 milliseconds for synchronising with the bus.
 constexpr std::uint32_t k_init_timeout = 10;
 
+// Bit timings for each bus speed for both possible APB1 clocks.
+constexpr auto k_timing_table = timing_table(hal::k_apb1_clock);
+constexpr auto k_timing_table_low_power = timing_table(hal::k_apb1_clock_low_power);
+static_assert(std::ranges::all_of(k_timing_table, &std::optional<BitTiming>::has_value),
+              "Bus speed not achievable at 28 MHz");
+static_assert(std::ranges::all_of(k_timing_table_low_power, &std::optional<BitTiming>::has_value),
+              "Bus speed not achievable at 8 MHz");
+
+// Number of messages that can wait for a free transmit mailbox.
+constexpr std::size_t k_tx_queue_capacity = 16;
+
+// Number of raw frames that can wait to be drained per FIFO in deferred mode.
+constexpr std::size_t k_rx_ring_capacity = 16;
+
+// Raw copy of a FIFO mailbox's registers.
+struct RawFrame {
+    std::uint32_t rir;
+    std::uint32_t rdtr;
+    std::uint32_t rdlr;
+    std::uint32_t rdhr;
+    std::uint32_t timestamp;
+};
+
+// Outcome of the last message to leave a transmit mailbox, identified by the mailbox's sequence number.
+struct MailboxOutcome {
+    std::uint32_t sequence;
+    bool sent;
+};
+
 std::array<fifo_callback_t, 2> s_fifo_callbacks{};
+std::array<raw_fifo_callback_t, 2> s_raw_fifo_callbacks{};
+tx_callback_t s_tx_callback = nullptr;
+std::array<bool, 2> s_fifo_deferred{};
 std::array<std::uint16_t, 2> s_fifo_overrun_counter{};
+std::array<std::uint32_t, 2> s_ring_full_counter{};
+std::array<std::uint32_t, 2> s_max_isr_cycles{};
+std::array<util::SpscRing<RawFrame, k_rx_ring_capacity>, 2> s_rx_rings;
+std::array<std::uint32_t, 3> s_mailbox_sequence{};
+std::array<MailboxOutcome, 3> s_mailbox_outcomes{};
+TxQueue<k_tx_queue_capacity> s_tx_queue;
+HealthMonitor s_health_monitor;
+BusOffRecovery s_bus_off_recovery;
+LoadMeter s_load_meter(0);
+TimestampExtender s_timestamp_extender;
+bool s_timestamps_enabled = false;
+bool s_manual_bus_off_recovery = false;
+
+// Mailboxes which may be filled from the software queue, as a mask of TME bits.
+std::uint32_t s_queue_mailboxes = 0b111u;
+std::uint32_t s_bitrate = 0;
+
+static_assert(k_esr_ewgf == CAN_ESR_EWGF && k_esr_epvf == CAN_ESR_EPVF && k_esr_boff == CAN_ESR_BOFF);
+static_assert(k_esr_lec_mask == CAN_ESR_LEC_Msk);
+static_assert(k_esr_tec_pos == CAN_ESR_TEC_Pos && k_esr_rec_pos == CAN_ESR_REC_Pos);
+
+void update_health() {
+    // Must be called with interrupts masked.
+    if (s_health_monitor.update(CAN1->ESR)) {
+        // Mark the error code as handled so that a repeat of the same error is seen as a change. The rest of the
+        // register is read-only.
+        CAN1->ESR = static_cast<std::uint32_t>(LastErrorCode::SetBySoftware) << k_esr_lec_pos;
+    }
+}
+
+RawMessage decode_frame(const RawFrame &frame) {
+    return {
+        .id_word = frame.rir,
+        .data_low = frame.rdlr,
+        .data_high = frame.rdhr,
+        .length = static_cast<std::uint8_t>((frame.rdtr & CAN_RDT0R_DLC_Msk) >> CAN_RDT0R_DLC_Pos),
+    };
+}
 
-Identifier decode_identifier(std::uint32_t rir) {
-    if ((rir & CAN_RI0R_IDE_Msk) != 0u) {
-        return ExtendedIdentifier((rir & CAN_RI0R_EXID_Msk) >> CAN_RI0R_EXID_Pos);
+void dispatch(std::uint8_t fifo_index, const RawFrame &frame) {
+    if (const auto raw_callback = s_raw_fifo_callbacks[fifo_index]) {
+        raw_callback(decode_frame(frame), frame.timestamp);
+    } else if (const auto callback = s_fifo_callbacks[fifo_index]) {
+        callback(decode_frame(frame).to_message());
     }
-    return StandardIdentifier((rir & CAN_RI0R_STID_Msk) >> CAN_RI0R_STID_Pos);
 }
 
 void fifo_interrupt(const std::uint8_t fifo_index) {
+    const auto start_cycles = hal::cycle_count();
     volatile std::uint32_t &fifo_reg = fifo_index == 1 ? CAN1->RF1R : CAN1->RF0R;
     const auto &mailbox = CAN1->sFIFOMailBox[fifo_index];
 
@@ -33,31 +117,155 @@ void fifo_interrupt(const std::uint8_t fifo_index) {
         s_fifo_overrun_counter[fifo_index]++;
     }
 
-    const auto callback = s_fifo_callbacks[fifo_index];
+    const bool deferred = s_fifo_deferred[fifo_index];
     const auto pending_count = (fifo_reg & CAN_RF0R_FMP0_Msk) >> CAN_RF0R_FMP0_Pos;
     for (std::uint32_t i = 0; i < pending_count; i++) {
         // Read data from mailbox.
-        Message message{
-            .identifier = decode_identifier(mailbox.RIR),
-            .data{
-                static_cast<std::uint8_t>(mailbox.RDLR & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDLR >> 8u) & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDLR >> 16u) & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDLR >> 24u) & 0xffu),
-                static_cast<std::uint8_t>(mailbox.RDHR & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDHR >> 8u) & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDHR >> 16u) & 0xffu),
-                static_cast<std::uint8_t>((mailbox.RDHR >> 24u) & 0xffu),
-            },
-            .length = static_cast<std::uint8_t>((mailbox.RDTR & CAN_RDT0R_DLC_Msk) >> CAN_RDT0R_DLC_Pos),
+        RawFrame frame{
+            .rir = mailbox.RIR,
+            .rdtr = mailbox.RDTR,
+            .rdlr = mailbox.RDLR,
+            .rdhr = mailbox.RDHR,
+            .timestamp = 0,
         };
-        if (callback != nullptr) {
-            callback(message);
-        }
 
-        // Release FIFO.
+        // Release FIFO as early as possible to make room for the next message.
         fifo_reg |= CAN_RF0R_RFOM0;
+
+        // Each FIFO has its own load meter source, so only the shared time stamp extender needs interrupts masked.
+        s_load_meter.record(frame.rir, static_cast<std::uint8_t>(frame.rdtr & CAN_RDT0R_DLC_Msk),
+                            static_cast<LoadSource>(fifo_index));
+        if (s_timestamps_enabled) {
+            hal::CriticalSection critical_section;
+            const auto time = static_cast<std::uint16_t>(frame.rdtr >> CAN_RDT0R_TIME_Pos);
+            frame.timestamp = s_timestamp_extender.extend(time, hal::cycle_count());
+        }
+
+        if (deferred) {
+            if (!s_rx_rings[fifo_index].push(frame)) {
+                s_ring_full_counter[fifo_index]++;
+            }
+        } else {
+            dispatch(fifo_index, frame);
+        }
+    }
+
+    // Record the worst-case time spent per message.
+    if (pending_count != 0) {
+        const std::uint32_t cycles = (hal::cycle_count() - start_cycles) / pending_count;
+        s_max_isr_cycles[fifo_index] = std::max(s_max_isr_cycles[fifo_index], cycles);
+    }
+}
+
+void acknowledge_mailbox(std::uint8_t mailbox) {
+    // Must be called with interrupts masked. The status bits of each mailbox are eight bits apart.
+    const std::uint32_t shift = mailbox * 8u;
+    const auto tsr = CAN1->TSR;
+    if ((tsr & (CAN_TSR_RQCP0 << shift)) == 0u) {
+        return;
+    }
+
+    // The mailbox registers keep their contents after the request completes, so sent frames can be accounted for.
+    const bool sent = (tsr & (CAN_TSR_TXOK0 << shift)) != 0u;
+    s_mailbox_outcomes[mailbox] = {.sequence = s_mailbox_sequence[mailbox], .sent = sent};
+    if (sent) {
+        const auto &registers = CAN1->sTxMailBox[mailbox];
+        const auto length = static_cast<std::uint8_t>(registers.TDTR & CAN_TDT0R_DLC_Msk);
+        s_load_meter.record(registers.TIR, length, LoadSource::Transmit);
+        if (s_tx_callback != nullptr) {
+            const auto time = static_cast<std::uint16_t>(registers.TDTR >> CAN_TDT0R_TIME_Pos);
+            const auto timestamp = s_timestamps_enabled ? s_timestamp_extender.extend(time, hal::cycle_count()) : 0u;
+            s_tx_callback(
+                {
+                    // TXRQ has already been cleared by hardware.
+                    .id_word = registers.TIR,
+                    .data_low = registers.TDLR,
+                    .data_high = registers.TDHR,
+                    .length = length,
+                },
+                timestamp);
+        }
+    }
+    CAN1->TSR = CAN_TSR_RQCP0 << shift;
+}
+
+void fill_mailbox(std::uint8_t mailbox_index, const RawMessage &message) {
+    auto &mailbox = CAN1->sTxMailBox[mailbox_index];
+
+    // Account for the previous message before it is overwritten, in case the transmit interrupt hasn't run yet.
+    acknowledge_mailbox(mailbox_index);
+    mailbox.TIR = message.id_word;
+    mailbox.TDTR = message.length & 0xfu;
+    mailbox.TDLR = message.data_low;
+    mailbox.TDHR = message.data_high;
+
+    // Request transmission.
+    mailbox.TIR = message.id_word | CAN_TI0R_TXRQ;
+    s_mailbox_sequence[mailbox_index]++;
+}
+
+bool is_mailbox_empty(std::uint8_t mailbox) {
+    return (CAN1->TSR & (CAN_TSR_TME0 << mailbox)) != 0u;
+}
+
+std::uint32_t free_mailboxes() {
+    return (CAN1->TSR & CAN_TSR_TME) >> CAN_TSR_TME0_Pos;
+}
+
+std::uint32_t free_queue_mailboxes() {
+    return free_mailboxes() & s_queue_mailboxes;
+}
+
+void refill_mailboxes() {
+    // Move the highest priority queued messages into any free mailboxes. Must be called with interrupts masked.
+    for (auto free = free_queue_mailboxes(); free != 0u && !s_tx_queue.empty(); free &= free - 1u) {
+        fill_mailbox(static_cast<std::uint8_t>(std::countr_zero(free)), s_tx_queue.pop());
+    }
+}
+
+MailboxStatus mailbox_status_locked(const MailboxTicket &ticket) {
+    // Must be called with interrupts masked.
+    if (s_mailbox_sequence[ticket.mailbox] == ticket.sequence && !is_mailbox_empty(ticket.mailbox)) {
+        return MailboxStatus::Pending;
+    }
+
+    // Record the outcome of a request which has completed but whose transmit interrupt hasn't run yet.
+    acknowledge_mailbox(ticket.mailbox);
+    const auto &outcome = s_mailbox_outcomes[ticket.mailbox];
+    if (outcome.sequence == ticket.sequence && !outcome.sent) {
+        return MailboxStatus::Aborted;
+    }
+    return MailboxStatus::Sent;
+}
+
+RawMessage to_raw_message(const Message &message) {
+    return RawMessage::from_message(message);
+}
+
+const RawMessage &to_raw_message(const RawMessage &message) {
+    return message;
+}
+
+template <typename T>
+std::size_t transmit_batch(std::span<const T> messages) {
+    hal::CriticalSection critical_section;
+    std::size_t count = 0;
+    if (s_tx_queue.empty()) {
+        // Nothing is waiting, so the leading messages can go straight into the free mailboxes without overtaking a
+        // queued message.
+        for (auto free = free_queue_mailboxes(); free != 0u && count < messages.size(); free &= free - 1u) {
+            fill_mailbox(static_cast<std::uint8_t>(std::countr_zero(free)), to_raw_message(messages[count++]));
+        }
     }
+
+    // Only take the free queue slots, since pushing into a full queue evicts its lowest priority message, which could
+    // be one accepted earlier in this batch.
+    const auto accepted = count + std::min(messages.size() - count, s_tx_queue.free_count());
+    for (; count < accepted; count++) {
+        s_tx_queue.push(to_raw_message(messages[count]));
+    }
+    refill_mailboxes();
+    return count;
 }
 
 std::pair<hal::Gpio, hal::Gpio> pin_pair(Port port) {
@@ -73,6 +281,16 @@ std::pair<hal::Gpio, hal::Gpio> pin_pair(Port port) {
 
 } // namespace
 
+extern "C" void USB_HP_CAN1_TX_IRQHandler() {
+    hal::CriticalSection critical_section;
+
+    // Acknowledge completed requests on all mailboxes and refill them from the software queue.
+    for (std::uint8_t mailbox = 0; mailbox < 3; mailbox++) {
+        acknowledge_mailbox(mailbox);
+    }
+    refill_mailboxes();
+}
+
 extern "C" void USB_LP_CAN1_RX0_IRQHandler() {
     fifo_interrupt(0);
 }
@@ -90,9 +308,20 @@ extern "C" void CAN1_SCE_IRQHandler() {
 
     // Clear interrupt flag.
     CAN1->MSR |= CAN_MSR_ERRI;
+
+    hal::CriticalSection critical_section;
+    update_health();
+}
+
+bool init(Port port, Speed speed, const InitOptions &options) {
+    const auto &table = hal_low_power() ? k_timing_table_low_power : k_timing_table;
+    return init(port, *table[static_cast<std::size_t>(speed)], options);
 }
 
-bool init(Port port, Speed speed) {
+bool init(Port port, const BitTiming &timing, const InitOptions &options) {
+    // Enable the cycle counter for interrupt timing statistics.
+    hal::enable_cycle_counter();
+
     // Enable CAN1's peripheral clock.
     RCC->APB1ENR |= RCC_APB1ENR_CAN1EN;
 
@@ -123,25 +352,43 @@ bool init(Port port, Speed speed) {
         return false;
     }
 
-    // Configure the bit timing register. The peripheral is clocked at 28 MHz.
-    switch (speed) {
-    case Speed::_33_3:
-        // 33.333 kbit/s sets 12+2+3 (seg1+seg2+sync) time quanta per bit with a prescaler of 56.
-        CAN1->BTR = 0x001b0037;
-        break;
-    case Speed::_500:
-        // 500 kbit/s sets 11+2+1 (seg1+seg2+sync) time quanta per bit with a prescaler of 4.
-        CAN1->BTR = 0x001a0003;
-        break;
-    case Speed::_1000:
-        // 1000 kbit/s sets 11+2+1 (seg1+seg2+sync) time quanta per bit with a prescaler of 2.
-        CAN1->BTR = 0x001a0001;
-        break;
+    // Configure the bit timing register.
+    CAN1->BTR = timing.btr();
+    const auto apb1_clock = hal_low_power() ? hal::k_apb1_clock_low_power : hal::k_apb1_clock;
+    const auto core_clock = hal_low_power() ? hal::k_core_clock_low_power : hal::k_core_clock;
+    {
+        hal::CriticalSection critical_section;
+        s_bitrate = timing.bitrate(apb1_clock);
+        s_load_meter.reset(s_bitrate, 0);
+
+        // The CAN timer ticks once per bit time, which is a whole number of core clock cycles.
+        s_timestamp_extender.reset(core_clock / apb1_clock * timing.prescaler * timing.quanta_per_bit());
+        s_timestamps_enabled = options.timestamps;
+        s_tx_queue.set_ordered(options.ordered);
+        s_manual_bus_off_recovery = options.manual_bus_off_recovery;
+        s_queue_mailboxes = options.reserve_mailbox ? 0b011u : 0b111u;
+    }
+
+    // Configure time triggered communication mode, which captures the CAN timer into RDTxR and TDTxR.
+    if (options.timestamps) {
+        CAN1->MCR |= CAN_MCR_TTCM;
+    } else {
+        CAN1->MCR &= ~CAN_MCR_TTCM;
+    }
+
+    // Configure transmit FIFO priority, which sends pending mailboxes in request order rather than identifier order.
+    if (options.ordered) {
+        CAN1->MCR |= CAN_MCR_TXFP;
+    } else {
+        CAN1->MCR &= ~CAN_MCR_TXFP;
     }
 
-    // Set automatic bus-off management for now.
-    // TODO: We should handle this manually eventually.
-    CAN1->MCR |= CAN_MCR_ABOM;
+    // Configure automatic bus-off management. Without it, recovery is delayed by poll_bus_off_recovery.
+    if (options.manual_bus_off_recovery) {
+        CAN1->MCR &= ~CAN_MCR_ABOM;
+    } else {
+        CAN1->MCR |= CAN_MCR_ABOM;
+    }
 
     // Leave initialisation mode.
     CAN1->MCR &= ~CAN_MCR_INRQ;
@@ -149,12 +396,15 @@ bool init(Port port, Speed speed) {
         return false;
     }
 
-    // Enable setting of CAN_MSR_ERRI on bus-off event.
-    CAN1->IER |= CAN_IER_BOFIE;
+    // Enable setting of CAN_MSR_ERRI on error warning, error passive, and bus-off events.
+    CAN1->IER |= CAN_IER_EWGIE | CAN_IER_EPVIE | CAN_IER_BOFIE;
 
     // Enable setting of CAN_MSR_ERRI on last error code change event.
     CAN1->IER |= CAN_IER_LECIE;
 
+    // Enable transmit mailbox empty interrupt generation for draining the software queue.
+    CAN1->IER |= CAN_IER_TMEIE;
+
     // Enable message pending and overrun interrupt generation for both FIFOs.
     CAN1->IER |= CAN_IER_FOVIE0 | CAN_IER_FMPIE0;
     CAN1->IER |= CAN_IER_FOVIE1 | CAN_IER_FMPIE1;
@@ -194,35 +444,192 @@ void route_filter(const std::uint8_t filter, const std::uint8_t fifo, const std:
     CAN1->FMR &= ~CAN_FMR_FINIT;
 }
 
+void apply_filters(const FilterPlan &plan) {
+    // Enable filter init mode and disable all filters.
+    CAN1->FMR |= CAN_FMR_FINIT;
+    CAN1->FA1R = 0u;
+
+    std::uint32_t list_bits = 0;
+    std::uint32_t scale_bits = 0;
+    std::uint32_t fifo_bits = 0;
+    std::uint32_t active_bits = 0;
+    for (std::size_t i = 0; i < plan.bank_count && i < plan.banks.size(); i++) {
+        const auto &bank = plan.banks[i];
+        const std::uint32_t filter_bit = 1u << i;
+        if (bank.mode == FilterMode::List) {
+            list_bits |= filter_bit;
+        }
+        if (bank.scale == FilterScale::Single32) {
+            scale_bits |= filter_bit;
+        }
+        if (bank.fifo != 0u) {
+            fifo_bits |= filter_bit;
+        }
+        active_bits |= filter_bit;
+        CAN1->sFilterRegister[i].FR1 = bank.fr1;
+        CAN1->sFilterRegister[i].FR2 = bank.fr2;
+    }
+    CAN1->FM1R = list_bits;
+    CAN1->FS1R = scale_bits;
+    CAN1->FFA1R = fifo_bits;
+
+    // Enable the used filters and leave init mode.
+    CAN1->FA1R = active_bits;
+    CAN1->FMR &= ~CAN_FMR_FINIT;
+}
+
 void set_fifo_callback(std::uint8_t index, fifo_callback_t callback) {
+    s_raw_fifo_callbacks[index] = nullptr;
     s_fifo_callbacks[index] = callback;
 }
 
+void set_fifo_callback(std::uint8_t index, raw_fifo_callback_t callback) {
+    s_fifo_callbacks[index] = nullptr;
+    s_raw_fifo_callbacks[index] = callback;
+}
+
+void set_tx_callback(tx_callback_t callback) {
+    hal::CriticalSection critical_section;
+    s_tx_callback = callback;
+}
+
+std::uint64_t timestamp_to_us(std::uint32_t timestamp) {
+    return s_bitrate != 0 ? static_cast<std::uint64_t>(timestamp) * 1'000'000u / s_bitrate : 0u;
+}
+
+std::uint32_t timestamp_now() {
+    hal::CriticalSection critical_section;
+    return s_timestamps_enabled ? s_timestamp_extender.estimate(hal::cycle_count()) : 0u;
+}
+
+void set_fifo_deferred(std::uint8_t index, bool deferred) {
+    s_fifo_deferred[index] = deferred;
+}
+
+std::size_t drain_fifo(std::uint8_t index, std::size_t max_count) {
+    std::size_t count = 0;
+    RawFrame frame;
+    while (count < max_count && s_rx_rings[index].pop(frame)) {
+        dispatch(index, frame);
+        count++;
+    }
+    return count;
+}
+
+RxStatistics rx_statistics(std::uint8_t index) {
+    hal::CriticalSection critical_section;
+    return {
+        .overrun_count = s_fifo_overrun_counter[index],
+        .ring_full_count = s_ring_full_counter[index],
+        .ring_depth = static_cast<std::uint16_t>(s_rx_rings[index].size()),
+        .max_isr_cycles = s_max_isr_cycles[index],
+    };
+}
+
 bool transmit(const Message &message) {
-    if ((CAN1->TSR & CAN_TSR_TME) == 0u) {
-        // All mailboxes full.
-        return false;
+    return transmit(RawMessage::from_message(message));
+}
+
+bool transmit(const RawMessage &message) {
+    hal::CriticalSection critical_section;
+
+    // Queue the message and then immediately move as many messages as possible into free mailboxes, so that a message
+    // never overtakes a higher priority one that is already waiting.
+    const bool queued = s_tx_queue.push(message);
+    refill_mailboxes();
+    return queued;
+}
+
+std::size_t transmit(std::span<const Message> messages) {
+    return transmit_batch(messages);
+}
+
+std::size_t transmit(std::span<const RawMessage> messages) {
+    return transmit_batch(messages);
+}
+
+TxStatistics tx_statistics() {
+    hal::CriticalSection critical_section;
+    return {
+        .queue_depth = static_cast<std::uint16_t>(s_tx_queue.size()),
+        .high_water_mark = static_cast<std::uint16_t>(s_tx_queue.high_water_mark()),
+        .drop_count = s_tx_queue.drop_count(),
+    };
+}
+
+void set_bus_off_policy(const BusOffPolicy &policy) {
+    hal::CriticalSection critical_section;
+    s_bus_off_recovery.set_policy(policy);
+}
+
+bool poll_bus_off_recovery(std::uint32_t now) {
+    {
+        hal::CriticalSection critical_section;
+
+        // The controller raises no interrupt when the error counters decrease, so refresh the state here.
+        update_health();
+        if (!s_manual_bus_off_recovery) {
+            return false;
+        }
+        if (!s_bus_off_recovery.poll(s_health_monitor.statistics().state, now)) {
+            return false;
+        }
+        s_health_monitor.record_recovery();
     }
 
-    // Fill mailbox data.
-    const auto mailbox_index = (CAN1->TSR & CAN_TSR_CODE_Msk) >> CAN_TSR_CODE_Pos;
-    auto &mailbox = CAN1->sTxMailBox[mailbox_index];
-    if (auto *standard = std::get_if<StandardIdentifier>(&message.identifier)) {
-        mailbox.TIR = *standard << CAN_TI0R_STID_Pos;
-    } else {
-        mailbox.TIR = (message.extended_id() << CAN_TI0R_EXID_Pos) | CAN_TI0R_IDE;
+    // Entering and leaving initialisation mode starts the recovery sequence. The controller then rejoins the bus
+    // once it has seen 128 occurrences of 11 recessive bits, which is not waited for here.
+    CAN1->MCR |= CAN_MCR_INRQ;
+    const bool entered = hal::wait_equal(CAN1->MSR, CAN_MSR_INAK, CAN_MSR_INAK, k_init_timeout);
+    CAN1->MCR &= ~CAN_MCR_INRQ;
+    return entered;
+}
+
+void update_bus_load(std::uint32_t now) {
+    hal::CriticalSection critical_section;
+    s_load_meter.advance(now);
+}
+
+BusLoadStatistics bus_load_statistics() {
+    hal::CriticalSection critical_section;
+    return s_load_meter.statistics();
+}
+
+HealthStatistics health_statistics() {
+    hal::CriticalSection critical_section;
+    update_health();
+    auto statistics = s_health_monitor.statistics();
+    statistics.fifo_overrun_count = s_fifo_overrun_counter;
+    return statistics;
+}
+
+std::optional<MailboxTicket> transmit_mailbox(const RawMessage &message) {
+    hal::CriticalSection critical_section;
+    const auto free = free_mailboxes();
+    if (free == 0u) {
+        return std::nullopt;
     }
-    mailbox.TDTR = message.length & 0xfu;
-    mailbox.TDLR = (static_cast<std::uint32_t>(message.data[3]) << 24u) |
-                   (static_cast<std::uint32_t>(message.data[2]) << 16u) |
-                   (static_cast<std::uint32_t>(message.data[1]) << 8u) | message.data[0];
-    mailbox.TDHR = (static_cast<std::uint32_t>(message.data[7]) << 24u) |
-                   (static_cast<std::uint32_t>(message.data[6]) << 16u) |
-                   (static_cast<std::uint32_t>(message.data[5]) << 8u) | message.data[4];
 
-    // Request transmission.
-    mailbox.TIR |= CAN_TI0R_TXRQ;
-    return true;
+    // Take the highest free mailbox, which is the reserved one if it is free, to leave the others to the queue.
+    const auto mailbox = static_cast<std::uint8_t>(std::bit_width(free) - 1u);
+    fill_mailbox(mailbox, message);
+    return MailboxTicket{mailbox, s_mailbox_sequence[mailbox]};
+}
+
+MailboxStatus mailbox_status(const MailboxTicket &ticket) {
+    hal::CriticalSection critical_section;
+    return mailbox_status_locked(ticket);
+}
+
+MailboxStatus abort_mailbox(const MailboxTicket &ticket) {
+    // Interrupts stay masked so that the transmit interrupt can't refill the mailbox between the check and the request.
+    hal::CriticalSection critical_section;
+    if (s_mailbox_sequence[ticket.mailbox] == ticket.sequence && !is_mailbox_empty(ticket.mailbox)) {
+        // The status bits of each mailbox are eight bits apart. A message which is being sent can't be stopped, so
+        // the request only takes effect at the end of the frame; that is left to the next status check.
+        CAN1->TSR = CAN_TSR_ABRQ0 << (ticket.mailbox * 8u);
+    }
+    return mailbox_status_locked(ticket);
 }
 
 } // namespace can
@@ -2,8 +2,12 @@
 
 #include <array>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <span>
+#include <type_traits>
+#include <utility>
 #include <variant>
 
 namespace can {
@@ -22,22 +26,47 @@ enum class Port {
 
 /// An enum which represents the different available bus speeds.
 enum class Speed {
+    /// 10 kbit/s.
+    _10,
+
+    /// 20 kbit/s.
+    _20,
+
     /// 33.3333 kbit/s.
     _33_3,
 
+    /// 50 kbit/s.
+    _50,
+
+    /// 100 kbit/s.
+    _100,
+
+    /// 125 kbit/s.
+    _125,
+
+    /// 250 kbit/s.
+    _250,
+
     /// 500 kbit/s.
     _500,
 
+    /// 800 kbit/s.
+    _800,
+
     /// 1000 kbit/s.
     _1000,
 };
 
+/// Number of entries in the Speed enum.
+constexpr std::size_t k_speed_count = static_cast<std::size_t>(Speed::_1000) + 1;
+
 /// A class to make distinct numerical types for CAN identifiers.
 template <int N, std::integral T>
 struct BaseIdentifier {
     using Self = BaseIdentifier<N, T>;
-    T value;
+    T value{};
 
+    BaseIdentifier() = default;
     BaseIdentifier(T value) : value(value) {}
     constexpr operator T() const { return value; }
 };
@@ -80,17 +109,208 @@ struct Message {
     bool is_extended() const { return std::holds_alternative<ExtendedIdentifier>(identifier); }
 };
 
+/// A compact CAN message which stores the identifier and data in the same layout as the bxCAN mailbox registers, so
+/// that it can be copied to and from a mailbox without any decoding. Unlike Message, it has no variant discriminator
+/// and fits into 13 bytes plus padding.
+struct RawMessage {
+    static constexpr std::uint32_t k_ide_bit = 1u << 2u;
+    static constexpr std::uint32_t k_rtr_bit = 1u << 1u;
+
+    /// Identifier in the CAN_TIxR/CAN_RIxR layout: STID[10:0] | EXID[17:0] | IDE | RTR | 0.
+    std::uint32_t id_word;
+
+    /// Data bytes 0-3 with byte 0 in the least significant byte, as in CAN_TDLxR/CAN_RDLxR.
+    std::uint32_t data_low;
+
+    /// Data bytes 4-7 with byte 4 in the least significant byte, as in CAN_TDHxR/CAN_RDHxR.
+    std::uint32_t data_high;
+
+    std::uint8_t length;
+
+    bool operator==(const RawMessage &) const = default;
+
+    /**
+     * Builds a raw message given a standard identifier and an array of bytes. The number of bytes will be truncated
+     * to eight bytes maximum.
+     */
+    static constexpr RawMessage standard(std::uint16_t id, std::span<const std::uint8_t> data) {
+        return build(static_cast<std::uint32_t>(id) << 21u, data);
+    }
+
+    /**
+     * Builds a raw message given an extended identifier and an array of bytes. The number of bytes will be truncated
+     * to eight bytes maximum.
+     */
+    static constexpr RawMessage extended(std::uint32_t id, std::span<const std::uint8_t> data) {
+        return build((id << 3u) | k_ide_bit, data);
+    }
+
+    /**
+     * Converts a variant-based message into the raw representation.
+     */
+    static RawMessage from_message(const Message &message) {
+        return message.is_standard() ? standard(message.standard_id(), message.data).with_length(message.length)
+                                     : extended(message.extended_id(), message.data).with_length(message.length);
+    }
+
+    /**
+     * @return true if the message has a standard identifier; false otherwise
+     */
+    constexpr bool is_standard() const { return (id_word & k_ide_bit) == 0u; }
+
+    /**
+     * @return true if the message has an extended identifier; false otherwise
+     */
+    constexpr bool is_extended() const { return (id_word & k_ide_bit) != 0u; }
+
+    /**
+     * @return true if the message is a remote transmission request; false otherwise
+     */
+    constexpr bool is_remote() const { return (id_word & k_rtr_bit) != 0u; }
+
+    /**
+     * @return the standard identifier of the message; only valid if is_standard() is true
+     */
+    constexpr std::uint16_t standard_id() const { return static_cast<std::uint16_t>(id_word >> 21u); }
+
+    /**
+     * @return the extended identifier of the message; only valid if is_extended() is true
+     */
+    constexpr std::uint32_t extended_id() const { return id_word >> 3u; }
+
+    /**
+     * @return the data byte at the given index, which must be in the range [0, 7]
+     */
+    constexpr std::uint8_t byte(std::size_t index) const {
+        return static_cast<std::uint8_t>((index < 4 ? data_low : data_high) >> ((index % 4) * 8));
+    }
+
+    /**
+     * Reads a big endian integral from the data bytes starting at the given offset.
+     *
+     * @param offset the index of the first byte; the integral must not extend past byte 7
+     */
+    template <std::integral T>
+    constexpr T read_be(std::size_t offset) const {
+        const auto bytes = ((static_cast<std::uint64_t>(data_high) << 32u) | data_low) >> (offset * 8u);
+
+        // Expanded into straight-line code so that the compiler can recognise a byte swap.
+        return [bytes]<std::size_t... I>(std::index_sequence<I...>) {
+            return static_cast<T>(((((bytes >> (I * 8u)) & 0xffu) << ((sizeof(T) - 1 - I) * 8u)) | ...));
+        }(std::make_index_sequence<sizeof(T)>());
+    }
+
+    /**
+     * @return the eight data bytes
+     */
+    constexpr std::array<std::uint8_t, 8> data() const {
+        std::array<std::uint8_t, 8> bytes{};
+        for (std::size_t i = 0; i < bytes.size(); i++) {
+            bytes[i] = byte(i);
+        }
+        return bytes;
+    }
+
+    /**
+     * @return the decoded identifier of the message
+     */
+    Identifier identifier() const {
+        if (is_extended()) {
+            return ExtendedIdentifier(extended_id());
+        }
+        return StandardIdentifier(standard_id());
+    }
+
+    /**
+     * Converts the message into the variant-based representation.
+     */
+    Message to_message() const {
+        return {
+            .identifier = identifier(),
+            .data = data(),
+            .length = length,
+        };
+    }
+
+private:
+    static constexpr RawMessage build(std::uint32_t id_word, std::span<const std::uint8_t> data) {
+        RawMessage message{
+            .id_word = id_word,
+            .data_low = 0,
+            .data_high = 0,
+            .length = static_cast<std::uint8_t>(data.size() > 8 ? 8 : data.size()),
+        };
+        for (std::size_t i = 0; i < message.length; i++) {
+            auto &word = i < 4 ? message.data_low : message.data_high;
+            word |= static_cast<std::uint32_t>(data[i]) << ((i % 4) * 8);
+        }
+        return message;
+    }
+
+    constexpr RawMessage with_length(std::uint8_t new_length) const {
+        auto message = *this;
+        message.length = new_length;
+        return message;
+    }
+};
+
 /// CAN FIFO callback function type.
 using fifo_callback_t = void (*)(const Message &);
 
+/// CAN FIFO callback function type for callbacks which take the undecoded message. The second argument is the time of
+/// the start of frame in bit times, if time stamps are enabled in InitOptions; zero otherwise.
+using raw_fifo_callback_t = void (*)(const RawMessage &, std::uint32_t timestamp);
+
+/// CAN transmit complete callback function type. The second argument is the time stamp of the sent message, as for
+/// raw_fifo_callback_t.
+using tx_callback_t = void (*)(const RawMessage &, std::uint32_t timestamp);
+
+/// A struct which holds optional peripheral features for init.
+struct InitOptions {
+    /// Enables time triggered communication mode, which captures the time of the start of frame of every received and
+    /// sent message. The time stamps count bit times and are extended to 32 bits.
+    bool timestamps{false};
+
+    /// Sends messages in the order they were queued rather than by identifier priority. Sets the transmit FIFO
+    /// priority bit, so the hardware mailboxes are sent chronologically, and makes the software queue first in, first
+    /// out. Useful when a multi-frame payload must arrive in order.
+    bool ordered{false};
+
+    /// Disables automatic bus-off management, so that the controller stays in bus-off until poll_bus_off_recovery
+    /// starts the recovery sequence after the back-off delay. The firmware must then call poll_bus_off_recovery
+    /// periodically; otherwise the hardware rejoins the bus on its own as soon as it can.
+    bool manual_bus_off_recovery{false};
+
+    /// Keeps the last transmit mailbox free of messages from the software queue, so that it is only filled by
+    /// transmit_mailbox. A burst of queued messages then can't keep the messages of a can::TxScheduler out of the
+    /// mailboxes until their deadline, at the cost of one mailbox for queued messages.
+    bool reserve_mailbox{false};
+};
+
+struct BitTiming;
+
 /**
- * Initialises the CAN1 peripheral to the given bus speed. Assumes a 28 MHz APB1 clock.
+ * Initialises the CAN1 peripheral to the given bus speed. The bit timing is computed at compile time for both the
+ * 28 MHz APB1 clock and the 8 MHz low power clock, and selected based on hal_low_power().
  *
  * @param port the pin pair to use as RX and TX
  * @param speed the bus speed to use
+ * @param options optional features to enable
+ * @return true if initialisation was successful; false otherwise
+ */
+[[nodiscard]] bool init(Port port, Speed speed, const InitOptions &options = {});
+
+/**
+ * Initialises the CAN1 peripheral with an explicit bit timing configuration, usually built with can::make_bit_timing.
+ *
+ * @param port the pin pair to use as RX and TX
+ * @param timing the bit timing configuration for the current APB1 clock
+ * @param options optional features to enable
  * @return true if initialisation was successful; false otherwise
  */
-[[nodiscard]] bool init(Port port, Speed speed);
+[[nodiscard]] bool init(Port port, const BitTiming &timing, const InitOptions &options = {});
+
+struct FilterPlan;
 
 /**
  * Configures and enables the specified CAN filter to route incoming messages to the specified FIFO index. A
@@ -110,17 +330,220 @@ using fifo_callback_t = void (*)(const Message &);
 void route_filter(std::uint8_t filter, std::uint8_t fifo, std::uint32_t mask, std::uint32_t value);
 
 /**
- * Sets the given callback to be called from the message pending interrupt of the specified FIFO index.
+ * Replaces the configuration of all filter banks with the given plan. Banks not used by the plan are disabled.
+ *
+ * @param plan a filter plan, usually built at compile time with can::make_filter_plan
+ */
+void apply_filters(const FilterPlan &plan);
+
+/// A snapshot of a receive FIFO's counters.
+struct RxStatistics {
+    /// Number of hardware FIFO overruns, i.e. messages lost because the three-deep FIFO was full.
+    std::uint16_t overrun_count;
+
+    /// Number of messages dropped in deferred mode because the software ring was full.
+    std::uint32_t ring_full_count;
+
+    /// Number of messages waiting in the software ring to be drained.
+    std::uint16_t ring_depth;
+
+    /// Largest number of core clock cycles the message pending interrupt has spent on a single message.
+    std::uint32_t max_isr_cycles;
+};
+
+/**
+ * Sets the given callback to be called for each message received on the specified FIFO index. By default, the
+ * callback is called from the message pending interrupt. In deferred mode it is called from drain_fifo instead.
  */
 void set_fifo_callback(std::uint8_t index, fifo_callback_t callback);
 
 /**
- * Queues the given message for transmission on the CAN bus.
+ * Sets the given callback to be called for each message received on the specified FIFO index, without decoding the
+ * message into a Message first, along with its time stamp. Replaces any callback set with the overload above.
+ */
+void set_fifo_callback(std::uint8_t index, raw_fifo_callback_t callback);
+
+/**
+ * Sets the given callback to be called from the transmit interrupt for each message which has been successfully sent.
+ */
+void set_tx_callback(tx_callback_t callback);
+
+/**
+ * Converts a time stamp in bit times into microseconds at the configured bitrate.
  *
- * @return true if the message was successfully placed into a FIFO; false otherwise
+ * @param timestamp a time stamp from a received or sent message
+ * @return the time stamp in microseconds
+ */
+std::uint64_t timestamp_to_us(std::uint32_t timestamp);
+
+/**
+ * Estimates the current time in bit times, on the same time base as message time stamps. Only meaningful once time
+ * stamps are enabled and a message has been sent or received, and lags the CAN timer by up to the shortest time
+ * between the start of a frame and its interrupt.
+ */
+std::uint32_t timestamp_now();
+
+/**
+ * Sets whether the specified FIFO operates in deferred mode. In deferred mode, the message pending interrupt only
+ * copies the raw mailbox registers into a lock-free ring, and messages are decoded and passed to the FIFO callback
+ * when drain_fifo is called from thread context. This keeps the interrupt short to avoid hardware FIFO overruns.
+ *
+ * @param index the FIFO index; must be 0 or 1
+ * @param deferred true to enable deferred mode; false to call the callback from the interrupt
+ */
+void set_fifo_deferred(std::uint8_t index, bool deferred);
+
+/**
+ * Decodes messages received in deferred mode and passes them to the FIFO callback in the order they were received.
+ * Must only be called from a single context.
+ *
+ * @param index the FIFO index; must be 0 or 1
+ * @param max_count the maximum number of messages to handle in this batch
+ * @return the number of messages handled
+ */
+std::size_t drain_fifo(std::uint8_t index, std::size_t max_count);
+
+/**
+ * @param index the FIFO index; must be 0 or 1
+ * @return a snapshot of the specified FIFO's counters
+ */
+RxStatistics rx_statistics(std::uint8_t index);
+
+/// A snapshot of the software transmit queue counters.
+struct TxStatistics {
+    /// Number of messages currently waiting for a free mailbox.
+    std::uint16_t queue_depth;
+
+    /// Largest number of messages that have been waiting at once.
+    std::uint16_t high_water_mark;
+
+    /// Number of messages dropped because the queue was full.
+    std::uint32_t drop_count;
+};
+
+/**
+ * Queues the given message for transmission on the CAN bus. If all three hardware mailboxes are busy, the message is
+ * placed into a priority-ordered software queue which is drained from the transmit mailbox empty interrupt. The
+ * USB_HP_CAN1_TX IRQ must be enabled for queued messages to be sent. If the software queue is full, the lowest
+ * priority message is dropped.
+ *
+ * @return true if the message was placed into a mailbox or the software queue; false if it was dropped
  */
 bool transmit(const Message &message);
 
+/**
+ * Queues the given raw message for transmission on the CAN bus. Behaves the same as the overload above, but avoids
+ * converting the message.
+ */
+bool transmit(const RawMessage &message);
+
+/**
+ * Queues several messages for transmission at once. Free mailboxes are found with a single read of the transmit status
+ * register and filled in one pass, and any remaining messages are placed into the software queue. Messages are
+ * accepted in order, stopping once the software queue is full, so that the caller can retry the rest later. Unlike
+ * the single message overloads, a batch never evicts a queued message. Combine with InitOptions::ordered to have the messages arrive in the order given.
+ *
+ * @param messages the messages to send
+ * @return the number of leading messages which were accepted
+ */
+std::size_t transmit(std::span<const Message> messages);
+
+/**
+ * Queues several raw messages for transmission at once. Behaves the same as the overload above, but avoids converting
+ * the messages.
+ */
+std::size_t transmit(std::span<const RawMessage> messages);
+
+/**
+ * @return a snapshot of the software transmit queue counters
+ */
+TxStatistics tx_statistics();
+
+struct BusLoadStatistics;
+
+/**
+ * Closes any elapsed bus load measurement buckets. Must be called at least every 100 milliseconds for the bus load
+ * statistics to be accurate.
+ *
+ * @param now the current time in milliseconds
+ */
+void update_bus_load(std::uint32_t now);
+
+/**
+ * @return the bus utilisation and per-identifier frame rates, counting received frames which passed the acceptance
+ * filters and successfully sent frames
+ */
+BusLoadStatistics bus_load_statistics();
+
+/// A struct which identifies a message placed into a transmit mailbox by transmit_mailbox.
+struct MailboxTicket {
+    std::uint8_t mailbox;
+
+    /// Incremented each time the mailbox is filled, so that a stale ticket never refers to another message.
+    std::uint32_t sequence;
+};
+
+/// An enum which represents the progress of a message placed into a transmit mailbox by transmit_mailbox.
+enum class MailboxStatus : std::uint8_t {
+    /// The message is waiting in its mailbox or is being sent.
+    Pending,
+
+    /// The message was sent.
+    Sent,
+
+    /// The message was aborted before being sent.
+    Aborted,
+};
+
+/**
+ * Places the given message directly into a free transmit mailbox, bypassing the software queue. The reserved mailbox
+ * is used first if InitOptions::reserve_mailbox is set. Intended for use by can::TxScheduler.
+ *
+ * @return a ticket for the message if a mailbox was free; std::nullopt otherwise
+ */
+std::optional<MailboxTicket> transmit_mailbox(const RawMessage &message);
+
+/**
+ * Returns the progress of the message referred to by the ticket. The outcome of a message is only kept until the next
+ * message placed into the same mailbox leaves it; after that the message is reported as sent, since the hardware
+ * retries a message until it is either sent or aborted.
+ *
+ * @return the progress of the message
+ */
+MailboxStatus mailbox_status(const MailboxTicket &ticket);
+
+/**
+ * Requests that the message referred to by the ticket is aborted, without waiting. The abort completes at once unless
+ * the message is being sent, in which case the message is either sent or aborted by the end of the frame, and the
+ * outcome is reported by mailbox_status.
+ *
+ * @return the progress of the message after the request, which is MailboxStatus::Pending if it is being sent
+ */
+MailboxStatus abort_mailbox(const MailboxTicket &ticket);
+
+struct BusOffPolicy;
+struct HealthStatistics;
+
+/**
+ * Sets the delays used when recovering from bus-off. The default policy is used if this is never called.
+ */
+void set_bus_off_policy(const BusOffPolicy &policy);
+
+/**
+ * Refreshes the error state and starts the bus-off recovery sequence if the controller is in bus-off and the back-off
+ * delay has elapsed. Only has an effect if InitOptions::manual_bus_off_recovery was set, in which case it must be
+ * called periodically from thread context, otherwise the controller stays in bus-off.
+ *
+ * @param now the current time in milliseconds
+ * @return true if a recovery sequence was started; false otherwise
+ */
+bool poll_bus_off_recovery(std::uint32_t now);
+
+/**
+ * @return a snapshot of the error counters, error state transitions, last error code histogram, and FIFO overruns
+ */
+HealthStatistics health_statistics();
+
 /**
  * Builds a CAN message given an identifier and an array of bytes. The number of bytes will be truncated to eight
  * bytes maximum.
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <can.hh>
+#include <can_filter.hh>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+namespace can {
+
+/// A struct which represents a handler subscribed to an inclusive range of identifiers received on a FIFO.
+struct Subscription {
+    std::uint8_t fifo;
+    bool extended;
+    std::uint32_t first;
+    std::uint32_t last;
+    raw_fifo_callback_t handler;
+
+    /**
+     * @return the filter rule which routes the subscribed identifiers into the subscription's FIFO
+     */
+    constexpr FilterRule filter_rule() const { return {fifo, extended, first, last}; }
+};
+
+/**
+ * @return a subscription to a single standard identifier received on the given FIFO
+ */
+constexpr Subscription subscribe_standard(std::uint8_t fifo, std::uint16_t id, raw_fifo_callback_t handler) {
+    return {fifo, false, id, id, handler};
+}
+
+/**
+ * @return a subscription to an inclusive range of standard identifiers received on the given FIFO
+ */
+constexpr Subscription subscribe_standard_range(std::uint8_t fifo, std::uint16_t first, std::uint16_t last,
+                                                raw_fifo_callback_t handler) {
+    return {fifo, false, first, last, handler};
+}
+
+/**
+ * @return a subscription to a single extended identifier received on the given FIFO
+ */
+constexpr Subscription subscribe_extended(std::uint8_t fifo, std::uint32_t id, raw_fifo_callback_t handler) {
+    return {fifo, true, id, id, handler};
+}
+
+/**
+ * @return a subscription to an inclusive range of extended identifiers received on the given FIFO
+ */
+constexpr Subscription subscribe_extended_range(std::uint8_t fifo, std::uint32_t first, std::uint32_t last,
+                                                raw_fifo_callback_t handler) {
+    return {fifo, true, first, last, handler};
+}
+
+/**
+ * A table which dispatches received messages to every handler subscribed to their identifier. The subscribed ranges
+ * are split at compile time into sorted, non-overlapping intervals which each hold a bit mask of their subscribers, so
+ * that a lookup is a binary search over at most 2N intervals followed by one call per matching handler.
+ *
+ * @tparam N the number of subscriptions; at most 32
+ */
+template <std::size_t N>
+class DispatchTable {
+    static_assert(N > 0 && N <= 32, "A dispatch table supports between 1 and 32 subscriptions");
+
+    struct Interval {
+        std::uint32_t first_key;
+        std::uint32_t last_key;
+        std::uint32_t subscribers;
+    };
+
+    std::array<Subscription, N> m_subscriptions{};
+    std::array<Interval, 2 * N> m_intervals{};
+    std::size_t m_interval_count{0};
+
+    // Standard and extended identifiers are kept apart by placing the IDE flag above the 29 identifier bits.
+    static constexpr std::uint32_t key(bool extended, std::uint32_t id) { return (extended ? 1u << 29u : 0u) | id; }
+
+public:
+    /**
+     * Builds the table. Subscriptions with an empty range never match.
+     *
+     * @param subscriptions the subscriptions; handlers of a message are called in the order given here
+     */
+    constexpr explicit DispatchTable(const std::array<Subscription, N> &subscriptions);
+
+    /**
+     * Calls every handler subscribed to the message's identifier. Remote frames are not dispatched.
+     *
+     * @param message the received message
+     * @param timestamp the time stamp of the message, which is passed on to the handlers
+     * @return the number of handlers called
+     */
+    constexpr std::size_t dispatch(const RawMessage &message, std::uint32_t timestamp) const;
+
+    /**
+     * @return the number of subscribers to the given identifier
+     */
+    constexpr std::size_t subscriber_count(bool extended, std::uint32_t id) const;
+
+    /**
+     * @return the filter rules which accept every subscribed identifier into its subscription's FIFO, for use with
+     * can::plan_filters
+     */
+    constexpr std::array<FilterRule, N> filter_rules() const;
+
+    /**
+     * @return the number of non-overlapping intervals searched per lookup
+     */
+    constexpr std::size_t interval_count() const { return m_interval_count; }
+
+private:
+    constexpr std::uint32_t find(std::uint32_t message_key) const;
+};
+
+template <std::size_t N>
+constexpr DispatchTable<N>::DispatchTable(const std::array<Subscription, N> &subscriptions)
+    : m_subscriptions(subscriptions) {
+    // Every range start and every key after a range end is an interval boundary.
+    std::array<std::uint32_t, 2 * N> boundaries{};
+    std::size_t boundary_count = 0;
+    for (const auto &subscription : subscriptions) {
+        if (subscription.first <= subscription.last) {
+            boundaries[boundary_count++] = key(subscription.extended, subscription.first);
+            boundaries[boundary_count++] = key(subscription.extended, subscription.last) + 1;
+        }
+    }
+    const auto boundaries_end = boundaries.begin() + static_cast<std::ptrdiff_t>(boundary_count);
+    std::sort(boundaries.begin(), boundaries_end);
+    boundary_count = static_cast<std::size_t>(std::unique(boundaries.begin(), boundaries_end) - boundaries.begin());
+
+    // Keep only the intervals which have at least one subscriber, merging neighbours with the same subscribers.
+    for (std::size_t i = 0; i + 1 < boundary_count; i++) {
+        const auto first_key = boundaries[i];
+        const auto last_key = boundaries[i + 1] - 1;
+        std::uint32_t subscribers = 0;
+        for (std::size_t j = 0; j < N; j++) {
+            const auto &subscription = subscriptions[j];
+            const bool covers = key(subscription.extended, subscription.first) <= first_key &&
+                                key(subscription.extended, subscription.last) >= last_key;
+            if (subscription.first <= subscription.last && covers) {
+                subscribers |= 1u << j;
+            }
+        }
+        if (subscribers == 0) {
+            continue;
+        }
+        if (m_interval_count != 0) {
+            auto &previous = m_intervals[m_interval_count - 1];
+            if (previous.last_key + 1 == first_key && previous.subscribers == subscribers) {
+                previous.last_key = last_key;
+                continue;
+            }
+        }
+        m_intervals[m_interval_count++] = {first_key, last_key, subscribers};
+    }
+}
+
+template <std::size_t N>
+constexpr std::uint32_t DispatchTable<N>::find(std::uint32_t message_key) const {
+    // Find the last interval starting at or before the key.
+    std::size_t low = 0;
+    std::size_t high = m_interval_count;
+    while (low < high) {
+        const auto middle = (low + high) / 2;
+        if (m_intervals[middle].first_key <= message_key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0 || m_intervals[low - 1].last_key < message_key) {
+        return 0;
+    }
+    return m_intervals[low - 1].subscribers;
+}
+
+template <std::size_t N>
+constexpr std::size_t DispatchTable<N>::dispatch(const RawMessage &message, std::uint32_t timestamp) const {
+    if (message.is_remote()) {
+        return 0;
+    }
+    const auto id = message.is_extended() ? message.extended_id() : static_cast<std::uint32_t>(message.standard_id());
+    auto subscribers = find(key(message.is_extended(), id));
+    const auto count = static_cast<std::size_t>(std::popcount(subscribers));
+    for (; subscribers != 0; subscribers &= subscribers - 1) {
+        m_subscriptions[static_cast<std::size_t>(std::countr_zero(subscribers))].handler(message, timestamp);
+    }
+    return count;
+}
+
+template <std::size_t N>
+constexpr std::size_t DispatchTable<N>::subscriber_count(bool extended, std::uint32_t id) const {
+    return static_cast<std::size_t>(std::popcount(find(key(extended, id))));
+}
+
+template <std::size_t N>
+constexpr std::array<FilterRule, N> DispatchTable<N>::filter_rules() const {
+    std::array<FilterRule, N> rules{};
+    for (std::size_t i = 0; i < N; i++) {
+        rules[i] = m_subscriptions[i].filter_rule();
+    }
+    return rules;
+}
+
+/**
+ * Builds a dispatch table, which should be assigned to a constexpr variable so that it is built at compile time.
+ * Subscriptions can't be template arguments like filter rules since they hold function pointers.
+ *
+ * @param subscriptions the set of subscriptions
+ * @return the dispatch table, whose dispatch member function can be called from a FIFO callback
+ */
+template <std::same_as<Subscription>... Subscriptions>
+constexpr DispatchTable<sizeof...(Subscriptions)> make_dispatch_table(const Subscriptions &...subscriptions) {
+    return DispatchTable<sizeof...(Subscriptions)>(
+        std::array<Subscription, sizeof...(Subscriptions)>{subscriptions...});
+}
+
+} // namespace can
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace can {
+
+/// Number of filter banks available to CAN1.
+constexpr std::size_t k_filter_bank_count = 14;
+
+/// An enum which represents the mode of a filter bank.
+enum class FilterMode : std::uint8_t {
+    /// Each register holds an identifier and a mask.
+    Mask,
+
+    /// Each register holds one or two exact identifiers.
+    List,
+};
+
+/// An enum which represents the scale of a filter bank.
+enum class FilterScale : std::uint8_t {
+    /// Two 16-bit filters per register. Only suitable for standard identifiers.
+    Dual16,
+
+    /// One 32-bit filter per register.
+    Single32,
+};
+
+/// A struct which represents the configuration of a single hardware filter bank.
+struct FilterBank {
+    std::uint8_t fifo;
+    FilterMode mode;
+    FilterScale scale;
+    std::uint32_t fr1;
+    std::uint32_t fr2;
+
+    bool operator==(const FilterBank &) const = default;
+};
+
+/// A struct which represents a rule to accept an inclusive range of identifiers into a FIFO.
+struct FilterRule {
+    std::uint8_t fifo;
+    bool extended;
+    std::uint32_t first;
+    std::uint32_t last;
+};
+
+/// A struct which represents a set of filter banks produced by plan_filters.
+struct FilterPlan {
+    std::array<FilterBank, k_filter_bank_count> banks;
+
+    /// Number of banks required to implement all of the rules. May exceed k_filter_bank_count, in which case only the
+    /// first k_filter_bank_count banks are populated.
+    std::size_t bank_count;
+
+    /**
+     * Determines which FIFO a data frame would be routed to by the hardware, following the filter priority rules.
+     *
+     * @param extended true if the identifier is extended; false if it is standard
+     * @param id the frame's identifier
+     * @return the FIFO index if the frame is accepted; std::nullopt otherwise
+     */
+    constexpr std::optional<std::uint8_t> route(bool extended, std::uint32_t id) const;
+};
+
+/**
+ * @return a rule which accepts a single standard identifier into the given FIFO
+ */
+constexpr FilterRule accept_standard(std::uint8_t fifo, std::uint16_t id) {
+    return {fifo, false, id, id};
+}
+
+/**
+ * @return a rule which accepts an inclusive range of standard identifiers into the given FIFO
+ */
+constexpr FilterRule accept_standard_range(std::uint8_t fifo, std::uint16_t first, std::uint16_t last) {
+    return {fifo, false, first, last};
+}
+
+/**
+ * @return a rule which accepts a single extended identifier into the given FIFO
+ */
+constexpr FilterRule accept_extended(std::uint8_t fifo, std::uint32_t id) {
+    return {fifo, true, id, id};
+}
+
+/**
+ * @return a rule which accepts an inclusive range of extended identifiers into the given FIFO
+ */
+constexpr FilterRule accept_extended_range(std::uint8_t fifo, std::uint32_t first, std::uint32_t last) {
+    return {fifo, true, first, last};
+}
+
+namespace detail {
+
+// 16-bit filter layout: STID[10:0] | RTR | IDE | EXID[17:15].
+constexpr std::uint32_t k_filter16_rtr = 1u << 4u;
+constexpr std::uint32_t k_filter16_ide = 1u << 3u;
+
+// 32-bit filter layout: STID[10:0] | EXID[17:0] | IDE | RTR | 0.
+constexpr std::uint32_t k_filter32_ide = 1u << 2u;
+constexpr std::uint32_t k_filter32_rtr = 1u << 1u;
+
+// Upper bound on the number of entries of any one kind that could possibly fit into the filter banks.
+constexpr std::size_t k_max_entries = k_filter_bank_count * 4;
+
+// An identifier and a mask of the bits which must match.
+struct FilterEntry {
+    std::uint32_t id;
+    std::uint32_t mask;
+};
+
+struct EntryList {
+    std::array<FilterEntry, k_max_entries> entries{};
+    std::size_t count{0};
+
+    constexpr void push(FilterEntry entry) {
+        if (count < entries.size()) {
+            entries[count] = entry;
+        }
+        count++;
+    }
+
+    // Unused slots in a bank are filled by repeating an entry, which does not widen what is accepted.
+    constexpr FilterEntry get(std::size_t index) const {
+        const auto last = (count < entries.size() ? count : entries.size()) - 1;
+        return entries[index < last ? index : last];
+    }
+};
+
+// Entries for one FIFO, split by the bank layout they will use.
+struct FifoEntries {
+    EntryList standard_exact;
+    EntryList standard_masked;
+    EntryList extended_exact;
+    EntryList extended_masked;
+};
+
+constexpr std::uint32_t encode16(std::uint32_t id) {
+    return id << 5u;
+}
+
+constexpr std::uint32_t encode16_mask(std::uint32_t mask) {
+    return (mask << 5u) | k_filter16_rtr | k_filter16_ide;
+}
+
+constexpr std::uint32_t encode32(std::uint32_t id) {
+    return (id << 3u) | k_filter32_ide;
+}
+
+constexpr std::uint32_t encode32_mask(std::uint32_t mask) {
+    return (mask << 3u) | k_filter32_ide | k_filter32_rtr;
+}
+
+// Splits an identifier range into the fewest aligned power-of-two blocks, each of which can be matched by one mask.
+constexpr void add_range(FifoEntries &fifo, const FilterRule &rule) {
+    const std::uint32_t id_mask = rule.extended ? 0x1fffffffu : 0x7ffu;
+    std::uint64_t first = rule.first & id_mask;
+    const std::uint64_t last = rule.last & id_mask;
+    while (first <= last) {
+        // Grow the block while it stays aligned and within the range.
+        std::uint64_t size = 1;
+        while ((first & (size * 2 - 1)) == 0 && first + size * 2 - 1 <= last && size * 2 <= id_mask + 1u) {
+            size *= 2;
+        }
+
+        const FilterEntry entry{static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(id_mask & ~(size - 1))};
+        auto &list = rule.extended ? (size == 1 ? fifo.extended_exact : fifo.extended_masked)
+                                   : (size == 1 ? fifo.standard_exact : fifo.standard_masked);
+        list.push(entry);
+        first += size;
+    }
+}
+
+constexpr void push_bank(FilterPlan &plan, const FilterBank &bank) {
+    if (plan.bank_count < plan.banks.size()) {
+        plan.banks[plan.bank_count] = bank;
+    }
+    plan.bank_count++;
+}
+
+} // namespace detail
+
+/**
+ * Packs a set of acceptance rules into hardware filter banks. Exact identifiers use list mode and standard identifiers
+ * use the 16-bit scale so that as many identifiers as possible fit into each bank. Ranges are split into aligned blocks
+ * which each use one mask, so that no identifier outside of the given ranges is accepted. Remote frames are never
+ * accepted.
+ *
+ * @param rules the set of rules to plan
+ * @return the filter plan; its bank_count must be checked against k_filter_bank_count
+ */
+template <std::size_t N>
+constexpr FilterPlan plan_filters(const std::array<FilterRule, N> &rules) {
+    using namespace detail;
+    FilterPlan plan{};
+    for (std::uint8_t fifo = 0; fifo < 2; fifo++) {
+        FifoEntries entries;
+        for (const auto &rule : rules) {
+            if (rule.fifo == fifo && rule.first <= rule.last) {
+                add_range(entries, rule);
+            }
+        }
+
+        // Four exact standard identifiers per 16-bit list bank.
+        for (std::size_t i = 0; i < entries.standard_exact.count; i += 4) {
+            const auto &list = entries.standard_exact;
+            push_bank(plan, {
+                                fifo,
+                                FilterMode::List,
+                                FilterScale::Dual16,
+                                encode16(list.get(i).id) | (encode16(list.get(i + 1).id) << 16u),
+                                encode16(list.get(i + 2).id) | (encode16(list.get(i + 3).id) << 16u),
+                            });
+        }
+
+        // Two masked standard identifiers per 16-bit mask bank.
+        for (std::size_t i = 0; i < entries.standard_masked.count; i += 2) {
+            const auto first = entries.standard_masked.get(i);
+            const auto second = entries.standard_masked.get(i + 1);
+            push_bank(plan, {
+                                fifo,
+                                FilterMode::Mask,
+                                FilterScale::Dual16,
+                                encode16(first.id) | (encode16_mask(first.mask) << 16u),
+                                encode16(second.id) | (encode16_mask(second.mask) << 16u),
+                            });
+        }
+
+        // Two exact extended identifiers per 32-bit list bank.
+        for (std::size_t i = 0; i < entries.extended_exact.count; i += 2) {
+            const auto &list = entries.extended_exact;
+            push_bank(plan, {
+                                fifo,
+                                FilterMode::List,
+                                FilterScale::Single32,
+                                encode32(list.get(i).id),
+                                encode32(list.get(i + 1).id),
+                            });
+        }
+
+        // One masked extended identifier per 32-bit mask bank.
+        for (std::size_t i = 0; i < entries.extended_masked.count; i++) {
+            const auto entry = entries.extended_masked.get(i);
+            push_bank(plan, {
+                                fifo,
+                                FilterMode::Mask,
+                                FilterScale::Single32,
+                                encode32(entry.id),
+                                encode32_mask(entry.mask),
+                            });
+        }
+    }
+    return plan;
+}
+
+/**
+ * Plans the given rules at compile time, failing compilation if they do not fit into the available filter banks.
+ *
+ * @tparam Rules the set of rules to plan
+ * @return the filter plan, to be passed to can::apply_filters
+ */
+template <FilterRule... Rules>
+consteval FilterPlan make_filter_plan() {
+    constexpr auto plan = plan_filters(std::array<FilterRule, sizeof...(Rules)>{Rules...});
+    static_assert(plan.bank_count <= k_filter_bank_count, "CAN filter rules do not fit into the 14 filter banks");
+    return plan;
+}
+
+constexpr std::optional<std::uint8_t> FilterPlan::route(bool extended, std::uint32_t id) const {
+    using namespace detail;
+    const auto value32 = extended ? encode32(id) : id << 21u;
+    const auto value16 = extended ? (((id >> 18u) << 5u) | k_filter16_ide | ((id >> 15u) & 0b111u)) : encode16(id);
+    const auto matches16 = [&](std::uint32_t value, std::uint32_t mask) {
+        return ((value16 ^ value) & mask & 0xffffu) == 0;
+    };
+
+    // The hardware prefers 32-bit banks over 16-bit banks, then list mode over mask mode, then the lowest bank number.
+    for (const auto scale : {FilterScale::Single32, FilterScale::Dual16}) {
+        for (const auto mode : {FilterMode::List, FilterMode::Mask}) {
+            for (std::size_t i = 0; i < bank_count && i < banks.size(); i++) {
+                const auto &bank = banks[i];
+                if (bank.scale != scale || bank.mode != mode) {
+                    continue;
+                }
+                bool matched;
+                if (scale == FilterScale::Single32) {
+                    matched = mode == FilterMode::List ? value32 == bank.fr1 || value32 == bank.fr2
+                                                       : ((value32 ^ bank.fr1) & bank.fr2) == 0;
+                } else if (mode == FilterMode::List) {
+                    matched = matches16(bank.fr1, 0xffffu) || matches16(bank.fr1 >> 16u, 0xffffu) ||
+                              matches16(bank.fr2, 0xffffu) || matches16(bank.fr2 >> 16u, 0xffffu);
+                } else {
+                    matched = matches16(bank.fr1, bank.fr1 >> 16u) || matches16(bank.fr2, bank.fr2 >> 16u);
+                }
+                if (matched) {
+                    return bank.fifo;
+                }
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace can
@@ -0,0 +1,99 @@
+#include <can_health.hh>
+
+#include <can.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace can {
+
+bool HealthMonitor::update(std::uint32_t esr) {
+    m_statistics.tec = static_cast<std::uint8_t>(esr >> k_esr_tec_pos);
+    m_statistics.rec = static_cast<std::uint8_t>(esr >> k_esr_rec_pos);
+
+    // Count transitions into the more severe states.
+    const auto state = decode_error_state(esr);
+    if (state != m_statistics.state) {
+        if (state == ErrorState::BusOff) {
+            m_statistics.bus_off_count++;
+        } else if (state == ErrorState::Passive && m_statistics.state != ErrorState::BusOff) {
+            m_statistics.error_passive_count++;
+        }
+        m_statistics.state = state;
+    }
+
+    const auto code = decode_last_error_code(esr);
+    if (code == LastErrorCode::None || code == LastErrorCode::SetBySoftware) {
+        return false;
+    }
+    m_statistics.lec_histogram[static_cast<std::size_t>(code)]++;
+    return true;
+}
+
+void BusOffRecovery::set_policy(const BusOffPolicy &policy) {
+    m_policy = policy;
+    m_delay = policy.initial_delay;
+}
+
+bool BusOffRecovery::poll(ErrorState state, std::uint32_t now) {
+    if (state != ErrorState::BusOff) {
+        if (m_bus_off) {
+            m_bus_off = false;
+            m_since = now;
+        }
+
+        // Forget about previous bus-off events once the bus has been stable for long enough.
+        if (now - m_since >= m_policy.stable_time) {
+            m_delay = m_policy.initial_delay;
+        }
+        return false;
+    }
+
+    if (!m_bus_off) {
+        m_bus_off = true;
+        m_since = now;
+    }
+    if (now - m_since < m_delay) {
+        return false;
+    }
+
+    // Start recovery and back off further in case it fails again. The controller stays in bus-off until it has seen
+    // 128 occurrences of 11 recessive bits, so restart the delay rather than retrying immediately.
+    m_since = now;
+    m_delay = std::min(m_delay * 2, m_policy.max_delay);
+    return true;
+}
+
+RawMessage build_health_report(std::uint16_t id, const HealthStatistics &statistics, std::uint8_t page) {
+    const auto wrap = [](std::uint16_t count) {
+        return static_cast<std::uint8_t>(count);
+    };
+
+    if (page == 0) {
+        return RawMessage::standard(id, std::to_array<std::uint8_t>({
+                                            page,
+                                            statistics.tec,
+                                            statistics.rec,
+                                            static_cast<std::uint8_t>(statistics.state),
+                                            wrap(statistics.error_passive_count),
+                                            wrap(statistics.bus_off_count),
+                                            wrap(statistics.fifo_overrun_count[0]),
+                                            wrap(statistics.fifo_overrun_count[1]),
+                                        }));
+    }
+
+    const auto &histogram = statistics.lec_histogram;
+    return RawMessage::standard(id, std::to_array<std::uint8_t>({
+                                        page,
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::Stuff)]),
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::Form)]),
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::Acknowledgment)]),
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::BitRecessive)]),
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::BitDominant)]),
+                                        wrap(histogram[static_cast<std::size_t>(LastErrorCode::Crc)]),
+                                        wrap(statistics.recovery_count),
+                                    }));
+}
+
+} // namespace can
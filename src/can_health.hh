@@ -0,0 +1,184 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace can {
+
+// CAN_ESR field layout, duplicated here so that the decoding logic can be tested on the host.
+constexpr std::uint32_t k_esr_ewgf = 1u << 0u;
+constexpr std::uint32_t k_esr_epvf = 1u << 1u;
+constexpr std::uint32_t k_esr_boff = 1u << 2u;
+constexpr std::uint32_t k_esr_lec_pos = 4u;
+constexpr std::uint32_t k_esr_lec_mask = 0b111u << k_esr_lec_pos;
+constexpr std::uint32_t k_esr_tec_pos = 16u;
+constexpr std::uint32_t k_esr_rec_pos = 24u;
+
+/// Number of frames which make up a full health report.
+constexpr std::uint8_t k_health_report_page_count = 2;
+
+/// An enum which represents the fault confinement state of the controller.
+enum class ErrorState : std::uint8_t {
+    /// Both error counters are below 96.
+    Active,
+
+    /// At least one error counter has reached the warning limit of 96.
+    Warning,
+
+    /// At least one error counter is above 127. The node may no longer send active error flags.
+    Passive,
+
+    /// The transmit error counter exceeded 255 and the node has disconnected from the bus.
+    BusOff,
+};
+
+/// An enum which represents the last error code field of CAN_ESR.
+enum class LastErrorCode : std::uint8_t {
+    None = 0,
+    Stuff,
+    Form,
+    Acknowledgment,
+    BitRecessive,
+    BitDominant,
+    Crc,
+
+    /// Written by software so that a repeat of the same hardware error code can be detected.
+    SetBySoftware,
+};
+
+/// Number of distinct last error codes.
+constexpr std::size_t k_last_error_code_count = 8;
+
+/// A struct which configures the delay before recovering from bus-off. The delay doubles on each consecutive bus-off
+/// event, so that a node with a persistent fault does not keep disturbing the bus. All times are in milliseconds.
+struct BusOffPolicy {
+    /// Delay before the first recovery attempt.
+    std::uint32_t initial_delay{100};
+
+    /// Upper limit of the delay after repeated bus-off events.
+    std::uint32_t max_delay{5000};
+
+    /// Time the node must stay off of bus-off before the delay is reset to the initial delay.
+    std::uint32_t stable_time{1000};
+};
+
+/// A snapshot of the bus health counters.
+struct HealthStatistics {
+    /// Transmit and receive error counters.
+    std::uint8_t tec;
+    std::uint8_t rec;
+
+    ErrorState state;
+
+    /// Number of transitions into the error-passive state.
+    std::uint16_t error_passive_count;
+
+    /// Number of transitions into the bus-off state.
+    std::uint16_t bus_off_count;
+
+    /// Number of bus-off recovery sequences started.
+    std::uint16_t recovery_count;
+
+    /// Number of times each last error code has been reported, indexed by LastErrorCode.
+    std::array<std::uint16_t, k_last_error_code_count> lec_histogram;
+
+    /// Number of hardware FIFO overruns for each FIFO.
+    std::array<std::uint16_t, 2> fifo_overrun_count;
+};
+
+/**
+ * @return the error state encoded in the given CAN_ESR value
+ */
+constexpr ErrorState decode_error_state(std::uint32_t esr) {
+    if ((esr & k_esr_boff) != 0u) {
+        return ErrorState::BusOff;
+    }
+    if ((esr & k_esr_epvf) != 0u) {
+        return ErrorState::Passive;
+    }
+    if ((esr & k_esr_ewgf) != 0u) {
+        return ErrorState::Warning;
+    }
+    return ErrorState::Active;
+}
+
+/**
+ * @return the last error code encoded in the given CAN_ESR value
+ */
+constexpr LastErrorCode decode_last_error_code(std::uint32_t esr) {
+    return static_cast<LastErrorCode>((esr & k_esr_lec_mask) >> k_esr_lec_pos);
+}
+
+/// A class which accumulates error state transitions and last error codes from successive CAN_ESR reads.
+class HealthMonitor {
+    HealthStatistics m_statistics{};
+
+public:
+    /**
+     * Records a CAN_ESR value. After a hardware error code has been recorded, the caller should write
+     * LastErrorCode::SetBySoftware to the LEC field so that the next error is counted even if it has the same code.
+     *
+     * @param esr the value of CAN_ESR
+     * @return true if a hardware error code was recorded; false otherwise
+     */
+    bool update(std::uint32_t esr);
+
+    /**
+     * Records the start of a bus-off recovery sequence.
+     */
+    void record_recovery() { m_statistics.recovery_count++; }
+
+    /**
+     * @return a snapshot of the counters, without the FIFO overrun counts
+     */
+    const HealthStatistics &statistics() const { return m_statistics; }
+};
+
+/// A class which decides when to start recovering from bus-off, following a BusOffPolicy.
+class BusOffRecovery {
+    BusOffPolicy m_policy;
+    std::uint32_t m_delay;
+    std::uint32_t m_since{0};
+    bool m_bus_off{false};
+
+public:
+    explicit BusOffRecovery(const BusOffPolicy &policy = {}) : m_policy(policy), m_delay(policy.initial_delay) {}
+
+    /**
+     * Replaces the policy and resets the current delay to the new initial delay.
+     */
+    void set_policy(const BusOffPolicy &policy);
+
+    /**
+     * Should be called periodically with the current error state.
+     *
+     * @param state the current error state
+     * @param now the current time in milliseconds
+     * @return true if the recovery sequence should be started now; false otherwise
+     */
+    bool poll(ErrorState state, std::uint32_t now);
+
+    /**
+     * @return the delay which will be applied to the next bus-off event in milliseconds
+     */
+    std::uint32_t current_delay() const { return m_delay; }
+};
+
+/**
+ * Builds one page of a health report. Counters are truncated to eight bits and wrap around, so that the receiver can
+ * compute deltas between reports.
+ *
+ * Page 0: page | TEC | REC | state | error-passive count | bus-off count | FIFO 0 overruns | FIFO 1 overruns
+ * Page 1: page | stuff | form | acknowledgment | bit recessive | bit dominant | CRC | recovery count
+ *
+ * @param id the standard identifier to send the report on
+ * @param statistics the counters to report
+ * @param page the page index; must be less than k_health_report_page_count
+ * @return the report frame
+ */
+RawMessage build_health_report(std::uint16_t id, const HealthStatistics &statistics, std::uint8_t page);
+
+} // namespace can
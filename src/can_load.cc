@@ -0,0 +1,143 @@
+#include <can_load.hh>
+
+#include <can.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+
+namespace can {
+
+void LoadMeter::close_window() {
+    std::uint16_t rx_count = 0;
+    std::uint16_t untracked_count = 0;
+    std::size_t rate_count = 0;
+    for (std::size_t source = 0; source < m_tallies.size(); source++) {
+        auto &tally = m_tallies[source];
+        const auto frame_count = std::exchange(tally.frame_count, 0);
+        if (source == static_cast<std::size_t>(LoadSource::Transmit)) {
+            m_statistics.tx_frames_per_second = frame_count;
+        } else {
+            rx_count += frame_count;
+        }
+        untracked_count += std::exchange(tally.untracked_count, 0);
+
+        // Publish the rates, merging identifiers seen by several sources, and forget identifiers which weren't seen
+        // during the window, to make room for new ones.
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < tally.count_size; i++) {
+            const auto entry = tally.counts[i];
+            if (entry.count == 0) {
+                continue;
+            }
+            tally.counts[kept++] = {entry.id_word, 0};
+            const auto rates_end = m_statistics.rates.begin() + static_cast<std::ptrdiff_t>(rate_count);
+            const auto rate = std::find_if(m_statistics.rates.begin(), rates_end, [&](const IdRate &rate) {
+                return rate.id_word == entry.id_word;
+            });
+            if (rate != rates_end) {
+                rate->frames_per_second += entry.count;
+            } else if (rate_count < m_statistics.rates.size()) {
+                m_statistics.rates[rate_count++] = {entry.id_word, entry.count};
+            } else {
+                untracked_count += entry.count;
+            }
+        }
+        tally.count_size = kept;
+    }
+    m_statistics.rx_frames_per_second = rx_count;
+    m_statistics.untracked_frames_per_second = untracked_count;
+    m_statistics.rate_count = static_cast<std::uint8_t>(rate_count);
+}
+
+void LoadMeter::reset(std::uint32_t bitrate, std::uint32_t now) {
+    *this = LoadMeter(bitrate);
+    m_bucket_start = now;
+}
+
+void LoadMeter::record(std::uint32_t id_word, std::uint8_t length, LoadSource source) {
+    auto &tally = m_tallies[static_cast<std::size_t>(source)];
+    id_word &= ~(RawMessage::k_rtr_bit | 1u);
+    tally.bits += frame_bits((id_word & RawMessage::k_ide_bit) != 0u, length);
+    tally.frame_count++;
+
+    for (std::size_t i = 0; i < tally.count_size; i++) {
+        if (tally.counts[i].id_word == id_word) {
+            tally.counts[i].count++;
+            return;
+        }
+    }
+    if (tally.count_size < tally.counts.size()) {
+        tally.counts[tally.count_size++] = {id_word, 1};
+    } else {
+        tally.untracked_count++;
+    }
+}
+
+void LoadMeter::advance(std::uint32_t now) {
+    // Start afresh after a long gap rather than closing every missed bucket.
+    if (now - m_bucket_start >= 2 * k_load_bucket_period * k_load_bucket_count) {
+        reset(m_bitrate, now);
+        return;
+    }
+
+    bool closed = false;
+    while (now - m_bucket_start >= k_load_bucket_period) {
+        std::uint32_t bits = 0;
+        for (auto &tally : m_tallies) {
+            bits += std::exchange(tally.bits, 0);
+        }
+        m_buckets[m_bucket_index] = bits;
+        m_bucket_start += k_load_bucket_period;
+        if (++m_bucket_index == m_buckets.size()) {
+            m_bucket_index = 0;
+            close_window();
+        }
+        closed = true;
+    }
+
+    if (closed) {
+        // The buckets cover exactly one second, so the bit total divided by the bitrate is the utilisation.
+        const auto bits = std::accumulate(m_buckets.begin(), m_buckets.end(), std::uint64_t(0));
+        const auto utilisation = m_bitrate != 0 ? bits * 1000u / m_bitrate : 0u;
+        m_statistics.utilisation = static_cast<std::uint16_t>(utilisation > 1000u ? 1000u : utilisation);
+    }
+}
+
+RawMessage build_load_report(std::uint16_t id, const BusLoadStatistics &statistics, std::uint8_t page) {
+    if (page == 0) {
+        const auto utilisation = util::write_be(statistics.utilisation);
+        const auto rx_rate = util::write_be(statistics.rx_frames_per_second);
+        const auto tx_rate = util::write_be(statistics.tx_frames_per_second);
+        return RawMessage::standard(id, std::to_array<std::uint8_t>({
+                                            page,
+                                            utilisation[0],
+                                            utilisation[1],
+                                            rx_rate[0],
+                                            rx_rate[1],
+                                            tx_rate[0],
+                                            tx_rate[1],
+                                            statistics.rate_count,
+                                        }));
+    }
+
+    const auto &rate = statistics.rates[page - 1];
+    const auto rate_id = util::write_be(rate.id());
+    const auto frames_per_second = util::write_be(rate.frames_per_second);
+    return RawMessage::standard(id, std::to_array<std::uint8_t>({
+                                        page,
+                                        static_cast<std::uint8_t>(rate.is_extended() ? 1 : 0),
+                                        rate_id[0],
+                                        rate_id[1],
+                                        rate_id[2],
+                                        rate_id[3],
+                                        frames_per_second[0],
+                                        frames_per_second[1],
+                                    }));
+}
+
+} // namespace can
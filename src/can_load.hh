@@ -0,0 +1,165 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace can {
+
+/// Number of distinct identifiers for which the frame rate is tracked.
+constexpr std::size_t k_load_id_capacity = 12;
+
+/// Length of one utilisation bucket in milliseconds.
+constexpr std::uint32_t k_load_bucket_period = 100;
+
+/// Number of buckets in the rolling utilisation window, which together make up one second.
+constexpr std::size_t k_load_bucket_count = 10;
+
+/// The places frames are recorded from. Each source keeps its own counts, so that frames from different interrupts
+/// can be recorded without masking each other.
+enum class LoadSource : std::uint8_t {
+    /// Frames received into FIFO 0 or 1; the values match the FIFO indices.
+    Fifo0 = 0,
+    Fifo1 = 1,
+
+    /// Frames sent by this node.
+    Transmit = 2,
+};
+
+/// Number of entries in the LoadSource enum.
+constexpr std::size_t k_load_source_count = static_cast<std::size_t>(LoadSource::Transmit) + 1;
+
+/**
+ * Computes the worst-case number of bits a data frame occupies on the bus, including stuff bits, the CRC delimiter,
+ * the acknowledgement slot, the end of frame, and the interframe space.
+ *
+ * @param extended true if the frame has an extended identifier; false if it is standard
+ * @param length the data length code, which is treated as eight if larger
+ * @return the frame length in bits
+ */
+constexpr std::uint32_t frame_bits(bool extended, std::uint8_t length) {
+    // Bits from the start of frame to the end of the CRC are subject to stuffing, which at worst inserts one bit after
+    // the first five and then after every four.
+    const std::uint32_t data_bits = 8u * (length > 8 ? 8 : length);
+    const std::uint32_t stuffable_bits = (extended ? 54u : 34u) + data_bits;
+    return stuffable_bits + 13u + (stuffable_bits - 1u) / 4u;
+}
+
+/// The frame rate of a single identifier.
+struct IdRate {
+    /// Identifier word in the CAN_TIxR/CAN_RIxR layout, with the RTR and TXRQ bits cleared.
+    std::uint32_t id_word;
+
+    std::uint16_t frames_per_second;
+
+    /**
+     * @return true if the identifier is extended; false if it is standard
+     */
+    constexpr bool is_extended() const { return (id_word & RawMessage::k_ide_bit) != 0u; }
+
+    /**
+     * @return the identifier value
+     */
+    constexpr std::uint32_t id() const { return is_extended() ? id_word >> 3u : id_word >> 21u; }
+};
+
+/// A snapshot of the bus load over the last second.
+struct BusLoadStatistics {
+    /// Bus utilisation in tenths of a percent over the rolling one second window.
+    std::uint16_t utilisation;
+
+    /// Number of frames received and sent in the last complete second.
+    std::uint16_t rx_frames_per_second;
+    std::uint16_t tx_frames_per_second;
+
+    /// Number of frames in the last complete second whose identifier didn't fit into the rate table.
+    std::uint16_t untracked_frames_per_second;
+
+    /// Per-identifier frame rates of the last complete second, of which the first rate_count are valid.
+    std::array<IdRate, k_load_id_capacity> rates;
+    std::uint8_t rate_count;
+};
+
+/**
+ * A class which measures bus utilisation from the frames seen by this node. Only frames which pass the acceptance
+ * filters are seen, so a node must accept all traffic for the utilisation to cover the whole bus.
+ *
+ * Each source must only be recorded from one context at a time, but different sources may be recorded from interrupts
+ * which preempt each other without any locking. advance must not run while any source is being recorded.
+ */
+class LoadMeter {
+    struct IdCount {
+        std::uint32_t id_word;
+        std::uint16_t count;
+    };
+
+    // Counts of a single source, which only its own context writes between calls to advance.
+    struct Tally {
+        std::uint32_t bits;
+        std::uint16_t frame_count;
+        std::uint16_t untracked_count;
+        std::array<IdCount, k_load_id_capacity> counts;
+        std::size_t count_size;
+    };
+
+    std::uint32_t m_bitrate;
+    std::uint32_t m_bucket_start{0};
+    std::array<std::uint32_t, k_load_bucket_count> m_buckets{};
+    std::size_t m_bucket_index{0};
+    std::array<Tally, k_load_source_count> m_tallies{};
+    BusLoadStatistics m_statistics{};
+
+    void close_window();
+
+public:
+    /**
+     * @param bitrate the nominal bitrate of the bus in bit/s
+     */
+    explicit LoadMeter(std::uint32_t bitrate) : m_bitrate(bitrate) {}
+
+    /**
+     * Sets the nominal bitrate and restarts the measurement.
+     *
+     * @param bitrate the nominal bitrate of the bus in bit/s
+     * @param now the current time in milliseconds
+     */
+    void reset(std::uint32_t bitrate, std::uint32_t now);
+
+    /**
+     * Records a frame which was received or successfully sent.
+     *
+     * @param id_word the identifier word in the CAN_TIxR/CAN_RIxR layout
+     * @param length the data length code
+     * @param source the FIFO the frame was received into, or LoadSource::Transmit if it was sent by this node
+     */
+    void record(std::uint32_t id_word, std::uint8_t length, LoadSource source);
+
+    /**
+     * Closes any buckets which have elapsed. Should be called at least once per bucket period.
+     *
+     * @param now the current time in milliseconds
+     */
+    void advance(std::uint32_t now);
+
+    /**
+     * @return the statistics as of the last advance
+     */
+    const BusLoadStatistics &statistics() const { return m_statistics; }
+};
+
+/**
+ * Builds one page of a bus load report. Page 0 is a summary and each following page holds the rate of one identifier.
+ *
+ * Page 0: page | utilisation (u16) | RX frames/s (u16) | TX frames/s (u16) | identifier count
+ * Page n: page | extended flag | identifier (u32) | frames/s (u16)
+ *
+ * @param id the standard identifier to send the report on
+ * @param statistics the bus load to report
+ * @param page the page index; must be at most statistics.rate_count
+ * @return the report frame
+ */
+RawMessage build_load_report(std::uint16_t id, const BusLoadStatistics &statistics, std::uint8_t page);
+
+} // namespace can
@@ -0,0 +1,439 @@
+#include <can_log.hh>
+
+#include <can.hh>
+#include <can_virtual.hh>
+#include <dti.hh>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace can_log {
+namespace {
+
+constexpr std::uint32_t k_max_standard_id = 0x7ff;
+constexpr std::uint32_t k_max_extended_id = 0x1fffffff;
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Removes and returns the next whitespace-separated token of a line.
+std::string_view next_token(std::string_view &line) {
+    std::size_t begin = 0;
+    while (begin < line.size() && is_space(line[begin])) {
+        begin++;
+    }
+    std::size_t end = begin;
+    while (end < line.size() && !is_space(line[end])) {
+        end++;
+    }
+    const auto token = line.substr(begin, end - begin);
+    line.remove_prefix(end);
+    return token;
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::optional<std::uint32_t> parse_number(std::string_view text, bool decimal) {
+    if (text.empty() || text.size() > (decimal ? 9 : 8)) {
+        return std::nullopt;
+    }
+    std::uint32_t value = 0;
+    for (const char c : text) {
+        const auto digit = hex_digit(c);
+        if (digit < 0 || (decimal && digit > 9)) {
+            return std::nullopt;
+        }
+        value = value * (decimal ? 10u : 16u) + static_cast<std::uint32_t>(digit);
+    }
+    return value;
+}
+
+// Parses a time in seconds with up to six decimal places into microseconds. Further places are truncated.
+std::optional<std::uint64_t> parse_time(std::string_view text) {
+    const auto point = text.find('.');
+    const auto whole = text.substr(0, point);
+    const auto fraction = point == std::string_view::npos ? std::string_view() : text.substr(point + 1);
+    if (whole.empty() || whole.size() > 12) {
+        return std::nullopt;
+    }
+    std::uint64_t time = 0;
+    for (const char c : whole) {
+        if (c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        time = time * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    for (std::size_t i = 0; i < 6; i++) {
+        const char c = i < fraction.size() ? fraction[i] : '0';
+        if (c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        time = time * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    return time;
+}
+
+std::optional<can::Message> build_message(std::uint32_t id, bool extended, std::span<const std::uint8_t> data) {
+    if (id > (extended ? k_max_extended_id : k_max_standard_id)) {
+        return std::nullopt;
+    }
+    return extended ? can::build_extended(id, data) : can::build_standard(static_cast<std::uint16_t>(id), data);
+}
+
+// Appends a fixed-point value given as a raw integer and a number of decimal places, so that no precision is lost.
+void append_fixed(std::string &out, std::int64_t raw, unsigned decimals) {
+    std::array<char, 24> buffer{};
+    if (raw < 0) {
+        out.push_back('-');
+    }
+    const auto magnitude = static_cast<std::uint64_t>(raw < 0 ? -raw : raw);
+    std::uint64_t divisor = 1;
+    for (unsigned i = 0; i < decimals; i++) {
+        divisor *= 10;
+    }
+    const auto whole = std::to_chars(buffer.data(), buffer.data() + buffer.size(), magnitude / divisor);
+    out.append(buffer.data(), whole.ptr);
+    if (decimals == 0) {
+        return;
+    }
+    out.push_back('.');
+    auto fraction = magnitude % divisor;
+    const auto start = out.size();
+    out.append(decimals, '0');
+    for (auto i = out.size(); i > start; i--) {
+        out[i - 1] = static_cast<char>('0' + fraction % 10);
+        fraction /= 10;
+    }
+}
+
+// Writes the columns of one CSV row in order, skipping over empty ones.
+class Row {
+    std::string &m_out;
+    std::size_t m_column{0};
+
+public:
+    explicit Row(std::string &out) : m_out(out) {}
+
+    void column(std::size_t index) {
+        while (m_column < index) {
+            m_out.push_back(',');
+            m_column++;
+        }
+    }
+
+    void fixed(std::size_t index, std::int64_t raw, unsigned decimals = 0) {
+        column(index);
+        append_fixed(m_out, raw, decimals);
+    }
+
+    void end(std::size_t column_count) {
+        column(column_count - 1);
+        m_out.push_back('\n');
+    }
+};
+
+// Columns of k_csv_header.
+enum Column : std::size_t {
+    k_time,
+    k_node_id,
+    k_general_data,
+    k_erpm,
+    k_duty_cycle,
+    k_input_voltage,
+    k_ac_current,
+    k_dc_current,
+    k_controller_temperature,
+    k_motor_temperature,
+    k_fault_code,
+    k_d_current,
+    k_q_current,
+    k_throttle,
+    k_brake,
+    k_digital_pin_state,
+    k_drive_enabled,
+    k_limit_flags,
+    k_can_map_version,
+    k_column_count,
+};
+
+std::uint64_t wall_time() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+} // namespace
+
+std::optional<Record> parse_candump_line(std::string_view line) {
+    auto time_token = next_token(line);
+    if (time_token.size() < 3 || time_token.front() != '(' || time_token.back() != ')') {
+        return std::nullopt;
+    }
+    const auto time = parse_time(time_token.substr(1, time_token.size() - 2));
+    next_token(line);
+    const auto frame = next_token(line);
+    const auto hash = frame.find('#');
+    if (!time || hash == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    // A second '#' marks a CAN FD frame, and an 'R' a remote frame.
+    const auto id_text = frame.substr(0, hash);
+    const auto data_text = frame.substr(hash + 1);
+    const auto id = parse_number(id_text, false);
+    if (!id || data_text.size() % 2 != 0 || data_text.size() > 16) {
+        return std::nullopt;
+    }
+    std::array<std::uint8_t, 8> data{};
+    for (std::size_t i = 0; i < data_text.size() / 2; i++) {
+        const auto high = hex_digit(data_text[2 * i]);
+        const auto low = hex_digit(data_text[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        data[i] = static_cast<std::uint8_t>((high << 4) | low);
+    }
+    const auto message = build_message(*id, id_text.size() > 3, std::span(data).first(data_text.size() / 2));
+    if (!message) {
+        return std::nullopt;
+    }
+    return Record{*time, *message};
+}
+
+std::optional<Record> parse_asc_line(std::string_view line, bool decimal) {
+    const auto time = parse_time(next_token(line));
+    const auto channel = parse_number(next_token(line), true);
+    auto id_text = next_token(line);
+    if (!time || !channel || id_text.empty()) {
+        return std::nullopt;
+    }
+    const bool extended = id_text.back() == 'x' || id_text.back() == 'X';
+    if (extended) {
+        id_text.remove_suffix(1);
+    }
+    const auto id = parse_number(id_text, decimal);
+
+    // The direction is left out by some loggers.
+    auto type = next_token(line);
+    if (type == "Rx" || type == "Tx") {
+        type = next_token(line);
+    }
+    const auto length = parse_number(next_token(line), true);
+    if (!id || type != "d" || !length || *length > 8) {
+        return std::nullopt;
+    }
+    std::array<std::uint8_t, 8> data{};
+    for (std::size_t i = 0; i < *length; i++) {
+        const auto byte = parse_number(next_token(line), decimal);
+        if (!byte || *byte > 0xff) {
+            return std::nullopt;
+        }
+        data[i] = static_cast<std::uint8_t>(*byte);
+    }
+    const auto message = build_message(*id, extended, std::span(data).first(*length));
+    if (!message) {
+        return std::nullopt;
+    }
+    return Record{*time, *message};
+}
+
+std::optional<Record> Reader::next() {
+    while (m_offset < m_text.size()) {
+        const auto *begin = m_text.data() + m_offset;
+        const auto *newline = static_cast<const char *>(std::memchr(begin, '\n', m_text.size() - m_offset));
+        const auto length = newline != nullptr ? static_cast<std::size_t>(newline - begin) : m_text.size() - m_offset;
+        auto line = std::string_view(begin, length);
+        m_offset += newline != nullptr ? length + 1 : length;
+        m_line_count++;
+
+        while (!line.empty() && is_space(line.front())) {
+            line.remove_prefix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        std::optional<Record> record;
+        if (line.front() == '(') {
+            record = parse_candump_line(line);
+        } else if (line.starts_with("base ")) {
+            auto header = line.substr(5);
+            m_decimal = next_token(header) == "dec";
+        } else {
+            record = parse_asc_line(line, m_decimal);
+        }
+        if (record) {
+            return record;
+        }
+        m_skipped_count++;
+    }
+    return std::nullopt;
+}
+
+std::optional<MappedFile> MappedFile::open(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return MappedFile(nullptr, 0);
+    }
+
+    // The mapping stays valid after the file is closed.
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return std::nullopt;
+    }
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return MappedFile(static_cast<const char *>(data), size);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        if (m_data != nullptr) {
+            ::munmap(const_cast<char *>(m_data), m_size);
+        }
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+}
+
+bool append_csv_row(std::string &out, const Record &record) {
+    const auto &message = record.message;
+    if (!message.is_extended()) {
+        return false;
+    }
+    const auto packet = dti::parse_packet(message);
+    if (std::holds_alternative<dti::UnknownMessageType>(packet) || std::holds_alternative<dti::InvalidLength>(packet)) {
+        return false;
+    }
+
+    Row row(out);
+    row.fixed(k_time, static_cast<std::int64_t>(record.time), 6);
+    row.fixed(k_node_id, dti::identifier_node_id(message.extended_id()));
+    row.fixed(k_general_data, dti::identifier_packet_id(message.extended_id()) - dti::k_general_data_1_id + 1);
+    std::visit(
+        [&row](const auto &data) {
+            using T = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<T, dti::GeneralData1>) {
+                row.fixed(k_erpm, data.erpm);
+                row.fixed(k_duty_cycle, data.duty_cycle, 1);
+                row.fixed(k_input_voltage, data.input_voltage);
+            } else if constexpr (std::is_same_v<T, dti::GeneralData2>) {
+                row.fixed(k_ac_current, data.ac_current, 1);
+                row.fixed(k_dc_current, data.dc_current, 1);
+            } else if constexpr (std::is_same_v<T, dti::GeneralData3>) {
+                row.fixed(k_controller_temperature, data.controller_temperature, 1);
+                row.fixed(k_motor_temperature, data.motor_temperature, 1);
+                row.fixed(k_fault_code, static_cast<std::uint8_t>(data.fault_code));
+            } else if constexpr (std::is_same_v<T, dti::GeneralData4>) {
+                row.fixed(k_d_current, data.d_current, 2);
+                row.fixed(k_q_current, data.q_current, 2);
+            } else if constexpr (std::is_same_v<T, dti::GeneralData5>) {
+                const auto limit_flags = std::to_array<bool>({
+                    data.capacitor_temperature_limit_active,
+                    data.dc_current_limit_active,
+                    data.drive_enable_limit_active,
+                    data.igbt_acceleration_limit_active,
+                    data.igbt_temperature_limit_active,
+                    data.input_voltage_limit_active,
+                    data.motor_acceleration_temperature_limit_active,
+                    data.motor_temperature_limit_active,
+                    data.rpm_min_limit_active,
+                    data.rpm_max_limit_active,
+                    data.power_limit_active,
+                });
+                std::int64_t flags = 0;
+                for (std::size_t i = 0; i < limit_flags.size(); i++) {
+                    flags |= static_cast<std::int64_t>(limit_flags[i]) << i;
+                }
+                row.fixed(k_throttle, data.throttle);
+                row.fixed(k_brake, data.brake);
+                row.fixed(k_digital_pin_state, data.digital_pin_state);
+                row.fixed(k_drive_enabled, data.drive_enabled);
+                row.fixed(k_limit_flags, flags);
+                row.fixed(k_can_map_version, data.can_map_version);
+            }
+        },
+        packet);
+    row.end(k_column_count);
+    return true;
+}
+
+void Replayer::send(const Record &record) {
+    if (!m_first_time) {
+        m_first_time = record.time;
+        m_start_wall_time = wall_time();
+        m_start_bus_time = m_bus.time();
+    }
+
+    // Frames out of order by a little, e.g. from merged channels, are sent at once.
+    const auto offset = record.time > *m_first_time ? record.time - *m_first_time : 0;
+    if (m_speed > 0.0) {
+        const auto due = m_start_wall_time + static_cast<std::uint64_t>(static_cast<double>(offset) / m_speed);
+        const auto now = wall_time();
+        if (due > now) {
+            std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+        }
+    }
+    const auto due_bits = m_start_bus_time + offset * m_bus.bitrate() / 1'000'000u;
+    if (due_bits > m_bus.time()) {
+        m_bus.idle(due_bits - m_bus.time());
+    }
+
+    m_node.select();
+    if (can::transmit(record.message)) {
+        m_sent_count++;
+    } else {
+        m_dropped_count++;
+    }
+    m_bus.run(std::numeric_limits<std::size_t>::max());
+}
+
+} // namespace can_log
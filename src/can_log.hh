@@ -0,0 +1,145 @@
+#pragma once
+
+#include <can.hh>
+#include <can_virtual.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace can_log {
+
+/// One data frame from a log, with its time stamp in microseconds since the log's own epoch.
+struct Record {
+    std::uint64_t time;
+    can::Message message;
+};
+
+/**
+ * Parses one line of a log written by candump -l, e.g. "(1436509052.249713) can0 0CF00400#0102030405060708". As in
+ * candump, an identifier of more than three hex digits is extended.
+ *
+ * @return the frame; std::nullopt if the line isn't a classic data frame, e.g. a remote, error or CAN FD frame
+ */
+std::optional<Record> parse_candump_line(std::string_view line);
+
+/**
+ * Parses one line of a Vector ASC log, e.g. "0.002400 1  123x       Rx   d 8 01 02 03 04 05 06 07 08". Extended
+ * identifiers end in 'x'.
+ *
+ * @param decimal whether the log's header declared "base dec" rather than "base hex"
+ * @return the frame; std::nullopt if the line isn't a classic data frame, e.g. a header, comment or error frame
+ */
+std::optional<Record> parse_asc_line(std::string_view line, bool decimal = false);
+
+/**
+ * A class which reads the frames of a candump or ASC log held in memory, e.g. a mapped file, without copying it. The
+ * format is told apart line by line, so a log can't be mistaken for the other format.
+ */
+class Reader {
+    std::string_view m_text;
+    std::size_t m_offset{0};
+    bool m_decimal{false};
+    std::uint64_t m_line_count{0};
+    std::uint64_t m_skipped_count{0};
+
+public:
+    /**
+     * @param text the contents of the log
+     */
+    explicit Reader(std::string_view text) : m_text(text) {}
+
+    /**
+     * @return the next frame; std::nullopt at the end of the log
+     */
+    std::optional<Record> next();
+
+    /// Number of bytes of the log read so far.
+    std::size_t offset() const { return m_offset; }
+
+    std::uint64_t line_count() const { return m_line_count; }
+
+    /// Number of non-empty lines which weren't frames, e.g. headers, comments and remote or error frames.
+    std::uint64_t skipped_count() const { return m_skipped_count; }
+};
+
+/**
+ * A read-only memory mapping of a whole file, read sequentially. Only available on POSIX hosts.
+ */
+class MappedFile {
+    const char *m_data{nullptr};
+    std::size_t m_size{0};
+
+    MappedFile(const char *data, std::size_t size) : m_data(data), m_size(size) {}
+
+public:
+    /**
+     * @param path the path of the file
+     * @return the mapped file; std::nullopt if the file couldn't be opened or mapped
+     */
+    static std::optional<MappedFile> open(const std::string &path);
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    std::string_view text() const { return {m_data, m_size}; }
+};
+
+/// Header line of the CSV written by append_csv_row. The general_data column holds the status packet number, 1 to 5,
+/// and limit_flags holds the limit activation states of GeneralData5 as a bit field in the order of the struct.
+constexpr std::string_view k_csv_header =
+    "time,node_id,general_data,erpm,duty_cycle,input_voltage,ac_current,dc_current,controller_temperature,"
+    "motor_temperature,fault_code,d_current,q_current,throttle,brake,digital_pin_state,drive_enabled,limit_flags,"
+    "can_map_version\n";
+
+/**
+ * Decodes a frame with dti::parse_packet and appends it to a CSV with one column per DTI status signal, in physical
+ * units. Only the columns of the frame's own packet are filled.
+ *
+ * @param out the CSV to append to
+ * @param record the frame
+ * @return true if the frame was a DTI status packet and a row was appended; false otherwise
+ */
+bool append_csv_row(std::string &out, const Record &record);
+
+/**
+ * A class which sends the frames of a log onto a virtual bus, keeping the bus time in step with the log time, and
+ * optionally also pacing the frames against the wall clock. The bus time starts at the first frame's time.
+ */
+class Replayer {
+    can::VirtualBus &m_bus;
+    can::VirtualNode &m_node;
+    double m_speed;
+    std::optional<std::uint64_t> m_first_time;
+    std::uint64_t m_start_wall_time{0};
+    std::uint64_t m_start_bus_time{0};
+    std::uint64_t m_sent_count{0};
+    std::uint64_t m_dropped_count{0};
+
+public:
+    /**
+     * @param bus the bus to replay onto
+     * @param node an initialised node on the bus which sends the frames
+     * @param speed the replay speed as a multiple of real time, or zero to replay as fast as possible
+     */
+    Replayer(can::VirtualBus &bus, can::VirtualNode &node, double speed)
+        : m_bus(bus), m_node(node), m_speed(speed) {}
+
+    /**
+     * Waits until the frame is due, sends it, and runs the bus until it is idle. A frame is sent late if the bus is
+     * still busy with earlier frames at its time.
+     */
+    void send(const Record &record);
+
+    std::uint64_t sent_count() const { return m_sent_count; }
+
+    /// Number of frames which couldn't be sent because the transmit queue of the node was full.
+    std::uint64_t dropped_count() const { return m_dropped_count; }
+};
+
+} // namespace can_log
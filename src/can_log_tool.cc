@@ -0,0 +1,165 @@
+#include <can.hh>
+#include <can_log.hh>
+#include <can_virtual.hh>
+#include <config.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// Size of the CSV output buffer, which is written out whenever it fills.
+constexpr std::size_t k_output_buffer_size = 1u << 20u;
+
+// Maximum age of inverter data shown while replaying, in microseconds.
+constexpr std::uint32_t k_max_display_age = 1'000'000;
+
+dti::InverterTable s_dti_table(config::k_dti_can_ids, config::k_can_bitrate);
+
+int usage() {
+    std::fputs("usage: can-log csv <log> [<output.csv>]\n"
+               "       can-log replay <log> [<speed>]\n"
+               "\n"
+               "Reads candump -l and Vector ASC logs. csv decodes every DTI status packet into one row,\n"
+               "written to standard output if no output is given. replay sends the log onto a virtual bus at\n"
+               "config::k_can_bitrate at the given multiple of real time, or as fast as possible if the speed is\n"
+               "0, and prints the state of the inverters in config::k_dti_can_ids once per second of log time.\n",
+               stderr);
+    return EXIT_FAILURE;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int write_csv(const can_log::MappedFile &file, const char *output_path) {
+    std::FILE *output = output_path != nullptr ? std::fopen(output_path, "wb") : stdout;
+    if (output == nullptr) {
+        std::fprintf(stderr, "can't open %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::string buffer;
+    buffer.reserve(k_output_buffer_size + 512);
+    buffer.append(can_log::k_csv_header);
+    can_log::Reader reader(file.text());
+    std::uint64_t frame_count = 0;
+    std::uint64_t row_count = 0;
+    bool ok = true;
+    while (const auto record = reader.next()) {
+        frame_count++;
+        if (can_log::append_csv_row(buffer, *record)) {
+            row_count++;
+        }
+        if (buffer.size() >= k_output_buffer_size) {
+            ok &= std::fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size();
+            buffer.clear();
+        }
+    }
+    ok &= std::fwrite(buffer.data(), 1, buffer.size(), output) == buffer.size();
+    ok &= output == stdout ? std::fflush(output) == 0 : std::fclose(output) == 0;
+    if (!ok) {
+        std::fputs("error writing the CSV\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    const auto elapsed = seconds_since(start);
+    std::fprintf(stderr, "%llu lines, %llu frames, %llu DTI rows, %llu lines skipped; %.1f MB/s\n",
+                 static_cast<unsigned long long>(reader.line_count()), static_cast<unsigned long long>(frame_count),
+                 static_cast<unsigned long long>(row_count), static_cast<unsigned long long>(reader.skipped_count()),
+                 static_cast<double>(file.text().size()) / 1e6 / elapsed);
+    return EXIT_SUCCESS;
+}
+
+// Prints a fixed-point signal in physical units, or a dash if its packet hasn't arrived recently.
+template <typename T>
+void print_signal(const char *name, std::optional<T> value, int decimals, const char *unit) {
+    if (value) {
+        std::printf(", %s %.*f%s", name, decimals, static_cast<double>(*value) / std::pow(10.0, decimals), unit);
+    } else {
+        std::printf(", %s -", name);
+    }
+}
+
+void print_inverters(std::uint64_t log_time) {
+    const auto now = can::timestamp_now();
+    for (std::size_t i = 0; i < s_dti_table.size(); i++) {
+        const auto &inverter = s_dti_table[i];
+        std::printf("%8.1f s  inverter %u", static_cast<double>(log_time) / 1e6, s_dti_table.node_ids()[i]);
+        print_signal("ERPM", inverter.erpm(now, k_max_display_age), 0, "");
+        print_signal("AC", inverter.ac_current(now, k_max_display_age), 1, " A");
+        print_signal("DC", inverter.dc_current(now, k_max_display_age), 1, " A");
+        print_signal("controller", inverter.controller_temperature(now, k_max_display_age), 1, " C");
+        print_signal("motor", inverter.motor_temperature(now, k_max_display_age), 1, " C");
+        std::printf("\n");
+    }
+}
+
+int replay(const can_log::MappedFile &file, double speed) {
+    can::VirtualBus bus(config::k_can_bitrate);
+    can::VirtualNode replay_node(bus);
+    can::VirtualNode listener_node(bus);
+    replay_node.select();
+    if (!can::init(can::Port::B, config::k_can_speed)) {
+        return EXIT_FAILURE;
+    }
+    listener_node.select();
+    if (!can::init(can::Port::B, config::k_can_speed, {.timestamps = true})) {
+        return EXIT_FAILURE;
+    }
+    can::route_filter(0, 0, 0, 0);
+    can::set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t timestamp) {
+        s_dti_table.update(message.to_message(), timestamp);
+    });
+
+    can_log::Replayer replayer(bus, replay_node, speed);
+    can_log::Reader reader(file.text());
+    std::optional<std::uint64_t> next_print;
+    while (const auto record = reader.next()) {
+        replayer.send(*record);
+        if (!next_print) {
+            next_print = record->time;
+        }
+        if (record->time >= *next_print) {
+            listener_node.select();
+            print_inverters(record->time);
+            std::fflush(stdout);
+            next_print = record->time + 1'000'000;
+        }
+    }
+    std::fprintf(stderr, "%llu frames sent, %llu dropped, %llu lines skipped\n",
+                 static_cast<unsigned long long>(replayer.sent_count()),
+                 static_cast<unsigned long long>(replayer.dropped_count()),
+                 static_cast<unsigned long long>(reader.skipped_count()));
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        return usage();
+    }
+    const std::string_view command(argv[1]);
+    const auto file = can_log::MappedFile::open(argv[2]);
+    if (!file) {
+        std::fprintf(stderr, "can't read %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (command == "csv" && argc <= 4) {
+        return write_csv(*file, argc == 4 ? argv[3] : nullptr);
+    }
+    if (command == "replay" && argc <= 4) {
+        return replay(*file, argc == 4 ? std::strtod(argv[3], nullptr) : 1.0);
+    }
+    return usage();
+}
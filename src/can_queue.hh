@@ -0,0 +1,127 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace can {
+
+/**
+ * Computes a key which orders messages in the same way as bus arbitration, i.e. the message with the lower key wins.
+ * A standard identifier beats an extended identifier sharing the same 11 base bits, since the extended frame's SRR and
+ * IDE bits are recessive.
+ *
+ * @param message the message to compute the key for
+ * @return the 30-bit arbitration key
+ */
+constexpr std::uint32_t arbitration_key(const RawMessage &message) {
+    // The identifier word holds STID[10:0] above EXID[17:0]; the IDE bit is moved in between them.
+    const auto base = message.id_word >> 21u;
+    if (message.is_standard()) {
+        return base << 19u;
+    }
+    return (base << 19u) | (1u << 18u) | ((message.id_word >> 3u) & 0x3ffffu);
+}
+
+/**
+ * @copydoc arbitration_key(const RawMessage &)
+ */
+inline std::uint32_t arbitration_key(const Message &message) {
+    return arbitration_key(RawMessage::from_message(message));
+}
+
+/**
+ * A fixed-capacity transmit queue which keeps messages sorted by arbitration priority. Messages of equal priority are
+ * kept in insertion order. When full, the lowest priority message is dropped to make room for a higher priority one.
+ * In ordered mode, all messages are treated as having equal priority, so the queue becomes first in, first out.
+ *
+ * @tparam Capacity the maximum number of queued messages
+ */
+template <std::size_t Capacity>
+class TxQueue {
+    static_assert(Capacity > 0);
+
+    std::array<RawMessage, Capacity> m_messages{};
+    std::size_t m_size{0};
+    std::size_t m_high_water_mark{0};
+    std::uint32_t m_drop_count{0};
+    bool m_ordered{false};
+
+    std::uint32_t key(const RawMessage &message) const { return m_ordered ? 0u : arbitration_key(message); }
+
+public:
+    /**
+     * Inserts a message into the queue after any queued messages of higher or equal priority.
+     *
+     * @param message the message to queue
+     * @return true if the message was queued; false if the queue is full of higher priority messages
+     */
+    bool push(const RawMessage &message);
+
+    /**
+     * Removes the highest priority message from the queue. The queue must not be empty.
+     */
+    RawMessage pop();
+
+    /**
+     * @return the highest priority message without removing it; the queue must not be empty
+     */
+    const RawMessage &front() const { return m_messages[0]; }
+
+    /**
+     * Switches between priority order and insertion order. Messages already queued keep their position, so this should
+     * only be called while the queue is empty.
+     *
+     * @param ordered true to keep messages in insertion order; false to sort them by priority
+     */
+    void set_ordered(bool ordered) { m_ordered = ordered; }
+
+    bool empty() const { return m_size == 0; }
+    std::size_t size() const { return m_size; }
+    std::size_t free_count() const { return Capacity - m_size; }
+    std::size_t high_water_mark() const { return m_high_water_mark; }
+    std::uint32_t drop_count() const { return m_drop_count; }
+};
+
+template <std::size_t Capacity>
+bool TxQueue<Capacity>::push(const RawMessage &message) {
+    const auto message_key = key(message);
+    if (m_size == Capacity) {
+        if (key(m_messages[Capacity - 1]) <= message_key) {
+            // Every queued message has a higher or equal priority - drop the new one.
+            m_drop_count++;
+            return false;
+        }
+
+        // Evict the lowest priority message.
+        m_size--;
+        m_drop_count++;
+    }
+
+    // Find the insertion point after all messages of higher or equal priority.
+    std::size_t index = m_size;
+    while (index > 0 && key(m_messages[index - 1]) > message_key) {
+        m_messages[index] = m_messages[index - 1];
+        index--;
+    }
+    m_messages[index] = message;
+    m_size++;
+    if (m_size > m_high_water_mark) {
+        m_high_water_mark = m_size;
+    }
+    return true;
+}
+
+template <std::size_t Capacity>
+RawMessage TxQueue<Capacity>::pop() {
+    const auto message = m_messages[0];
+    for (std::size_t i = 1; i < m_size; i++) {
+        m_messages[i - 1] = m_messages[i];
+    }
+    m_size--;
+    return message;
+}
+
+} // namespace can
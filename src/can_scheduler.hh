@@ -0,0 +1,287 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace can {
+
+/// A concept for the transmit mailbox interface used by TxScheduler, so that it can be driven by a fake on the host.
+template <typename T>
+concept TxDriver = requires(T &driver, const RawMessage &message, const MailboxTicket &ticket) {
+    { driver.submit(message) } -> std::same_as<std::optional<MailboxTicket>>;
+    { driver.status(ticket) } -> std::same_as<MailboxStatus>;
+    { driver.abort(ticket) } -> std::same_as<MailboxStatus>;
+};
+
+/// A TxDriver which uses the bxCAN transmit mailboxes directly.
+struct MailboxDriver {
+    std::optional<MailboxTicket> submit(const RawMessage &message) { return transmit_mailbox(message); }
+    MailboxStatus status(const MailboxTicket &ticket) { return mailbox_status(ticket); }
+    MailboxStatus abort(const MailboxTicket &ticket) { return abort_mailbox(ticket); }
+};
+
+/// A struct which describes a class of periodic messages. All times are in milliseconds.
+struct TxClass {
+    /// Scheduling priority; classes with a lower value are given a free mailbox first.
+    std::uint8_t priority;
+
+    /// Time between releases of the message, or zero for a class which is only released by TxScheduler::release.
+    std::uint32_t period;
+
+    /// Time after release by which the message must have been sent. Should not exceed the period.
+    std::uint32_t deadline;
+};
+
+/// Per-class transmit counters.
+struct TxClassStatistics {
+    /// Number of messages sent on time.
+    std::uint32_t sent_count;
+
+    /// Number of releases which were not sent by their deadline, either because no mailbox became free or because the
+    /// message was aborted after losing arbitration for too long.
+    std::uint32_t miss_count;
+};
+
+/**
+ * A scheduler for periodic messages which places each release of a message class directly into a transmit mailbox,
+ * bypassing the software queue. A message which has not been sent by its deadline is aborted rather than sent late,
+ * and the next release sends the freshest value given to update. Queued messages are moved into free mailboxes from
+ * the transmit interrupt, so InitOptions::reserve_mailbox should be set to keep a burst of them from taking every
+ * mailbox. All member functions must be called from the same context.
+ *
+ * @tparam Driver the transmit mailbox interface
+ * @tparam ClassCount the number of message classes
+ */
+template <TxDriver Driver, std::size_t ClassCount>
+class TxScheduler {
+    enum class SlotState : std::uint8_t {
+        Idle,
+        Waiting,
+        InFlight,
+    };
+
+    struct Slot {
+        TxClass config;
+        RawMessage message;
+        bool has_message;
+        SlotState state;
+        std::uint32_t next_release;
+        std::uint32_t release_time;
+        MailboxTicket ticket;
+
+        /// A message which was being sent when it was aborted, whose outcome is taken on the next poll.
+        std::optional<MailboxTicket> aborting;
+        bool aborting_expired;
+
+        /// Set when a release misses its deadline, until taken by take_missed.
+        bool missed;
+        TxClassStatistics statistics;
+    };
+
+    Driver &m_driver;
+    std::array<Slot, ClassCount> m_slots{};
+    std::array<std::uint8_t, ClassCount> m_order{};
+
+    static bool reached(std::uint32_t now, std::uint32_t time) {
+        return static_cast<std::int32_t>(now - time) >= 0;
+    }
+
+    void record(Slot &slot, MailboxStatus status, bool expired);
+    void abort(Slot &slot, bool expired);
+    void start_release(Slot &slot, std::uint32_t now);
+    void service(Slot &slot, std::uint32_t now);
+
+public:
+    /**
+     * @param driver the transmit mailbox interface
+     * @param classes the message classes, which are referred to by their index
+     * @param now the current time in milliseconds; each class is first released at this time
+     */
+    TxScheduler(Driver &driver, const std::array<TxClass, ClassCount> &classes, std::uint32_t now);
+
+    /**
+     * Sets the value to be sent on the next release of the given class. A release which is still waiting for a mailbox
+     * will send this value instead of the one it was released with.
+     *
+     * @param index the class index
+     * @param message the freshest value of the message
+     */
+    void update(std::size_t index, const RawMessage &message);
+
+    /**
+     * Releases the given message at once rather than at the next period, which then follows a full period later. The
+     * message is placed into a mailbox on the next call to poll.
+     *
+     * @param index the class index
+     * @param message the value to send
+     * @param now the current time in milliseconds
+     */
+    void release(std::size_t index, const RawMessage &message, std::uint32_t now);
+
+    /**
+     * Stops sending the given class until update is next called, and forgets any missed release. A message already in a
+     * mailbox is not aborted.
+     *
+     * @param index the class index
+     */
+    void clear(std::size_t index);
+
+    /**
+     * Releases any due messages, aborts any messages which have missed their deadline, and places waiting messages
+     * into free mailboxes in priority order. Should be called at least as often as the shortest deadline.
+     *
+     * @param now the current time in milliseconds
+     */
+    void poll(std::uint32_t now);
+
+    /**
+     * Takes the flag which is set when a release of the given class misses its deadline, so that a class which is only
+     * released on change can be released again. A release which is replaced by a newer one before being sent doesn't
+     * set the flag, since the newer value is sent instead.
+     *
+     * @param index the class index
+     * @return true if a release has missed its deadline since the last call; false otherwise
+     */
+    bool take_missed(std::size_t index) { return std::exchange(m_slots[index].missed, false); }
+
+    /**
+     * @param index the class index
+     * @return the counters of the given class
+     */
+    const TxClassStatistics &statistics(std::size_t index) const { return m_slots[index].statistics; }
+};
+
+template <TxDriver Driver, std::size_t ClassCount>
+TxScheduler<Driver, ClassCount>::TxScheduler(Driver &driver, const std::array<TxClass, ClassCount> &classes,
+                                             std::uint32_t now)
+    : m_driver(driver) {
+    for (std::size_t i = 0; i < ClassCount; i++) {
+        m_slots[i].config = classes[i];
+        m_slots[i].next_release = now;
+
+        // Insertion sort by priority, keeping the declaration order for equal priorities.
+        std::size_t position = i;
+        while (position > 0 && classes[m_order[position - 1]].priority > classes[i].priority) {
+            m_order[position] = m_order[position - 1];
+            position--;
+        }
+        m_order[position] = static_cast<std::uint8_t>(i);
+    }
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::update(std::size_t index, const RawMessage &message) {
+    m_slots[index].message = message;
+    m_slots[index].has_message = true;
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::release(std::size_t index, const RawMessage &message, std::uint32_t now) {
+    auto &slot = m_slots[index];
+    update(index, message);
+    start_release(slot, now);
+    slot.next_release = now + slot.config.period;
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::clear(std::size_t index) {
+    auto &slot = m_slots[index];
+    slot.has_message = false;
+    slot.missed = false;
+    if (slot.state == SlotState::Waiting) {
+        slot.state = SlotState::Idle;
+    }
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::record(Slot &slot, MailboxStatus status, bool expired) {
+    if (status == MailboxStatus::Sent) {
+        slot.statistics.sent_count++;
+    } else {
+        slot.statistics.miss_count++;
+        slot.missed |= expired;
+    }
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::abort(Slot &slot, bool expired) {
+    // The message may still have been sent if it won arbitration meanwhile. If it is being sent right now, the outcome
+    // is only known at the end of the frame.
+    const auto status = m_driver.abort(slot.ticket);
+    if (status == MailboxStatus::Pending) {
+        slot.aborting = slot.ticket;
+        slot.aborting_expired = expired;
+    } else {
+        record(slot, status, expired);
+    }
+    slot.state = SlotState::Idle;
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::start_release(Slot &slot, std::uint32_t now) {
+    if (slot.state == SlotState::InFlight) {
+        // The previous release is still pending; replace it with the fresh value.
+        abort(slot, false);
+    } else if (slot.state == SlotState::Waiting) {
+        slot.statistics.miss_count++;
+    }
+    slot.state = slot.has_message ? SlotState::Waiting : SlotState::Idle;
+    slot.release_time = now;
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::service(Slot &slot, std::uint32_t now) {
+    if (slot.aborting) {
+        if (const auto status = m_driver.status(*slot.aborting); status != MailboxStatus::Pending) {
+            record(slot, status, slot.aborting_expired);
+            slot.aborting.reset();
+        }
+    }
+    if (slot.state == SlotState::InFlight) {
+        if (const auto status = m_driver.status(slot.ticket); status != MailboxStatus::Pending) {
+            record(slot, status, true);
+            slot.state = SlotState::Idle;
+        }
+    }
+
+    // Abort a message which has missed its deadline.
+    const bool expired = reached(now, slot.release_time + slot.config.deadline);
+    if (slot.state == SlotState::InFlight && expired) {
+        abort(slot, true);
+    } else if (slot.state == SlotState::Waiting && expired) {
+        record(slot, MailboxStatus::Aborted, true);
+        slot.state = SlotState::Idle;
+    }
+
+    if (slot.config.period != 0 && reached(now, slot.next_release)) {
+        start_release(slot, now);
+
+        // Skip any releases which were missed entirely rather than bursting to catch up.
+        slot.next_release += slot.config.period;
+        if (reached(now, slot.next_release)) {
+            slot.next_release = now + slot.config.period;
+        }
+    }
+
+    if (slot.state == SlotState::Waiting) {
+        if (const auto ticket = m_driver.submit(slot.message)) {
+            slot.ticket = *ticket;
+            slot.state = SlotState::InFlight;
+        }
+    }
+}
+
+template <TxDriver Driver, std::size_t ClassCount>
+void TxScheduler<Driver, ClassCount>::poll(std::uint32_t now) {
+    for (const auto index : m_order) {
+        service(m_slots[index], now);
+    }
+}
+
+} // namespace can
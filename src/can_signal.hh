@@ -0,0 +1,241 @@
+#pragma once
+
+#include <can.hh>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace can {
+
+/// An enum which represents the byte order of a signal.
+enum class ByteOrder : std::uint8_t {
+    /// Most significant byte first, also known as Motorola order.
+    BigEndian,
+
+    /// Least significant byte first, also known as Intel order.
+    LittleEndian,
+};
+
+/**
+ * A struct which describes where a signal lives in the eight data bytes of a message, using the same conventions as
+ * DBC files. Bit n is bit n % 8 of byte n / 8. The start bit is the least significant bit of a little endian signal and
+ * the most significant bit of a big endian signal. The signedness of the raw value is taken from the value type.
+ *
+ * @tparam T the integral, enum or bool type the raw value is decoded into
+ */
+template <typename T>
+struct Signal {
+    using value_type = T;
+
+    std::uint8_t start_bit;
+    std::uint8_t length;
+    ByteOrder byte_order;
+
+    /// Physical value of one raw unit, e.g. 0.1 for a value sent in tenths.
+    float scale{1.0f};
+
+    /// Physical value of a raw zero.
+    float offset{0.0f};
+};
+
+/**
+ * @return a big endian signal whose most significant bit is the given start bit
+ */
+template <typename T>
+constexpr Signal<T> big_endian(std::uint8_t start_bit, std::uint8_t length, float scale = 1.0f, float offset = 0.0f) {
+    return {start_bit, length, ByteOrder::BigEndian, scale, offset};
+}
+
+/**
+ * @return a little endian signal whose least significant bit is the given start bit
+ */
+template <typename T>
+constexpr Signal<T> little_endian(std::uint8_t start_bit, std::uint8_t length, float scale = 1.0f,
+                                  float offset = 0.0f) {
+    return {start_bit, length, ByteOrder::LittleEndian, scale, offset};
+}
+
+namespace detail {
+
+template <typename T>
+struct RawType {
+    using type = T;
+};
+
+template <typename T>
+    requires std::is_enum_v<T>
+struct RawType<T> {
+    using type = std::underlying_type_t<T>;
+};
+
+// The integral type which holds the raw value of a signal before it is converted into the value type.
+template <typename T>
+using raw_type_t = typename RawType<T>::type;
+
+template <typename T>
+constexpr bool k_is_signed = std::is_signed_v<raw_type_t<T>> && !std::is_same_v<T, bool>;
+
+template <auto S>
+constexpr std::uint64_t k_mask = S.length >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << S.length) - 1u;
+
+// Position of the signal's least significant bit within the data bytes loaded as a 64-bit integer in the signal's
+// byte order.
+template <auto S>
+constexpr std::uint32_t k_shift = S.byte_order == ByteOrder::LittleEndian
+                                      ? S.start_bit
+                                      : (7u - S.start_bit / 8u) * 8u + S.start_bit % 8u - (S.length - 1u);
+
+// Number of data bytes needed to hold the signal.
+template <auto S>
+constexpr std::size_t k_end_byte = S.byte_order == ByteOrder::LittleEndian ? (S.start_bit + S.length - 1u) / 8u + 1u
+                                                                           : 8u - k_shift<S> / 8u;
+
+template <auto S>
+constexpr bool is_valid() {
+    return S.length >= 1 && S.length <= 64 && S.start_bit < 64 && k_shift<S> + S.length <= 64;
+}
+
+constexpr std::uint64_t load_le(std::span<const std::uint8_t, 8> data) {
+    if (!std::is_constant_evaluated() && std::endian::native == std::endian::little) {
+        std::uint64_t word;
+        std::memcpy(&word, data.data(), sizeof(word));
+        return word;
+    }
+    std::uint64_t word = 0;
+    for (std::size_t i = 0; i < 8; i++) {
+        word |= static_cast<std::uint64_t>(data[i]) << (8u * i);
+    }
+    return word;
+}
+
+constexpr std::uint64_t byteswap(std::uint64_t word) {
+    // Compiles to a single rev pair on Cortex-M3, whereas GCC doesn't reliably recognise a shift loop.
+    return __builtin_bswap64(word);
+}
+
+template <auto S>
+constexpr typename decltype(S)::value_type extract(std::uint64_t le, std::uint64_t be) {
+    using T = typename decltype(S)::value_type;
+    static_assert(is_valid<S>(), "Signal does not fit into eight bytes");
+    const auto word = S.byte_order == ByteOrder::LittleEndian ? le : be;
+    const auto raw = (word >> k_shift<S>) & k_mask<S>;
+    if constexpr (k_is_signed<T>) {
+        // Sign extend by moving the sign bit to the top and shifting back arithmetically.
+        constexpr auto unused = 64u - S.length;
+        return static_cast<T>(static_cast<std::int64_t>(raw << unused) >> unused);
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return raw != 0u;
+    } else {
+        return static_cast<T>(raw);
+    }
+}
+
+template <auto S>
+constexpr void insert(std::uint64_t &le, std::uint64_t &be, typename decltype(S)::value_type value) {
+    static_assert(is_valid<S>(), "Signal does not fit into eight bytes");
+    const auto raw = static_cast<std::uint64_t>(static_cast<raw_type_t<typename decltype(S)::value_type>>(value));
+    auto &word = S.byte_order == ByteOrder::LittleEndian ? le : be;
+    word |= (raw & k_mask<S>) << k_shift<S>;
+}
+
+} // namespace detail
+
+/**
+ * Decodes a single signal from the data bytes of a message.
+ *
+ * @tparam S the signal
+ * @param data the data bytes
+ * @return the raw value of the signal
+ */
+template <auto S>
+constexpr typename decltype(S)::value_type decode_signal(std::span<const std::uint8_t, 8> data) {
+    const auto le = detail::load_le(data);
+    return detail::extract<S>(le, detail::byteswap(le));
+}
+
+/**
+ * Converts a raw signal value into its physical value using the signal's scale and offset.
+ */
+template <auto S>
+constexpr float to_physical(typename decltype(S)::value_type raw) {
+    return static_cast<float>(static_cast<detail::raw_type_t<typename decltype(S)::value_type>>(raw)) * S.scale +
+           S.offset;
+}
+
+/**
+ * Converts a physical value into the nearest raw signal value using the signal's scale and offset. Values outside of
+ * the range of the value type are not clamped.
+ */
+template <auto S>
+constexpr typename decltype(S)::value_type from_physical(float value) {
+    using Raw = detail::raw_type_t<typename decltype(S)::value_type>;
+    const auto scaled = (value - S.offset) / S.scale;
+    return static_cast<typename decltype(S)::value_type>(
+        static_cast<Raw>(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f));
+}
+
+/**
+ * A struct which generates the decoder and encoder of a message from a list of signals. The data bytes are loaded
+ * into 64-bit integers once and every signal is then extracted with constant shifts and masks, so both directions
+ * compile down to straight-line code.
+ *
+ * @tparam Id the base identifier of the message
+ * @tparam T the type to decode into, which is aggregate initialised from the signal values in order
+ * @tparam Signals the signals of the message
+ */
+template <std::uint32_t Id, typename T, auto... Signals>
+struct MessageCodec {
+    /// Base identifier of the message.
+    static constexpr std::uint32_t k_id = Id;
+
+    /// Number of data bytes needed to hold every signal.
+    static constexpr std::size_t k_length = std::max({detail::k_end_byte<Signals>...});
+
+    /**
+     * @param data the data bytes of the message
+     * @return the decoded message
+     */
+    static constexpr T decode(std::span<const std::uint8_t, 8> data) {
+        const auto le = detail::load_le(data);
+        const auto be = detail::byteswap(le);
+        return T{detail::extract<Signals>(le, be)...};
+    }
+
+    /**
+     * Decodes a message straight from the mailbox layout, which already holds the data bytes as little endian words.
+     *
+     * @param message the raw message
+     * @return the decoded message
+     */
+    static constexpr T decode(const RawMessage &message) {
+        const auto le = (static_cast<std::uint64_t>(message.data_high) << 32u) | message.data_low;
+        const auto be = detail::byteswap(le);
+        return T{detail::extract<Signals>(le, be)...};
+    }
+
+    /**
+     * Encodes the given signal values, in the same order as the signals.
+     *
+     * @return the first k_length data bytes of the message; unused bits are zero
+     */
+    static constexpr std::array<std::uint8_t, k_length>
+    encode(const typename decltype(Signals)::value_type &...values) {
+        std::uint64_t le = 0;
+        std::uint64_t be = 0;
+        (detail::insert<Signals>(le, be, values), ...);
+        const auto word = le | detail::byteswap(be);
+        std::array<std::uint8_t, k_length> data{};
+        for (std::size_t i = 0; i < k_length; i++) {
+            data[i] = static_cast<std::uint8_t>(word >> (8u * i));
+        }
+        return data;
+    }
+};
+
+} // namespace can
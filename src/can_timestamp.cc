@@ -0,0 +1,35 @@
+#include <can_timestamp.hh>
+
+#include <cstdint>
+
+namespace can {
+
+void TimestampExtender::reset(std::uint32_t cycles_per_tick) {
+    *this = {};
+    m_cycles_per_tick = cycles_per_tick != 0 ? cycles_per_tick : 1;
+}
+
+std::uint32_t TimestampExtender::extend(std::uint16_t time, std::uint32_t cycles) {
+    if (!m_started) {
+        // The CAN timer can't be read, so the first capture defines the relation between the two counters.
+        m_started = true;
+        m_reference_cycles = cycles;
+        m_reference_ticks = time;
+        return time;
+    }
+
+    // Advance the reference by whole ticks only, carrying the remainder so that rounding errors never accumulate.
+    const auto elapsed_ticks = (cycles - m_reference_cycles) / m_cycles_per_tick;
+    m_reference_cycles += elapsed_ticks * m_cycles_per_tick;
+    m_reference_ticks += elapsed_ticks;
+
+    // Step back from the estimate to the latest value which matches the captured bits.
+    const auto estimate = m_reference_ticks + k_margin;
+    const auto extended = estimate - static_cast<std::uint16_t>(estimate - time);
+    if (static_cast<std::int32_t>(extended - m_reference_ticks) > 0) {
+        m_reference_ticks = extended;
+    }
+    return extended;
+}
+
+} // namespace can
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+namespace can {
+
+/**
+ * A class which extends the 16-bit time stamps captured by the bxCAN time triggered communication mode into 32 bits.
+ *
+ * The CAN timer increments once per bit time and can't be read directly, so a free-running cycle counter which is
+ * clocked from the same oscillator is used to estimate how much time has passed since the last capture. The extended
+ * value is the latest time at or before the estimate (plus a small margin) which matches the captured 16 bits. This is
+ * correct as long as frames are captured within 65536 bit times of arriving, and the estimate stays correct as long as
+ * extend is called at least once per cycle counter period.
+ *
+ * Since a frame can only be captured after it has started, the estimate is moved forward whenever a capture shows that
+ * it lags behind, so it converges on the CAN timer less the shortest delay between the start of a frame and its
+ * capture.
+ */
+class TimestampExtender {
+    std::uint32_t m_cycles_per_tick{1};
+    std::uint32_t m_reference_cycles{0};
+    std::uint32_t m_reference_ticks{0};
+    bool m_started{false};
+
+public:
+    /// Margin in ticks which absorbs a frame captured slightly after the estimate, e.g. due to rounding.
+    static constexpr std::uint32_t k_margin = 256;
+
+    /**
+     * Restarts the extension with a new tick length.
+     *
+     * @param cycles_per_tick the number of cycle counter increments per CAN bit time
+     */
+    void reset(std::uint32_t cycles_per_tick);
+
+    /**
+     * Extends a captured time stamp.
+     *
+     * @param time the 16-bit time stamp from CAN_RDTxR or CAN_TDTxR
+     * @param cycles the value of the cycle counter when the time stamp was read
+     * @return the extended time stamp in bit times
+     */
+    std::uint32_t extend(std::uint16_t time, std::uint32_t cycles);
+
+    /**
+     * Estimates the current value of the CAN timer. Only meaningful once a time stamp has been extended.
+     *
+     * @param cycles the current value of the cycle counter
+     * @return the estimated time in bit times
+     */
+    std::uint32_t estimate(std::uint32_t cycles) const {
+        return m_reference_ticks + (cycles - m_reference_cycles) / m_cycles_per_tick;
+    }
+};
+
+} // namespace can
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace can {
+
+/// A struct which represents a bxCAN bit timing configuration. All segment lengths are in time quanta.
+struct BitTiming {
+    /// Peripheral clock prescaler in the range [1, 1024].
+    std::uint16_t prescaler;
+
+    /// Time segment 1 (propagation and phase segment 1) in the range [1, 16].
+    std::uint8_t time_segment_1;
+
+    /// Time segment 2 (phase segment 2) in the range [1, 8].
+    std::uint8_t time_segment_2;
+
+    /// Resynchronisation jump width in the range [1, 4].
+    std::uint8_t sync_jump_width;
+
+    bool operator==(const BitTiming &) const = default;
+
+    /**
+     * @return the number of time quanta per bit, including the synchronisation segment
+     */
+    constexpr std::uint32_t quanta_per_bit() const { return 1u + time_segment_1 + time_segment_2; }
+
+    /**
+     * @return the sample point as a fraction of the bit time in tenths of a percent
+     */
+    constexpr std::uint32_t sample_point() const { return (1u + time_segment_1) * 1000u / quanta_per_bit(); }
+
+    /**
+     * @param clock the peripheral clock frequency in Hz
+     * @return the resulting bitrate in bit/s
+     */
+    constexpr std::uint32_t bitrate(std::uint32_t clock) const { return clock / (prescaler * quanta_per_bit()); }
+
+    /**
+     * @return the value of the CAN_BTR register for this configuration
+     */
+    constexpr std::uint32_t btr() const {
+        return ((sync_jump_width - 1u) << 24u) | ((time_segment_2 - 1u) << 20u) | ((time_segment_1 - 1u) << 16u) |
+               (prescaler - 1u);
+    }
+};
+
+/**
+ * Computes a bit timing configuration for the given peripheral clock and bitrate. Among all prescalers which give a
+ * bitrate within 0.1% of the requested one, the configuration with the sample point closest to the target is chosen,
+ * preferring more time quanta per bit on a tie.
+ *
+ * @param clock the peripheral clock frequency in Hz
+ * @param bitrate the desired bitrate in bit/s
+ * @param sample_point the desired sample point in tenths of a percent, e.g. 875 for 87.5%
+ * @param sync_jump_width the resynchronisation jump width in time quanta; must be in the range [1, 4]
+ * @return the bit timing configuration, or std::nullopt if the combination is impossible
+ */
+constexpr std::optional<BitTiming> compute_bit_timing(std::uint32_t clock, std::uint32_t bitrate,
+                                                      std::uint32_t sample_point, std::uint8_t sync_jump_width = 1) {
+    if (bitrate == 0 || sync_jump_width < 1 || sync_jump_width > 4) {
+        return std::nullopt;
+    }
+
+    std::optional<BitTiming> best;
+    std::uint32_t best_error = UINT32_MAX;
+    for (std::uint32_t quanta = 25; quanta >= 4; quanta--) {
+        // Pick the nearest prescaler and check that the resulting bitrate is within tolerance.
+        const auto quanta_rate = static_cast<std::uint64_t>(bitrate) * quanta;
+        const auto prescaler = (clock + quanta_rate / 2) / quanta_rate;
+        if (prescaler < 1 || prescaler > 1024) {
+            continue;
+        }
+        const auto actual_rate = prescaler * quanta_rate;
+        const auto rate_error = actual_rate > clock ? actual_rate - clock : clock - actual_rate;
+        if (rate_error * 1000 > clock) {
+            continue;
+        }
+
+        // Place the sample point as close to the target as the segment limits allow.
+        const auto ideal_segment_1 = static_cast<std::int32_t>((sample_point * quanta + 500) / 1000) - 1;
+        const auto max_segment_1 = static_cast<std::int32_t>(quanta) - 1 - sync_jump_width;
+        const auto min_segment_1 = static_cast<std::int32_t>(quanta) - 1 - 8;
+        auto segment_1 = ideal_segment_1 > max_segment_1 ? max_segment_1 : ideal_segment_1;
+        segment_1 = segment_1 < min_segment_1 ? min_segment_1 : segment_1;
+        segment_1 = segment_1 > 16 ? 16 : segment_1;
+        const auto segment_2 = static_cast<std::int32_t>(quanta) - 1 - segment_1;
+        if (segment_1 < 1 || segment_2 < sync_jump_width || segment_2 > 8) {
+            continue;
+        }
+
+        const BitTiming timing{
+            .prescaler = static_cast<std::uint16_t>(prescaler),
+            .time_segment_1 = static_cast<std::uint8_t>(segment_1),
+            .time_segment_2 = static_cast<std::uint8_t>(segment_2),
+            .sync_jump_width = sync_jump_width,
+        };
+        const auto actual_sample_point = timing.sample_point();
+        const auto error = actual_sample_point > sample_point ? actual_sample_point - sample_point
+                                                              : sample_point - actual_sample_point;
+        if (error < best_error) {
+            best = timing;
+            best_error = error;
+        }
+    }
+    return best;
+}
+
+/**
+ * Computes a bit timing configuration at compile time, failing compilation if the combination is impossible.
+ */
+template <std::uint32_t Clock, std::uint32_t Bitrate, std::uint32_t SamplePoint = 875, std::uint8_t SyncJumpWidth = 1>
+consteval BitTiming make_bit_timing() {
+    constexpr auto timing = compute_bit_timing(Clock, Bitrate, SamplePoint, SyncJumpWidth);
+    static_assert(timing.has_value(), "Impossible CAN bit timing for the given clock and bitrate");
+    return *timing;
+}
+
+/**
+ * @return the nominal bitrate in bit/s of the given bus speed
+ */
+constexpr std::uint32_t bitrate(Speed speed) {
+    switch (speed) {
+    case Speed::_10:
+        return 10'000;
+    case Speed::_20:
+        return 20'000;
+    case Speed::_33_3:
+        return 33'333;
+    case Speed::_50:
+        return 50'000;
+    case Speed::_100:
+        return 100'000;
+    case Speed::_125:
+        return 125'000;
+    case Speed::_250:
+        return 250'000;
+    case Speed::_500:
+        return 500'000;
+    case Speed::_800:
+        return 800'000;
+    case Speed::_1000:
+        return 1'000'000;
+    }
+    return 0;
+}
+
+/**
+ * @return the target sample point in tenths of a percent used for the given bus speed
+ */
+constexpr std::uint32_t sample_point(Speed speed) {
+    switch (speed) {
+    case Speed::_33_3:
+        // Matches the original hand-picked 12+2+1 configuration.
+        return 867;
+    case Speed::_500:
+    case Speed::_1000:
+        // Matches the original hand-picked 11+2+1 configuration.
+        return 857;
+    default:
+        // CiA recommended sample point.
+        return 875;
+    }
+}
+
+/**
+ * Computes the bit timing configuration for every bus speed at the given peripheral clock.
+ *
+ * @param clock the peripheral clock frequency in Hz
+ * @return an array indexed by Speed; an entry is std::nullopt if that speed is not achievable
+ */
+constexpr std::array<std::optional<BitTiming>, k_speed_count> timing_table(std::uint32_t clock) {
+    std::array<std::optional<BitTiming>, k_speed_count> table{};
+    for (std::size_t i = 0; i < table.size(); i++) {
+        const auto speed = static_cast<Speed>(i);
+        table[i] = compute_bit_timing(clock, bitrate(speed), sample_point(speed));
+    }
+    return table;
+}
+
+} // namespace can
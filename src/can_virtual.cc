@@ -0,0 +1,472 @@
+#include <can_virtual.hh>
+
+#include <can.hh>
+#include <can_filter.hh>
+#include <can_health.hh>
+#include <can_load.hh>
+#include <can_queue.hh>
+#include <can_timing.hh>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace can {
+namespace {
+
+VirtualNode *s_selected = nullptr;
+
+VirtualNode &selected() {
+    return *s_selected;
+}
+
+// Selects a node for the duration of a callback, restoring the previous selection afterwards.
+class Selection {
+    VirtualNode *m_previous;
+
+public:
+    explicit Selection(VirtualNode *node) : m_previous(std::exchange(s_selected, node)) {}
+    Selection(const Selection &) = delete;
+    Selection(Selection &&) = delete;
+    ~Selection() { s_selected = m_previous; }
+
+    Selection &operator=(const Selection &) = delete;
+    Selection &operator=(Selection &&) = delete;
+};
+
+RawMessage to_raw_message(const Message &message) {
+    return RawMessage::from_message(message);
+}
+
+const RawMessage &to_raw_message(const RawMessage &message) {
+    return message;
+}
+
+} // namespace
+
+VirtualNode::VirtualNode(VirtualBus &bus) : m_bus(bus) {
+    m_bus.m_nodes.push_back(this);
+}
+
+VirtualNode::~VirtualNode() {
+    std::erase(m_bus.m_nodes, this);
+    if (s_selected == this) {
+        s_selected = nullptr;
+    }
+}
+
+void VirtualNode::select() {
+    s_selected = this;
+}
+
+VirtualNode *VirtualNode::selected() {
+    return s_selected;
+}
+
+std::optional<std::size_t> VirtualNode::next_mailbox() const {
+    // With transmit FIFO priority the oldest request goes first; otherwise the lowest identifier, then the lowest
+    // mailbox number.
+    std::optional<std::size_t> next;
+    for (std::size_t i = 0; i < m_mailboxes.size(); i++) {
+        const auto &mailbox = m_mailboxes[i];
+        if (!mailbox.pending) {
+            continue;
+        }
+        if (!next) {
+            next = i;
+            continue;
+        }
+        const auto &best = m_mailboxes[*next];
+        if (m_ordered ? mailbox.request_order < best.request_order
+                      : arbitration_key(mailbox.message) < arbitration_key(best.message)) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+void VirtualNode::fill_mailbox(std::size_t index, const RawMessage &message) {
+    auto &mailbox = m_mailboxes[index];
+    mailbox.message = message;
+    mailbox.request_order = m_request_counter++;
+    mailbox.sequence++;
+    mailbox.pending = true;
+    mailbox.sent = false;
+}
+
+void VirtualNode::refill_mailboxes() {
+    const auto count = m_reserve_mailbox ? m_mailboxes.size() - 1 : m_mailboxes.size();
+    for (std::size_t i = 0; i < count && !m_tx_queue.empty(); i++) {
+        if (!m_mailboxes[i].pending) {
+            fill_mailbox(i, m_tx_queue.pop());
+        }
+    }
+}
+
+void VirtualNode::complete_mailbox(std::size_t index, std::uint64_t bus_time) {
+    auto &mailbox = m_mailboxes[index];
+    mailbox.pending = false;
+    mailbox.sent = true;
+    m_statistics.tx_count++;
+    m_load_meter.record(mailbox.message.id_word, mailbox.message.length, LoadSource::Transmit);
+    if (m_tx_callback != nullptr) {
+        Selection selection(this);
+        m_tx_callback(mailbox.message, m_timestamps ? local_time(bus_time) : 0u);
+    }
+}
+
+void VirtualNode::receive(const RawMessage &message, std::uint64_t bus_time) {
+    // Inactive banks are left out, which keeps the relative order of the active ones for the priority rules.
+    FilterPlan active{};
+    for (std::size_t i = 0; i < m_filters.banks.size(); i++) {
+        if ((m_active_filters & (1u << i)) != 0u) {
+            active.banks[active.bank_count++] = m_filters.banks[i];
+        }
+    }
+    const auto id = message.is_extended() ? message.extended_id() : static_cast<std::uint32_t>(message.standard_id());
+    const auto index = active.route(message.is_extended(), id);
+    if (!index) {
+        return;
+    }
+
+    m_statistics.rx_count++;
+    m_load_meter.record(message.id_word, message.length, static_cast<LoadSource>(*index));
+    auto &fifo = m_fifos[*index];
+    const Frame frame{message, m_timestamps ? local_time(bus_time) : 0u};
+    if (fifo.size == fifo.frames.size()) {
+        // Without FIFO lock mode, the last message in the FIFO is overwritten by the new one.
+        fifo.frames.back() = frame;
+        m_statistics.overrun_count[*index]++;
+    } else {
+        fifo.frames[fifo.size++] = frame;
+    }
+}
+
+void VirtualNode::dispatch(std::uint8_t index, const Frame &frame) {
+    Selection selection(this);
+    const auto &fifo = m_fifos[index];
+    if (fifo.raw_callback != nullptr) {
+        fifo.raw_callback(frame.message, frame.timestamp);
+    } else if (fifo.callback != nullptr) {
+        fifo.callback(frame.message.to_message());
+    }
+}
+
+std::uint32_t VirtualNode::local_time(std::uint64_t bus_time) const {
+    const auto drift = std::llround(static_cast<double>(bus_time) * m_clock_drift / 1e6);
+    return static_cast<std::uint32_t>(static_cast<std::int64_t>(bus_time) + drift + m_clock_offset);
+}
+
+void VirtualNode::set_interrupts_enabled(bool enabled) {
+    m_interrupts_enabled = enabled;
+    if (enabled) {
+        service_interrupts();
+    }
+}
+
+void VirtualNode::service_interrupts() {
+    for (std::uint8_t index = 0; index < m_fifos.size(); index++) {
+        auto &fifo = m_fifos[index];
+        while (fifo.size != 0) {
+            const auto frame = fifo.frames[0];
+            std::shift_left(fifo.frames.begin(), fifo.frames.end(), 1);
+            fifo.size--;
+            if (!fifo.deferred) {
+                dispatch(index, frame);
+            } else if (!m_rx_rings[index].push(frame)) {
+                m_statistics.ring_full_count[index]++;
+            }
+        }
+    }
+    refill_mailboxes();
+}
+
+bool VirtualNode::init(std::uint32_t bitrate, const InitOptions &options) {
+    // A node with the wrong bit rate would only cause errors, so treat it as failing to synchronise.
+    m_online = bitrate == m_bus.bitrate();
+    if (!m_online) {
+        return false;
+    }
+    m_ordered = options.ordered;
+    m_timestamps = options.timestamps;
+    m_reserve_mailbox = options.reserve_mailbox;
+    m_tx_queue.set_ordered(options.ordered);
+    m_load_meter.reset(bitrate, m_bus.now());
+    return true;
+}
+
+void VirtualNode::route_filter(std::uint8_t filter, std::uint8_t fifo, std::uint32_t mask, std::uint32_t value) {
+    m_filters.banks[filter] = {
+        .fifo = fifo,
+        .mode = FilterMode::Mask,
+        .scale = FilterScale::Single32,
+        .fr1 = value,
+        .fr2 = mask,
+    };
+    m_active_filters |= 1u << filter;
+}
+
+void VirtualNode::apply_filters(const FilterPlan &plan) {
+    m_filters = plan;
+    m_active_filters = 0;
+    for (std::size_t i = 0; i < plan.bank_count && i < plan.banks.size(); i++) {
+        m_active_filters |= 1u << i;
+    }
+}
+
+void VirtualNode::set_fifo_callback(std::uint8_t index, fifo_callback_t callback) {
+    m_fifos[index].raw_callback = nullptr;
+    m_fifos[index].callback = callback;
+}
+
+void VirtualNode::set_fifo_callback(std::uint8_t index, raw_fifo_callback_t callback) {
+    m_fifos[index].callback = nullptr;
+    m_fifos[index].raw_callback = callback;
+}
+
+std::size_t VirtualNode::drain_fifo(std::uint8_t index, std::size_t max_count) {
+    std::size_t count = 0;
+    Frame frame;
+    while (count < max_count && m_rx_rings[index].pop(frame)) {
+        dispatch(index, frame);
+        count++;
+    }
+    return count;
+}
+
+RxStatistics VirtualNode::rx_statistics(std::uint8_t index) const {
+    return {
+        .overrun_count = static_cast<std::uint16_t>(m_statistics.overrun_count[index]),
+        .ring_full_count = m_statistics.ring_full_count[index],
+        .ring_depth = static_cast<std::uint16_t>(m_rx_rings[index].size()),
+        .max_isr_cycles = 0,
+    };
+}
+
+bool VirtualNode::transmit(const RawMessage &message) {
+    const bool queued = m_tx_queue.push(message);
+    refill_mailboxes();
+    return queued;
+}
+
+template <typename T>
+std::size_t VirtualNode::transmit_batch(std::span<const T> messages) {
+    // As on the hardware, a batch only takes free queue slots so that it can't evict its own messages.
+    std::size_t count = 0;
+    for (; count < messages.size() && m_tx_queue.free_count() != 0; count++) {
+        transmit(to_raw_message(messages[count]));
+    }
+    return count;
+}
+
+std::size_t VirtualNode::transmit(std::span<const Message> messages) {
+    return transmit_batch(messages);
+}
+
+std::size_t VirtualNode::transmit(std::span<const RawMessage> messages) {
+    return transmit_batch(messages);
+}
+
+TxStatistics VirtualNode::tx_statistics() const {
+    return {
+        .queue_depth = static_cast<std::uint16_t>(m_tx_queue.size()),
+        .high_water_mark = static_cast<std::uint16_t>(m_tx_queue.high_water_mark()),
+        .drop_count = m_tx_queue.drop_count(),
+    };
+}
+
+std::optional<MailboxTicket> VirtualNode::transmit_mailbox(const RawMessage &message) {
+    // As on the hardware, the highest free mailbox is taken, which is the reserved one if it is free.
+    const auto free = std::ranges::find(m_mailboxes.rbegin(), m_mailboxes.rend(), false, &Mailbox::pending);
+    if (free == m_mailboxes.rend()) {
+        return std::nullopt;
+    }
+    const auto index = static_cast<std::size_t>(m_mailboxes.rend() - free) - 1;
+    fill_mailbox(index, message);
+    return MailboxTicket{static_cast<std::uint8_t>(index), m_mailboxes[index].sequence};
+}
+
+MailboxStatus VirtualNode::mailbox_status(const MailboxTicket &ticket) const {
+    // As on the hardware, the outcome is lost once the mailbox is refilled, and the message is then reported as sent.
+    const auto &mailbox = m_mailboxes[ticket.mailbox];
+    if (mailbox.sequence != ticket.sequence || mailbox.sent) {
+        return MailboxStatus::Sent;
+    }
+    return mailbox.pending ? MailboxStatus::Pending : MailboxStatus::Aborted;
+}
+
+MailboxStatus VirtualNode::abort_mailbox(const MailboxTicket &ticket) {
+    // Frames are sent atomically between bus steps, so a pending request can always be aborted at once.
+    auto &mailbox = m_mailboxes[ticket.mailbox];
+    if (mailbox.sequence == ticket.sequence) {
+        mailbox.pending = false;
+    }
+    return mailbox_status(ticket);
+}
+
+HealthStatistics VirtualNode::health_statistics() const {
+    // Bus errors aren't simulated, so the node is always error active.
+    HealthStatistics statistics{};
+    statistics.state = ErrorState::Active;
+    for (std::size_t i = 0; i < statistics.fifo_overrun_count.size(); i++) {
+        statistics.fifo_overrun_count[i] = static_cast<std::uint16_t>(m_statistics.overrun_count[i]);
+    }
+    return statistics;
+}
+
+bool VirtualBus::step() {
+    // Find the pending frame with the lowest arbitration key across all online nodes.
+    VirtualNode *sender = nullptr;
+    std::size_t sender_mailbox = 0;
+    std::size_t online_count = 0;
+    for (auto *node : m_nodes) {
+        if (!node->is_online()) {
+            continue;
+        }
+        online_count++;
+        const auto mailbox = node->next_mailbox();
+        if (mailbox && (sender == nullptr || arbitration_key(node->m_mailboxes[*mailbox].message) <
+                                                 arbitration_key(sender->m_mailboxes[sender_mailbox].message))) {
+            sender = node;
+            sender_mailbox = *mailbox;
+        }
+    }
+
+    // Without another node to acknowledge it, the frame would be retransmitted forever.
+    if (sender == nullptr || online_count < 2) {
+        return false;
+    }
+
+    const auto message = sender->m_mailboxes[sender_mailbox].message;
+    const auto start_time = m_time;
+    m_time += frame_bits(message.is_extended(), message.length);
+    m_frame_count++;
+
+    for (auto *node : m_nodes) {
+        if (node != sender && node->is_online()) {
+            node->receive(message, start_time);
+            if (node->m_interrupts_enabled) {
+                node->service_interrupts();
+            }
+        }
+    }
+    sender->complete_mailbox(sender_mailbox, start_time);
+    if (sender->m_interrupts_enabled) {
+        sender->service_interrupts();
+    }
+    return true;
+}
+
+std::size_t VirtualBus::run(std::size_t max_count) {
+    std::size_t count = 0;
+    while (count < max_count && step()) {
+        count++;
+    }
+    return count;
+}
+
+// The can.hh API, acting on the selected node.
+
+bool init(Port, Speed speed, const InitOptions &options) {
+    return selected().init(bitrate(speed), options);
+}
+
+bool init(Port, const BitTiming &timing, const InitOptions &options) {
+    return selected().init(timing.bitrate(k_virtual_apb1_clock), options);
+}
+
+void route_filter(std::uint8_t filter, std::uint8_t fifo, std::uint32_t mask, std::uint32_t value) {
+    selected().route_filter(filter, fifo, mask, value);
+}
+
+void apply_filters(const FilterPlan &plan) {
+    selected().apply_filters(plan);
+}
+
+void set_fifo_callback(std::uint8_t index, fifo_callback_t callback) {
+    selected().set_fifo_callback(index, callback);
+}
+
+void set_fifo_callback(std::uint8_t index, raw_fifo_callback_t callback) {
+    selected().set_fifo_callback(index, callback);
+}
+
+void set_tx_callback(tx_callback_t callback) {
+    selected().set_tx_callback(callback);
+}
+
+std::uint64_t timestamp_to_us(std::uint32_t timestamp) {
+    return static_cast<std::uint64_t>(timestamp) * 1'000'000u / selected().bus().bitrate();
+}
+
+std::uint32_t timestamp_now() {
+    return selected().local_time(selected().bus().time());
+}
+
+void set_fifo_deferred(std::uint8_t index, bool deferred) {
+    selected().set_fifo_deferred(index, deferred);
+}
+
+std::size_t drain_fifo(std::uint8_t index, std::size_t max_count) {
+    return selected().drain_fifo(index, max_count);
+}
+
+RxStatistics rx_statistics(std::uint8_t index) {
+    return selected().rx_statistics(index);
+}
+
+bool transmit(const Message &message) {
+    return selected().transmit(RawMessage::from_message(message));
+}
+
+bool transmit(const RawMessage &message) {
+    return selected().transmit(message);
+}
+
+std::size_t transmit(std::span<const Message> messages) {
+    return selected().transmit(messages);
+}
+
+std::size_t transmit(std::span<const RawMessage> messages) {
+    return selected().transmit(messages);
+}
+
+TxStatistics tx_statistics() {
+    return selected().tx_statistics();
+}
+
+void update_bus_load(std::uint32_t now) {
+    selected().update_bus_load(now);
+}
+
+BusLoadStatistics bus_load_statistics() {
+    return selected().bus_load_statistics();
+}
+
+std::optional<MailboxTicket> transmit_mailbox(const RawMessage &message) {
+    return selected().transmit_mailbox(message);
+}
+
+MailboxStatus mailbox_status(const MailboxTicket &ticket) {
+    return selected().mailbox_status(ticket);
+}
+
+MailboxStatus abort_mailbox(const MailboxTicket &ticket) {
+    return selected().abort_mailbox(ticket);
+}
+
+void set_bus_off_policy(const BusOffPolicy &) {}
+
+bool poll_bus_off_recovery(std::uint32_t) {
+    return false;
+}
+
+HealthStatistics health_statistics() {
+    return selected().health_statistics();
+}
+
+} // namespace can
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <can.hh>
+#include <can_filter.hh>
+#include <can_health.hh>
+#include <can_load.hh>
+#include <can_queue.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace can {
+
+/// Number of transmit mailboxes of the bxCAN peripheral.
+constexpr std::size_t k_virtual_mailbox_count = 3;
+
+/// Number of messages each bxCAN receive FIFO can hold.
+constexpr std::size_t k_virtual_fifo_depth = 3;
+
+/// APB1 clock used to convert a BitTiming into a bit rate. Matches hal::k_apb1_clock, which can't be included here.
+constexpr std::uint32_t k_virtual_apb1_clock = 28'000'000;
+
+/// Counters of a single virtual node.
+struct VirtualNodeStatistics {
+    /// Frames which won arbitration and were sent.
+    std::uint32_t tx_count;
+
+    /// Frames accepted by the filters into either FIFO, including ones later lost to an overrun.
+    std::uint32_t rx_count;
+
+    /// Frames lost because a FIFO was full, per FIFO.
+    std::array<std::uint32_t, 2> overrun_count;
+
+    /// Frames lost because the deferred ring of a FIFO was full, per FIFO.
+    std::array<std::uint32_t, 2> ring_full_count;
+};
+
+class VirtualBus;
+
+/**
+ * A class which simulates one bxCAN peripheral attached to a VirtualBus. The free functions declared in can.hh act on
+ * the selected node, and callbacks run with their own node selected, so firmware code can be run unchanged with several
+ * nodes in one process. The node models the three transmit mailboxes, the software transmit queue, the acceptance
+ * filters, and the two three-deep receive FIFOs. Interrupt handlers run right after each frame unless interrupts are
+ * disabled, which allows a busy CPU and FIFO overruns to be simulated.
+ */
+class VirtualNode {
+    friend class VirtualBus;
+
+    struct Mailbox {
+        RawMessage message;
+        std::uint32_t request_order;
+        std::uint32_t sequence;
+        bool pending;
+
+        /// Whether the message was sent rather than aborted, once it is no longer pending.
+        bool sent;
+    };
+
+    /// A received message with the local time stamp of its start of frame, as held by a FIFO mailbox.
+    struct Frame {
+        RawMessage message;
+        std::uint32_t timestamp;
+    };
+
+    struct Fifo {
+        std::array<Frame, k_virtual_fifo_depth> frames;
+        std::size_t size;
+        fifo_callback_t callback;
+        raw_fifo_callback_t raw_callback;
+        bool deferred;
+    };
+
+    VirtualBus &m_bus;
+    bool m_online{false};
+    bool m_ordered{false};
+    bool m_timestamps{false};
+    bool m_reserve_mailbox{false};
+    bool m_interrupts_enabled{true};
+    FilterPlan m_filters{};
+    std::uint32_t m_active_filters{0};
+    std::array<Mailbox, k_virtual_mailbox_count> m_mailboxes{};
+    std::uint32_t m_request_counter{0};
+    TxQueue<16> m_tx_queue;
+    tx_callback_t m_tx_callback{nullptr};
+    std::array<Fifo, 2> m_fifos{};
+    std::array<util::SpscRing<Frame, 16>, 2> m_rx_rings;
+    LoadMeter m_load_meter{0};
+    VirtualNodeStatistics m_statistics{};
+    std::int64_t m_clock_offset{0};
+    double m_clock_drift{0.0};
+
+    std::optional<std::size_t> next_mailbox() const;
+    void fill_mailbox(std::size_t index, const RawMessage &message);
+    void refill_mailboxes();
+    void complete_mailbox(std::size_t index, std::uint64_t bus_time);
+    void receive(const RawMessage &message, std::uint64_t bus_time);
+    void dispatch(std::uint8_t index, const Frame &frame);
+
+    template <typename T>
+    std::size_t transmit_batch(std::span<const T> messages);
+
+public:
+    explicit VirtualNode(VirtualBus &bus);
+    VirtualNode(const VirtualNode &) = delete;
+    VirtualNode(VirtualNode &&) = delete;
+    ~VirtualNode();
+
+    VirtualNode &operator=(const VirtualNode &) = delete;
+    VirtualNode &operator=(VirtualNode &&) = delete;
+
+    /**
+     * Makes the free functions declared in can.hh act on this node.
+     */
+    void select();
+
+    /**
+     * @return the node which the free functions declared in can.hh act on, which is the node whose callback is
+     * running during a callback; null if no node has been selected
+     */
+    static VirtualNode *selected();
+
+    /**
+     * Enables or disables the simulated interrupts. While disabled, received frames stay in the hardware FIFOs and
+     * completed mailboxes aren't refilled from the software queue. Enabling runs any pending interrupt handlers.
+     */
+    void set_interrupts_enabled(bool enabled);
+
+    /**
+     * Runs the receive and transmit interrupt handlers once, as if they had become pending.
+     */
+    void service_interrupts();
+
+    /**
+     * Takes the node off the bus, as if the transceiver were disconnected, until init is called again.
+     */
+    void go_offline() { m_online = false; }
+
+    /**
+     * Makes the node's CAN timer run off its own clock rather than the bus time, as a real node's does.
+     *
+     * @param offset the value of the node's timer at bus time zero, in bit times
+     * @param drift_ppm the error of the node's clock in parts per million
+     */
+    void set_clock(std::int64_t offset, double drift_ppm) {
+        m_clock_offset = offset;
+        m_clock_drift = drift_ppm;
+    }
+
+    /**
+     * @return the value of the node's CAN timer at the given bus time
+     */
+    std::uint32_t local_time(std::uint64_t bus_time) const;
+
+    VirtualBus &bus() const { return m_bus; }
+    bool is_online() const { return m_online; }
+    std::size_t fifo_level(std::uint8_t index) const { return m_fifos[index].size; }
+    const VirtualNodeStatistics &statistics() const { return m_statistics; }
+
+    // Implementations of the can.hh API for this node.
+    bool init(std::uint32_t bitrate, const InitOptions &options);
+    void route_filter(std::uint8_t filter, std::uint8_t fifo, std::uint32_t mask, std::uint32_t value);
+    void apply_filters(const FilterPlan &plan);
+    void set_fifo_callback(std::uint8_t index, fifo_callback_t callback);
+    void set_fifo_callback(std::uint8_t index, raw_fifo_callback_t callback);
+    void set_tx_callback(tx_callback_t callback) { m_tx_callback = callback; }
+    void set_fifo_deferred(std::uint8_t index, bool deferred) { m_fifos[index].deferred = deferred; }
+    std::size_t drain_fifo(std::uint8_t index, std::size_t max_count);
+    RxStatistics rx_statistics(std::uint8_t index) const;
+    bool transmit(const RawMessage &message);
+    std::size_t transmit(std::span<const Message> messages);
+    std::size_t transmit(std::span<const RawMessage> messages);
+    TxStatistics tx_statistics() const;
+    void update_bus_load(std::uint32_t now) { m_load_meter.advance(now); }
+    BusLoadStatistics bus_load_statistics() const { return m_load_meter.statistics(); }
+    std::optional<MailboxTicket> transmit_mailbox(const RawMessage &message);
+    MailboxStatus mailbox_status(const MailboxTicket &ticket) const;
+    MailboxStatus abort_mailbox(const MailboxTicket &ticket);
+    HealthStatistics health_statistics() const;
+};
+
+/**
+ * A class which connects virtual nodes and simulates the bus between them one frame at a time. Each frame goes to the
+ * pending mailbox which wins arbitration across all nodes, and is received by every other online node. A frame is only
+ * sent if at least one other node is online to acknowledge it. Bus time is kept in bit times, assuming worst-case bit
+ * stuffing.
+ */
+class VirtualBus {
+    friend class VirtualNode;
+
+    std::uint32_t m_bitrate;
+    std::uint64_t m_time{0};
+    std::uint32_t m_frame_count{0};
+    std::vector<VirtualNode *> m_nodes;
+
+public:
+    /**
+     * @param bitrate the bit rate which nodes must be initialised with to join the bus
+     */
+    explicit VirtualBus(std::uint32_t bitrate) : m_bitrate(bitrate) {}
+
+    /**
+     * Sends the frame which wins arbitration, if any.
+     *
+     * @return true if a frame was sent; false if the bus stayed idle
+     */
+    bool step();
+
+    /**
+     * Sends frames until the bus is idle.
+     *
+     * @param max_count the maximum number of frames to send
+     * @return the number of frames sent
+     */
+    std::size_t run(std::size_t max_count);
+
+    /**
+     * Lets the bus sit idle, e.g. while the nodes' software does something else.
+     *
+     * @param bits the number of bit times to advance by
+     */
+    void idle(std::uint64_t bits) { m_time += bits; }
+
+    /**
+     * Runs the bus one millisecond at a time, as if the nodes' software had a 1 ms tick. Each millisecond, the tick is
+     * called and frames are then sent until the bus is idle or the millisecond is over. The rest of the millisecond is
+     * left idle.
+     *
+     * @param ms the number of milliseconds to run for
+     * @param tick called at the start of each millisecond, e.g. to queue frames
+     */
+    template <std::invocable Tick>
+    void run_for(std::uint32_t ms, Tick &&tick);
+
+    /**
+     * Runs the bus for the given number of milliseconds without a tick.
+     */
+    void run_for(std::uint32_t ms) {
+        run_for(ms, [] {});
+    }
+
+    std::uint32_t bitrate() const { return m_bitrate; }
+    std::uint32_t frame_count() const { return m_frame_count; }
+    std::uint64_t time() const { return m_time; }
+
+    /**
+     * @return the bus time in milliseconds
+     */
+    std::uint32_t now() const { return static_cast<std::uint32_t>(m_time * 1000u / m_bitrate); }
+};
+
+template <std::invocable Tick>
+void VirtualBus::run_for(std::uint32_t ms, Tick &&tick) {
+    const std::uint64_t bits_per_ms = m_bitrate / 1000u;
+    for (std::uint32_t i = 0; i < ms; i++) {
+        tick();
+        const auto end = m_time + bits_per_ms;
+        while (m_time < end && step()) {
+        }
+        m_time = std::max(m_time, end);
+    }
+}
+
+} // namespace can
@@ -1,10 +1,41 @@
 #pragma once
 
+#include <can.hh>
+#include <can_timing.hh>
+
+#include <array>
 #include <cstdint>
 
 namespace config {
 
-constexpr std::uint8_t k_dti_can_id = 0x5;
+// Speed of the vehicle CAN bus, and its bit rate, which is also the tick rate of CAN time stamps.
+constexpr can::Speed k_can_speed = can::Speed::_500;
+constexpr std::uint32_t k_can_bitrate = can::bitrate(k_can_speed);
+
+// Node IDs of the DTI inverters, one per motor.
+constexpr auto k_dti_can_ids = std::to_array<std::uint8_t>({0x5});
+
+// Time in milliseconds after which an unchanged throttle command is sent again. This assumes an inverter command
+// timeout of 1000 ms, as in the DTI manual's example, which recommends sending at least four times per timeout.
+constexpr std::uint32_t k_dti_keepalive_period = 250;
+
+// Node IDs, as used by the bootloaders and in the heartbeat identifiers.
+constexpr std::uint8_t k_apps_node_id = 1;
+constexpr std::uint8_t k_bms_master_node_id = 2;
+
+// Time between heartbeats in milliseconds, and the time without one after which a node is considered dead.
+constexpr std::uint32_t k_heartbeat_period = 100;
+constexpr std::uint32_t k_heartbeat_timeout = 350;
+
+// Standard identifier of the APPS board's periodic CAN health report.
+constexpr std::uint16_t k_apps_health_report_id = 0x7f0;
+
+// Standard identifier of the APPS board's periodic bus load report.
+constexpr std::uint16_t k_apps_load_report_id = 0x7f1;
+
+// Standard identifiers of the APPS board's XCP commands, and of its XCP responses and DAQ frames.
+constexpr std::uint16_t k_apps_xcp_command_id = 0x6e0;
+constexpr std::uint16_t k_apps_xcp_response_id = 0x6e1;
 
 // RPM to ERPM conversion factor. Emrax 228 has 10 motor pole pairs.
 constexpr std::uint8_t k_erpm_factor = 10;
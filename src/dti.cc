@@ -3,100 +3,102 @@
 #include <can.hh>
 #include <util.hh>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 
 namespace dti {
+
 namespace {
 
-// Messages from the inverter.
-constexpr std::uint32_t k_general_data_1_id = 0x20;
-constexpr std::uint32_t k_general_data_2_id = 0x21;
-constexpr std::uint32_t k_general_data_3_id = 0x22;
-constexpr std::uint32_t k_general_data_5_id = 0x24;
+template <typename Codec>
+can::Message build(std::uint8_t node_id, auto value) {
+    return can::build_extended(packet_identifier(Codec::k_id, node_id), Codec::encode(value));
+}
+
+struct PacketDecoder {
+    // Minimum length of the message, or zero if the packet ID is unused.
+    std::uint8_t length;
+    Packet (*decode)(std::span<const std::uint8_t, 8> data);
+};
+
+template <typename Codec>
+Packet decode(std::span<const std::uint8_t, 8> data) {
+    return Codec::decode(data);
+}
+
+// A table of decoders indexed by packet ID, offset by the lowest packet ID.
+template <typename... Codecs>
+struct DecoderTable {
+    static constexpr std::uint32_t k_first_id = std::min({Codecs::k_id...});
+    static constexpr std::uint32_t k_last_id = std::max({Codecs::k_id...});
+
+    static constexpr auto k_decoders = [] {
+        std::array<PacketDecoder, k_last_id - k_first_id + 1> decoders{};
+        ((decoders[Codecs::k_id - k_first_id] = {Codecs::k_length, &decode<Codecs>}), ...);
+        return decoders;
+    }();
+
+    static constexpr const PacketDecoder *find(std::uint32_t packet_id) {
+        const auto index = packet_id - k_first_id;
+        if (index >= k_decoders.size() || k_decoders[index].length == 0) {
+            return nullptr;
+        }
+        return &k_decoders[index];
+    }
+};
+
+using StatusDecoders =
+    DecoderTable<GeneralData1Codec, GeneralData2Codec, GeneralData3Codec, GeneralData4Codec, GeneralData5Codec>;
 
 } // namespace
 
 can::Message build_set_current(std::uint8_t node_id, std::int16_t current) {
-    current = util::clamp(current, -10000, 10000);
-    return can::build_extended((0x01u << 8u) | node_id, util::write_be(current));
+    return build<SetCurrentCodec>(node_id, util::clamp(current, -10000, 10000));
 }
 
 can::Message build_set_brake_current(std::uint8_t node_id, std::uint16_t current) {
-    current = util::clamp(current, 0, 10000);
-    return can::build_extended((0x02u << 8u) | node_id, util::write_be(current));
+    return build<SetBrakeCurrentCodec>(node_id, util::clamp(current, 0, 10000));
 }
 
 can::Message build_set_erpm(std::uint8_t node_id, std::int32_t erpm) {
-    return can::build_extended((0x03u << 8u) | node_id, util::write_be(erpm));
+    return build<SetErpmCodec>(node_id, erpm);
 }
 
 can::Message build_set_position(std::uint8_t node_id, std::int16_t position) {
-    return can::build_extended((0x04u << 8u) | node_id, util::write_be(position));
+    return build<SetPositionCodec>(node_id, position);
 }
 
 can::Message build_set_relative_current(std::uint8_t node_id, std::int16_t percentage) {
-    percentage = util::clamp(percentage, -1000, 1000);
-    return can::build_extended((0x05u << 8u) | node_id, util::write_be(percentage));
+    return build<SetRelativeCurrentCodec>(node_id, util::clamp(percentage, -1000, 1000));
 }
 
 can::Message build_set_relative_brake_current(std::uint8_t node_id, std::uint16_t percentage) {
-    percentage = util::clamp(percentage, 0, 1000);
-    return can::build_extended((0x06u << 8u) | node_id, util::write_be(percentage));
+    return build<SetRelativeBrakeCurrentCodec>(node_id, util::clamp(percentage, 0, 1000));
 }
 
 can::Message build_set_drive_enabled(std::uint8_t node_id, bool drive_enabled) {
-    std::array<std::uint8_t, 1> data{static_cast<std::uint8_t>(drive_enabled ? 1 : 0)};
-    return can::build_extended((0x0cu << 8u) | node_id, data);
+    return build<SetDriveEnabledCodec>(node_id, drive_enabled);
 }
 
 Packet parse_packet(const can::Message &message) {
-    // Extract packet ID (upper 21 bits) from extended CAN ID.
-    const auto packet_id = (message.extended_id() >> 8u) & 0x1fffffu;
-    std::span<const std::uint8_t> span = message.data;
-
-    // TODO: Should probably check message.length.
-    switch (packet_id) {
-    case k_general_data_1_id:
-        return GeneralData1{
-            .erpm = util::read_be<std::int32_t>(span.subspan<0, 4>()),
-            .duty_cycle = util::read_be<std::int16_t>(span.subspan<4, 2>()),
-            .input_voltage = util::read_be<std::int16_t>(span.subspan<6, 2>()),
-        };
-    case k_general_data_2_id:
-        return GeneralData2{
-            .ac_current = util::read_be<std::int16_t>(span.subspan<0, 2>()),
-            .dc_current = util::read_be<std::int16_t>(span.subspan<2, 2>()),
-        };
-    case k_general_data_3_id:
-        return GeneralData3{
-            .controller_temperature = util::read_be<std::int16_t>(span.subspan<0, 2>()),
-            .motor_temperature = util::read_be<std::int16_t>(span.subspan<2, 2>()),
-            .fault_code = static_cast<FaultCode>(span[4]),
+    const auto packet_id = identifier_packet_id(message.extended_id());
+
+    const auto *decoder = StatusDecoders::find(packet_id);
+    if (decoder == nullptr) {
+        return UnknownMessageType{
+            .packet_id = packet_id,
         };
-    case k_general_data_5_id:
-        return GeneralData5{
-            .throttle = static_cast<std::int8_t>(span[0]),
-            .brake = static_cast<std::int8_t>(span[1]),
-            .digital_pin_state = span[2],
-            .drive_enabled = span[3] != 0u,
-            .capacitor_temperature_limit_active = ((span[4] >> 0u) & 1u) != 0u,
-            .dc_current_limit_active = ((span[4] >> 1u) & 1u) != 0u,
-            .drive_enable_limit_active = ((span[4] >> 2u) & 1u) != 0u,
-            .igbt_acceleration_limit_active = ((span[4] >> 3u) & 1u) != 0u,
-            .igbt_temperature_limit_active = ((span[4] >> 4u) & 1u) != 0u,
-            .input_voltage_limit_active = ((span[4] >> 5u) & 1u) != 0u,
-            .motor_acceleration_temperature_limit_active = ((span[4] >> 6u) & 1u) != 0u,
-            .motor_temperature_limit_active = ((span[4] >> 7u) & 1u) != 0u,
-            .rpm_min_limit_active = ((span[5] >> 0u) & 1u) != 0u,
-            .rpm_max_limit_active = ((span[5] >> 1u) & 1u) != 0u,
-            .power_limit_active = ((span[5] >> 2u) & 1u) != 0u,
-            .can_map_version = span[7],
+    }
+    if (message.length < decoder->length) {
+        return InvalidLength{
+            .packet_id = packet_id,
+            .length = message.length,
         };
     }
-
-    return UnknownMessageType{
-        .packet_id = packet_id,
-    };
+    return decoder->decode(message.data);
 }
 
 } // namespace dti
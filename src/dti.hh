@@ -1,5 +1,7 @@
 #pragma once
 
+#include <can_signal.hh>
+
 #include <cstdint>
 #include <variant>
 
@@ -11,6 +13,52 @@ struct Message;
 
 namespace dti {
 
+// Packet IDs of the status messages broadcast by the inverter.
+constexpr std::uint32_t k_general_data_1_id = 0x20;
+constexpr std::uint32_t k_general_data_2_id = 0x21;
+constexpr std::uint32_t k_general_data_3_id = 0x22;
+constexpr std::uint32_t k_general_data_4_id = 0x23;
+constexpr std::uint32_t k_general_data_5_id = 0x24;
+
+// Packet IDs of the commands accepted by the inverter.
+constexpr std::uint32_t k_set_current_id = 0x01;
+constexpr std::uint32_t k_set_brake_current_id = 0x02;
+constexpr std::uint32_t k_set_erpm_id = 0x03;
+constexpr std::uint32_t k_set_position_id = 0x04;
+constexpr std::uint32_t k_set_relative_current_id = 0x05;
+constexpr std::uint32_t k_set_relative_brake_current_id = 0x06;
+constexpr std::uint32_t k_set_drive_enabled_id = 0x0c;
+
+// Node id to which every inverter on the bus responds.
+constexpr std::uint8_t k_broadcast_node_id = 0xff;
+
+/**
+ * Computes the extended CAN identifier used for the given packet ID by the specified DTI inverter.
+ *
+ * @param packet_id the 21-bit packet ID
+ * @param node_id the inverter's node id on the CAN bus
+ * @return the 29-bit extended identifier
+ */
+constexpr std::uint32_t packet_identifier(std::uint32_t packet_id, std::uint8_t node_id) {
+    return (packet_id << 8u) | node_id;
+}
+
+/**
+ * @param identifier a 29-bit extended identifier used by a DTI inverter
+ * @return the 21-bit packet ID held in the upper bits
+ */
+constexpr std::uint32_t identifier_packet_id(std::uint32_t identifier) {
+    return (identifier >> 8u) & 0x1fffffu;
+}
+
+/**
+ * @param identifier a 29-bit extended identifier used by a DTI inverter
+ * @return the node id of the sending or receiving inverter, held in the lower 8 bits
+ */
+constexpr std::uint8_t identifier_node_id(std::uint32_t identifier) {
+    return static_cast<std::uint8_t>(identifier & 0xffu);
+}
+
 enum class FaultCode : std::uint8_t {
     NoFaults = 0,
     Overvoltage = 1,
@@ -54,6 +102,14 @@ struct GeneralData3 {
     FaultCode fault_code;
 };
 
+struct GeneralData4 {
+    // FOC direct axis current component. 100x scale.
+    std::int32_t d_current;
+
+    // FOC quadrature axis current component. 100x scale.
+    std::int32_t q_current;
+};
+
 struct GeneralData5 {
     // Throttle signal received from analog inputs or CAN2. 1x scale.
     std::int8_t throttle;
@@ -88,7 +144,60 @@ struct UnknownMessageType {
     std::uint32_t packet_id;
 };
 
-using Packet = std::variant<GeneralData1, GeneralData2, GeneralData3, GeneralData5, UnknownMessageType>;
+// A known status message whose length is too short to hold all of its signals.
+struct InvalidLength {
+    std::uint32_t packet_id;
+    std::uint8_t length;
+};
+
+using Packet = std::variant<GeneralData1, GeneralData2, GeneralData3, GeneralData4, GeneralData5, UnknownMessageType,
+                            InvalidLength>;
+
+// Signal layouts of the status messages, in the order of the struct members. Scales give physical units.
+using GeneralData1Codec = can::MessageCodec<k_general_data_1_id, GeneralData1,
+                                            can::big_endian<std::int32_t>(7, 32),
+                                            can::big_endian<std::int16_t>(39, 16, 0.1f),
+                                            can::big_endian<std::int16_t>(55, 16)>;
+using GeneralData2Codec = can::MessageCodec<k_general_data_2_id, GeneralData2,
+                                            can::big_endian<std::int16_t>(7, 16, 0.1f),
+                                            can::big_endian<std::int16_t>(23, 16, 0.1f)>;
+using GeneralData3Codec = can::MessageCodec<k_general_data_3_id, GeneralData3,
+                                            can::big_endian<std::int16_t>(7, 16, 0.1f),
+                                            can::big_endian<std::int16_t>(23, 16, 0.1f),
+                                            can::big_endian<FaultCode>(39, 8)>;
+using GeneralData4Codec = can::MessageCodec<k_general_data_4_id, GeneralData4,
+                                            can::big_endian<std::int32_t>(7, 32, 0.01f),
+                                            can::big_endian<std::int32_t>(39, 32, 0.01f)>;
+using GeneralData5Codec = can::MessageCodec<k_general_data_5_id, GeneralData5,
+                                            can::big_endian<std::int8_t>(7, 8),
+                                            can::big_endian<std::int8_t>(15, 8),
+                                            can::big_endian<std::uint8_t>(23, 8),
+                                            can::big_endian<bool>(31, 8),
+                                            can::little_endian<bool>(32, 1),
+                                            can::little_endian<bool>(33, 1),
+                                            can::little_endian<bool>(34, 1),
+                                            can::little_endian<bool>(35, 1),
+                                            can::little_endian<bool>(36, 1),
+                                            can::little_endian<bool>(37, 1),
+                                            can::little_endian<bool>(38, 1),
+                                            can::little_endian<bool>(39, 1),
+                                            can::little_endian<bool>(40, 1),
+                                            can::little_endian<bool>(41, 1),
+                                            can::little_endian<bool>(42, 1),
+                                            can::big_endian<std::uint8_t>(63, 8)>;
+
+// Signal layouts of the commands.
+using SetCurrentCodec = can::MessageCodec<k_set_current_id, std::int16_t, can::big_endian<std::int16_t>(7, 16, 0.1f)>;
+using SetBrakeCurrentCodec =
+    can::MessageCodec<k_set_brake_current_id, std::uint16_t, can::big_endian<std::uint16_t>(7, 16, 0.1f)>;
+using SetErpmCodec = can::MessageCodec<k_set_erpm_id, std::int32_t, can::big_endian<std::int32_t>(7, 32)>;
+using SetPositionCodec =
+    can::MessageCodec<k_set_position_id, std::int16_t, can::big_endian<std::int16_t>(7, 16, 0.1f)>;
+using SetRelativeCurrentCodec =
+    can::MessageCodec<k_set_relative_current_id, std::int16_t, can::big_endian<std::int16_t>(7, 16, 0.1f)>;
+using SetRelativeBrakeCurrentCodec =
+    can::MessageCodec<k_set_relative_brake_current_id, std::uint16_t, can::big_endian<std::uint16_t>(7, 16, 0.1f)>;
+using SetDriveEnabledCodec = can::MessageCodec<k_set_drive_enabled_id, bool, can::big_endian<bool>(7, 8)>;
 
 /**
  * Builds a CAN message for the specified DTI inverter to set the absolute motor current. The value is in hundreds of
@@ -161,11 +270,13 @@ can::Message build_set_relative_brake_current(std::uint8_t node_id, std::uint16_
 can::Message build_set_drive_enabled(std::uint8_t node_id, bool drive_enabled);
 
 /**
- * Attempts to parse the given CAN message into a DTI status message.
+ * Attempts to parse the given CAN message into a DTI status message. The inverter pads every message to eight bytes,
+ * but shorter messages are accepted as long as they hold all of the signals.
  *
  * @param message the CAN message to parse
  * @return GeneralData if successful
  * @return UnkownMessageType if the packet ID is not known
+ * @return InvalidLength if the message is too short for its packet ID
  */
 Packet parse_packet(const can::Message &message);
 
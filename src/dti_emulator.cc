@@ -0,0 +1,282 @@
+#include <dti_emulator.hh>
+
+#include <can.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+
+namespace dti {
+namespace {
+
+constexpr float k_two_pi = 6.28318531f;
+constexpr float k_step_seconds = static_cast<float>(k_emulator_step) / 1000.0f;
+
+// Drop below a temperature limit at which an overtemperature fault clears.
+constexpr float k_fault_hysteresis = 5.0f;
+
+// CAN map version reported in GeneralData5.
+constexpr std::uint8_t k_can_map_version = 24;
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+// Converts a physical value into the nearest raw value of the given scale, saturating at the range of T.
+template <typename T>
+T to_raw(float value, float scale) {
+    const auto scaled = std::round(static_cast<double>(value) / static_cast<double>(scale));
+    return static_cast<T>(std::clamp(scaled, static_cast<double>(std::numeric_limits<T>::min()),
+                                     static_cast<double>(std::numeric_limits<T>::max())));
+}
+
+template <typename Codec>
+std::optional<float> decode_command(const can::RawMessage &message, float scale) {
+    if (message.length < Codec::k_length) {
+        return std::nullopt;
+    }
+    return static_cast<float>(Codec::decode(message)) * scale;
+}
+
+} // namespace
+
+Emulator::Emulator(const EmulatorConfig &config)
+    : m_config(config), m_state{
+                            .erpm = 0.0f,
+                            .duty_cycle = 0.0f,
+                            .input_voltage = config.battery_voltage,
+                            .ac_current = 0.0f,
+                            .dc_current = 0.0f,
+                            .controller_temperature = config.ambient_temperature,
+                            .motor_temperature = config.ambient_temperature,
+                            .fault_code = FaultCode::NoFaults,
+                            .drive_enabled = !config.require_drive_enable,
+                        } {}
+
+bool Emulator::on_frame(const can::RawMessage &message, std::uint32_t now) {
+    if (message.is_standard() || message.is_remote()) {
+        return false;
+    }
+    const auto node_id = identifier_node_id(message.extended_id());
+    const auto packet_id = identifier_packet_id(message.extended_id());
+    if ((node_id != m_config.node_id && node_id != k_broadcast_node_id) || packet_id >= k_general_data_1_id) {
+        return false;
+    }
+
+    if (packet_id == k_set_drive_enabled_id) {
+        if (message.length < SetDriveEnabledCodec::k_length) {
+            m_statistics.ignored_count++;
+            return true;
+        }
+        m_drive_enable_commanded = SetDriveEnabledCodec::decode(message);
+        m_commanded = true;
+        m_last_command = now;
+        m_statistics.command_count++;
+        return true;
+    }
+
+    Mode mode = Mode::FreeRunning;
+    std::optional<float> setpoint;
+    const float relative_scale = m_config.max_current / 1000.0f;
+    switch (packet_id) {
+    case k_set_current_id:
+        mode = Mode::Current;
+        setpoint = decode_command<SetCurrentCodec>(message, 0.1f);
+        break;
+    case k_set_brake_current_id:
+        mode = Mode::BrakeCurrent;
+        setpoint = decode_command<SetBrakeCurrentCodec>(message, 0.1f);
+        break;
+    case k_set_erpm_id:
+        mode = Mode::Erpm;
+        setpoint = decode_command<SetErpmCodec>(message, 1.0f);
+        break;
+    case k_set_relative_current_id:
+        mode = Mode::Current;
+        setpoint = decode_command<SetRelativeCurrentCodec>(message, relative_scale);
+        break;
+    case k_set_relative_brake_current_id:
+        mode = Mode::BrakeCurrent;
+        setpoint = decode_command<SetRelativeBrakeCurrentCodec>(message, relative_scale);
+        break;
+    default:
+        break;
+    }
+
+    // Without drive enable, control commands neither move the motor nor keep the drive alive.
+    if (!setpoint || (m_config.require_drive_enable && !m_drive_enable_commanded)) {
+        m_statistics.ignored_count++;
+        return true;
+    }
+    m_mode = mode;
+    m_setpoint = *setpoint;
+    m_commanded = true;
+    m_last_command = now;
+    m_statistics.command_count++;
+    return true;
+}
+
+std::span<can::RawMessage> Emulator::poll(std::uint32_t now, std::span<can::RawMessage> frames) {
+    if (!m_started) {
+        m_started = true;
+        m_time = now;
+        m_next_broadcast.fill(now);
+    }
+
+    while (reached(now, m_time + k_emulator_step)) {
+        m_time += k_emulator_step;
+        if (m_commanded && reached(m_time, m_last_command + m_config.command_timeout)) {
+            // Leave the motor free-running and drop drive enable until the commands come back.
+            m_commanded = false;
+            m_drive_enable_commanded = false;
+            m_mode = Mode::FreeRunning;
+            m_setpoint = 0.0f;
+            m_statistics.timeout_count++;
+        }
+        step();
+    }
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < k_status_packet_count && count < frames.size(); i++) {
+        const auto period = m_config.periods[i];
+        if (period == 0 || !reached(now, m_next_broadcast[i])) {
+            continue;
+        }
+
+        // Keep to the period, unless polling has fallen so far behind that whole periods were skipped.
+        m_next_broadcast[i] += period;
+        if (reached(now, m_next_broadcast[i])) {
+            m_next_broadcast[i] = now + period;
+        }
+        frames[count++] = build_status(k_general_data_1_id + static_cast<std::uint32_t>(i));
+    }
+    m_statistics.broadcast_count += static_cast<std::uint32_t>(count);
+    return frames.first(count);
+}
+
+void Emulator::step() {
+    const auto &config = m_config;
+    auto &state = m_state;
+    state.drive_enabled = !config.require_drive_enable || m_drive_enable_commanded;
+
+    // Pick the target of the current loop from the active command.
+    const float omega = state.erpm / static_cast<float>(config.pole_pairs) * k_two_pi / 60.0f;
+    float target = 0.0f;
+    if (state.drive_enabled && state.fault_code == FaultCode::NoFaults) {
+        switch (m_mode) {
+        case Mode::FreeRunning:
+            break;
+        case Mode::Current:
+            target = m_setpoint;
+            break;
+        case Mode::BrakeCurrent:
+            target = omega > 0.0f ? -m_setpoint : (omega < 0.0f ? m_setpoint : 0.0f);
+            break;
+        case Mode::Erpm:
+            target = config.erpm_gain * (m_setpoint - state.erpm);
+            break;
+        }
+    }
+    target = std::clamp(target, -config.max_current, config.max_current);
+
+    // Once the back EMF reaches the input voltage, no more current can be driven in the direction of motion.
+    const float back_emf = std::abs(omega) * config.torque_constant;
+    if (back_emf >= state.input_voltage && target * omega > 0.0f) {
+        target = 0.0f;
+    }
+    state.ac_current += (target - state.ac_current) * std::min(1.0f, k_emulator_step / config.current_time_constant);
+
+    // Accelerate the vehicle. A brake current stops and holds the motor rather than reversing it.
+    const float torque = config.torque_constant * state.ac_current;
+    float next_omega = omega + (torque - config.drag * omega) / config.inertia * k_step_seconds;
+    if (m_mode == Mode::BrakeCurrent && next_omega * omega <= 0.0f) {
+        next_omega = 0.0f;
+    }
+    state.erpm = next_omega * 60.0f / k_two_pi * static_cast<float>(config.pole_pairs);
+
+    // Draw the power from the battery, which sags under load. Negative power is regeneration.
+    const float power = torque * next_omega;
+    const float input_power = power >= 0.0f ? power / config.efficiency : power * config.efficiency;
+    state.dc_current = input_power / state.input_voltage;
+    state.input_voltage = config.battery_voltage - config.battery_resistance * state.dc_current;
+    const float duty_cycle = std::min(100.0f, 100.0f * back_emf / state.input_voltage);
+    state.duty_cycle = power < 0.0f ? -duty_cycle : duty_cycle;
+
+    const auto heat = [&](float &temperature, float loss_resistance, float thermal_resistance, float heat_capacity) {
+        const float loss = state.ac_current * state.ac_current * loss_resistance;
+        const float cooling = (temperature - config.ambient_temperature) / thermal_resistance;
+        temperature += (loss - cooling) / heat_capacity * k_step_seconds;
+    };
+    heat(state.controller_temperature, config.controller_loss_resistance, config.controller_thermal_resistance,
+         config.controller_heat_capacity);
+    heat(state.motor_temperature, config.motor_loss_resistance, config.motor_thermal_resistance,
+         config.motor_heat_capacity);
+
+    switch (state.fault_code) {
+    case FaultCode::NoFaults:
+        if (state.controller_temperature > config.controller_temperature_limit) {
+            state.fault_code = FaultCode::ControllerOvertemperature;
+        } else if (state.motor_temperature > config.motor_temperature_limit) {
+            state.fault_code = FaultCode::MotorOvertemperature;
+        }
+        break;
+    case FaultCode::ControllerOvertemperature:
+        if (state.controller_temperature < config.controller_temperature_limit - k_fault_hysteresis) {
+            state.fault_code = FaultCode::NoFaults;
+        }
+        break;
+    case FaultCode::MotorOvertemperature:
+        if (state.motor_temperature < config.motor_temperature_limit - k_fault_hysteresis) {
+            state.fault_code = FaultCode::NoFaults;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+can::RawMessage Emulator::build_status(std::uint32_t packet_id) const {
+    // The inverter always sends eight bytes, with the unused ones set to 0xff.
+    std::array<std::uint8_t, 8> data{};
+    data.fill(0xff);
+    const auto copy = [&data](const auto &encoded) {
+        std::copy(encoded.begin(), encoded.end(), data.begin());
+    };
+
+    const auto &state = m_state;
+    switch (packet_id) {
+    case k_general_data_1_id:
+        copy(GeneralData1Codec::encode(to_raw<std::int32_t>(state.erpm, 1.0f),
+                                       to_raw<std::int16_t>(state.duty_cycle, 0.1f),
+                                       to_raw<std::int16_t>(state.input_voltage, 1.0f)));
+        break;
+    case k_general_data_2_id:
+        copy(GeneralData2Codec::encode(to_raw<std::int16_t>(state.ac_current, 0.1f),
+                                       to_raw<std::int16_t>(state.dc_current, 0.1f)));
+        break;
+    case k_general_data_3_id:
+        copy(GeneralData3Codec::encode(to_raw<std::int16_t>(state.controller_temperature, 0.1f),
+                                       to_raw<std::int16_t>(state.motor_temperature, 0.1f), state.fault_code));
+        break;
+    case k_general_data_4_id:
+        // Field weakening isn't modelled, so all of the current is on the quadrature axis.
+        copy(GeneralData4Codec::encode(0, to_raw<std::int32_t>(state.ac_current, 0.01f)));
+        break;
+    case k_general_data_5_id:
+        copy(GeneralData5Codec::encode(0, 0, 0, state.drive_enabled, false, false, false, false, false, false, false,
+                                       false, false, false, false, k_can_map_version));
+        break;
+    default:
+        break;
+    }
+    return can::RawMessage::extended(packet_identifier(packet_id, m_config.node_id), data);
+}
+
+} // namespace dti
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <can.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+namespace dti {
+
+/// Step of the emulator's motor model in milliseconds.
+constexpr std::uint32_t k_emulator_step = 1;
+
+/**
+ * Parameters of an emulated inverter and of the motor, vehicle and battery behind it. Times are in milliseconds and
+ * everything else is in SI units. The defaults are roughly those of a single motor driving a 300 kg car.
+ */
+struct EmulatorConfig {
+    std::uint8_t node_id;
+
+    /// Broadcast period of each status packet from GeneralData1 to GeneralData5, or zero to not send it. The real
+    /// periods are set in the DTI CAN Tool; the defaults send the ERPM every 10 ms, as the apps firmware expects.
+    std::array<std::uint32_t, k_status_packet_count> periods{10, 10, 100, 0, 100};
+
+    /// Time without a control command after which the motor is left free-running and the drive is disabled, as set
+    /// under APP Settings / General / Timeout.
+    std::uint32_t command_timeout{1000};
+
+    /// Whether the drive must be enabled with a drive enable command before any other command has an effect.
+    bool require_drive_enable{false};
+
+    float max_current{200.0f};
+    float current_time_constant{5.0f};
+    float torque_constant{0.5f};
+    std::uint8_t pole_pairs{10};
+
+    /// Gain of the speed loop used for ERPM commands, in amps per ERPM.
+    float erpm_gain{0.2f};
+
+    /// Moment of inertia and viscous drag of the vehicle, reflected through the gearbox onto the motor shaft.
+    float inertia{1.0f};
+    float drag{0.05f};
+
+    float battery_voltage{400.0f};
+    float battery_resistance{0.1f};
+    float efficiency{0.95f};
+
+    /// Thermal model of the controller and motor: heat is the square of the AC current times the loss resistance, and
+    /// leaves through the thermal resistance to ambient.
+    float ambient_temperature{25.0f};
+    float controller_loss_resistance{0.003f};
+    float controller_thermal_resistance{0.1f};
+    float controller_heat_capacity{2000.0f};
+    float controller_temperature_limit{80.0f};
+    float motor_loss_resistance{0.01f};
+    float motor_thermal_resistance{0.2f};
+    float motor_heat_capacity{3000.0f};
+    float motor_temperature_limit{120.0f};
+};
+
+/// The modelled state of an emulated inverter, in the physical units of the status packets.
+struct EmulatorState {
+    float erpm;
+    float duty_cycle;
+    float input_voltage;
+    float ac_current;
+    float dc_current;
+    float controller_temperature;
+    float motor_temperature;
+    FaultCode fault_code;
+    bool drive_enabled;
+};
+
+struct EmulatorStatistics {
+    /// Number of control and drive enable commands accepted.
+    std::uint32_t command_count;
+
+    /// Number of commands to this inverter which weren't understood, e.g. position commands or short frames.
+    std::uint32_t ignored_count;
+
+    /// Number of times the command timeout expired.
+    std::uint32_t timeout_count;
+
+    std::uint32_t broadcast_count;
+};
+
+/**
+ * A host-side model of a DTI inverter for closed-loop testing. It takes the command frames built by the functions in
+ * dti.hh, runs a simple model of the current loop, the motor speed, the battery and the temperatures, and returns the
+ * status packets as the real inverter would broadcast them. It knows nothing about the transport, so the frames can be
+ * passed through a virtual bus or straight between the emulator and the code under test.
+ *
+ * Faults are raised when a temperature limit is exceeded, which removes the current until the temperature has dropped
+ * 5 degrees below the limit. Position commands aren't modelled and are ignored.
+ */
+class Emulator {
+    enum class Mode : std::uint8_t {
+        FreeRunning,
+        Current,
+        BrakeCurrent,
+        Erpm,
+    };
+
+    EmulatorConfig m_config;
+    EmulatorState m_state;
+    EmulatorStatistics m_statistics{};
+    Mode m_mode{Mode::FreeRunning};
+    float m_setpoint{0.0f};
+    bool m_drive_enable_commanded{false};
+    bool m_commanded{false};
+    bool m_started{false};
+    std::uint32_t m_last_command{0};
+    std::uint32_t m_time{0};
+    std::array<std::uint32_t, k_status_packet_count> m_next_broadcast{};
+
+    void step();
+    can::RawMessage build_status(std::uint32_t packet_id) const;
+
+public:
+    /**
+     * @param config the parameters of the emulated inverter
+     */
+    explicit Emulator(const EmulatorConfig &config);
+
+    /**
+     * Handles a received frame. Commands to other node ids are ignored.
+     *
+     * @param message the received frame
+     * @param now the current time in milliseconds
+     * @return true if the frame was a command to this inverter; false otherwise
+     */
+    bool on_frame(const can::RawMessage &message, std::uint32_t now);
+
+    /**
+     * Advances the model to the given time in steps of k_emulator_step and builds the status packets which are due.
+     * The first call sends every enabled packet.
+     *
+     * @param now the current time in milliseconds
+     * @param frames storage for the due packets, which should hold k_status_packet_count frames
+     * @return the due packets, in packet ID order, or fewer if frames is too small
+     */
+    std::span<can::RawMessage> poll(std::uint32_t now, std::span<can::RawMessage> frames);
+
+    const EmulatorConfig &config() const { return m_config; }
+    const EmulatorState &state() const { return m_state; }
+    const EmulatorStatistics &statistics() const { return m_statistics; }
+};
+
+} // namespace dti
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <can.hh>
+#include <can_load.hh>
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+namespace dti {
+
+/// The reason a CommandPublisher sent a command.
+enum class SendReason : std::uint8_t {
+    /// The value moved by at least the threshold since it was last sent, or it was the first value.
+    Change,
+
+    /// The value went to zero or changed sign, which is sent whatever the threshold.
+    Safety,
+
+    /// The keepalive period passed without a send.
+    Keepalive,
+};
+
+/// A struct which describes when a CommandPublisher sends. Times are in milliseconds.
+template <typename T>
+struct PublisherConfig {
+    /// Smallest change from the last sent value which is sent at once, in the units of the command.
+    T threshold;
+
+    /// Time after the last send at which the value is sent again even if it hasn't moved. The DTI manual asks for
+    /// commands at least twice per command timeout, and recommends four times.
+    std::uint32_t keepalive_period;
+};
+
+struct PublisherStatistics {
+    std::uint32_t change_count;
+    std::uint32_t safety_count;
+    std::uint32_t keepalive_count;
+
+    /// Number of updates which weren't sent, each of which would have been a frame if every update were sent.
+    std::uint32_t suppressed_count;
+
+    /// Bus time saved by the suppressed frames, in bit times with worst-case bit stuffing.
+    std::uint32_t saved_bits;
+};
+
+/**
+ * A class which decides when to send a command to a DTI inverter from a value updated at a fixed rate, so that an
+ * unchanged value doesn't take a frame every update. A value is sent at once if it moved by at least the threshold
+ * since it was last sent, or if it went to zero or changed sign, since the motor must stop as soon as it is asked to.
+ * Otherwise the latest value is only sent at the keepalive period, which keeps the inverter's command timeout from
+ * expiring and catches up with any change smaller than the threshold. A command which didn't make it onto the bus must
+ * be reported with resend, otherwise it is only repeated at the keepalive period.
+ *
+ * @tparam T the value type of the command's build function
+ */
+template <typename T>
+class CommandPublisher {
+public:
+    using BuildFunction = can::Message (*)(std::uint8_t, T);
+
+private:
+    BuildFunction m_build;
+    std::uint8_t m_node_id;
+    PublisherConfig<T> m_config;
+    std::uint32_t m_frame_bits;
+    PublisherStatistics m_statistics{};
+    std::optional<T> m_sent;
+    std::uint32_t m_last_send{0};
+    std::optional<SendReason> m_last_reason;
+    bool m_resend{false};
+
+    static bool reached(std::uint32_t now, std::uint32_t time) {
+        return static_cast<std::int32_t>(now - time) >= 0;
+    }
+
+    bool is_safety_change(T value) const {
+        if (value == T{0}) {
+            return *m_sent != T{0};
+        }
+        if constexpr (std::is_signed_v<T>) {
+            return *m_sent != T{0} && (value < T{0}) != (*m_sent < T{0});
+        }
+        return false;
+    }
+
+    bool is_change(T value) const {
+        const auto difference = value > *m_sent ? value - *m_sent : *m_sent - value;
+        return difference >= m_config.threshold;
+    }
+
+public:
+    /**
+     * @param build one of the build_* command functions
+     * @param node_id the target inverter's node id on the CAN bus
+     * @param config when to send
+     */
+    CommandPublisher(BuildFunction build, std::uint8_t node_id, const PublisherConfig<T> &config)
+        : m_build(build), m_node_id(node_id), m_config(config) {
+        const auto message = build(node_id, T{0});
+        m_frame_bits = can::frame_bits(message.is_extended(), message.length);
+    }
+
+    /**
+     * Takes the latest value of the command, to be called at a fixed rate.
+     *
+     * @param value the latest value
+     * @param now the current time in milliseconds
+     * @return the command to send now, if any
+     */
+    std::optional<can::RawMessage> update(T value, std::uint32_t now) {
+        SendReason reason;
+        if (!m_sent) {
+            reason = SendReason::Change;
+        } else if (is_safety_change(value)) {
+            reason = SendReason::Safety;
+        } else if (is_change(value)) {
+            reason = SendReason::Change;
+        } else if (m_resend && m_last_reason) {
+            reason = *m_last_reason;
+        } else if (reached(now, m_last_send + m_config.keepalive_period)) {
+            reason = SendReason::Keepalive;
+        } else {
+            m_statistics.suppressed_count++;
+            m_statistics.saved_bits += m_frame_bits;
+            return std::nullopt;
+        }
+
+        switch (reason) {
+        case SendReason::Change:
+            m_statistics.change_count++;
+            break;
+        case SendReason::Safety:
+            m_statistics.safety_count++;
+            break;
+        case SendReason::Keepalive:
+            m_statistics.keepalive_count++;
+            break;
+        }
+        m_sent = value;
+        m_last_send = now;
+        m_last_reason = reason;
+        m_resend = false;
+        return can::RawMessage::from_message(m_build(m_node_id, value));
+    }
+
+    /**
+     * Forgets the last sent value, so that the next update is sent at once, e.g. after the commands were stopped.
+     */
+    void reset() {
+        m_sent.reset();
+        m_resend = false;
+    }
+
+    /**
+     * Marks the last sent command as lost, e.g. because it missed its transmit deadline, so that the next update sends
+     * the latest value at once. The send is counted under the reason of the lost command.
+     */
+    void resend() { m_resend = true; }
+
+    /**
+     * @return the reason for the last send; std::nullopt if nothing has been sent
+     */
+    std::optional<SendReason> last_reason() const { return m_last_reason; }
+    const PublisherStatistics &statistics() const { return m_statistics; }
+};
+
+} // namespace dti
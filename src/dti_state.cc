@@ -0,0 +1,121 @@
+#include <dti_state.hh>
+
+#include <can.hh>
+#include <dti.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace dti {
+
+bool InverterState::update(const can::Message &message, std::uint32_t timestamp) {
+    if (!message.is_extended()) {
+        return false;
+    }
+    const auto packet = parse_packet(message);
+    const bool is_status = std::visit(
+        [this](const auto &data) {
+            using T = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<T, GeneralData1>) {
+                m_erpm.store(data.erpm, std::memory_order_relaxed);
+                m_input_voltage.store(data.input_voltage, std::memory_order_relaxed);
+            } else if constexpr (std::is_same_v<T, GeneralData2>) {
+                m_ac_current.store(data.ac_current, std::memory_order_relaxed);
+                m_dc_current.store(data.dc_current, std::memory_order_relaxed);
+            } else if constexpr (std::is_same_v<T, GeneralData3>) {
+                m_controller_temperature.store(data.controller_temperature, std::memory_order_relaxed);
+                m_motor_temperature.store(data.motor_temperature, std::memory_order_relaxed);
+                m_fault_code.store(data.fault_code, std::memory_order_relaxed);
+            } else if constexpr (std::is_same_v<T, GeneralData5>) {
+                m_drive_enabled.store(data.drive_enabled, std::memory_order_relaxed);
+            } else if constexpr (std::is_same_v<T, UnknownMessageType> || std::is_same_v<T, InvalidLength>) {
+                return false;
+            }
+            return true;
+        },
+        packet);
+    if (!is_status) {
+        return false;
+    }
+
+    // Stamp after storing the signals, so that a reader which sees the new time stamp also sees the new values.
+    stamp(identifier_packet_id(message.extended_id()), timestamp);
+    return true;
+}
+
+void InverterState::stamp(std::uint32_t packet_id, std::uint32_t timestamp) {
+    auto &record = m_packets[packet_id - k_general_data_1_id];
+    auto &statistics = record.statistics;
+    if (record.received.load(std::memory_order_relaxed)) {
+        const auto ticks = timestamp - record.timestamp.load(std::memory_order_relaxed);
+        const auto interval = static_cast<std::uint32_t>(static_cast<std::uint64_t>(ticks) * 1'000'000u / m_tick_rate);
+        statistics.min_interval = statistics.count > 1 ? std::min(statistics.min_interval, interval) : interval;
+        statistics.max_interval = std::max(statistics.max_interval, interval);
+        statistics.last_interval = interval;
+    }
+    statistics.count++;
+    record.timestamp.store(timestamp, std::memory_order_release);
+    record.received.store(true, std::memory_order_release);
+}
+
+std::optional<std::uint32_t> InverterState::age(std::uint32_t packet_id, std::uint32_t now) const {
+    const auto last = timestamp(packet_id);
+    if (!last) {
+        return std::nullopt;
+    }
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(now - *last) * 1'000'000u / m_tick_rate);
+}
+
+std::optional<std::uint32_t> InverterState::timestamp(std::uint32_t packet_id) const {
+    const auto index = packet_id - k_general_data_1_id;
+    if (index >= m_packets.size() || !m_packets[index].received.load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    return m_packets[index].timestamp.load(std::memory_order_acquire);
+}
+
+PacketStatistics InverterState::statistics(std::uint32_t packet_id) const {
+    const auto index = packet_id - k_general_data_1_id;
+    return index < m_packets.size() ? m_packets[index].statistics : PacketStatistics{};
+}
+
+bool InverterState::is_fresh(std::uint32_t packet_id, std::uint32_t now, std::uint32_t max_age) const {
+    const auto packet_age = age(packet_id, now);
+    return packet_age && *packet_age < max_age;
+}
+
+InverterTable::InverterTable(std::span<const std::uint8_t> node_ids, std::uint32_t tick_rate)
+    : m_count(std::min(node_ids.size(), k_max_inverter_count)),
+      m_states(make_states(tick_rate, std::make_index_sequence<k_max_inverter_count>())) {
+    m_slots.fill(k_no_slot);
+    for (std::size_t i = 0; i < m_count; i++) {
+        m_node_ids[i] = node_ids[i];
+        m_slots[node_ids[i]] = static_cast<std::uint8_t>(i);
+    }
+}
+
+bool InverterTable::update(const can::Message &message, std::uint32_t timestamp) {
+    if (!message.is_extended()) {
+        return false;
+    }
+    auto *state = find(identifier_node_id(message.extended_id()));
+    return state != nullptr && state->update(message, timestamp);
+}
+
+InverterState *InverterTable::find(std::uint8_t node_id) {
+    const auto slot = m_slots[node_id];
+    return slot != k_no_slot ? &m_states[slot] : nullptr;
+}
+
+const InverterState *InverterTable::find(std::uint8_t node_id) const {
+    const auto slot = m_slots[node_id];
+    return slot != k_no_slot ? &m_states[slot] : nullptr;
+}
+
+} // namespace dti
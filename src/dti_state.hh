@@ -0,0 +1,200 @@
+#pragma once
+
+#include <can.hh>
+#include <dti.hh>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace dti {
+
+/// Number of status packets tracked by InverterState, which are those from k_general_data_1_id to k_general_data_5_id.
+constexpr std::size_t k_status_packet_count = k_general_data_5_id - k_general_data_1_id + 1;
+
+/// Largest number of inverters an InverterTable can hold.
+constexpr std::size_t k_max_inverter_count = 4;
+
+/// Inter-arrival statistics of one status packet. Intervals are measured from CAN time stamps, in microseconds.
+struct PacketStatistics {
+    std::uint32_t count;
+    std::uint32_t last_interval;
+    std::uint32_t min_interval;
+    std::uint32_t max_interval;
+};
+
+/**
+ * A class which holds the last known state of an inverter, with the arrival time of every status packet so that stale
+ * values can be rejected. Time stamps must be enabled in can::init. Ages are taken modulo 2^32 ticks, which is over two
+ * hours at 500 kbit/s.
+ *
+ * update must only be called from a single context for each status packet, since packets don't share any state. The
+ * signal getters may be called from any context; a getter may return a value which is newer than the time stamp it was
+ * checked against, but never an older one. statistics must be called from the same context as update for the packet.
+ */
+class InverterState {
+    struct PacketRecord {
+        std::atomic<std::uint32_t> timestamp{0};
+        std::atomic<bool> received{false};
+        PacketStatistics statistics{};
+    };
+
+    const std::uint32_t m_tick_rate;
+    std::atomic<std::int32_t> m_erpm{};
+    std::atomic<std::int16_t> m_input_voltage{};
+    std::atomic<std::int16_t> m_ac_current{};
+    std::atomic<std::int16_t> m_dc_current{};
+    std::atomic<std::int16_t> m_controller_temperature{};
+    std::atomic<std::int16_t> m_motor_temperature{};
+    std::atomic<FaultCode> m_fault_code{};
+    std::atomic<bool> m_drive_enabled{};
+    std::array<PacketRecord, k_status_packet_count> m_packets;
+
+    void stamp(std::uint32_t packet_id, std::uint32_t timestamp);
+    bool is_fresh(std::uint32_t packet_id, std::uint32_t now, std::uint32_t max_age) const;
+
+    template <typename T>
+    std::optional<T> fresh(const std::atomic<T> &signal, std::uint32_t packet_id, std::uint32_t now,
+                           std::uint32_t max_age) const {
+        if (!is_fresh(packet_id, now, max_age)) {
+            return std::nullopt;
+        }
+        return signal.load(std::memory_order_relaxed);
+    }
+
+public:
+    /**
+     * @param tick_rate the rate of the CAN time stamps in hertz, which is the bit rate
+     */
+    explicit InverterState(std::uint32_t tick_rate) : m_tick_rate(tick_rate) {}
+    InverterState(const InverterState &) = delete;
+    InverterState &operator=(const InverterState &) = delete;
+
+    /**
+     * Parses a received message and, if it is a status packet, stores its signals along with its time stamp.
+     *
+     * @param message the received message
+     * @param timestamp the time stamp of the message, as passed to the FIFO callback
+     * @return true if the message was a valid status packet; false otherwise
+     */
+    bool update(const can::Message &message, std::uint32_t timestamp);
+
+    /**
+     * @param packet_id the packet ID of a status packet
+     * @param now the current CAN time stamp, e.g. from can::timestamp_now
+     * @return the time since the packet last arrived in microseconds; std::nullopt if it never has
+     */
+    std::optional<std::uint32_t> age(std::uint32_t packet_id, std::uint32_t now) const;
+
+    /**
+     * @return the CAN time stamp of the last arrival of the given status packet; std::nullopt if it never has arrived
+     */
+    std::optional<std::uint32_t> timestamp(std::uint32_t packet_id) const;
+
+    /**
+     * @return the inter-arrival statistics of the given status packet
+     */
+    PacketStatistics statistics(std::uint32_t packet_id) const;
+
+    // Each getter returns the signal only if its packet arrived less than max_age microseconds before now, where now
+    // is the current CAN time stamp. Units and scales are as in the packet structs.
+    std::optional<std::int32_t> erpm(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_erpm, k_general_data_1_id, now, max_age);
+    }
+    std::optional<std::int16_t> input_voltage(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_input_voltage, k_general_data_1_id, now, max_age);
+    }
+    std::optional<std::int16_t> ac_current(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_ac_current, k_general_data_2_id, now, max_age);
+    }
+    std::optional<std::int16_t> dc_current(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_dc_current, k_general_data_2_id, now, max_age);
+    }
+    std::optional<std::int16_t> controller_temperature(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_controller_temperature, k_general_data_3_id, now, max_age);
+    }
+    std::optional<std::int16_t> motor_temperature(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_motor_temperature, k_general_data_3_id, now, max_age);
+    }
+    std::optional<FaultCode> fault_code(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_fault_code, k_general_data_3_id, now, max_age);
+    }
+    std::optional<bool> is_drive_enabled(std::uint32_t now, std::uint32_t max_age) const {
+        return fresh(m_drive_enabled, k_general_data_5_id, now, max_age);
+    }
+};
+
+/**
+ * A class which holds the state of several inverters on the same bus, keyed by node id. A frame is routed to its
+ * inverter through a table indexed by the node id in its identifier, so routing takes the same time however many
+ * inverters there are. The same rules about contexts apply as for InverterState.
+ */
+class InverterTable {
+    static constexpr std::uint8_t k_no_slot = 0xff;
+
+    std::array<std::uint8_t, 256> m_slots;
+    std::array<std::uint8_t, k_max_inverter_count> m_node_ids{};
+    std::size_t m_count;
+    std::array<InverterState, k_max_inverter_count> m_states;
+
+    template <std::size_t... Is>
+    static std::array<InverterState, sizeof...(Is)> make_states(std::uint32_t tick_rate, std::index_sequence<Is...>) {
+        return {(static_cast<void>(Is), InverterState(tick_rate))...};
+    }
+
+public:
+    /**
+     * @param node_ids the node ids of the inverters, of which there must be at most k_max_inverter_count
+     * @param tick_rate the rate of the CAN time stamps in hertz, which is the bit rate
+     */
+    InverterTable(std::span<const std::uint8_t> node_ids, std::uint32_t tick_rate);
+    InverterTable(const InverterTable &) = delete;
+    InverterTable &operator=(const InverterTable &) = delete;
+
+    /**
+     * Updates the state of the inverter which sent the given message.
+     *
+     * @param message the received message
+     * @param timestamp the time stamp of the message, as passed to the FIFO callback
+     * @return true if the message was a valid status packet from an inverter in the table; false otherwise
+     */
+    bool update(const can::Message &message, std::uint32_t timestamp);
+
+    /**
+     * @return the state of the inverter with the given node id; nullptr if it isn't in the table
+     */
+    InverterState *find(std::uint8_t node_id);
+    const InverterState *find(std::uint8_t node_id) const;
+
+    /**
+     * Builds the same command for every inverter in the table, in table order, so that they can be sent as one batch
+     * with can::transmit.
+     *
+     * @param build one of the build_* command functions
+     * @param value the value passed to the build function
+     * @param messages storage for the built messages
+     * @return the built messages, one per inverter, or fewer if messages is too small
+     */
+    template <typename T>
+    std::span<can::RawMessage> build_all(can::Message (*build)(std::uint8_t, T), std::type_identity_t<T> value,
+                                         std::span<can::RawMessage> messages) const {
+        const auto count = std::min(m_count, messages.size());
+        for (std::size_t i = 0; i < count; i++) {
+            messages[i] = can::RawMessage::from_message(build(m_node_ids[i], value));
+        }
+        return messages.first(count);
+    }
+
+    InverterState &operator[](std::size_t index) { return m_states[index]; }
+    const InverterState &operator[](std::size_t index) const { return m_states[index]; }
+    std::span<const std::uint8_t> node_ids() const { return std::span(m_node_ids).first(m_count); }
+    std::size_t size() const { return m_count; }
+};
+
+} // namespace dti
@@ -80,6 +80,12 @@ void disable_irq(IRQn_Type irq) {
     NVIC_DisableIRQ(irq);
 }
 
+void enable_cycle_counter() {
+    // The DWT unit is gated behind the trace enable bit.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
 // Workaround for STM32F103 erratum affecting stop debug mode.
 [[gnu::noinline]] static void wfe() {
     __WFE();
@@ -8,8 +8,26 @@
 #include <span>
 #include <utility>
 
+/**
+ * Returns whether the firmware runs from the 8 MHz internal oscillator rather than the 56 MHz PLL clock. Defaults to
+ * false and may be overridden by defining this function in the firmware.
+ */
+bool hal_low_power();
+
 namespace hal {
 
+/// Core clock frequency in Hz when running from the PLL.
+constexpr std::uint32_t k_core_clock = 56'000'000;
+
+/// Core clock frequency in Hz in low power mode.
+constexpr std::uint32_t k_core_clock_low_power = 8'000'000;
+
+/// APB1 peripheral clock frequency in Hz when running from the PLL.
+constexpr std::uint32_t k_apb1_clock = 28'000'000;
+
+/// APB1 peripheral clock frequency in Hz in low power mode.
+constexpr std::uint32_t k_apb1_clock_low_power = 8'000'000;
+
 enum class [[nodiscard]] I2cStatus {
     Ok,
     OkRead,
@@ -98,9 +116,36 @@ void gpio_reset(Ts... list) {
     }
 }
 
+/// An RAII guard which masks all configurable priority interrupts for its lifetime and restores the previous mask
+/// on destruction, so that it may be safely nested.
+class CriticalSection {
+    const std::uint32_t m_primask;
+
+public:
+    CriticalSection() : m_primask(__get_PRIMASK()) { __disable_irq(); }
+    CriticalSection(const CriticalSection &) = delete;
+    CriticalSection(CriticalSection &&) = delete;
+    ~CriticalSection() { __set_PRIMASK(m_primask); }
+
+    CriticalSection &operator=(const CriticalSection &) = delete;
+    CriticalSection &operator=(CriticalSection &&) = delete;
+};
+
 void enable_irq(IRQn_Type irq, std::uint32_t priority);
 void disable_irq(IRQn_Type irq);
 
+/**
+ * Enables the DWT cycle counter, which counts core clock cycles.
+ */
+void enable_cycle_counter();
+
+/**
+ * @return the current value of the free-running DWT cycle counter
+ */
+inline std::uint32_t cycle_count() {
+    return DWT->CYCCNT;
+}
+
 /**
  * Place the MCU into stop mode. In this mode, all clocks are stopped but register, RAM, and GPIO states are saved.
  * The MCU will wake up on an event.
@@ -0,0 +1,150 @@
+#include <heartbeat.hh>
+
+#include <can.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace heartbeat {
+namespace {
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+} // namespace
+
+can::RawMessage build_heartbeat(const Heartbeat &heartbeat) {
+    const auto detail = util::write_be(heartbeat.detail);
+    const auto uptime = util::write_be(heartbeat.uptime);
+    return can::RawMessage::standard(static_cast<std::uint16_t>(k_base_id + heartbeat.node_id),
+                                     std::to_array<std::uint8_t>({
+                                         static_cast<std::uint8_t>(heartbeat.state),
+                                         heartbeat.counter,
+                                         detail[0],
+                                         detail[1],
+                                         uptime[0],
+                                         uptime[1],
+                                         uptime[2],
+                                         uptime[3],
+                                     }));
+}
+
+std::optional<Heartbeat> parse_heartbeat(const can::RawMessage &message) {
+    if (message.is_remote() || !message.is_standard() || message.length != 8) {
+        return std::nullopt;
+    }
+    const auto id = message.standard_id();
+    if (id < k_base_id || id > k_base_id + k_max_node_id) {
+        return std::nullopt;
+    }
+    return Heartbeat{
+        .node_id = static_cast<std::uint8_t>(id - k_base_id),
+        .state = static_cast<State>(message.byte(0)),
+        .counter = message.byte(1),
+        .detail = message.read_be<std::uint16_t>(2),
+        .uptime = message.read_be<std::uint32_t>(4),
+    };
+}
+
+std::optional<can::RawMessage> Sender::poll(std::uint32_t now, State state, std::uint16_t detail) {
+    if (m_started && !reached(now, m_last_time + m_period)) {
+        return std::nullopt;
+    }
+    m_started = true;
+    m_last_time = now;
+    return build_heartbeat({m_node_id, state, m_counter++, detail, now});
+}
+
+Monitor::Monitor(std::span<const PeerConfig> peers, std::uint32_t tick_rate)
+    : m_peers(peers.first(std::min(peers.size(), k_max_peer_count))), m_tick_rate(tick_rate) {}
+
+std::optional<std::size_t> Monitor::find(std::uint8_t node_id) const {
+    for (std::size_t i = 0; i < m_peers.size(); i++) {
+        if (m_peers[i].node_id == node_id) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+bool Monitor::on_frame(const can::RawMessage &message, std::uint32_t timestamp, std::uint32_t now) {
+    const auto heartbeat = parse_heartbeat(message);
+    const auto index = heartbeat ? find(heartbeat->node_id) : std::nullopt;
+    if (!index) {
+        return false;
+    }
+
+    auto &peer = m_status[*index];
+    auto &statistics = peer.status.statistics;
+    if (peer.status.liveness != Liveness::Unknown) {
+        if (heartbeat->uptime < peer.status.heartbeat.uptime) {
+            statistics.restart_count++;
+        } else {
+            statistics.lost_count += static_cast<std::uint8_t>(heartbeat->counter - peer.status.heartbeat.counter - 1u);
+        }
+
+        // Only measure intervals between consecutive frames, so that a lost frame or an outage doesn't count as
+        // jitter.
+        if (peer.status.liveness == Liveness::Alive &&
+            heartbeat->counter == static_cast<std::uint8_t>(peer.status.heartbeat.counter + 1u)) {
+            const auto ticks = timestamp - peer.last_timestamp;
+            const auto interval = static_cast<std::uint32_t>(static_cast<std::uint64_t>(ticks) * 1'000'000u /
+                                                             m_tick_rate);
+            if (statistics.max_interval != 0) {
+                const auto difference = interval > statistics.last_interval ? interval - statistics.last_interval
+                                                                            : statistics.last_interval - interval;
+                statistics.jitter = difference > statistics.jitter
+                                        ? statistics.jitter + ((difference - statistics.jitter) >> k_jitter_shift)
+                                        : statistics.jitter - ((statistics.jitter - difference) >> k_jitter_shift);
+                statistics.min_interval = std::min(statistics.min_interval, interval);
+            } else {
+                statistics.min_interval = interval;
+            }
+            statistics.max_interval = std::max(statistics.max_interval, interval);
+            statistics.last_interval = interval;
+        }
+    }
+
+    statistics.frame_count++;
+    peer.status.liveness = Liveness::Alive;
+    peer.status.heartbeat = *heartbeat;
+    peer.last_arrival = now;
+    peer.last_timestamp = timestamp;
+    return true;
+}
+
+std::size_t Monitor::poll(std::uint32_t now) {
+    std::size_t dead_count = 0;
+    for (std::size_t i = 0; i < m_peers.size(); i++) {
+        auto &peer = m_status[i];
+        if (peer.status.liveness != Liveness::Alive || !reached(now, peer.last_arrival + m_peers[i].timeout)) {
+            continue;
+        }
+        peer.status.liveness = Liveness::Dead;
+        auto &statistics = peer.status.statistics;
+        statistics.timeout_count++;
+        statistics.max_detection_latency = std::max(statistics.max_detection_latency, now - peer.last_arrival);
+        dead_count++;
+    }
+    return dead_count;
+}
+
+const PeerStatus *Monitor::status(std::uint8_t node_id) const {
+    const auto index = find(node_id);
+    return index ? &m_status[*index].status : nullptr;
+}
+
+bool Monitor::all_alive() const {
+    return std::all_of(m_status.begin(), m_status.begin() + static_cast<std::ptrdiff_t>(m_peers.size()),
+                       [](const Peer &peer) {
+                           return peer.status.liveness == Liveness::Alive;
+                       });
+}
+
+} // namespace heartbeat
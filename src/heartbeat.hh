@@ -0,0 +1,191 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace heartbeat {
+
+/// Base of the standard identifiers of heartbeat frames; a node sends on k_base_id plus its node ID, as in CANopen.
+constexpr std::uint16_t k_base_id = 0x700;
+
+/// Largest node ID, which keeps heartbeat identifiers clear of the report identifiers at 0x7f0 and above.
+constexpr std::uint8_t k_max_node_id = 0x7f;
+
+/// Largest number of peers a monitor can track.
+constexpr std::size_t k_max_peer_count = 8;
+
+/// Weight of a new sample in the smoothed jitter, as a power of two, as in RFC 3550.
+constexpr std::uint32_t k_jitter_shift = 4;
+
+/// An enum which represents the overall state of a node.
+enum class State : std::uint8_t {
+    /// Starting up, e.g. waiting for calibration.
+    Initialising,
+    Operational,
+
+    /// Running, but with a fault that limits what the node can do.
+    Fault,
+};
+
+/// The contents of a heartbeat frame, [state, counter, detail (2), uptime (4)], with multi-byte fields big endian.
+struct Heartbeat {
+    std::uint8_t node_id;
+    State state;
+
+    /// Incremented with every frame, so that a receiver can count lost frames.
+    std::uint8_t counter;
+
+    /// Node-specific status bits, e.g. error flags.
+    std::uint16_t detail;
+
+    /// Time since the node started in milliseconds.
+    std::uint32_t uptime;
+};
+
+/**
+ * @return the heartbeat frame of the given node
+ */
+can::RawMessage build_heartbeat(const Heartbeat &heartbeat);
+
+/**
+ * @return the heartbeat carried by the given frame; std::nullopt if it isn't a heartbeat frame
+ */
+std::optional<Heartbeat> parse_heartbeat(const can::RawMessage &message);
+
+/**
+ * A class which sends a node's heartbeat once per period.
+ */
+class Sender {
+    std::uint8_t m_node_id;
+    std::uint32_t m_period;
+    std::uint32_t m_last_time{0};
+    std::uint8_t m_counter{0};
+    bool m_started{false};
+
+public:
+    /**
+     * @param node_id the node ID, which must not exceed k_max_node_id
+     * @param period the time between frames in milliseconds
+     */
+    Sender(std::uint8_t node_id, std::uint32_t period) : m_node_id(node_id), m_period(period) {}
+
+    /**
+     * @param now the current time in milliseconds, which is also sent as the uptime
+     * @param state the state of the node
+     * @param detail node-specific status bits
+     * @return the frame to send, if one is due
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now, State state, std::uint16_t detail = 0);
+};
+
+/// A struct which describes a peer to be monitored.
+struct PeerConfig {
+    std::uint8_t node_id;
+
+    /// Expected time between heartbeats in milliseconds.
+    std::uint32_t period;
+
+    /// Time without a heartbeat in milliseconds after which the peer is considered dead.
+    std::uint32_t timeout;
+};
+
+/// An enum which represents what is known about whether a peer is alive.
+enum class Liveness : std::uint8_t {
+    /// No heartbeat has been received yet.
+    Unknown,
+    Alive,
+    Dead,
+};
+
+/// Counters and inter-arrival statistics of a peer. Intervals are measured from CAN time stamps, in microseconds.
+struct PeerStatistics {
+    std::uint32_t frame_count;
+
+    /// Frames missing from the counter sequence.
+    std::uint32_t lost_count;
+
+    /// Transitions from alive to dead.
+    std::uint32_t timeout_count;
+
+    /// Times the peer's uptime went backwards, meaning that it restarted.
+    std::uint32_t restart_count;
+
+    std::uint32_t last_interval;
+    std::uint32_t min_interval;
+    std::uint32_t max_interval;
+
+    /// Smoothed absolute difference between consecutive intervals.
+    std::uint32_t jitter;
+
+    /// Largest time from a peer's last heartbeat to it being declared dead, in milliseconds.
+    std::uint32_t max_detection_latency;
+};
+
+/// The last known state of a peer.
+struct PeerStatus {
+    Liveness liveness;
+    Heartbeat heartbeat;
+    PeerStatistics statistics;
+};
+
+/**
+ * A class which tracks the liveness of a set of peers from their heartbeats. Time stamps must be enabled in can::init
+ * for the inter-arrival statistics. All member functions must be called from the same context.
+ */
+class Monitor {
+    struct Peer {
+        PeerStatus status;
+        std::uint32_t last_arrival;
+        std::uint32_t last_timestamp;
+    };
+
+    const std::span<const PeerConfig> m_peers;
+    const std::uint32_t m_tick_rate;
+    std::array<Peer, k_max_peer_count> m_status{};
+
+    std::optional<std::size_t> find(std::uint8_t node_id) const;
+
+public:
+    /**
+     * @param peers the peers to monitor, of which there must be at most k_max_peer_count
+     * @param tick_rate the rate of the CAN time stamps in hertz, which is the bit rate
+     */
+    Monitor(std::span<const PeerConfig> peers, std::uint32_t tick_rate);
+
+    /**
+     * Handles a received frame.
+     *
+     * @param message the received frame
+     * @param timestamp the time stamp passed to the FIFO callback
+     * @param now the current time in milliseconds
+     * @return true if the frame was the heartbeat of a monitored peer; false otherwise
+     */
+    bool on_frame(const can::RawMessage &message, std::uint32_t timestamp, std::uint32_t now);
+
+    /**
+     * Declares peers which have been silent for longer than their timeout dead.
+     *
+     * @param now the current time in milliseconds
+     * @return the number of peers which were declared dead by this call
+     */
+    std::size_t poll(std::uint32_t now);
+
+    /**
+     * @return the status of the given node; nullptr if it isn't monitored
+     */
+    const PeerStatus *status(std::uint8_t node_id) const;
+
+    /**
+     * @return true if every monitored peer is alive
+     */
+    bool all_alive() const;
+
+    std::size_t peer_count() const { return m_peers.size(); }
+};
+
+} // namespace heartbeat
@@ -0,0 +1,261 @@
+#include <isotp.hh>
+
+#include <can.hh>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace isotp {
+namespace {
+
+// Protocol control information types in the upper nibble of the first byte.
+constexpr std::uint8_t k_single_frame = 0x0;
+constexpr std::uint8_t k_first_frame = 0x1;
+constexpr std::uint8_t k_consecutive_frame = 0x2;
+constexpr std::uint8_t k_flow_control = 0x3;
+
+// Flow status values of a flow control frame.
+constexpr std::uint8_t k_continue_to_send = 0x0;
+constexpr std::uint8_t k_wait = 0x1;
+constexpr std::uint8_t k_overflow = 0x2;
+
+// Data bytes carried by each frame type.
+constexpr std::size_t k_single_frame_capacity = 7;
+constexpr std::size_t k_first_frame_capacity = 6;
+constexpr std::size_t k_consecutive_frame_capacity = 7;
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+std::uint32_t id_word(std::uint32_t id, bool extended) {
+    return extended ? can::RawMessage::extended(id, {}).id_word : can::RawMessage::standard(id, {}).id_word;
+}
+
+} // namespace
+
+Link::Link(const Config &config, std::span<std::uint8_t> rx_buffer, std::span<std::uint8_t> tx_buffer)
+    : m_config(config), m_tx_id_word(id_word(config.tx_id, config.extended)),
+      m_rx_id_word(id_word(config.rx_id, config.extended)), m_rx_buffer(rx_buffer), m_tx_buffer(tx_buffer) {}
+
+can::RawMessage Link::build_frame(std::span<const std::uint8_t> bytes) const {
+    std::array<std::uint8_t, 8> data;
+    data.fill(k_padding);
+    std::copy_n(bytes.begin(), std::min(bytes.size(), data.size()), data.begin());
+    auto frame = can::RawMessage::standard(0, data);
+    frame.id_word = m_tx_id_word;
+    return frame;
+}
+
+void Link::queue_flow_control(std::uint8_t status) {
+    const std::array<std::uint8_t, 3> bytes{
+        static_cast<std::uint8_t>((k_flow_control << 4u) | status),
+        m_config.block_size,
+        m_config.st_min,
+    };
+    m_flow_control = build_frame(bytes);
+}
+
+void Link::abort_tx() {
+    m_tx_state = TxState::Idle;
+    m_statistics.tx_error_count++;
+}
+
+void Link::abort_rx() {
+    m_rx_state = RxState::Idle;
+    m_statistics.rx_error_count++;
+}
+
+bool Link::send(std::span<const std::uint8_t> payload, std::uint32_t now) {
+    if (m_tx_state != TxState::Idle || payload.empty() || payload.size() > m_tx_buffer.size() ||
+        payload.size() > k_max_payload_size) {
+        return false;
+    }
+    std::copy(payload.begin(), payload.end(), m_tx_buffer.begin());
+    m_tx_size = payload.size();
+    m_tx_offset = 0;
+    m_tx_time = now;
+    m_tx_state = m_tx_size <= k_single_frame_capacity ? TxState::SendSingle : TxState::SendFirst;
+    return true;
+}
+
+void Link::handle_flow_control(const can::RawMessage &frame, std::uint32_t now) {
+    if (m_tx_state != TxState::WaitFlowControl || frame.length < 3) {
+        return;
+    }
+
+    switch (frame.byte(0) & 0xfu) {
+    case k_continue_to_send:
+        m_tx_block_size = frame.byte(1);
+        m_tx_st_min = decode_st_min(frame.byte(2));
+        m_tx_block_count = 0;
+        m_tx_wait_count = 0;
+        m_tx_time = now;
+        m_tx_state = TxState::SendConsecutive;
+        break;
+    case k_wait:
+        // Restart the timeout for the next flow control frame.
+        if (++m_tx_wait_count > k_max_wait_count) {
+            abort_tx();
+        }
+        m_tx_time = now;
+        break;
+    default:
+        // Overflow or an invalid flow status.
+        abort_tx();
+        break;
+    }
+}
+
+void Link::on_frame(const can::RawMessage &frame, std::uint32_t now) {
+    if (frame.is_remote() || (frame.id_word & ~1u) != m_rx_id_word || frame.length == 0) {
+        return;
+    }
+
+    const auto data = frame.data();
+    switch (frame.byte(0) >> 4u) {
+    case k_single_frame: {
+        const std::size_t length = frame.byte(0) & 0xfu;
+        if (length == 0 || length > k_single_frame_capacity || length >= frame.length) {
+            return;
+        }
+        if (m_rx_state == RxState::Complete || length > m_rx_buffer.size()) {
+            m_statistics.rx_error_count++;
+            return;
+        }
+        if (m_rx_state == RxState::Receiving) {
+            // A new message interrupts the one in progress.
+            abort_rx();
+        }
+        std::copy_n(data.begin() + 1, length, m_rx_buffer.begin());
+        m_rx_size = length;
+        m_rx_state = RxState::Complete;
+        m_statistics.rx_complete_count++;
+        break;
+    }
+    case k_first_frame: {
+        const std::size_t size = ((frame.byte(0) & 0xfu) << 8u) | frame.byte(1);
+        if (size <= k_single_frame_capacity || frame.length < 8) {
+            return;
+        }
+        if (m_rx_state == RxState::Complete || size > m_rx_buffer.size()) {
+            queue_flow_control(k_overflow);
+            m_statistics.rx_error_count++;
+            return;
+        }
+        if (m_rx_state == RxState::Receiving) {
+            abort_rx();
+        }
+        std::copy_n(data.begin() + 2, k_first_frame_capacity, m_rx_buffer.begin());
+        m_rx_size = size;
+        m_rx_offset = k_first_frame_capacity;
+        m_rx_sequence = 1;
+        m_rx_block_count = 0;
+        m_rx_time = now;
+        m_rx_state = RxState::Receiving;
+        queue_flow_control(k_continue_to_send);
+        break;
+    }
+    case k_consecutive_frame: {
+        if (m_rx_state != RxState::Receiving) {
+            return;
+        }
+        const auto length = std::min(k_consecutive_frame_capacity, m_rx_size - m_rx_offset);
+        if ((frame.byte(0) & 0xfu) != m_rx_sequence || frame.length < length + 1) {
+            abort_rx();
+            return;
+        }
+        std::copy_n(data.begin() + 1, length, m_rx_buffer.begin() + static_cast<std::ptrdiff_t>(m_rx_offset));
+        m_rx_offset += length;
+        m_rx_sequence = (m_rx_sequence + 1) & 0xfu;
+        m_rx_time = now;
+        if (m_rx_offset == m_rx_size) {
+            m_rx_state = RxState::Complete;
+            m_statistics.rx_complete_count++;
+        } else if (m_config.block_size != 0 && ++m_rx_block_count == m_config.block_size) {
+            m_rx_block_count = 0;
+            queue_flow_control(k_continue_to_send);
+        }
+        break;
+    }
+    case k_flow_control:
+        handle_flow_control(frame, now);
+        break;
+    default:
+        break;
+    }
+}
+
+std::optional<can::RawMessage> Link::poll(std::uint32_t now) {
+    if (m_tx_state == TxState::WaitFlowControl && reached(now, m_tx_time + m_config.timeout)) {
+        abort_tx();
+    }
+    if (m_rx_state == RxState::Receiving && reached(now, m_rx_time + m_config.timeout)) {
+        abort_rx();
+    }
+
+    if (m_flow_control) {
+        return std::exchange(m_flow_control, std::nullopt);
+    }
+
+    std::array<std::uint8_t, 8> bytes{};
+    switch (m_tx_state) {
+    case TxState::SendSingle:
+        bytes[0] = static_cast<std::uint8_t>((k_single_frame << 4u) | m_tx_size);
+        std::copy_n(m_tx_buffer.begin(), m_tx_size, bytes.begin() + 1);
+        m_tx_state = TxState::Idle;
+        m_statistics.tx_complete_count++;
+        return build_frame(std::span(bytes).first(m_tx_size + 1));
+    case TxState::SendFirst:
+        bytes[0] = static_cast<std::uint8_t>((k_first_frame << 4u) | (m_tx_size >> 8u));
+        bytes[1] = static_cast<std::uint8_t>(m_tx_size);
+        std::copy_n(m_tx_buffer.begin(), k_first_frame_capacity, bytes.begin() + 2);
+        m_tx_offset = k_first_frame_capacity;
+        m_tx_sequence = 1;
+        m_tx_wait_count = 0;
+        m_tx_time = now;
+        m_tx_state = TxState::WaitFlowControl;
+        return build_frame(bytes);
+    case TxState::SendConsecutive: {
+        if (!reached(now, m_tx_time)) {
+            return std::nullopt;
+        }
+        const auto length = std::min(k_consecutive_frame_capacity, m_tx_size - m_tx_offset);
+        bytes[0] = static_cast<std::uint8_t>((k_consecutive_frame << 4u) | m_tx_sequence);
+        std::copy_n(m_tx_buffer.begin() + static_cast<std::ptrdiff_t>(m_tx_offset), length, bytes.begin() + 1);
+        m_tx_offset += length;
+        m_tx_sequence = (m_tx_sequence + 1) & 0xfu;
+        m_tx_time = now + m_tx_st_min;
+        if (m_tx_offset == m_tx_size) {
+            m_tx_state = TxState::Idle;
+            m_statistics.tx_complete_count++;
+        } else if (m_tx_block_size != 0 && ++m_tx_block_count == m_tx_block_size) {
+            m_tx_time = now;
+            m_tx_state = TxState::WaitFlowControl;
+        }
+        return build_frame(std::span(bytes).first(length + 1));
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<std::span<const std::uint8_t>> Link::received() const {
+    if (m_rx_state != RxState::Complete) {
+        return std::nullopt;
+    }
+    return m_rx_buffer.first(m_rx_size);
+}
+
+void Link::release() {
+    if (m_rx_state == RxState::Complete) {
+        m_rx_state = RxState::Idle;
+    }
+}
+
+} // namespace isotp
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <can.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace isotp {
+
+/// Largest payload which can be described by a classic first frame.
+constexpr std::size_t k_max_payload_size = 4095;
+
+/// Byte used to pad every frame to eight bytes.
+constexpr std::uint8_t k_padding = 0xcc;
+
+/// Largest number of consecutive wait flow control frames accepted before a transfer is aborted.
+constexpr std::uint8_t k_max_wait_count = 10;
+
+/// A struct which holds the configuration of one end of an ISO-TP link.
+struct Config {
+    /// Identifier which frames are sent on.
+    std::uint32_t tx_id;
+
+    /// Identifier which frames are received on.
+    std::uint32_t rx_id;
+
+    /// True if both identifiers are extended; false if they are standard.
+    bool extended;
+
+    /// Number of consecutive frames the peer may send before waiting for the next flow control frame, or zero to
+    /// receive the whole message without further flow control.
+    std::uint8_t block_size{0};
+
+    /// Minimum separation time the peer must leave between consecutive frames, in the encoding used on the wire:
+    /// 0x00-0x7f are milliseconds and 0xf1-0xf9 are 100-900 microseconds.
+    std::uint8_t st_min{0};
+
+    /// Time in milliseconds to wait for a flow control or consecutive frame before aborting a transfer.
+    std::uint32_t timeout{1000};
+};
+
+/// Counters of completed and failed transfers.
+struct Statistics {
+    std::uint32_t tx_complete_count;
+    std::uint32_t rx_complete_count;
+
+    /// Transfers aborted due to a timeout, an overflow reported by the peer, or too many wait frames.
+    std::uint32_t tx_error_count;
+
+    /// Transfers aborted due to a timeout, a wrong sequence number, or a message which didn't fit into the buffer.
+    std::uint32_t rx_error_count;
+};
+
+/**
+ * Decodes a separation time from its wire encoding, rounding sub-millisecond values up to one millisecond. Reserved
+ * values are treated as the maximum of 127 milliseconds.
+ *
+ * @param st_min the encoded separation time
+ * @return the separation time in milliseconds
+ */
+constexpr std::uint32_t decode_st_min(std::uint8_t st_min) {
+    if (st_min <= 0x7f) {
+        return st_min;
+    }
+    if (st_min >= 0xf1 && st_min <= 0xf9) {
+        return 1;
+    }
+    return 0x7f;
+}
+
+/**
+ * A class which implements both directions of an ISO 15765-2 transport link using buffers owned by the caller. Received
+ * frames are passed to on_frame from the receive path, and frames to send are pulled with poll, which allows the caller
+ * to only take as many frames as the transmit queue has room for. All member functions must be called from the same
+ * context.
+ */
+class Link {
+    enum class TxState : std::uint8_t {
+        Idle,
+        SendSingle,
+        SendFirst,
+        WaitFlowControl,
+        SendConsecutive,
+    };
+
+    enum class RxState : std::uint8_t {
+        Idle,
+        Receiving,
+        Complete,
+    };
+
+    Config m_config;
+    std::uint32_t m_tx_id_word;
+    std::uint32_t m_rx_id_word;
+    std::span<std::uint8_t> m_rx_buffer;
+    std::span<std::uint8_t> m_tx_buffer;
+    Statistics m_statistics{};
+
+    // Transmit state.
+    TxState m_tx_state{TxState::Idle};
+    std::size_t m_tx_size{0};
+    std::size_t m_tx_offset{0};
+    std::uint8_t m_tx_sequence{0};
+    std::uint8_t m_tx_block_size{0};
+    std::uint8_t m_tx_block_count{0};
+    std::uint8_t m_tx_wait_count{0};
+    std::uint32_t m_tx_st_min{0};
+    std::uint32_t m_tx_time{0};
+
+    // Receive state.
+    RxState m_rx_state{RxState::Idle};
+    std::size_t m_rx_size{0};
+    std::size_t m_rx_offset{0};
+    std::uint8_t m_rx_sequence{0};
+    std::uint8_t m_rx_block_count{0};
+    std::uint32_t m_rx_time{0};
+
+    // A flow control frame waiting to be sent, which takes priority over data frames.
+    std::optional<can::RawMessage> m_flow_control;
+
+    can::RawMessage build_frame(std::span<const std::uint8_t> bytes) const;
+    void queue_flow_control(std::uint8_t status);
+    void handle_flow_control(const can::RawMessage &frame, std::uint32_t now);
+    void abort_tx();
+    void abort_rx();
+
+public:
+    /**
+     * @param config the link configuration
+     * @param rx_buffer storage for received messages, which limits the largest message which can be received
+     * @param tx_buffer storage for messages being sent, which limits the largest message which can be sent
+     */
+    Link(const Config &config, std::span<std::uint8_t> rx_buffer, std::span<std::uint8_t> tx_buffer);
+
+    /**
+     * Starts sending the given payload. The payload is copied, so it doesn't need to outlive the transfer.
+     *
+     * @param payload the payload to send
+     * @param now the current time in milliseconds
+     * @return true if the transfer was started; false if a transfer is in progress or the payload is too large
+     */
+    bool send(std::span<const std::uint8_t> payload, std::uint32_t now);
+
+    /**
+     * Handles a received frame. Frames with an identifier other than the configured receive identifier are ignored.
+     *
+     * @param frame the received frame
+     * @param now the current time in milliseconds
+     */
+    void on_frame(const can::RawMessage &frame, std::uint32_t now);
+
+    /**
+     * Checks for timeouts and returns the next frame to send, if any. Should be called repeatedly until it returns
+     * std::nullopt or the transmit queue is full, and then called again periodically.
+     *
+     * @param now the current time in milliseconds
+     * @return the next frame to send
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now);
+
+    /**
+     * @return the completely received message, which stays valid until release is called; std::nullopt if no message
+     * has been completely received
+     */
+    std::optional<std::span<const std::uint8_t>> received() const;
+
+    /**
+     * Releases the received message, allowing the next message to be received. Until then, new messages are rejected.
+     */
+    void release();
+
+    /**
+     * @return true if a transfer started with send hasn't finished yet; false otherwise
+     */
+    bool is_sending() const { return m_tx_state != TxState::Idle; }
+
+    const Statistics &statistics() const { return m_statistics; }
+};
+
+} // namespace isotp
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace throttle {
+
+/// Current requested at full throttle, in the units of dti::build_set_relative_current (0.1%).
+constexpr std::uint16_t k_max_current = 1000;
+
+/// Fixed-point pedal position of a fully pressed pedal; a released pedal is zero.
+constexpr std::uint32_t k_position_bits = 16;
+constexpr std::uint32_t k_full_position = 1u << k_position_bits;
+
+/// Number of straight segments the curve is split into, as a power of two so that a position splits into a segment and
+/// an offset within it with shifts.
+constexpr std::uint32_t k_segment_bits = 7;
+constexpr std::uint32_t k_segment_count = 1u << k_segment_bits;
+
+/// Shape of the throttle curve, a sigmoid of the normalised pedal position.
+struct CurveShape {
+    /// Slope of the sigmoid; larger values give a sharper step around the midpoint.
+    float steepness;
+
+    /// Normalised pedal position, from 0 to 1, at which half of the maximum current is requested.
+    float midpoint;
+};
+
+namespace detail {
+
+// e^x by range reduction to |r| <= ln(2) / 2 and a Taylor series, which is exact to within a few ulps, since std::exp
+// can't be used in a constant expression.
+constexpr double exp(double x) {
+    constexpr double ln2 = 0.693147180559945309417;
+    const auto n = static_cast<int>(x / ln2 + (x < 0.0 ? -0.5 : 0.5));
+    const double r = x - n * ln2;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int i = 1; i < 18; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (int i = 0; i < n; i++) {
+        sum *= 2.0;
+    }
+    for (int i = 0; i > n; i--) {
+        sum *= 0.5;
+    }
+    return sum;
+}
+
+// The sigmoid, saturated where it is within a rounding error of 0 or 1. A NaN, e.g. from a bad parameter, gives 0.
+constexpr double sigmoid(double x) {
+    if (!(x > -40.0)) {
+        return 0.0;
+    }
+    if (x >= 40.0) {
+        return 1.0;
+    }
+    return 1.0 / (1.0 + exp(-x));
+}
+
+} // namespace detail
+
+/**
+ * The throttle curve as the floating point formula, which the table of Curve approximates. Too slow for the throttle
+ * update on a core without an FPU, but kept as the reference for tests and benchmarks.
+ *
+ * @param normalised the pedal position, from 0 for released to 1 for fully pressed
+ * @return the current to request, truncated to an integer
+ */
+inline std::uint16_t reference_current(float normalised, const CurveShape &shape) {
+    const float curve = 1.0f / (1.0f + std::exp(-shape.steepness * (normalised - shape.midpoint)));
+    return static_cast<std::uint16_t>(curve * static_cast<float>(k_max_current));
+}
+
+/**
+ * The throttle curve as a table of the current at k_segment_count + 1 evenly spaced pedal positions, which are
+ * linearly interpolated between. Lookup takes only integer operations. The table can be generated at compile time,
+ * or at runtime when the shape is recalibrated.
+ */
+class Curve {
+    CurveShape m_shape;
+    std::array<std::uint16_t, k_segment_count + 1> m_table{};
+
+public:
+    constexpr explicit Curve(const CurveShape &shape) : m_shape(shape) {
+        for (std::uint32_t i = 0; i <= k_segment_count; i++) {
+            const double position = static_cast<double>(i) / k_segment_count;
+            const double x = static_cast<double>(shape.steepness) * (position - static_cast<double>(shape.midpoint));
+            m_table[i] = static_cast<std::uint16_t>(detail::sigmoid(x) * k_max_current + 0.5);
+        }
+    }
+
+    /**
+     * @param position the fixed-point pedal position, from 0 to k_full_position; larger values are clamped
+     * @return the current to request, rounded to the nearest integer
+     */
+    constexpr std::uint16_t operator()(std::uint32_t position) const {
+        constexpr std::uint32_t offset_bits = k_position_bits - k_segment_bits;
+        if (position >= k_full_position) {
+            return m_table.back();
+        }
+        const auto segment = position >> offset_bits;
+        const auto offset = static_cast<std::int32_t>(position & ((1u << offset_bits) - 1u));
+        const auto start = static_cast<std::int32_t>(m_table[segment]);
+        const auto rise = static_cast<std::int32_t>(m_table[segment + 1]) - start;
+        return static_cast<std::uint16_t>(start + ((rise * offset + (1 << (offset_bits - 1))) >> offset_bits));
+    }
+
+    const CurveShape &shape() const { return m_shape; }
+    const std::array<std::uint16_t, k_segment_count + 1> &table() const { return m_table; }
+};
+
+/**
+ * Normalises a pedal sensor reading against its calibration. The sensor reads highest with the pedal released.
+ *
+ * @param reading the ADC reading
+ * @param min_value the calibrated reading with the pedal fully pressed
+ * @param max_value the calibrated reading with the pedal released
+ * @return the fixed-point pedal position, clamped to the range from 0 to k_full_position
+ */
+constexpr std::uint32_t pedal_position(std::uint16_t reading, std::uint16_t min_value, std::uint16_t max_value) {
+    if (max_value <= min_value || reading >= max_value) {
+        return 0;
+    }
+    if (reading <= min_value) {
+        return k_full_position;
+    }
+    return (static_cast<std::uint32_t>(max_value - reading) << k_position_bits) / (max_value - min_value);
+}
+
+} // namespace throttle
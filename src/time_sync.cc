@@ -0,0 +1,150 @@
+#include <time_sync.hh>
+
+#include <can.hh>
+#include <util.hh>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace time_sync {
+namespace {
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+bool is_frame(const can::RawMessage &message, std::uint16_t id, std::uint8_t length) {
+    return !message.is_remote() && message.is_standard() && message.standard_id() == id && message.length >= length;
+}
+
+// Applies a rate error in units of 2^-32 to a duration in microseconds.
+std::int64_t apply_drift(std::int64_t duration, std::int32_t drift) {
+    return duration + ((duration * drift) >> 32);
+}
+
+std::int32_t clamp_drift(std::int64_t drift) {
+    return static_cast<std::int32_t>(std::clamp<std::int64_t>(drift, INT32_MIN, INT32_MAX));
+}
+
+} // namespace
+
+void Clock::publish(std::uint32_t reference, std::uint64_t time, std::int32_t drift) {
+    const auto index = static_cast<std::uint8_t>(m_index.load(std::memory_order_relaxed) ^ 1u);
+    m_mappings[index] = {reference, time, drift};
+    m_index.store(index, std::memory_order_release);
+    m_valid.store(true, std::memory_order_release);
+}
+
+std::optional<std::uint64_t> Clock::time(std::uint32_t ticks) const {
+    if (!m_valid.load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    const auto mapping = m_mappings[m_index.load(std::memory_order_acquire)];
+    const auto elapsed = ticks_to_us(static_cast<std::int32_t>(ticks - mapping.reference));
+    return mapping.time + static_cast<std::uint64_t>(apply_drift(elapsed, mapping.drift));
+}
+
+std::optional<can::RawMessage> Master::poll(std::uint32_t now) {
+    if (m_follow_up_pending.exchange(false, std::memory_order_acquire)) {
+        const auto time = util::write_be(static_cast<std::uint64_t>(m_clock.ticks_to_us(m_ticks)));
+        std::array<std::uint8_t, 8> data{m_sequence};
+        std::copy(time.begin() + 1, time.end(), data.begin() + 1);
+        m_statistics.follow_up_count++;
+        return can::RawMessage::standard(m_config.follow_up_id, data);
+    }
+    if (m_started && !reached(now, m_last_sync + m_config.period)) {
+        return std::nullopt;
+    }
+
+    // A sync frame which was never sent, e.g. during bus-off, is simply superseded by the next one.
+    m_started = true;
+    m_last_sync = now;
+    m_sequence++;
+    m_statistics.sync_count++;
+    return can::RawMessage::standard(m_config.sync_id, std::to_array({m_sequence}));
+}
+
+void Master::on_transmit(const can::RawMessage &message, std::uint32_t timestamp) {
+    if (!is_frame(message, m_config.sync_id, 1) || message.byte(0) != m_sequence) {
+        return;
+    }
+
+    // Extend the local time stamps into 64 bits, with vehicle time starting at the first sync frame. Sync frames are
+    // far less than 2^32 ticks apart.
+    if (!m_first_sync) {
+        m_ticks += timestamp - m_sync_ticks;
+    }
+    m_first_sync = false;
+    m_sync_ticks = timestamp;
+    m_clock.publish(timestamp, static_cast<std::uint64_t>(m_clock.ticks_to_us(m_ticks)), 0);
+    m_follow_up_pending.store(true, std::memory_order_release);
+}
+
+void Slave::on_frame(const can::RawMessage &message, std::uint32_t timestamp) {
+    if (is_frame(message, m_config.sync_id, 1)) {
+        m_sequence = message.byte(0);
+        m_sync_ticks = timestamp;
+        m_sync_pending = true;
+    } else if (is_frame(message, m_config.follow_up_id, 8) && m_sync_pending && message.byte(0) == m_sequence) {
+        m_sync_pending = false;
+        const auto data = message.data();
+        std::array<std::uint8_t, 8> time{};
+        std::copy(data.begin() + 1, data.end(), time.begin() + 1);
+        synchronise(m_sync_ticks, util::read_be<std::uint64_t>(time));
+    }
+}
+
+void Slave::synchronise(std::uint32_t ticks, std::uint64_t master) {
+    m_statistics.sync_count++;
+    m_local += static_cast<std::uint64_t>(
+        m_clock.ticks_to_us(m_history_count != 0 ? static_cast<std::int32_t>(ticks - m_last_ticks) : 0));
+    m_last_ticks = ticks;
+    m_last_point.store(ticks, std::memory_order_relaxed);
+    m_synchronised.store(true, std::memory_order_relaxed);
+
+    const auto predicted = m_clock.time(ticks);
+    const auto error = predicted ? static_cast<std::int64_t>(master - *predicted) : INT64_MAX;
+    if (error > k_step_threshold || error < -static_cast<std::int64_t>(k_step_threshold)) {
+        // The master's time has jumped, so the history no longer applies.
+        m_statistics.step_count++;
+        m_history_count = 0;
+    }
+
+    // Shift the new point into the history and estimate drift from the oldest one.
+    std::move_backward(m_history.begin(), m_history.end() - 1, m_history.end());
+    m_history[0] = {m_local, master};
+    m_history_count = std::min(m_history_count + 1, m_history.size());
+    const auto &oldest = m_history[m_history_count - 1];
+    const auto local_span = static_cast<std::int64_t>(m_local - oldest.local);
+    if (local_span > 0) {
+        const auto master_span = static_cast<std::int64_t>(master - oldest.master);
+        m_statistics.drift = clamp_drift(((master_span - local_span) << 32) / local_span);
+    } else {
+        m_statistics.drift = 0;
+    }
+
+    if (m_history_count == 1) {
+        m_statistics.last_error = 0;
+        m_clock.publish(ticks, master, m_statistics.drift);
+        return;
+    }
+
+    // Continue from the current clock and correct the error over the next period.
+    m_statistics.last_error = static_cast<std::int32_t>(error);
+    m_statistics.max_error = std::max(m_statistics.max_error, static_cast<std::uint32_t>(error < 0 ? -error : error));
+    const auto period = static_cast<std::int64_t>(m_config.period) * 1000;
+    m_clock.publish(ticks, *predicted, clamp_drift(m_statistics.drift + (error << 32) / period));
+}
+
+bool Slave::is_synchronised(std::uint32_t ticks) const {
+    const auto elapsed = static_cast<std::int64_t>(ticks - m_last_point.load(std::memory_order_relaxed));
+    return m_synchronised.load(std::memory_order_relaxed) &&
+           m_clock.ticks_to_us(elapsed) < static_cast<std::int64_t>(m_config.timeout) * 1000;
+}
+
+} // namespace time_sync
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace time_sync {
+
+/// Number of past synchronisation points the slave estimates drift over.
+constexpr std::size_t k_history_size = 8;
+
+/// Error in microseconds above which the slave steps its clock rather than slewing it.
+constexpr std::uint32_t k_step_threshold = 1000;
+
+/// A struct which describes the CAN identifiers and timing shared by a master and its slaves. Both identifiers are
+/// standard.
+struct Config {
+    /// Identifier of the sync frame, [sequence]. Its start of frame is the synchronisation point.
+    std::uint16_t sync_id{0x0f0};
+
+    /// Identifier of the follow-up frame, [sequence, time (7)], which carries the master's vehicle time in microseconds
+    /// at the start of the sync frame with the same sequence number, big endian.
+    std::uint16_t follow_up_id{0x0f1};
+
+    /// Rate in hertz of the time stamps passed in, which is the bit rate for CAN time stamps.
+    std::uint32_t tick_rate{500'000};
+
+    /// Time in milliseconds between sync frames.
+    std::uint32_t period{100};
+
+    /// Time in milliseconds without a synchronisation point after which a slave is no longer synchronised.
+    std::uint32_t timeout{500};
+};
+
+/**
+ * A class which maps local time stamps onto vehicle time. The mapping is written by one context and may be read from
+ * any other, using two copies so that a reader never sees a half-written one.
+ */
+class Clock {
+    struct Mapping {
+        std::uint32_t reference;
+        std::uint64_t time;
+
+        // Rate error relative to the local clock in units of 2^-32.
+        std::int32_t drift;
+    };
+
+    std::uint32_t m_tick_rate;
+    std::array<Mapping, 2> m_mappings{};
+    std::atomic<std::uint8_t> m_index{0};
+    std::atomic<bool> m_valid{false};
+
+public:
+    explicit Clock(std::uint32_t tick_rate) : m_tick_rate(tick_rate) {}
+
+    /**
+     * Replaces the mapping. Must only be called from a single context.
+     *
+     * @param reference a local time stamp
+     * @param time the vehicle time in microseconds at the local time stamp
+     * @param drift the rate of vehicle time relative to local time, less one, in units of 2^-32
+     */
+    void publish(std::uint32_t reference, std::uint64_t time, std::int32_t drift);
+
+    /**
+     * Converts a local time stamp into vehicle time. The time stamp must be within 2^31 ticks of the reference of the
+     * mapping, either side.
+     *
+     * @return the vehicle time in microseconds; std::nullopt if no mapping has been published
+     */
+    std::optional<std::uint64_t> time(std::uint32_t ticks) const;
+
+    /**
+     * @return the number of microseconds in the given number of ticks
+     */
+    std::int64_t ticks_to_us(std::int64_t ticks) const { return ticks * 1'000'000 / m_tick_rate; }
+};
+
+/// Counters of a master.
+struct MasterStatistics {
+    std::uint32_t sync_count;
+    std::uint32_t follow_up_count;
+};
+
+/**
+ * The node which defines vehicle time, which is its own local time since its first sync frame. A sync frame is sent
+ * every period, and once it has been sent, a follow-up frame with the time of its start of frame. Time stamps must be
+ * enabled in can::init, and on_transmit must be called from the transmit callback.
+ */
+class Master {
+    const Config m_config;
+    Clock m_clock;
+    std::uint32_t m_last_sync{0};
+    bool m_started{false};
+    std::uint8_t m_sequence{0};
+
+    // Written by on_transmit, which may interrupt poll.
+    std::uint32_t m_sync_ticks{0};
+    std::int64_t m_ticks{0};
+    bool m_first_sync{true};
+    std::atomic<bool> m_follow_up_pending{false};
+    MasterStatistics m_statistics{};
+
+public:
+    explicit Master(const Config &config) : m_config(config), m_clock(config.tick_rate) {}
+    Master(const Master &) = delete;
+    Master &operator=(const Master &) = delete;
+
+    /**
+     * @param now the current time in milliseconds
+     * @return the next frame to send, if any
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now);
+
+    /**
+     * Records the time stamp of a sent sync frame. Other frames are ignored.
+     *
+     * @param message the sent frame
+     * @param timestamp the time stamp passed to the transmit callback
+     */
+    void on_transmit(const can::RawMessage &message, std::uint32_t timestamp);
+
+    /**
+     * @param ticks a local time stamp
+     * @return the vehicle time in microseconds; std::nullopt until the first sync frame has been sent
+     */
+    std::optional<std::uint64_t> time(std::uint32_t ticks) const { return m_clock.time(ticks); }
+
+    const MasterStatistics &statistics() const { return m_statistics; }
+};
+
+/// Counters and estimates of a slave.
+struct SlaveStatistics {
+    std::uint32_t sync_count;
+
+    /// Synchronisation points where the clock was stepped rather than slewed.
+    std::uint32_t step_count;
+
+    /// Difference between the master's time and the slave's clock at the last synchronisation point, in microseconds.
+    std::int32_t last_error;
+
+    /// Largest absolute error of a slewed synchronisation point, in microseconds.
+    std::uint32_t max_error;
+
+    /// Estimated rate of vehicle time relative to local time, less one, in units of 2^-32.
+    std::int32_t drift;
+};
+
+/**
+ * A node which follows the master's vehicle time. The offset is measured at each synchronisation point and the drift
+ * over the last k_history_size of them. Small errors are slewed out over the next period by adjusting the rate, which
+ * keeps the clock continuous and monotonic; errors above k_step_threshold, such as on the first synchronisation or
+ * after the master restarts, step the clock. Time stamps must be enabled in can::init, and on_frame must be called
+ * from a single context.
+ */
+class Slave {
+    struct Point {
+        std::uint64_t local;
+        std::uint64_t master;
+    };
+
+    const Config m_config;
+    Clock m_clock;
+    std::uint8_t m_sequence{0};
+    std::uint32_t m_sync_ticks{0};
+    bool m_sync_pending{false};
+
+    // Local time stamps extended into microseconds since the first synchronisation point.
+    std::uint32_t m_last_ticks{0};
+    std::uint64_t m_local{0};
+
+    std::array<Point, k_history_size> m_history{};
+    std::size_t m_history_count{0};
+    std::atomic<std::uint32_t> m_last_point{0};
+    std::atomic<bool> m_synchronised{false};
+    SlaveStatistics m_statistics{};
+
+    void synchronise(std::uint32_t ticks, std::uint64_t master);
+
+public:
+    explicit Slave(const Config &config) : m_config(config), m_clock(config.tick_rate) {}
+    Slave(const Slave &) = delete;
+    Slave &operator=(const Slave &) = delete;
+
+    /**
+     * Handles a received sync or follow-up frame. Other frames are ignored.
+     *
+     * @param message the received frame
+     * @param timestamp the time stamp passed to the FIFO callback
+     */
+    void on_frame(const can::RawMessage &message, std::uint32_t timestamp);
+
+    /**
+     * @param ticks a local time stamp
+     * @return the vehicle time in microseconds; std::nullopt until the first synchronisation point
+     */
+    std::optional<std::uint64_t> time(std::uint32_t ticks) const { return m_clock.time(ticks); }
+
+    /**
+     * @param ticks the current local time stamp
+     * @return true if the last synchronisation point was less than the timeout ago
+     */
+    bool is_synchronised(std::uint32_t ticks) const;
+
+    const SlaveStatistics &statistics() const { return m_statistics; }
+};
+
+} // namespace time_sync
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
@@ -61,6 +64,56 @@ public:
     ScopeGuard &operator=(ScopeGuard &&) = delete;
 };
 
+/**
+ * A lock-free ring buffer for a single producer and a single consumer, e.g. an ISR and thread context. One side may
+ * only call push and the other may only call pop.
+ *
+ * @tparam T a trivially-copyable element type
+ * @tparam Capacity the number of elements; must be a power of two
+ */
+template <trivially_copyable T, std::size_t Capacity>
+class SpscRing {
+    static_assert(std::has_single_bit(Capacity));
+
+    std::array<T, Capacity> m_buffer{};
+    std::atomic<std::uint32_t> m_head{0};
+    std::atomic<std::uint32_t> m_tail{0};
+
+public:
+    /**
+     * Appends an element to the ring. Must only be called by the producer.
+     *
+     * @return true if the element was appended; false if the ring is full
+     */
+    bool push(const T &value) {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_buffer[head & (Capacity - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Removes the oldest element from the ring. Must only be called by the consumer.
+     *
+     * @return true if an element was removed into value; false if the ring is empty
+     */
+    bool pop(T &value) {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        value = m_buffer[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+};
+
 /**
  * Clamps the given value to the range [min_value, max_value].
  *
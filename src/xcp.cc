@@ -0,0 +1,654 @@
+#include <xcp.hh>
+
+#include <can.hh>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+
+namespace xcp {
+namespace {
+
+// Resources reported by Connect: calibration and DAQ.
+constexpr std::uint8_t k_resource_cal_pag = 0x01;
+constexpr std::uint8_t k_resource_daq = 0x04;
+
+// Session status bit reported by GetStatus while any DAQ list is running.
+constexpr std::uint8_t k_status_daq_running = 0x40;
+
+constexpr std::uint8_t k_xcp_version = 1;
+
+// Minimum length of each command, indexed by the command code less the lowest code.
+constexpr std::uint8_t k_lowest_command = 0xc0;
+constexpr auto k_command_lengths = [] {
+    std::array<std::uint8_t, 0x100 - k_lowest_command> lengths{};
+    const auto set = [&](Command command, std::uint8_t length) {
+        lengths[static_cast<std::uint8_t>(command) - k_lowest_command] = length;
+    };
+    set(Command::Connect, 2);
+    set(Command::Disconnect, 1);
+    set(Command::GetStatus, 1);
+    set(Command::SetMta, 8);
+    set(Command::Upload, 2);
+    set(Command::ShortUpload, 8);
+    set(Command::Download, 2);
+    set(Command::SetDaqPtr, 6);
+    set(Command::WriteDaq, 8);
+    set(Command::SetDaqListMode, 8);
+    set(Command::StartStopDaqList, 4);
+    set(Command::StartStopSynch, 2);
+    set(Command::FreeDaq, 1);
+    set(Command::AllocDaq, 4);
+    set(Command::AllocOdt, 5);
+    set(Command::AllocOdtEntry, 6);
+    return lengths;
+}();
+
+bool reached(std::uint32_t now, std::uint32_t time) {
+    return static_cast<std::int32_t>(now - time) >= 0;
+}
+
+std::uint16_t read_le16(const can::RawMessage &message, std::size_t offset) {
+    return static_cast<std::uint16_t>(message.byte(offset) | (message.byte(offset + 1) << 8u));
+}
+
+std::uint32_t read_le32(const can::RawMessage &message, std::size_t offset) {
+    return static_cast<std::uint32_t>(read_le16(message, offset)) |
+           (static_cast<std::uint32_t>(read_le16(message, offset + 2)) << 16u);
+}
+
+void write_le(std::span<std::uint8_t> bytes, std::uint32_t value) {
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<std::uint8_t>(value >> (8u * i));
+    }
+}
+
+std::uint32_t read_variable(const Variable &variable) {
+    switch (type_size(variable.type)) {
+    case 1:
+        return *static_cast<const volatile std::uint8_t *>(variable.address);
+    case 2:
+        return *static_cast<const volatile std::uint16_t *>(variable.address);
+    default:
+        return *static_cast<const volatile std::uint32_t *>(variable.address);
+    }
+}
+
+void write_variable(const Variable &variable, std::uint32_t raw) {
+    switch (type_size(variable.type)) {
+    case 1:
+        *static_cast<volatile std::uint8_t *>(variable.address) = static_cast<std::uint8_t>(raw);
+        break;
+    case 2:
+        *static_cast<volatile std::uint16_t *>(variable.address) = static_cast<std::uint16_t>(raw);
+        break;
+    default:
+        *static_cast<volatile std::uint32_t *>(variable.address) = raw;
+        break;
+    }
+}
+
+// Calls the given function with the ODT index and byte offset of each measurement in turn, packing measurements into
+// ODTs in order and starting a new ODT whenever the next one doesn't fit.
+template <typename F>
+void pack(std::span<const Measurement> measurements, F &&function) {
+    std::size_t odt = 0;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < measurements.size(); i++) {
+        const auto size = type_size(measurements[i].type);
+        if (offset + size > k_odt_size) {
+            odt++;
+            offset = 0;
+        }
+        function(odt, offset, i);
+        offset += size;
+    }
+}
+
+} // namespace
+
+std::size_t odt_count(std::span<const Measurement> measurements) {
+    std::size_t count = 0;
+    pack(measurements, [&](std::size_t odt, std::size_t, std::size_t) {
+        count = odt + 1;
+    });
+    return count;
+}
+
+double to_value(Type type, std::uint32_t raw) {
+    switch (type) {
+    case Type::U8:
+        return static_cast<std::uint8_t>(raw);
+    case Type::I8:
+        return static_cast<std::int8_t>(raw);
+    case Type::U16:
+        return static_cast<std::uint16_t>(raw);
+    case Type::I16:
+        return static_cast<std::int16_t>(raw);
+    case Type::U32:
+        return raw;
+    case Type::I32:
+        return static_cast<std::int32_t>(raw);
+    case Type::F32:
+        return std::bit_cast<float>(raw);
+    }
+    return 0.0;
+}
+
+std::uint32_t from_value(Type type, double value) {
+    if (type == Type::F32) {
+        return std::bit_cast<std::uint32_t>(static_cast<float>(value));
+    }
+    const auto rounded = static_cast<std::int64_t>(std::lround(value));
+    const auto mask = type_size(type) == 4 ? 0xffffffffu : (1u << (8u * type_size(type))) - 1u;
+    return static_cast<std::uint32_t>(rounded) & mask;
+}
+
+bool Slave::is_daq_running() const {
+    return std::any_of(m_lists.begin(), m_lists.begin() + m_list_count, [](const DaqList &list) {
+        return list.running.load(std::memory_order_relaxed);
+    });
+}
+
+void Slave::free_daq() {
+    for (auto &list : m_lists) {
+        list.running.store(false, std::memory_order_relaxed);
+    }
+    m_list_count = 0;
+    m_odt_count = 0;
+    m_entry_count = 0;
+    m_stage = AllocStage::Free;
+    m_daq_pointer_valid = false;
+}
+
+std::optional<Error> Slave::upload(std::uint32_t address, std::size_t size, std::array<std::uint8_t, 8> &response,
+                                   std::size_t &length) {
+    if (address >= m_variables.size() || type_size(m_variables[address].type) != size) {
+        return Error::OutOfRange;
+    }
+    write_le(std::span(response).subspan(1, size), read_variable(m_variables[address]));
+    length = 1 + size;
+    m_mta = address + 1;
+    return std::nullopt;
+}
+
+std::optional<Error> Slave::handle(const can::RawMessage &message, std::array<std::uint8_t, 8> &response,
+                                   std::size_t &length) {
+    switch (static_cast<Command>(message.byte(0))) {
+    case Command::Connect:
+        m_connected = true;
+        response = {k_positive_response,
+                    k_resource_cal_pag | k_resource_daq,
+                    0,
+                    8,
+                    8,
+                    0,
+                    k_xcp_version,
+                    k_xcp_version};
+        length = 8;
+        return std::nullopt;
+    case Command::Disconnect:
+        m_connected = false;
+        free_daq();
+        return std::nullopt;
+    case Command::GetStatus:
+        response[1] = is_daq_running() ? k_status_daq_running : 0;
+        length = 6;
+        return std::nullopt;
+    case Command::SetMta:
+        if (message.byte(3) != 0) {
+            return Error::OutOfRange;
+        }
+        m_mta = read_le32(message, 4);
+        return std::nullopt;
+    case Command::Upload:
+        return upload(m_mta, message.byte(1), response, length);
+    case Command::ShortUpload:
+        if (message.byte(3) != 0) {
+            return Error::OutOfRange;
+        }
+        return upload(read_le32(message, 4), message.byte(1), response, length);
+    case Command::Download: {
+        const auto size = message.byte(1);
+        if (m_mta >= m_variables.size() || type_size(m_variables[m_mta].type) != size ||
+            message.length < 2 + size) {
+            return Error::OutOfRange;
+        }
+        if (!m_variables[m_mta].writable) {
+            return Error::WriteProtected;
+        }
+        std::uint32_t raw = 0;
+        for (std::size_t i = 0; i < size; i++) {
+            raw |= static_cast<std::uint32_t>(message.byte(2 + i)) << (8u * i);
+        }
+        write_variable(m_variables[m_mta++], raw);
+        return std::nullopt;
+    }
+    default:
+        return handle_daq(message, response, length);
+    }
+}
+
+std::optional<Error> Slave::handle_daq(const can::RawMessage &message, std::array<std::uint8_t, 8> &response,
+                                       std::size_t &length) {
+    const auto command = static_cast<Command>(message.byte(0));
+    if (command == Command::StartStopDaqList || command == Command::StartStopSynch) {
+        const auto mode = message.byte(1);
+        if (command == Command::StartStopSynch) {
+            if (mode > 2) {
+                return Error::ModeNotValid;
+            }
+            for (std::size_t i = 0; i < m_list_count; i++) {
+                auto &list = m_lists[i];
+                if (mode == 0 || list.selected) {
+                    list.counter = 0;
+                    list.running.store(mode == 1, std::memory_order_release);
+                    list.selected = false;
+                }
+            }
+            return std::nullopt;
+        }
+
+        const auto index = read_le16(message, 2);
+        if (index >= m_list_count) {
+            return Error::OutOfRange;
+        }
+        auto &list = m_lists[index];
+        if (mode > 2) {
+            return Error::ModeNotValid;
+        }
+        if (mode == 2) {
+            list.selected = true;
+        } else {
+            list.counter = 0;
+            list.running.store(mode == 1, std::memory_order_release);
+        }
+        response[1] = list.first_odt;
+        length = 2;
+        return std::nullopt;
+    }
+
+    // Every other DAQ command changes the configuration, which the sampling context reads without synchronisation.
+    if (is_daq_running()) {
+        return Error::DaqActive;
+    }
+
+    switch (command) {
+    case Command::FreeDaq:
+        free_daq();
+        return std::nullopt;
+    case Command::AllocDaq: {
+        const auto count = read_le16(message, 2);
+        if (m_stage != AllocStage::Free) {
+            return Error::Sequence;
+        }
+        if (count > k_max_daq_count) {
+            return Error::MemoryOverflow;
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            auto &list = m_lists[i];
+            list.first_odt = 0;
+            list.odt_count = 0;
+            list.event = 0;
+            list.prescaler = 1;
+            list.selected = false;
+        }
+        m_list_count = static_cast<std::uint8_t>(count);
+        m_stage = AllocStage::Daq;
+        return std::nullopt;
+    }
+    case Command::AllocOdt: {
+        const auto index = read_le16(message, 2);
+        const auto count = message.byte(4);
+        if (m_stage != AllocStage::Daq && m_stage != AllocStage::Odt) {
+            return Error::Sequence;
+        }
+        if (index >= m_list_count || m_lists[index].odt_count != 0) {
+            return Error::OutOfRange;
+        }
+        if (m_odt_count + count > k_max_odt_count) {
+            return Error::MemoryOverflow;
+        }
+        m_lists[index].first_odt = m_odt_count;
+        m_lists[index].odt_count = count;
+        for (std::size_t i = 0; i < count; i++) {
+            m_odts[m_odt_count + i] = {};
+        }
+        m_odt_count = static_cast<std::uint8_t>(m_odt_count + count);
+        m_stage = AllocStage::Odt;
+        return std::nullopt;
+    }
+    case Command::AllocOdtEntry: {
+        const auto index = read_le16(message, 2);
+        const auto odt_index = message.byte(4);
+        const auto count = message.byte(5);
+        if (m_stage != AllocStage::Odt && m_stage != AllocStage::Entry) {
+            return Error::Sequence;
+        }
+        if (index >= m_list_count || odt_index >= m_lists[index].odt_count || count > k_odt_size) {
+            return Error::OutOfRange;
+        }
+        auto &odt = m_odts[m_lists[index].first_odt + odt_index];
+        if (odt.entry_count != 0) {
+            return Error::Sequence;
+        }
+        if (m_entry_count + count > k_max_entry_count) {
+            return Error::MemoryOverflow;
+        }
+        odt = {m_entry_count, count, 0};
+        m_entry_count = static_cast<std::uint8_t>(m_entry_count + count);
+        m_stage = AllocStage::Entry;
+        return std::nullopt;
+    }
+    case Command::SetDaqPtr: {
+        const auto index = read_le16(message, 2);
+        const auto odt_index = message.byte(4);
+        const auto entry = message.byte(5);
+        if (index >= m_list_count || odt_index >= m_lists[index].odt_count ||
+            entry >= m_odts[m_lists[index].first_odt + odt_index].entry_count) {
+            return Error::OutOfRange;
+        }
+        m_daq_odt = static_cast<std::uint8_t>(m_lists[index].first_odt + odt_index);
+        m_daq_entry = entry;
+        m_daq_pointer_valid = true;
+        return std::nullopt;
+    }
+    case Command::WriteDaq: {
+        const auto size = message.byte(2);
+        const auto address = read_le32(message, 4);
+        if (!m_daq_pointer_valid || m_daq_entry >= m_odts[m_daq_odt].entry_count) {
+            return Error::Sequence;
+        }
+        if (message.byte(1) != 0xff || message.byte(3) != 0 || address >= m_variables.size() ||
+            type_size(m_variables[address].type) != size) {
+            return Error::OutOfRange;
+        }
+
+        // Entries are expected to be written in order, so the size of the ODT is that of the entries up to this one.
+        auto &odt = m_odts[m_daq_odt];
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < m_daq_entry; i++) {
+            offset += type_size(m_variables[m_entries[odt.first_entry + i]].type);
+        }
+        if (offset + size > k_odt_size) {
+            return Error::DaqConfig;
+        }
+        m_entries[odt.first_entry + m_daq_entry] = static_cast<std::uint16_t>(address);
+        odt.size = static_cast<std::uint8_t>(offset + size);
+        m_daq_entry++;
+        return std::nullopt;
+    }
+    case Command::SetDaqListMode: {
+        const auto index = read_le16(message, 2);
+        const auto prescaler = message.byte(6);
+        if (index >= m_list_count || prescaler == 0) {
+            return Error::OutOfRange;
+        }
+        if (message.byte(1) != 0) {
+            return Error::ModeNotValid;
+        }
+        m_lists[index].event = read_le16(message, 4);
+        m_lists[index].prescaler = prescaler;
+        return std::nullopt;
+    }
+    default:
+        return Error::CmdUnknown;
+    }
+}
+
+std::optional<can::RawMessage> Slave::on_frame(const can::RawMessage &message) {
+    if (message.is_remote() || message.is_extended() || message.standard_id() != m_config.command_id ||
+        message.length == 0) {
+        return std::nullopt;
+    }
+
+    const auto code = message.byte(0);
+    if (!m_connected && code != static_cast<std::uint8_t>(Command::Connect)) {
+        return std::nullopt;
+    }
+
+    m_statistics.command_count++;
+    std::array<std::uint8_t, 8> response{k_positive_response};
+    std::size_t length = 1;
+    std::optional<Error> error;
+    if (code < k_lowest_command || k_command_lengths[code - k_lowest_command] == 0) {
+        error = Error::CmdUnknown;
+    } else if (message.length < k_command_lengths[code - k_lowest_command]) {
+        error = Error::CmdSyntax;
+    } else {
+        error = handle(message, response, length);
+    }
+
+    if (error) {
+        m_statistics.error_count++;
+        response = {k_error_response, static_cast<std::uint8_t>(*error)};
+        length = 2;
+    }
+    return can::RawMessage::standard(m_config.response_id, std::span(response).first(length));
+}
+
+std::size_t Slave::sample(std::uint16_t event, std::span<can::RawMessage> frames) {
+    std::size_t frame_count = 0;
+    for (std::size_t i = 0; i < m_list_count; i++) {
+        auto &list = m_lists[i];
+        if (!list.running.load(std::memory_order_acquire) || list.event != event) {
+            continue;
+        }
+        if (++list.counter < list.prescaler) {
+            continue;
+        }
+        list.counter = 0;
+
+        for (std::size_t odt_index = list.first_odt; odt_index < list.first_odt + list.odt_count; odt_index++) {
+            if (frame_count == frames.size()) {
+                m_statistics.overflow_count++;
+                continue;
+            }
+            const auto &odt = m_odts[odt_index];
+            std::array<std::uint8_t, 8> data{static_cast<std::uint8_t>(odt_index)};
+            std::size_t offset = 1;
+            for (std::size_t entry = 0; entry < odt.entry_count; entry++) {
+                const auto &variable = m_variables[m_entries[odt.first_entry + entry]];
+                const auto size = type_size(variable.type);
+                write_le(std::span(data).subspan(offset, size), read_variable(variable));
+                offset += size;
+            }
+            frames[frame_count++] = can::RawMessage::standard(m_config.response_id, std::span(data).first(offset));
+        }
+    }
+    m_statistics.daq_frame_count += static_cast<std::uint32_t>(frame_count);
+    return frame_count;
+}
+
+bool Master::push(std::span<const std::uint8_t> data, std::optional<Type> upload_type) {
+    if (!is_busy()) {
+        m_command_count = 0;
+        m_next_command = 0;
+        m_waiting = false;
+        m_error.reset();
+        m_timed_out = false;
+    }
+    if (m_command_count == m_commands.size()) {
+        return false;
+    }
+    m_commands[m_command_count++] = {can::RawMessage::standard(m_config.command_id, data), upload_type};
+    return true;
+}
+
+bool Master::connect() {
+    return push(std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Command::Connect), 0}));
+}
+
+bool Master::read(std::uint16_t variable, Type type) {
+    std::array<std::uint8_t, 8> data{static_cast<std::uint8_t>(Command::ShortUpload),
+                                     static_cast<std::uint8_t>(type_size(type))};
+    write_le(std::span(data).subspan(4), variable);
+    return push(data, type);
+}
+
+bool Master::write(std::uint16_t variable, Type type, double value) {
+    std::array<std::uint8_t, 8> mta{static_cast<std::uint8_t>(Command::SetMta)};
+    write_le(std::span(mta).subspan(4), variable);
+    const auto size = type_size(type);
+    std::array<std::uint8_t, 6> download{static_cast<std::uint8_t>(Command::Download),
+                                         static_cast<std::uint8_t>(size)};
+    write_le(std::span(download).subspan(2, size), from_value(type, value));
+    return push(mta) && push(std::span(download).first(2 + size));
+}
+
+bool Master::start_daq(std::span<const DaqListConfig> lists) {
+    std::size_t total_odts = 0;
+    std::size_t total_entries = 0;
+    std::size_t command_count = 4 + 3 * lists.size();
+    for (const auto &list : lists) {
+        const auto odts = odt_count(list.measurements);
+        total_odts += odts;
+        total_entries += list.measurements.size();
+        command_count += 2 * odts + list.measurements.size();
+        if (list.prescaler == 0) {
+            return false;
+        }
+    }
+    const auto base = is_busy() ? m_command_count : 0;
+    if (lists.size() > k_max_daq_count || total_odts > k_max_odt_count || total_entries > k_max_entry_count ||
+        base + command_count > m_commands.size()) {
+        return false;
+    }
+
+    const auto byte = [](auto value) {
+        return static_cast<std::uint8_t>(value);
+    };
+    const auto push_command = [&](Command command, std::initializer_list<std::uint8_t> arguments) {
+        std::array<std::uint8_t, 8> data{byte(command)};
+        std::copy(arguments.begin(), arguments.end(), data.begin() + 1);
+        push(std::span(data).first(1 + arguments.size()));
+    };
+
+    // Stop any running lists first, since the configuration can't be changed while they run.
+    push_command(Command::StartStopSynch, {0});
+    push_command(Command::FreeDaq, {});
+    push_command(Command::AllocDaq, {0, byte(lists.size()), 0});
+    for (std::size_t i = 0; i < lists.size(); i++) {
+        push_command(Command::AllocOdt, {0, byte(i), 0, byte(odt_count(lists[i].measurements))});
+    }
+    for (std::size_t i = 0; i < lists.size(); i++) {
+        std::array<std::uint8_t, k_max_odt_count> entry_counts{};
+        pack(lists[i].measurements, [&](std::size_t odt, std::size_t, std::size_t) {
+            entry_counts[odt]++;
+        });
+        for (std::size_t odt = 0; odt < odt_count(lists[i].measurements); odt++) {
+            push_command(Command::AllocOdtEntry, {0, byte(i), 0, byte(odt), entry_counts[odt]});
+        }
+    }
+    for (std::size_t i = 0; i < lists.size(); i++) {
+        const auto measurements = lists[i].measurements;
+        pack(measurements, [&](std::size_t odt, std::size_t offset, std::size_t index) {
+            if (offset == 0) {
+                push_command(Command::SetDaqPtr, {0, byte(i), 0, byte(odt), 0});
+            }
+            const auto variable = measurements[index].variable;
+            push_command(Command::WriteDaq, {0xff, byte(type_size(measurements[index].type)), 0, byte(variable),
+                                             byte(variable >> 8u), 0, 0});
+        });
+    }
+    for (std::size_t i = 0; i < lists.size(); i++) {
+        const auto event = lists[i].event;
+        push_command(Command::SetDaqListMode,
+                     {0, byte(i), 0, byte(event), byte(event >> 8u), lists[i].prescaler, 0});
+    }
+    for (std::size_t i = 0; i < lists.size(); i++) {
+        push_command(Command::StartStopDaqList, {2, byte(i), 0});
+    }
+    push_command(Command::StartStopSynch, {1});
+    m_lists = lists;
+    return true;
+}
+
+bool Master::stop_daq() {
+    return push(std::to_array<std::uint8_t>({static_cast<std::uint8_t>(Command::StartStopSynch), 0}));
+}
+
+void Master::on_frame(const can::RawMessage &message, std::uint32_t) {
+    if (message.is_remote() || message.is_extended() || message.standard_id() != m_config.response_id ||
+        message.length == 0 || !m_waiting || !is_busy()) {
+        return;
+    }
+
+    const auto &command = m_commands[m_next_command];
+    if (message.byte(0) == k_error_response) {
+        m_error = static_cast<Error>(message.length >= 2 ? message.byte(1) : 0);
+    } else if (message.byte(0) == k_positive_response) {
+        if (command.upload_type) {
+            std::uint32_t raw = 0;
+            for (std::size_t i = 0; i < type_size(*command.upload_type) && 1 + i < message.length; i++) {
+                raw |= static_cast<std::uint32_t>(message.byte(1 + i)) << (8u * i);
+            }
+            m_value = to_value(*command.upload_type, raw);
+        }
+        m_next_command++;
+    } else {
+        // A DAQ frame.
+        return;
+    }
+    m_waiting = false;
+}
+
+std::optional<can::RawMessage> Master::poll(std::uint32_t now) {
+    if (!is_busy()) {
+        return std::nullopt;
+    }
+    if (m_waiting) {
+        if (reached(now, m_time + m_config.timeout)) {
+            m_timed_out = true;
+            m_waiting = false;
+        }
+        return std::nullopt;
+    }
+    m_waiting = true;
+    m_time = now;
+    return m_commands[m_next_command].message;
+}
+
+std::size_t Master::decode(const can::RawMessage &message, std::span<Sample> samples) const {
+    if (message.is_remote() || message.is_extended() || message.standard_id() != m_config.response_id ||
+        message.length == 0 || message.byte(0) >= k_error_response) {
+        return 0;
+    }
+
+    // PIDs are allocated in list order.
+    std::size_t first_pid = 0;
+    const auto pid = message.byte(0);
+    for (std::size_t i = 0; i < m_lists.size(); i++) {
+        const auto measurements = m_lists[i].measurements;
+        const auto odts = odt_count(measurements);
+        if (pid >= first_pid + odts) {
+            first_pid += odts;
+            continue;
+        }
+
+        std::size_t count = 0;
+        pack(measurements, [&](std::size_t odt, std::size_t offset, std::size_t index) {
+            const auto type = measurements[index].type;
+            const auto size = type_size(type);
+            if (first_pid + odt != pid || 1 + offset + size > message.length || count == samples.size()) {
+                return;
+            }
+            std::uint32_t raw = 0;
+            for (std::size_t byte = 0; byte < size; byte++) {
+                raw |= static_cast<std::uint32_t>(message.byte(1 + offset + byte)) << (8u * byte);
+            }
+            samples[count++] = {static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(index), to_value(type, raw)};
+        });
+        return count;
+    }
+    return 0;
+}
+
+} // namespace xcp
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <can.hh>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+namespace xcp {
+
+/// Number of DAQ lists, ODTs and ODT entries which can be allocated at once on a slave.
+constexpr std::size_t k_max_daq_count = 4;
+constexpr std::size_t k_max_odt_count = 16;
+constexpr std::size_t k_max_entry_count = 64;
+
+/// Number of data bytes of an ODT, which is a frame less its PID byte.
+constexpr std::size_t k_odt_size = 7;
+
+/// First byte of a positive and a negative response. Every lower value is the PID of a DAQ frame, which is the absolute
+/// number of the ODT it carries.
+constexpr std::uint8_t k_positive_response = 0xff;
+constexpr std::uint8_t k_error_response = 0xfe;
+
+/// The subset of XCP 1.1 commands implemented, with their standard command codes. All multi-byte fields are little
+/// endian. An address is the index of a variable in the slave's variable table rather than a memory address, so that
+/// only registered variables can be accessed, and the address extension must be zero.
+enum class Command : std::uint8_t {
+    /// [cmd, mode] -> [res, resource, comm mode, max cto, max dto (2), protocol version, transport version]
+    Connect = 0xff,
+    Disconnect = 0xfe,
+
+    /// -> [res, session status, protection, reserved, session configuration (2)]
+    GetStatus = 0xfd,
+
+    /// [cmd, reserved (2), extension, address (4)]: sets the memory transfer address (MTA).
+    SetMta = 0xf6,
+
+    /// [cmd, size] -> [res, data...]: reads the variable at the MTA, which must have the given size, and moves the MTA
+    /// on to the next variable.
+    Upload = 0xf5,
+
+    /// [cmd, size, reserved, extension, address (4)] -> [res, data...]
+    ShortUpload = 0xf4,
+
+    /// [cmd, size, data...]: writes the variable at the MTA and moves the MTA on to the next variable.
+    Download = 0xf0,
+
+    /// [cmd, reserved, list (2), odt, entry]: selects the ODT entry written by the next WriteDaq.
+    SetDaqPtr = 0xe2,
+
+    /// [cmd, bit offset, size, extension, address (4)]: fills the selected ODT entry and selects the next one. The bit
+    /// offset must be 0xff.
+    WriteDaq = 0xe1,
+
+    /// [cmd, mode, list (2), event (2), prescaler, priority]: only a mode of zero is supported.
+    SetDaqListMode = 0xe0,
+
+    /// [cmd, mode, list (2)] -> [res, first pid]: mode 0 stops, 1 starts and 2 selects the DAQ list.
+    StartStopDaqList = 0xde,
+
+    /// [cmd, mode]: mode 0 stops all, 1 starts the selected and 2 stops the selected DAQ lists.
+    StartStopSynch = 0xdd,
+
+    FreeDaq = 0xd6,
+
+    /// [cmd, reserved, count (2)]
+    AllocDaq = 0xd5,
+
+    /// [cmd, reserved, list (2), count]
+    AllocOdt = 0xd4,
+
+    /// [cmd, reserved, list (2), odt, count]
+    AllocOdtEntry = 0xd3,
+};
+
+/// Error codes carried by a negative response, [k_error_response, code].
+enum class Error : std::uint8_t {
+    DaqActive = 0x11,
+    CmdUnknown = 0x20,
+    CmdSyntax = 0x21,
+    OutOfRange = 0x22,
+    WriteProtected = 0x23,
+    ModeNotValid = 0x27,
+    Sequence = 0x29,
+    DaqConfig = 0x2a,
+    MemoryOverflow = 0x30,
+};
+
+/// An enum which represents the type of a variable.
+enum class Type : std::uint8_t {
+    U8,
+    I8,
+    U16,
+    I16,
+    U32,
+    I32,
+    F32,
+};
+
+/**
+ * @return the size in bytes of a variable of the given type
+ */
+constexpr std::size_t type_size(Type type) {
+    switch (type) {
+    case Type::U8:
+    case Type::I8:
+        return 1;
+    case Type::U16:
+    case Type::I16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+/**
+ * @return the Type of the given C++ type
+ */
+template <typename T>
+constexpr Type type_of() {
+    if constexpr (std::is_same_v<T, std::uint8_t> || std::is_same_v<T, bool>) {
+        return Type::U8;
+    } else if constexpr (std::is_same_v<T, std::int8_t>) {
+        return Type::I8;
+    } else if constexpr (std::is_same_v<T, std::uint16_t>) {
+        return Type::U16;
+    } else if constexpr (std::is_same_v<T, std::int16_t>) {
+        return Type::I16;
+    } else if constexpr (std::is_same_v<T, std::uint32_t>) {
+        return Type::U32;
+    } else if constexpr (std::is_same_v<T, std::int32_t>) {
+        return Type::I32;
+    } else {
+        static_assert(std::is_same_v<T, float>, "Unsupported variable type");
+        return Type::F32;
+    }
+}
+
+/// A struct which describes a variable which can be accessed by the master. Variables must be naturally aligned, so
+/// that on the Cortex-M3 every read and write is a single access which can't tear against an interrupt.
+struct Variable {
+    volatile void *address;
+    Type type;
+    bool writable;
+};
+
+/**
+ * @return a read-only variable for a value which is only measured
+ */
+template <typename T>
+constexpr Variable measurement(const T &value) {
+    return {const_cast<T *>(&value), type_of<T>(), false};
+}
+
+template <typename T>
+constexpr Variable measurement(const std::atomic<T> &value) {
+    static_assert(std::atomic<T>::is_always_lock_free && sizeof(std::atomic<T>) == sizeof(T));
+    return {const_cast<std::atomic<T> *>(&value), type_of<T>(), false};
+}
+
+/**
+ * @return a writable variable for a value which can be calibrated at runtime
+ */
+template <typename T>
+constexpr Variable parameter(T &value) {
+    return {&value, type_of<T>(), true};
+}
+
+template <typename T>
+constexpr Variable parameter(std::atomic<T> &value) {
+    static_assert(std::atomic<T>::is_always_lock_free && sizeof(std::atomic<T>) == sizeof(T));
+    return {&value, type_of<T>(), true};
+}
+
+/// A struct which describes the CAN identifiers shared by a master and slave. Commands are sent on one identifier, and
+/// responses and DAQ frames on the other, as XCP on CAN does.
+struct Config {
+    std::uint16_t command_id{0x6e0};
+    std::uint16_t response_id{0x6e1};
+
+    /// Time in milliseconds the master waits for a response.
+    std::uint32_t timeout{100};
+};
+
+/// Counters of a slave.
+struct SlaveStatistics {
+    std::uint32_t command_count;
+    std::uint32_t error_count;
+    std::uint32_t daq_frame_count;
+
+    /// DAQ frames dropped because the buffer passed to Slave::sample was full.
+    std::uint32_t overflow_count;
+};
+
+/**
+ * The firmware side of XCP on CAN. Commands are handled by on_frame, which must be called from a single context, and
+ * DAQ lists are sampled by calling sample from the context of the event they are bound to, e.g. a timer interrupt.
+ * The DAQ configuration can only be changed while no DAQ list is running, so the two contexts never race.
+ */
+class Slave {
+    struct Odt {
+        std::uint8_t first_entry;
+        std::uint8_t entry_count;
+        std::uint8_t size;
+    };
+
+    struct DaqList {
+        std::uint8_t first_odt;
+        std::uint8_t odt_count;
+        std::uint16_t event;
+        std::uint8_t prescaler;
+        std::uint8_t counter;
+        bool selected;
+        std::atomic<bool> running;
+    };
+
+    enum class AllocStage : std::uint8_t {
+        Free,
+        Daq,
+        Odt,
+        Entry,
+    };
+
+    const Config m_config;
+    const std::span<const Variable> m_variables;
+    std::array<DaqList, k_max_daq_count> m_lists{};
+    std::array<Odt, k_max_odt_count> m_odts{};
+    std::array<std::uint16_t, k_max_entry_count> m_entries{};
+    std::uint8_t m_list_count{0};
+    std::uint8_t m_odt_count{0};
+    std::uint8_t m_entry_count{0};
+    AllocStage m_stage{AllocStage::Free};
+
+    // The ODT entry written by the next WriteDaq, as an absolute ODT number and an index within it.
+    std::uint8_t m_daq_odt{0};
+    std::uint8_t m_daq_entry{0};
+    bool m_daq_pointer_valid{false};
+
+    std::uint32_t m_mta{0};
+    bool m_connected{false};
+    SlaveStatistics m_statistics{};
+
+    std::optional<Error> handle(const can::RawMessage &message, std::array<std::uint8_t, 8> &response,
+                                std::size_t &length);
+    std::optional<Error> handle_daq(const can::RawMessage &message, std::array<std::uint8_t, 8> &response,
+                                    std::size_t &length);
+    std::optional<Error> upload(std::uint32_t address, std::size_t size, std::array<std::uint8_t, 8> &response,
+                                std::size_t &length);
+    bool is_daq_running() const;
+    void free_daq();
+
+public:
+    Slave(const Config &config, std::span<const Variable> variables) : m_config(config), m_variables(variables) {}
+    Slave(const Slave &) = delete;
+    Slave &operator=(const Slave &) = delete;
+
+    /**
+     * Handles a command. Frames on other identifiers are ignored, as are commands other than Connect while
+     * disconnected.
+     *
+     * @param message the received frame
+     * @return the response to send, if any
+     */
+    std::optional<can::RawMessage> on_frame(const can::RawMessage &message);
+
+    /**
+     * Samples every running DAQ list bound to the given event whose prescaler has elapsed, one frame per ODT.
+     *
+     * @param event the event channel
+     * @param frames the buffer to write the DAQ frames into
+     * @return the number of frames written
+     */
+    std::size_t sample(std::uint16_t event, std::span<can::RawMessage> frames);
+
+    bool is_connected() const { return m_connected; }
+    const SlaveStatistics &statistics() const { return m_statistics; }
+};
+
+/// A variable sampled by a DAQ list, as seen by the master.
+struct Measurement {
+    std::uint16_t variable;
+    Type type;
+};
+
+/// A struct which describes a DAQ list to be set up by the master.
+struct DaqListConfig {
+    std::uint16_t event;
+
+    /// Number of events per sample, which must be at least one.
+    std::uint8_t prescaler;
+    std::span<const Measurement> measurements;
+};
+
+/// A value decoded from a DAQ frame.
+struct Sample {
+    /// Index of the DAQ list and of the measurement within it.
+    std::uint8_t list;
+    std::uint8_t measurement;
+    double value;
+};
+
+/**
+ * @return the number of ODTs needed for the given measurements, which are packed into ODTs in order
+ */
+std::size_t odt_count(std::span<const Measurement> measurements);
+
+/**
+ * @return the value of a variable given its raw little endian bits
+ */
+double to_value(Type type, std::uint32_t raw);
+
+/**
+ * @return the raw bits of a variable given its value, which is rounded to the nearest integer for integral types
+ */
+std::uint32_t from_value(Type type, double value);
+
+/**
+ * The host side of XCP on CAN. Commands are queued and sent one at a time from poll, each after the response to the
+ * previous one; the queue is abandoned on a negative response or a timeout. DAQ frames are decoded against the lists
+ * given to start_daq.
+ */
+class Master {
+    static constexpr std::size_t k_max_command_count = 128;
+
+    struct PendingCommand {
+        can::RawMessage message;
+
+        // Type of the value returned by an upload command.
+        std::optional<Type> upload_type;
+    };
+
+    const Config m_config;
+    std::array<PendingCommand, k_max_command_count> m_commands{};
+    std::size_t m_command_count{0};
+    std::size_t m_next_command{0};
+    bool m_waiting{false};
+    std::uint32_t m_time{0};
+    std::optional<Error> m_error;
+    bool m_timed_out{false};
+    std::optional<double> m_value;
+    std::span<const DaqListConfig> m_lists;
+
+    bool push(std::span<const std::uint8_t> data, std::optional<Type> upload_type = std::nullopt);
+
+public:
+    explicit Master(const Config &config) : m_config(config) {}
+
+    /**
+     * Queues a connect command.
+     */
+    bool connect();
+
+    /**
+     * Queues a read of the given variable, whose value is returned by value() once the response is received.
+     */
+    bool read(std::uint16_t variable, Type type);
+
+    /**
+     * Queues a write of the given variable.
+     */
+    bool write(std::uint16_t variable, Type type, double value);
+
+    /**
+     * Queues the commands which replace the slave's DAQ configuration with the given lists and start them
+     * synchronously. The lists must outlive the master, since they are used to decode DAQ frames.
+     *
+     * @return false if the lists don't fit into the slave or the command queue; nothing is queued in that case
+     */
+    bool start_daq(std::span<const DaqListConfig> lists);
+
+    /**
+     * Queues the commands which stop every DAQ list.
+     */
+    bool stop_daq();
+
+    /**
+     * Handles a response. DAQ frames should be passed to decode instead.
+     */
+    void on_frame(const can::RawMessage &message, std::uint32_t now);
+
+    /**
+     * @return the next command to send, if any
+     */
+    std::optional<can::RawMessage> poll(std::uint32_t now);
+
+    /**
+     * Decodes a DAQ frame.
+     *
+     * @param message the received frame
+     * @param samples the buffer to write the values carried by the frame into, which needs room for k_odt_size
+     * @return the number of values decoded; zero if the frame isn't a known DAQ frame
+     */
+    std::size_t decode(const can::RawMessage &message, std::span<Sample> samples) const;
+
+    /// True while there are queued commands or a response is awaited.
+    bool is_busy() const { return !m_timed_out && !m_error && m_next_command < m_command_count; }
+
+    /// The error of the last negative response, which abandoned the command queue.
+    std::optional<Error> error() const { return m_error; }
+    bool is_timed_out() const { return m_timed_out; }
+
+    /// The value returned by the last read.
+    std::optional<double> value() const { return m_value; }
+};
+
+} // namespace xcp
@@ -0,0 +1,311 @@
+#include <boot.hh>
+
+#include <can.hh>
+#include <can_filter.hh>
+#include <can_virtual.hh>
+#include <test_node.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr boot::Config k_config{};
+constexpr std::uint8_t k_node_id = 3;
+constexpr std::uint32_t k_bitrate = 500'000;
+
+// Datasheet maximums for the STM32F103, in microseconds.
+constexpr std::uint64_t k_page_erase_time = 40'000;
+constexpr std::uint64_t k_half_word_program_time = 70;
+
+// An image slot in RAM which tracks how long the real flash would have stalled the CPU for.
+struct FakeFlash {
+    std::vector<std::uint8_t> memory;
+    boot::ImageInfo info{boot::k_image_magic, 0, 0};
+    std::uint64_t busy_time{0};
+    std::size_t program_error_count{0};
+
+    explicit FakeFlash(std::size_t size = boot::k_max_image_size) : memory(size, 0) {}
+
+    std::size_t slot_size() { return memory.size(); }
+
+    bool erase_page(std::size_t index) {
+        std::fill_n(memory.begin() + static_cast<std::ptrdiff_t>(index * boot::k_block_size), boot::k_block_size,
+                    boot::k_erased_byte);
+        busy_time += k_page_erase_time;
+        return true;
+    }
+
+    bool program(std::size_t offset, std::span<const std::uint8_t> data) {
+        for (std::size_t i = 0; i < data.size(); i++) {
+            // The hardware refuses to program a half word which isn't erased.
+            if (memory[offset + i] != boot::k_erased_byte) {
+                program_error_count++;
+                return false;
+            }
+            memory[offset + i] = data[i];
+        }
+        busy_time += data.size() / 2 * k_half_word_program_time;
+        return true;
+    }
+
+    std::span<const std::uint8_t> image() { return memory; }
+    std::uint32_t crc(std::span<const std::uint8_t> data) { return boot::crc32(data); }
+
+    bool write_info(const boot::ImageInfo &new_info) {
+        info = new_info;
+        return true;
+    }
+};
+
+std::vector<std::uint8_t> random_image(std::size_t size) {
+    std::mt19937 engine(size);
+    std::uniform_int_distribution<unsigned> distribution(0, 255);
+    std::vector<std::uint8_t> image(size);
+    std::generate(image.begin(), image.end(), [&] {
+        return static_cast<std::uint8_t>(distribution(engine));
+    });
+    return image;
+}
+
+// A host sending an image to a bootloader over the virtual bus. The bootloader drains its receive FIFO from its main
+// loop as the firmware does, and has its interrupts disabled for as long as the flash would stall the CPU. A third node
+// acknowledges frames like the rest of the vehicle would.
+struct Bootloader : testing::Test {
+    can::VirtualBus bus{k_bitrate};
+    test::TestNode host{bus};
+    test::TestNode target{bus};
+    test::TestNode bystander{bus};
+    FakeFlash flash;
+    boot::Receiver<FakeFlash> receiver{k_config, k_node_id, flash};
+    boot::Sender sender{k_config, k_node_id};
+    std::uint64_t target_time{0};
+    std::optional<can::RawMessage> response;
+
+    // Filters the sender's frames, e.g. to drop or corrupt one.
+    std::optional<can::RawMessage> (*tamper)(const can::RawMessage &, std::size_t){nullptr};
+    std::size_t sent_count{0};
+
+    explicit Bootloader(std::size_t slot_size = boot::k_max_image_size) : flash(slot_size) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(host.start({.ordered = true}));
+        host.receive_all([this](const can::RawMessage &message, std::uint32_t) {
+            sender.on_frame(message, bus.now());
+        });
+
+        ASSERT_TRUE(target.start());
+        constexpr auto k_filters = can::plan_filters(std::to_array<can::FilterRule>({
+            {0, false, k_config.command_id, k_config.command_id},
+            {0, false, k_config.data_id, k_config.data_id + boot::k_frames_per_block - 1},
+        }));
+        can::apply_filters(k_filters);
+        target.on_receive([this](const can::RawMessage &message, std::uint32_t) {
+            receiver.on_frame(message, bus.now());
+        });
+        can::set_fifo_deferred(0, true);
+
+        ASSERT_TRUE(bystander.start());
+    }
+
+    void step() {
+        const auto now = bus.now();
+        host.select();
+        while (can::tx_statistics().queue_depth < 4) {
+            const auto frame = sender.poll(now);
+            if (!frame) {
+                break;
+            }
+            const auto sent = tamper != nullptr ? tamper(*frame, sent_count) : frame;
+            sent_count++;
+            if (sent) {
+                can::transmit(*sent);
+            }
+        }
+
+        // Run the bootloader's main loop for as long as it has had the CPU since the last frame. A response returned by
+        // poll is only sent once the flash operation before it has finished.
+        while (target_time <= bus.time()) {
+            target.set_interrupts_enabled(true);
+            target.select();
+            if (response) {
+                can::transmit(*std::exchange(response, std::nullopt));
+            }
+            can::drain_fifo(0, 16);
+            const auto busy_time = flash.busy_time;
+            response = receiver.poll(bus.now());
+            if (flash.busy_time == busy_time) {
+                if (response) {
+                    can::transmit(*std::exchange(response, std::nullopt));
+                }
+                target_time = bus.time() + 1;
+                break;
+            }
+            target_time += (flash.busy_time - busy_time) * k_bitrate / 1'000'000;
+            target.set_interrupts_enabled(false);
+        }
+
+        if (!bus.step()) {
+            bus.idle(16);
+        }
+    }
+
+    void run(std::uint64_t max_time = 60ull * k_bitrate) {
+        while (sender.is_busy() && bus.time() < max_time) {
+            step();
+        }
+    }
+
+    void expect_written(std::span<const std::uint8_t> image) const {
+        EXPECT_TRUE(sender.is_done());
+        EXPECT_TRUE(receiver.is_complete());
+        EXPECT_TRUE(std::equal(image.begin(), image.end(), flash.memory.begin()));
+        EXPECT_EQ(flash.info.magic, boot::k_image_magic);
+        EXPECT_EQ(flash.info.size, image.size());
+        EXPECT_EQ(flash.info.crc, boot::crc32(image));
+        EXPECT_EQ(flash.program_error_count, 0);
+    }
+};
+
+TEST(Boot, Crc) {
+    // The result of writing 0x12345678 to the STM32 CRC data register after a reset.
+    EXPECT_EQ(boot::crc32(std::to_array<std::uint8_t>({0x78, 0x56, 0x34, 0x12})), 0xdf8a8a2bu);
+    EXPECT_EQ(boot::crc32({}), 0xffffffffu);
+
+    // The last word is zero padded.
+    EXPECT_EQ(boot::crc32(std::to_array<std::uint8_t>({0x78, 0x56})),
+              boot::crc32(std::to_array<std::uint8_t>({0x78, 0x56, 0, 0})));
+}
+
+TEST(Boot, FrameCount) {
+    EXPECT_EQ(boot::block_count(boot::k_max_image_size), 64);
+    EXPECT_EQ(boot::block_count(1025), 2);
+    EXPECT_EQ(boot::frame_count(1025, 0), 128);
+    EXPECT_EQ(boot::frame_count(1025, 1), 1);
+    EXPECT_EQ(boot::frame_count(1030, 1), 1);
+    EXPECT_EQ(boot::frame_count(1033, 1), 2);
+}
+
+TEST_F(Bootloader, FullImage) {
+    const auto image = random_image(boot::k_max_image_size);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+
+    // Measure from the first block header, which is sent once erasing has finished.
+    while (sender.statistics().frame_count < 2) {
+        step();
+    }
+    const auto data_start = bus.time();
+    run();
+    expect_written(image);
+    EXPECT_EQ(sender.statistics().retransmit_count, 0);
+    EXPECT_EQ(sender.acked_size(), image.size());
+    EXPECT_EQ(target.statistics().overrun_count[0], 0);
+
+    // A data frame carries 64 of its at most 135 bits as payload, so the transfer should get close to 47% of the bus.
+    const auto efficiency = static_cast<double>(image.size() * 8) / static_cast<double>(bus.time() - data_start);
+    EXPECT_GT(efficiency, 0.42);
+    RecordProperty("efficiency", std::to_string(efficiency));
+}
+
+TEST_F(Bootloader, ShortLastBlock) {
+    const auto image = random_image(3001);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    expect_written(image);
+
+    // Only the pages holding the image are erased.
+    EXPECT_EQ(flash.memory[3 * boot::k_block_size], 0);
+}
+
+TEST_F(Bootloader, LostFrame) {
+    tamper = [](const can::RawMessage &frame, std::size_t index) -> std::optional<can::RawMessage> {
+        // Frame 0 is the start command, then the header and data frames of the first block.
+        return index == 50 ? std::nullopt : std::make_optional(frame);
+    };
+    const auto image = random_image(4000);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    expect_written(image);
+    EXPECT_EQ(receiver.statistics().nack_count, 1);
+    EXPECT_EQ(sender.statistics().nack_count, 1);
+    EXPECT_EQ(sender.statistics().retransmit_count, 1);
+}
+
+TEST_F(Bootloader, LostLastFrame) {
+    // Without a later frame, the receiver can't tell that the last frame is missing, so the sender times out.
+    tamper = [](const can::RawMessage &frame, std::size_t index) -> std::optional<can::RawMessage> {
+        return index == 1 + 129 + 129 + 1 + 2 ? std::nullopt : std::make_optional(frame);
+    };
+    const auto image = random_image(2 * boot::k_block_size + 20);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    expect_written(image);
+    EXPECT_EQ(sender.statistics().timeout_count, 1);
+}
+
+TEST_F(Bootloader, CorruptFrame) {
+    tamper = [](const can::RawMessage &frame, std::size_t index) -> std::optional<can::RawMessage> {
+        auto corrupted = frame;
+        if (index == 200) {
+            corrupted.data_low ^= 1u;
+        }
+        return corrupted;
+    };
+    const auto image = random_image(5 * boot::k_block_size);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    expect_written(image);
+    EXPECT_EQ(sender.statistics().nack_count, 1);
+}
+
+TEST_F(Bootloader, ReceiverGoesAway) {
+    const auto image = random_image(8 * boot::k_block_size);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    while (receiver.statistics().block_count < 2) {
+        step();
+    }
+    target.go_offline();
+    run();
+    EXPECT_FALSE(sender.is_done());
+    EXPECT_EQ(sender.status(), boot::Status::Timeout);
+    EXPECT_EQ(sender.statistics().timeout_count, boot::k_max_retry_count + 1);
+
+    // The old image was invalidated when the transfer started.
+    EXPECT_EQ(flash.info.magic, 0u);
+    EXPECT_FALSE(receiver.is_complete());
+}
+
+TEST_F(Bootloader, OtherNode) {
+    boot::Sender other(k_config, k_node_id + 1);
+    sender = other;
+    const auto image = random_image(100);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    EXPECT_EQ(sender.status(), boot::Status::Timeout);
+    EXPECT_TRUE(receiver.is_idle());
+    EXPECT_EQ(flash.info.magic, boot::k_image_magic);
+}
+
+struct SmallBootloader : Bootloader {
+    SmallBootloader() : Bootloader(16 * boot::k_block_size) {}
+};
+
+TEST_F(SmallBootloader, TooLarge) {
+    const auto image = random_image(17 * boot::k_block_size);
+    ASSERT_TRUE(sender.start(image, bus.now()));
+    run();
+    EXPECT_EQ(sender.status(), boot::Status::TooLarge);
+    EXPECT_FALSE(sender.is_busy());
+    EXPECT_FALSE(sender.start(random_image(boot::k_max_image_size + 1), bus.now()));
+}
+
+} // namespace
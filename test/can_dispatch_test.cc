@@ -0,0 +1,85 @@
+#include <can_dispatch.hh>
+
+#include <can.hh>
+#include <can_filter.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+std::vector<int> s_calls;
+
+void handler_a(const can::RawMessage &, std::uint32_t) {
+    s_calls.push_back(0);
+}
+
+void handler_b(const can::RawMessage &, std::uint32_t) {
+    s_calls.push_back(1);
+}
+
+void handler_c(const can::RawMessage &, std::uint32_t) {
+    s_calls.push_back(2);
+}
+
+constexpr auto k_table = can::make_dispatch_table(
+    can::subscribe_standard_range(0, 0x100, 0x1ff, &handler_a), can::subscribe_standard(0, 0x180, &handler_b),
+    can::subscribe_extended_range(1, 0x100, 0x1ff, &handler_c), can::subscribe_extended(1, 0x2005, &handler_a));
+
+std::vector<int> dispatch(const can::RawMessage &message) {
+    s_calls.clear();
+    const auto count = k_table.dispatch(message, 0);
+    EXPECT_EQ(count, s_calls.size());
+    return s_calls;
+}
+
+TEST(CanDispatch, Lookup) {
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x0ff, {})), std::vector<int>{});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x100, {})), std::vector<int>{0});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x17f, {})), std::vector<int>{0});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x180, {})), (std::vector<int>{0, 1}));
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x181, {})), std::vector<int>{0});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x1ff, {})), std::vector<int>{0});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x200, {})), std::vector<int>{});
+
+    // Extended identifiers don't match standard subscriptions with the same value, and vice versa.
+    EXPECT_EQ(dispatch(can::RawMessage::extended(0x180, {})), std::vector<int>{2});
+    EXPECT_EQ(dispatch(can::RawMessage::extended(0x2005, {})), std::vector<int>{0});
+    EXPECT_EQ(dispatch(can::RawMessage::standard(0x205, {})), std::vector<int>{});
+    EXPECT_EQ(dispatch(can::RawMessage::extended(0x1fffffff, {})), std::vector<int>{});
+}
+
+TEST(CanDispatch, Intervals) {
+    // The overlap splits the standard range into three, and the extended subscriptions add one interval each.
+    static_assert(k_table.interval_count() == 5);
+    static_assert(k_table.subscriber_count(false, 0x180) == 2);
+    static_assert(k_table.subscriber_count(true, 0x2004) == 0);
+
+    // Subscribers to adjacent ranges with the same handlers are merged, and empty ranges are ignored.
+    constexpr auto merged =
+        can::make_dispatch_table(can::subscribe_standard_range(0, 0x10, 0x1f, &handler_a),
+                                 can::subscribe_standard_range(0, 0x20, 0x2f, &handler_a),
+                                 can::subscribe_standard_range(0, 0x30, 0x2f, &handler_b));
+    static_assert(merged.interval_count() == 2);
+    static_assert(merged.subscriber_count(false, 0x30) == 0);
+}
+
+TEST(CanDispatch, FilterRules) {
+    constexpr auto plan = can::plan_filters(k_table.filter_rules());
+    static_assert(plan.bank_count <= can::k_filter_bank_count);
+    EXPECT_EQ(plan.route(false, 0x180), 0);
+    EXPECT_EQ(plan.route(false, 0x200), std::nullopt);
+    EXPECT_EQ(plan.route(true, 0x150), 1);
+    EXPECT_EQ(plan.route(true, 0x2005), 1);
+}
+
+TEST(CanDispatch, RemoteFramesIgnored) {
+    auto message = can::RawMessage::standard(0x180, {});
+    message.id_word |= can::RawMessage::k_rtr_bit;
+    EXPECT_EQ(dispatch(message), std::vector<int>{});
+}
+
+} // namespace
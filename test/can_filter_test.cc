@@ -0,0 +1,72 @@
+#include <can_filter.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+namespace {
+
+TEST(CanFilter, ExtendedList) {
+    constexpr auto plan = can::make_filter_plan<can::accept_extended(0, 0x2005), can::accept_extended(0, 0x2105),
+                                                can::accept_extended(0, 0x2205)>();
+    ASSERT_EQ(plan.bank_count, 2);
+    EXPECT_EQ(plan.banks[0], (can::FilterBank{0, can::FilterMode::List, can::FilterScale::Single32,
+                                              (0x2005u << 3u) | 4u, (0x2105u << 3u) | 4u}));
+
+    // Unused slot repeats the last identifier.
+    EXPECT_EQ(plan.banks[1].fr1, plan.banks[1].fr2);
+    EXPECT_EQ(plan.route(true, 0x2005), 0);
+    EXPECT_EQ(plan.route(true, 0x2205), 0);
+    EXPECT_EQ(plan.route(true, 0x2305), std::nullopt);
+    EXPECT_EQ(plan.route(true, 0x2006), std::nullopt);
+    EXPECT_EQ(plan.route(false, 0x205), std::nullopt);
+}
+
+TEST(CanFilter, StandardListPacksFour) {
+    constexpr auto plan = can::make_filter_plan<can::accept_standard(1, 0x100), can::accept_standard(1, 0x101),
+                                                can::accept_standard(1, 0x200), can::accept_standard(1, 0x7ff)>();
+    ASSERT_EQ(plan.bank_count, 1);
+    EXPECT_EQ(plan.banks[0].mode, can::FilterMode::List);
+    EXPECT_EQ(plan.banks[0].scale, can::FilterScale::Dual16);
+    EXPECT_EQ(plan.banks[0].fr1, (0x100u << 5u) | (0x101u << 21u));
+    for (std::uint32_t id : {0x100u, 0x101u, 0x200u, 0x7ffu}) {
+        EXPECT_EQ(plan.route(false, id), 1);
+    }
+    EXPECT_EQ(plan.route(false, 0x102), std::nullopt);
+    EXPECT_EQ(plan.route(true, 0x100u << 18u), std::nullopt);
+}
+
+TEST(CanFilter, RangesAreExact) {
+    constexpr auto plan = can::make_filter_plan<can::accept_standard_range(0, 0x123, 0x1ff),
+                                                can::accept_extended_range(1, 0x1000, 0x10ff)>();
+    for (std::uint32_t id = 0; id <= 0x7ff; id++) {
+        const bool expected = id >= 0x123 && id <= 0x1ff;
+        EXPECT_EQ(plan.route(false, id).has_value(), expected) << id;
+    }
+    for (std::uint32_t id = 0xf00; id <= 0x1200; id++) {
+        const auto expected = id >= 0x1000 && id <= 0x10ff ? std::optional<std::uint8_t>(1) : std::nullopt;
+        EXPECT_EQ(plan.route(true, id), expected) << id;
+    }
+
+    // A single aligned block needs just one 32-bit mask bank.
+    EXPECT_EQ(can::plan_filters(std::array{can::accept_extended_range(0, 0x1000, 0x10ff)}).bank_count, 1);
+}
+
+TEST(CanFilter, WholeRange) {
+    constexpr auto plan = can::make_filter_plan<can::accept_standard_range(0, 0, 0x7ff)>();
+    EXPECT_EQ(plan.bank_count, 1);
+    EXPECT_EQ(plan.route(false, 0), 0);
+    EXPECT_EQ(plan.route(false, 0x7ff), 0);
+}
+
+TEST(CanFilter, Overflow) {
+    std::array<can::FilterRule, 30> rules{};
+    for (std::uint32_t i = 0; i < rules.size(); i++) {
+        rules[i] = can::accept_extended(0, 0x1000 + i * 2);
+    }
+    EXPECT_EQ(can::plan_filters(rules).bank_count, 15);
+}
+
+} // namespace
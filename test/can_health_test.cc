@@ -0,0 +1,124 @@
+#include <can_health.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+namespace {
+
+std::uint32_t esr(std::uint8_t tec, std::uint8_t rec, std::uint32_t flags = 0, can::LastErrorCode code = {}) {
+    return (static_cast<std::uint32_t>(rec) << can::k_esr_rec_pos) |
+           (static_cast<std::uint32_t>(tec) << can::k_esr_tec_pos) |
+           (static_cast<std::uint32_t>(code) << can::k_esr_lec_pos) | flags;
+}
+
+TEST(CanHealth, DecodeErrorState) {
+    EXPECT_EQ(can::decode_error_state(esr(0, 0)), can::ErrorState::Active);
+    EXPECT_EQ(can::decode_error_state(esr(96, 0, can::k_esr_ewgf)), can::ErrorState::Warning);
+    EXPECT_EQ(can::decode_error_state(esr(0, 128, can::k_esr_ewgf | can::k_esr_epvf)), can::ErrorState::Passive);
+    EXPECT_EQ(can::decode_error_state(esr(255, 0, can::k_esr_ewgf | can::k_esr_epvf | can::k_esr_boff)),
+              can::ErrorState::BusOff);
+    EXPECT_EQ(can::decode_last_error_code(esr(0, 0, 0, can::LastErrorCode::Crc)), can::LastErrorCode::Crc);
+}
+
+TEST(CanHealth, Transitions) {
+    can::HealthMonitor monitor;
+    monitor.update(esr(8, 16));
+    EXPECT_EQ(monitor.statistics().tec, 8);
+    EXPECT_EQ(monitor.statistics().rec, 16);
+    EXPECT_EQ(monitor.statistics().state, can::ErrorState::Active);
+
+    // Active -> passive -> bus-off -> active -> passive.
+    monitor.update(esr(130, 0, can::k_esr_ewgf | can::k_esr_epvf));
+    monitor.update(esr(130, 0, can::k_esr_ewgf | can::k_esr_epvf));
+    monitor.update(esr(255, 0, can::k_esr_ewgf | can::k_esr_epvf | can::k_esr_boff));
+    monitor.update(esr(0, 0));
+    monitor.update(esr(140, 0, can::k_esr_ewgf | can::k_esr_epvf));
+    EXPECT_EQ(monitor.statistics().error_passive_count, 2);
+    EXPECT_EQ(monitor.statistics().bus_off_count, 1);
+    EXPECT_EQ(monitor.statistics().state, can::ErrorState::Passive);
+    EXPECT_EQ(monitor.statistics().tec, 140);
+
+    // Leaving bus-off directly into error-passive is not a new transition into error-passive.
+    monitor.update(esr(255, 0, can::k_esr_ewgf | can::k_esr_epvf | can::k_esr_boff));
+    monitor.update(esr(130, 0, can::k_esr_ewgf | can::k_esr_epvf));
+    EXPECT_EQ(monitor.statistics().error_passive_count, 2);
+    EXPECT_EQ(monitor.statistics().bus_off_count, 2);
+}
+
+TEST(CanHealth, LastErrorCodeHistogram) {
+    can::HealthMonitor monitor;
+    EXPECT_FALSE(monitor.update(esr(0, 0, 0, can::LastErrorCode::None)));
+    EXPECT_TRUE(monitor.update(esr(0, 0, 0, can::LastErrorCode::Acknowledgment)));
+    EXPECT_FALSE(monitor.update(esr(0, 0, 0, can::LastErrorCode::SetBySoftware)));
+    EXPECT_TRUE(monitor.update(esr(0, 0, 0, can::LastErrorCode::Acknowledgment)));
+    EXPECT_TRUE(monitor.update(esr(0, 0, 0, can::LastErrorCode::Stuff)));
+
+    const auto &histogram = monitor.statistics().lec_histogram;
+    EXPECT_EQ(histogram[static_cast<std::size_t>(can::LastErrorCode::None)], 0);
+    EXPECT_EQ(histogram[static_cast<std::size_t>(can::LastErrorCode::Acknowledgment)], 2);
+    EXPECT_EQ(histogram[static_cast<std::size_t>(can::LastErrorCode::Stuff)], 1);
+    EXPECT_EQ(histogram[static_cast<std::size_t>(can::LastErrorCode::SetBySoftware)], 0);
+}
+
+TEST(CanHealth, RecoveryBackOff) {
+    can::BusOffRecovery recovery({.initial_delay = 100, .max_delay = 300, .stable_time = 1000});
+    EXPECT_FALSE(recovery.poll(can::ErrorState::Active, 0));
+
+    // First bus-off waits for the initial delay.
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 1000));
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 1099));
+    EXPECT_TRUE(recovery.poll(can::ErrorState::BusOff, 1100));
+
+    // Recovery did not complete, so the delay doubles.
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 1200));
+    EXPECT_TRUE(recovery.poll(can::ErrorState::BusOff, 1300));
+
+    // Recovered briefly then bus-off again; the delay is now capped.
+    EXPECT_FALSE(recovery.poll(can::ErrorState::Active, 1310));
+    EXPECT_EQ(recovery.current_delay(), 300);
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 1400));
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 1699));
+    EXPECT_TRUE(recovery.poll(can::ErrorState::BusOff, 1700));
+
+    // A long stable period resets the delay.
+    EXPECT_FALSE(recovery.poll(can::ErrorState::Warning, 1710));
+    EXPECT_FALSE(recovery.poll(can::ErrorState::Passive, 2709));
+    EXPECT_EQ(recovery.current_delay(), 300);
+    EXPECT_FALSE(recovery.poll(can::ErrorState::Active, 2710));
+    EXPECT_EQ(recovery.current_delay(), 100);
+}
+
+TEST(CanHealth, RecoveryTimeWraps) {
+    can::BusOffRecovery recovery({.initial_delay = 100, .max_delay = 100, .stable_time = 1000});
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, UINT32_MAX - 49));
+    EXPECT_FALSE(recovery.poll(can::ErrorState::BusOff, 49));
+    EXPECT_TRUE(recovery.poll(can::ErrorState::BusOff, 50));
+}
+
+TEST(CanHealth, Report) {
+    can::HealthStatistics statistics{
+        .tec = 12,
+        .rec = 34,
+        .state = can::ErrorState::Passive,
+        .error_passive_count = 3,
+        .bus_off_count = 257,
+        .recovery_count = 4,
+        .lec_histogram = {0, 1, 2, 3, 4, 5, 6, 0},
+        .fifo_overrun_count = {7, 8},
+    };
+
+    const auto page_0 = can::build_health_report(0x7f0, statistics, 0);
+    EXPECT_TRUE(page_0.is_standard());
+    EXPECT_EQ(page_0.standard_id(), 0x7f0);
+    EXPECT_EQ(page_0.length, 8);
+    EXPECT_EQ(page_0.data(), (std::array<std::uint8_t, 8>{0, 12, 34, 2, 3, 1, 7, 8}));
+
+    const auto page_1 = can::build_health_report(0x7f0, statistics, 1);
+    EXPECT_EQ(page_1.length, 8);
+    EXPECT_EQ(page_1.data(), (std::array<std::uint8_t, 8>{1, 1, 2, 3, 4, 5, 6, 4}));
+}
+
+} // namespace
@@ -0,0 +1,129 @@
+#include <can_load.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+
+namespace {
+
+constexpr auto k_standard = can::RawMessage::standard(0x123, {});
+constexpr auto k_extended = can::RawMessage::extended(0x1234567, {});
+
+TEST(CanLoad, FrameBits) {
+    // Worst-case lengths including stuffing and the interframe space.
+    EXPECT_EQ(can::frame_bits(false, 0), 55);
+    EXPECT_EQ(can::frame_bits(false, 8), 135);
+    EXPECT_EQ(can::frame_bits(true, 0), 80);
+    EXPECT_EQ(can::frame_bits(true, 8), 160);
+    EXPECT_EQ(can::frame_bits(true, 15), 160);
+}
+
+TEST(CanLoad, Utilisation) {
+    can::LoadMeter meter(500'000);
+    meter.reset(500'000, 1000);
+
+    // 370 standard 8-byte frames per 100 ms is 370 * 135 * 10 = 499500 bit/s.
+    for (std::uint32_t bucket = 0; bucket < can::k_load_bucket_count; bucket++) {
+        for (int i = 0; i < 370; i++) {
+            meter.record(k_standard.id_word, 8, can::LoadSource::Fifo0);
+        }
+        meter.advance(1000 + (bucket + 1) * can::k_load_bucket_period);
+    }
+    EXPECT_EQ(meter.statistics().utilisation, 999);
+    EXPECT_EQ(meter.statistics().rx_frames_per_second, 3700);
+
+    // Rolling: after half a second of silence the utilisation halves.
+    meter.advance(2500);
+    EXPECT_EQ(meter.statistics().utilisation, 499);
+
+    // A long gap starts afresh.
+    meter.advance(10000);
+    EXPECT_EQ(meter.statistics().utilisation, 0);
+    EXPECT_EQ(meter.statistics().rx_frames_per_second, 0);
+}
+
+TEST(CanLoad, PerIdRates) {
+    can::LoadMeter meter(500'000);
+    for (int i = 0; i < 100; i++) {
+        meter.record(k_standard.id_word, 2, can::LoadSource::Fifo0);
+        meter.record(k_extended.id_word | can::RawMessage::k_rtr_bit, 0, can::LoadSource::Transmit);
+    }
+    meter.record(k_extended.id_word | 1u, 8, can::LoadSource::Transmit);
+    meter.advance(999);
+    EXPECT_EQ(meter.statistics().rate_count, 0);
+    meter.advance(1000);
+
+    const auto &statistics = meter.statistics();
+    EXPECT_EQ(statistics.rx_frames_per_second, 100);
+    EXPECT_EQ(statistics.tx_frames_per_second, 101);
+    ASSERT_EQ(statistics.rate_count, 2);
+    EXPECT_FALSE(statistics.rates[0].is_extended());
+    EXPECT_EQ(statistics.rates[0].id(), 0x123);
+    EXPECT_EQ(statistics.rates[0].frames_per_second, 100);
+    EXPECT_TRUE(statistics.rates[1].is_extended());
+    EXPECT_EQ(statistics.rates[1].id(), 0x1234567);
+    EXPECT_EQ(statistics.rates[1].frames_per_second, 101);
+}
+
+TEST(CanLoad, Sources) {
+    can::LoadMeter meter(500'000);
+    for (int i = 0; i < 10; i++) {
+        meter.record(k_standard.id_word, 8, can::LoadSource::Fifo0);
+        meter.record(k_standard.id_word, 8, can::LoadSource::Fifo1);
+        meter.record(k_standard.id_word, 8, can::LoadSource::Transmit);
+        meter.record(k_extended.id_word, 8, can::LoadSource::Fifo1);
+    }
+    meter.advance(1000);
+
+    // Each source keeps its own table, and an identifier seen by several of them is reported once.
+    const auto &statistics = meter.statistics();
+    EXPECT_EQ(statistics.utilisation, (30 * 135 + 10 * 160) * 1000 / 500'000);
+    EXPECT_EQ(statistics.rx_frames_per_second, 30);
+    EXPECT_EQ(statistics.tx_frames_per_second, 10);
+    ASSERT_EQ(statistics.rate_count, 2);
+    EXPECT_EQ(statistics.rates[0].id(), 0x123);
+    EXPECT_EQ(statistics.rates[0].frames_per_second, 30);
+    EXPECT_EQ(statistics.rates[1].id(), 0x1234567);
+    EXPECT_EQ(statistics.rates[1].frames_per_second, 10);
+}
+
+TEST(CanLoad, RateTableEviction) {
+    can::LoadMeter meter(500'000);
+    for (std::uint16_t id = 0; id < can::k_load_id_capacity + 3; id++) {
+        meter.record(can::RawMessage::standard(id, {}).id_word, 0, can::LoadSource::Fifo0);
+    }
+    meter.advance(1000);
+    EXPECT_EQ(meter.statistics().rate_count, can::k_load_id_capacity);
+    EXPECT_EQ(meter.statistics().untracked_frames_per_second, 3);
+
+    // Identifiers which stop appearing make room for new ones in the following window.
+    meter.record(can::RawMessage::standard(0x700, {}).id_word, 0, can::LoadSource::Fifo0);
+    meter.advance(2000);
+    EXPECT_EQ(meter.statistics().rate_count, 0);
+    EXPECT_EQ(meter.statistics().untracked_frames_per_second, 1);
+    meter.record(can::RawMessage::standard(0x700, {}).id_word, 0, can::LoadSource::Fifo0);
+    meter.advance(3000);
+    ASSERT_EQ(meter.statistics().rate_count, 1);
+    EXPECT_EQ(meter.statistics().rates[0].id(), 0x700);
+    EXPECT_EQ(meter.statistics().untracked_frames_per_second, 0);
+}
+
+TEST(CanLoad, Report) {
+    can::BusLoadStatistics statistics{
+        .utilisation = 0x1234,
+        .rx_frames_per_second = 0x5678,
+        .tx_frames_per_second = 0x9abc,
+        .untracked_frames_per_second = 0,
+        .rates = {{{k_extended.id_word, 0x0102}}},
+        .rate_count = 1,
+    };
+    EXPECT_EQ(can::build_load_report(0x7f1, statistics, 0).data(),
+              (std::array<std::uint8_t, 8>{0, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 1}));
+    EXPECT_EQ(can::build_load_report(0x7f1, statistics, 1).data(),
+              (std::array<std::uint8_t, 8>{1, 1, 0x01, 0x23, 0x45, 0x67, 0x01, 0x02}));
+}
+
+} // namespace
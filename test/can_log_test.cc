@@ -0,0 +1,187 @@
+#include <can_log.hh>
+
+#include <can.hh>
+#include <can_virtual.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector<can::RawMessage> s_received;
+std::vector<std::uint32_t> s_timestamps;
+
+void capture(const can::RawMessage &message, std::uint32_t timestamp) {
+    s_received.push_back(message);
+    s_timestamps.push_back(timestamp);
+}
+
+std::string csv_row(std::string_view line) {
+    const auto parsed = can_log::parse_candump_line(line);
+    EXPECT_TRUE(parsed);
+    std::string out;
+    EXPECT_TRUE(parsed && can_log::append_csv_row(out, *parsed));
+    return out;
+}
+
+TEST(CanLog, Candump) {
+    const auto standard = can_log::parse_candump_line("(1436509052.249713) can0 123#0102");
+    ASSERT_TRUE(standard);
+    EXPECT_EQ(standard->time, 1436509052249713u);
+    EXPECT_EQ(standard->message, can::build_standard(0x123, std::to_array<std::uint8_t>({0x01, 0x02})));
+
+    // Identifiers of more than three digits are extended, even if the value would fit a standard one.
+    const auto extended = can_log::parse_candump_line("(0.5) vcan1 00000123#DEADbeef");
+    ASSERT_TRUE(extended);
+    EXPECT_EQ(extended->time, 500000u);
+    EXPECT_EQ(extended->message, can::build_extended(0x123, std::to_array<std::uint8_t>({0xde, 0xad, 0xbe, 0xef})));
+
+    const auto empty = can_log::parse_candump_line("(1.000001) can0 7FF#");
+    ASSERT_TRUE(empty);
+    EXPECT_EQ(empty->message.length, 0);
+
+    // Remote, CAN FD and error frames and malformed lines are rejected.
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 123#R"));
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 123##1010203"));
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 20000080#0000000000000000"));
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 800#00"));
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 123#010203040506070809"));
+    EXPECT_FALSE(can_log::parse_candump_line("(1.0) can0 123#012"));
+    EXPECT_FALSE(can_log::parse_candump_line("1.0 can0 123#01"));
+}
+
+TEST(CanLog, Asc) {
+    const auto standard = can_log::parse_asc_line("   0.002400 1  123             Rx   d 2 01 Fe");
+    ASSERT_TRUE(standard);
+    EXPECT_EQ(standard->time, 2400u);
+    EXPECT_EQ(standard->message, can::build_standard(0x123, std::to_array<std::uint8_t>({0x01, 0xfe})));
+
+    const auto extended = can_log::parse_asc_line("12.5 2 2022x Tx d 1 aa  Length = 0 BitCount = 0");
+    ASSERT_TRUE(extended);
+    EXPECT_EQ(extended->time, 12500000u);
+    EXPECT_EQ(extended->message, can::build_extended(0x2022, std::to_array<std::uint8_t>({0xaa})));
+
+    const auto decimal = can_log::parse_asc_line("1.0 1 291 d 2 1 254", true);
+    ASSERT_TRUE(decimal);
+    EXPECT_EQ(decimal->message, can::build_standard(0x123, std::to_array<std::uint8_t>({0x01, 0xfe})));
+    EXPECT_FALSE(can_log::parse_asc_line("1.0 1 12a d 1 01", true));
+
+    EXPECT_FALSE(can_log::parse_asc_line("date Tue Jan 1 00:00:00 2026"));
+    EXPECT_FALSE(can_log::parse_asc_line("1.0 1 ErrorFrame"));
+    EXPECT_FALSE(can_log::parse_asc_line("1.0 1 123 Rx r"));
+    EXPECT_FALSE(can_log::parse_asc_line("1.0 1 123 Rx d 9 01 02 03 04 05 06 07 08 09"));
+    EXPECT_FALSE(can_log::parse_asc_line("1.0 1 123 Rx d 2 01"));
+}
+
+TEST(CanLog, Reader) {
+    constexpr std::string_view log = "date Tue Jan 1 00:00:00 2026\r\n"
+                                     "base dec  timestamps absolute\r\n"
+                                     "\r\n"
+                                     "   1.000000 1  291 Rx d 1 16\r\n"
+                                     "   1.000100 1  ErrorFrame\r\n"
+                                     "(2.0) can0 123#10\n"
+                                     "base hex  timestamps absolute\n"
+                                     "   3.000000 1  291 Rx d 1 16";
+    can_log::Reader reader(log);
+    std::vector<std::uint64_t> times;
+    while (const auto record = reader.next()) {
+        EXPECT_EQ(record->message.length, 1);
+        times.push_back(record->time);
+    }
+    EXPECT_EQ(times, (std::vector<std::uint64_t>{1000000, 2000000, 3000000}));
+    EXPECT_EQ(reader.offset(), log.size());
+    EXPECT_EQ(reader.line_count(), 8);
+    EXPECT_EQ(reader.skipped_count(), 4);
+}
+
+TEST(CanLog, Csv) {
+    EXPECT_EQ(csv_row("(1.0) can0 00002022#0000245E00710186"), "1.000000,34,1,9310,11.3,390,,,,,,,,,,,,,\n");
+    EXPECT_EQ(csv_row("(0.25) can0 00002222#0153011704"), "0.250000,34,3,,,,,,33.9,27.9,4,,,,,,,,\n");
+    EXPECT_EQ(csv_row("(0.25) can0 00002322#00000064FFFFFD6E"), "0.250000,34,4,,,,,,,,,1.00,-6.58,,,,,,\n");
+    EXPECT_EQ(csv_row("(0.25) can0 00002422#38D8AA01AA05FF18"), "0.250000,34,5,,,,,,,,,,,56,-40,170,1,1450,24\n");
+
+    // Other frames, and status packets too short for their signals, aren't rows.
+    std::string out;
+    EXPECT_FALSE(can_log::append_csv_row(out, *can_log::parse_candump_line("(1.0) can0 022#0000245E00710186")));
+    EXPECT_FALSE(can_log::append_csv_row(out, *can_log::parse_candump_line("(1.0) can0 00000122#0064")));
+    EXPECT_FALSE(can_log::append_csv_row(out, *can_log::parse_candump_line("(1.0) can0 00002022#0000")));
+    EXPECT_TRUE(out.empty());
+
+    // Every row has a column for each heading.
+    const auto commas = [](std::string_view text) {
+        return std::count(text.begin(), text.end(), ',');
+    };
+    EXPECT_EQ(commas(csv_row("(1.0) can0 00002122#005C0011")), commas(can_log::k_csv_header));
+}
+
+TEST(CanLog, MappedFile) {
+    const auto path = std::filesystem::temp_directory_path() / "can_log_test.log";
+    constexpr std::string_view log = "(1.0) can0 123#01\n(1.5) can0 124#02\n";
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fwrite(log.data(), 1, log.size(), file);
+    std::fclose(file);
+
+    auto mapped = can_log::MappedFile::open(path.string());
+    ASSERT_TRUE(mapped);
+    EXPECT_EQ(mapped->text(), log);
+    auto moved = std::move(*mapped);
+    EXPECT_EQ(moved.text(), log);
+    EXPECT_TRUE(mapped->text().empty());
+    std::filesystem::remove(path);
+    EXPECT_FALSE(can_log::MappedFile::open(path.string()));
+}
+
+// Replays a log of GeneralData1 packets every 10 ms into a listening inverter table, as the can-log tool does.
+TEST(CanLog, Replay) {
+    s_received.clear();
+    s_timestamps.clear();
+    can::VirtualBus bus(500'000);
+    can::VirtualNode sender(bus);
+    can::VirtualNode listener(bus);
+    sender.select();
+    ASSERT_TRUE(can::init(can::Port::A, can::Speed::_500));
+    listener.select();
+    ASSERT_TRUE(can::init(can::Port::A, can::Speed::_500, {.timestamps = true}));
+    can::route_filter(0, 0, 0, 0);
+    can::set_fifo_callback(0, &capture);
+
+    std::string log;
+    for (int i = 0; i < 10; i++) {
+        log += "(100.0" + std::to_string(i) + "0000) can0 00002022#000024" + std::to_string(10 + i) + "00710186\n";
+    }
+    can_log::Replayer replayer(bus, sender, 0.0);
+    can_log::Reader reader(log);
+    while (const auto record = reader.next()) {
+        replayer.send(*record);
+    }
+    EXPECT_EQ(replayer.sent_count(), 10);
+    EXPECT_EQ(replayer.dropped_count(), 0);
+
+    // The frames are as far apart in bus time as in the log.
+    ASSERT_EQ(s_received.size(), 10);
+    for (std::size_t i = 1; i < s_timestamps.size(); i++) {
+        EXPECT_EQ(s_timestamps[i] - s_timestamps[i - 1], 5000u);
+    }
+
+    dti::InverterState inverter(bus.bitrate());
+    for (std::size_t i = 0; i < s_received.size(); i++) {
+        EXPECT_TRUE(inverter.update(s_received[i].to_message(), s_timestamps[i]));
+    }
+    EXPECT_EQ(inverter.erpm(s_timestamps.back(), 1000), 0x2419);
+    EXPECT_EQ(inverter.statistics(dti::k_general_data_1_id).count, 10);
+}
+
+} // namespace
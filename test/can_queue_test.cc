@@ -0,0 +1,87 @@
+#include <can_queue.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+
+namespace {
+
+can::RawMessage standard(std::uint16_t id, std::uint8_t tag = 0) {
+    return can::RawMessage::standard(id, std::to_array<std::uint8_t>({tag}));
+}
+
+can::RawMessage extended(std::uint32_t id, std::uint8_t tag = 0) {
+    return can::RawMessage::extended(id, std::to_array<std::uint8_t>({tag}));
+}
+
+TEST(CanQueue, ArbitrationKey) {
+    EXPECT_LT(can::arbitration_key(standard(0x100)), can::arbitration_key(standard(0x101)));
+    EXPECT_LT(can::arbitration_key(standard(0x100)), can::arbitration_key(extended(0x100u << 18u)));
+    EXPECT_LT(can::arbitration_key(extended(0x100u << 18u)), can::arbitration_key(standard(0x101)));
+    EXPECT_LT(can::arbitration_key(extended(0x2005)), can::arbitration_key(extended(0x2105)));
+    EXPECT_EQ(can::arbitration_key(can::build_extended(0x12345678, {})), can::arbitration_key(extended(0x12345678)));
+}
+
+TEST(CanQueue, PriorityOrder) {
+    can::TxQueue<4> queue;
+    EXPECT_TRUE(queue.push(standard(0x300)));
+    EXPECT_TRUE(queue.push(standard(0x100)));
+    EXPECT_TRUE(queue.push(standard(0x200)));
+    EXPECT_EQ(queue.size(), 3);
+    EXPECT_EQ(queue.pop(), standard(0x100));
+    EXPECT_EQ(queue.pop(), standard(0x200));
+    EXPECT_EQ(queue.pop(), standard(0x300));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.high_water_mark(), 3);
+}
+
+TEST(CanQueue, EqualPriorityKeepsOrder) {
+    can::TxQueue<4> queue;
+    EXPECT_TRUE(queue.push(extended(0x0510, 1)));
+    EXPECT_TRUE(queue.push(extended(0x0510, 2)));
+    EXPECT_TRUE(queue.push(standard(0x000)));
+    EXPECT_TRUE(queue.push(extended(0x0510, 3)));
+    EXPECT_EQ(queue.pop(), standard(0x000));
+    EXPECT_EQ(queue.pop(), extended(0x0510, 1));
+    EXPECT_EQ(queue.pop(), extended(0x0510, 2));
+    EXPECT_EQ(queue.pop(), extended(0x0510, 3));
+}
+
+TEST(CanQueue, FullEvictsLowestPriority) {
+    can::TxQueue<2> queue;
+    EXPECT_TRUE(queue.push(standard(0x200)));
+    EXPECT_TRUE(queue.push(standard(0x300)));
+
+    // Lower priority than everything queued - dropped.
+    EXPECT_FALSE(queue.push(standard(0x400)));
+    EXPECT_EQ(queue.drop_count(), 1);
+
+    // Higher priority - evicts 0x300.
+    EXPECT_TRUE(queue.push(standard(0x100)));
+    EXPECT_EQ(queue.drop_count(), 2);
+    EXPECT_EQ(queue.size(), 2);
+    EXPECT_EQ(queue.pop(), standard(0x100));
+    EXPECT_EQ(queue.pop(), standard(0x200));
+    EXPECT_EQ(queue.high_water_mark(), 2);
+}
+
+TEST(CanQueue, OrderedMode) {
+    can::TxQueue<3> queue;
+    queue.set_ordered(true);
+    EXPECT_TRUE(queue.push(standard(0x300)));
+    EXPECT_TRUE(queue.push(standard(0x100)));
+    EXPECT_TRUE(queue.push(extended(0x0510)));
+
+    // Full - the new message is dropped rather than evicting an earlier one, even with a higher priority.
+    EXPECT_FALSE(queue.push(standard(0x000)));
+    EXPECT_EQ(queue.drop_count(), 1);
+    EXPECT_EQ(queue.pop(), standard(0x300));
+    EXPECT_EQ(queue.pop(), standard(0x100));
+    EXPECT_EQ(queue.pop(), extended(0x0510));
+    EXPECT_TRUE(queue.empty());
+}
+
+} // namespace
@@ -0,0 +1,314 @@
+#include <can_scheduler.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace {
+
+// Fake mailboxes which only send when told to.
+class FakeDriver {
+    std::array<std::optional<can::RawMessage>, 3> m_mailboxes{};
+    std::array<std::uint32_t, 3> m_sequence{};
+    std::array<can::MailboxStatus, 3> m_outcome{};
+    std::array<bool, 3> m_sending{};
+
+public:
+    std::vector<can::RawMessage> sent;
+    std::vector<can::RawMessage> aborted;
+
+    std::optional<can::MailboxTicket> submit(const can::RawMessage &message) {
+        for (std::uint8_t i = 0; i < m_mailboxes.size(); i++) {
+            if (!m_mailboxes[i]) {
+                m_mailboxes[i] = message;
+                return can::MailboxTicket{i, ++m_sequence[i]};
+            }
+        }
+        return std::nullopt;
+    }
+
+    can::MailboxStatus status(const can::MailboxTicket &ticket) {
+        if (m_sequence[ticket.mailbox] != ticket.sequence) {
+            return can::MailboxStatus::Sent;
+        }
+        return m_mailboxes[ticket.mailbox] ? can::MailboxStatus::Pending : m_outcome[ticket.mailbox];
+    }
+
+    can::MailboxStatus abort(const can::MailboxTicket &ticket) {
+        // A message which is being sent can't be stopped.
+        if (status(ticket) == can::MailboxStatus::Pending && !m_sending[ticket.mailbox]) {
+            aborted.push_back(*m_mailboxes[ticket.mailbox]);
+            m_mailboxes[ticket.mailbox].reset();
+            m_outcome[ticket.mailbox] = can::MailboxStatus::Aborted;
+        }
+        return status(ticket);
+    }
+
+    // Starts sending the message in the given mailbox, which then can't be aborted until it is complete.
+    void start(std::uint8_t mailbox) { m_sending[mailbox] = true; }
+
+    // Sends the message in the given mailbox.
+    void complete(std::uint8_t mailbox) {
+        sent.push_back(*m_mailboxes[mailbox]);
+        m_mailboxes[mailbox].reset();
+        m_outcome[mailbox] = can::MailboxStatus::Sent;
+        m_sending[mailbox] = false;
+    }
+
+    void complete_all() {
+        for (std::uint8_t i = 0; i < m_mailboxes.size(); i++) {
+            if (m_mailboxes[i]) {
+                complete(i);
+            }
+        }
+    }
+
+    // Fills all mailboxes with other traffic.
+    void fill() {
+        while (submit(can::RawMessage::standard(0x7ff, {}))) {
+        }
+    }
+
+    std::size_t occupied() const {
+        return static_cast<std::size_t>(std::count_if(m_mailboxes.begin(), m_mailboxes.end(), [](const auto &mailbox) {
+            return mailbox.has_value();
+        }));
+    }
+};
+
+can::RawMessage value(std::uint16_t id, std::uint8_t tag) {
+    return can::RawMessage::standard(id, std::to_array<std::uint8_t>({tag}));
+}
+
+TEST(CanScheduler, PeriodicRelease) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 10}}}, 0);
+
+    // Nothing is sent until a value is given.
+    scheduler.poll(0);
+    EXPECT_EQ(driver.occupied(), 0);
+
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(5);
+    EXPECT_EQ(driver.occupied(), 0);
+    scheduler.poll(10);
+    EXPECT_EQ(driver.occupied(), 1);
+    driver.complete_all();
+
+    // The same value is repeated every period.
+    scheduler.poll(15);
+    EXPECT_EQ(driver.occupied(), 0);
+    scheduler.poll(20);
+    driver.complete_all();
+    ASSERT_EQ(driver.sent.size(), 2);
+    EXPECT_EQ(driver.sent[1].byte(0), 1);
+
+    scheduler.poll(30);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 2);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 0);
+}
+
+TEST(CanScheduler, AbortAfterDeadline) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 4}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+    EXPECT_EQ(driver.occupied(), 1);
+
+    // Not sent by the deadline - aborted rather than sent late.
+    scheduler.update(0, value(0x100, 2));
+    scheduler.poll(4);
+    EXPECT_EQ(driver.occupied(), 0);
+    ASSERT_EQ(driver.aborted.size(), 1);
+    EXPECT_EQ(driver.aborted[0].byte(0), 1);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 1);
+
+    // The next release carries the freshest value.
+    scheduler.poll(10);
+    driver.complete_all();
+    ASSERT_EQ(driver.sent.size(), 1);
+    EXPECT_EQ(driver.sent[0].byte(0), 2);
+}
+
+TEST(CanScheduler, AbortWhileSending) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 4}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+    driver.start(0);
+
+    // The message is being sent at its deadline, so the abort doesn't wait for it and its outcome is taken later.
+    scheduler.poll(4);
+    EXPECT_EQ(driver.occupied(), 1);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 0);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 0);
+
+    driver.complete(0);
+    scheduler.poll(5);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 1);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 0);
+    EXPECT_TRUE(driver.aborted.empty());
+}
+
+TEST(CanScheduler, TakeMissed) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 0, .deadline = 10}}}, 0);
+
+    // A release replaced by a newer one isn't reported, since the newer value goes out instead.
+    driver.fill();
+    scheduler.release(0, value(0x100, 1), 0);
+    scheduler.poll(0);
+    scheduler.release(0, value(0x100, 2), 5);
+    scheduler.poll(5);
+    EXPECT_FALSE(scheduler.take_missed(0));
+
+    // A release which runs out of time is reported once.
+    scheduler.poll(15);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 2);
+    EXPECT_TRUE(scheduler.take_missed(0));
+    EXPECT_FALSE(scheduler.take_missed(0));
+}
+
+TEST(CanScheduler, ReplaceAtNextRelease) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 10}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+
+    // Polling only once per period still aborts the stale message and replaces it in the same call.
+    scheduler.update(0, value(0x100, 2));
+    scheduler.poll(10);
+    EXPECT_EQ(driver.occupied(), 1);
+    EXPECT_EQ(driver.aborted.size(), 1);
+    driver.complete_all();
+    ASSERT_EQ(driver.sent.size(), 1);
+    EXPECT_EQ(driver.sent[0].byte(0), 2);
+    scheduler.poll(11);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 1);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 1);
+}
+
+TEST(CanScheduler, WaitForMailbox) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 5}}}, 0);
+    driver.fill();
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+
+    // A mailbox frees up before the deadline and the freshest value is sent.
+    scheduler.update(0, value(0x100, 2));
+    driver.complete(1);
+    scheduler.poll(2);
+    driver.complete(1);
+    EXPECT_EQ(driver.sent.back().byte(0), 2);
+
+    // No mailbox before the deadline - counted as a miss without ever being submitted.
+    driver.fill();
+    scheduler.poll(10);
+    scheduler.poll(15);
+    driver.complete_all();
+    scheduler.poll(16);
+    EXPECT_EQ(driver.occupied(), 0);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 1);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 1);
+}
+
+TEST(CanScheduler, PriorityOrder) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 3> scheduler(driver,
+                                              {{
+                                                  {.priority = 2, .period = 10, .deadline = 10},
+                                                  {.priority = 0, .period = 10, .deadline = 10},
+                                                  {.priority = 1, .period = 10, .deadline = 10},
+                                              }},
+                                              0);
+    for (std::uint8_t i = 0; i < 3; i++) {
+        scheduler.update(i, value(0x100, i));
+    }
+
+    // Only two mailboxes free; the lowest priority class has to wait.
+    driver.submit(value(0x7ff, 0xff));
+    scheduler.poll(0);
+    ASSERT_EQ(driver.occupied(), 3);
+    driver.complete_all();
+    ASSERT_EQ(driver.sent.size(), 3);
+    EXPECT_EQ(driver.sent[1].byte(0), 1);
+    EXPECT_EQ(driver.sent[2].byte(0), 2);
+
+    scheduler.poll(1);
+    driver.complete_all();
+    EXPECT_EQ(driver.sent.back().byte(0), 0);
+}
+
+TEST(CanScheduler, Clear) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 10}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+    driver.complete_all();
+    scheduler.clear(0);
+    scheduler.poll(10);
+    scheduler.poll(20);
+    EXPECT_EQ(driver.occupied(), 0);
+    EXPECT_EQ(scheduler.statistics(0).sent_count, 1);
+}
+
+TEST(CanScheduler, SkipMissedReleases) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 1> scheduler(driver, {{{.priority = 0, .period = 10, .deadline = 10}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+    driver.complete_all();
+
+    // A long gap between polls releases only once.
+    scheduler.poll(95);
+    EXPECT_EQ(driver.occupied(), 1);
+    driver.complete_all();
+    scheduler.poll(100);
+    EXPECT_EQ(driver.occupied(), 0);
+    scheduler.poll(105);
+    EXPECT_EQ(driver.occupied(), 1);
+}
+
+TEST(CanScheduler, Release) {
+    FakeDriver driver;
+    can::TxScheduler<FakeDriver, 2> scheduler(
+        driver, {{{.priority = 0, .period = 10, .deadline = 10}, {.priority = 1, .period = 0, .deadline = 5}}}, 0);
+    scheduler.update(0, value(0x100, 1));
+    scheduler.poll(0);
+    driver.complete_all();
+
+    // A release ahead of the period is sent on the next poll, and moves the next periodic release a period later.
+    scheduler.release(0, value(0x100, 2), 4);
+    scheduler.poll(4);
+    EXPECT_EQ(driver.occupied(), 1);
+    driver.complete_all();
+    scheduler.poll(10);
+    EXPECT_EQ(driver.occupied(), 0);
+    scheduler.poll(14);
+    EXPECT_EQ(driver.occupied(), 1);
+    driver.complete_all();
+    EXPECT_EQ(driver.sent.back().byte(0), 2);
+
+    // A class with no period is only sent when released, and still misses its deadline.
+    scheduler.update(1, value(0x200, 1));
+    scheduler.poll(30);
+    driver.complete_all();
+    EXPECT_TRUE(std::none_of(driver.sent.begin(), driver.sent.end(), [](const can::RawMessage &message) {
+        return message.standard_id() == 0x200;
+    }));
+    scheduler.release(1, value(0x200, 2), 31);
+    driver.fill();
+    scheduler.poll(31);
+    scheduler.poll(36);
+    EXPECT_EQ(scheduler.statistics(1).miss_count, 1);
+    EXPECT_EQ(scheduler.statistics(1).sent_count, 0);
+}
+
+} // namespace
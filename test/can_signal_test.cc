@@ -0,0 +1,63 @@
+#include <can_signal.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+
+namespace {
+
+constexpr auto k_bytes = std::to_array<std::uint8_t>({0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0});
+
+TEST(CanSignal, BigEndian) {
+    static_assert(can::decode_signal<can::big_endian<std::uint32_t>(7, 32)>(k_bytes) == 0x12345678u);
+    static_assert(can::decode_signal<can::big_endian<std::uint16_t>(15, 16)>(k_bytes) == 0x3456u);
+    static_assert(can::decode_signal<can::big_endian<std::uint64_t>(7, 64)>(k_bytes) == 0x123456789abcdef0u);
+
+    // A 12-bit signal starting in the middle of byte 1: 0x4 from byte 1, then all of byte 2.
+    static_assert(can::decode_signal<can::big_endian<std::uint16_t>(11, 12)>(k_bytes) == 0x456u);
+    EXPECT_EQ(can::decode_signal<can::big_endian<std::int16_t>(55, 16)>(k_bytes), static_cast<std::int16_t>(0xdef0));
+}
+
+TEST(CanSignal, LittleEndian) {
+    static_assert(can::decode_signal<can::little_endian<std::uint32_t>(0, 32)>(k_bytes) == 0x78563412u);
+    static_assert(can::decode_signal<can::little_endian<std::uint8_t>(4, 8)>(k_bytes) == 0x41u);
+    static_assert(can::decode_signal<can::little_endian<bool>(10, 1)>(k_bytes));
+    static_assert(!can::decode_signal<can::little_endian<bool>(8, 1)>(k_bytes));
+
+    // Signed values narrower than their type are sign extended.
+    static_assert(can::decode_signal<can::little_endian<std::int8_t>(60, 4)>(k_bytes) == -1);
+    static_assert(can::decode_signal<can::little_endian<std::int8_t>(56, 4)>(k_bytes) == 0);
+    static_assert(can::decode_signal<can::little_endian<std::int16_t>(36, 12)>(k_bytes) == -0x437);
+}
+
+// Bytes 0-1 and the upper half of byte 2, then byte 3 and the lower half of byte 4, then bit 4 of byte 4.
+using MixedCodec = can::MessageCodec<0x123, std::array<std::int32_t, 3>, can::big_endian<std::int32_t>(7, 20),
+                                     can::little_endian<std::int32_t>(24, 12),
+                                     can::little_endian<std::int32_t>(36, 1)>;
+
+TEST(CanSignal, RoundTrip) {
+    static_assert(MixedCodec::k_id == 0x123);
+    static_assert(MixedCodec::k_length == 5);
+    constexpr auto encoded = MixedCodec::encode(-12345, 1000, -1);
+    auto data = std::array<std::uint8_t, 8>{};
+    std::copy(encoded.begin(), encoded.end(), data.begin());
+    EXPECT_EQ(MixedCodec::decode(data), (std::array<std::int32_t, 3>{-12345, 1000, -1}));
+    EXPECT_EQ(MixedCodec::decode(can::RawMessage::standard(0x123, encoded)),
+              (std::array<std::int32_t, 3>{-12345, 1000, -1}));
+
+    // Values are truncated to the signal length when encoding.
+    EXPECT_EQ(MixedCodec::decode(can::RawMessage::standard(0x123, MixedCodec::encode(0, 4097, 0))),
+              (std::array<std::int32_t, 3>{0, 1, 0}));
+}
+
+TEST(CanSignal, Physical) {
+    constexpr auto k_temperature = can::big_endian<std::int16_t>(7, 16, 0.1f, -40.0f);
+    EXPECT_FLOAT_EQ(can::to_physical<k_temperature>(653), 25.3f);
+    EXPECT_EQ(can::from_physical<k_temperature>(25.3f), 653);
+    EXPECT_EQ(can::from_physical<k_temperature>(-50.0f), -100);
+}
+
+} // namespace
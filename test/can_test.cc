@@ -0,0 +1,48 @@
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+
+namespace {
+
+TEST(CanRawMessage, Standard) {
+    const auto message = can::RawMessage::standard(0x123, std::to_array<std::uint8_t>({0x01, 0x02, 0x03, 0x04, 0x05}));
+    EXPECT_EQ(message.id_word, 0x123u << 21u);
+    EXPECT_EQ(message.data_low, 0x04030201u);
+    EXPECT_EQ(message.data_high, 0x05u);
+    EXPECT_EQ(message.length, 5);
+    EXPECT_TRUE(message.is_standard());
+    EXPECT_FALSE(message.is_remote());
+    EXPECT_EQ(message.standard_id(), 0x123);
+    EXPECT_EQ(message.byte(4), 0x05);
+}
+
+TEST(CanRawMessage, Extended) {
+    const auto message = can::RawMessage::extended(0x1abcdef0, std::to_array<std::uint8_t>({0xff, 0xff, 0x03, 0x79}));
+    EXPECT_EQ(message.id_word, (0x1abcdef0u << 3u) | 0b100u);
+    EXPECT_TRUE(message.is_extended());
+    EXPECT_EQ(message.extended_id(), 0x1abcdef0u);
+    EXPECT_EQ(message.read_be<std::int32_t>(0), -64647);
+    EXPECT_EQ(message.read_be<std::uint16_t>(2), 0x0379);
+}
+
+TEST(CanRawMessage, Truncates) {
+    std::array<std::uint8_t, 10> bytes{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    const auto message = can::RawMessage::standard(0x1, bytes);
+    EXPECT_EQ(message.length, 8);
+    EXPECT_EQ(message.data_high, 0x08070605u);
+}
+
+TEST(CanRawMessage, ConvertMessage) {
+    const auto payload = std::to_array<std::uint8_t>({0x38, 0xd8, 0xaa, 0x01, 0xaa, 0x05, 0xff, 0x18});
+    const auto extended = can::build_extended(0x2422, payload);
+    EXPECT_EQ(can::RawMessage::from_message(extended), can::RawMessage::extended(0x2422, payload));
+    EXPECT_EQ(can::RawMessage::from_message(extended).to_message(), extended);
+
+    const auto standard = can::build_standard(0x7ff, std::to_array<std::uint8_t>({0x12}));
+    EXPECT_EQ(can::RawMessage::from_message(standard).to_message(), standard);
+}
+
+} // namespace
@@ -0,0 +1,105 @@
+#include <can_timestamp.hh>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+namespace {
+
+// 500 kbit/s with a 56 MHz core clock.
+constexpr std::uint32_t k_cycles_per_tick = 112;
+
+class Capture {
+    can::TimestampExtender m_extender;
+    std::uint32_t m_start_cycles;
+
+public:
+    // Estimates the CAN timer at the given tick, as late in the tick as a capture.
+    std::uint32_t now(std::uint32_t tick) const {
+        return m_extender.estimate(m_start_cycles + tick * k_cycles_per_tick + 37);
+    }
+
+    explicit Capture(std::uint32_t start_cycles = 0) : m_start_cycles(start_cycles) {
+        m_extender.reset(k_cycles_per_tick);
+    }
+
+    // Captures a frame which started at the given tick, some ticks before the capture.
+    std::uint32_t frame(std::uint32_t tick, std::int32_t delay = 20) {
+        const auto cycles = m_start_cycles + (tick + static_cast<std::uint32_t>(delay)) * k_cycles_per_tick + 37;
+        return m_extender.extend(static_cast<std::uint16_t>(tick), cycles);
+    }
+};
+
+TEST(CanTimestamp, FirstCapture) {
+    // The first capture defines the offset between the counters, so the absolute value only has 16 bits.
+    Capture capture;
+    EXPECT_EQ(capture.frame(70000), 70000 - 65536);
+    EXPECT_EQ(capture.frame(80000), 80000 - 65536);
+}
+
+TEST(CanTimestamp, Monotonic) {
+    Capture capture;
+    EXPECT_EQ(capture.frame(1000), 1000);
+    EXPECT_EQ(capture.frame(1500), 1500);
+    EXPECT_EQ(capture.frame(65530), 65530);
+
+    // The 16-bit timer wraps.
+    EXPECT_EQ(capture.frame(65540), 65540);
+    EXPECT_EQ(capture.frame(200000), 200000);
+}
+
+TEST(CanTimestamp, LongGaps) {
+    Capture capture;
+    EXPECT_EQ(capture.frame(100), 100);
+
+    // Several wraps with no frames in between.
+    EXPECT_EQ(capture.frame(100 + 5 * 65536 + 1234), 100 + 5 * 65536 + 1234);
+    EXPECT_EQ(capture.frame(10'000'000), 10'000'000);
+}
+
+TEST(CanTimestamp, OutOfOrder) {
+    Capture capture;
+    EXPECT_EQ(capture.frame(1000), 1000);
+    EXPECT_EQ(capture.frame(70000), 70000);
+
+    // A transmit completion handled after a later receive still gets an earlier time stamp.
+    EXPECT_EQ(capture.frame(70500, 0), 70500);
+    EXPECT_EQ(capture.frame(70400, 300), 70400);
+
+    // A capture within the margin after the estimate.
+    EXPECT_EQ(capture.frame(80000, 0), 80000);
+    EXPECT_EQ(capture.frame(80100, -100), 80100);
+}
+
+TEST(CanTimestamp, CycleCounterWraps) {
+    Capture capture(UINT32_MAX - 1000 * k_cycles_per_tick);
+    EXPECT_EQ(capture.frame(500), 500);
+    EXPECT_EQ(capture.frame(1500), 1500);
+    EXPECT_EQ(capture.frame(90000), 90000);
+}
+
+TEST(CanTimestamp, NoDrift) {
+    // Many captures with a remainder never accumulate rounding errors.
+    Capture capture;
+    std::uint32_t tick = 0;
+    for (int i = 0; i < 100000; i++) {
+        tick += 997;
+        ASSERT_EQ(capture.frame(tick, 3), tick);
+    }
+}
+
+TEST(CanTimestamp, Estimate) {
+    Capture capture;
+    capture.frame(1000, 300);
+    EXPECT_EQ(capture.now(2000), 2000 - 300);
+
+    // A frame captured sooner after it started shows that the estimate lags.
+    capture.frame(5000, 120);
+    EXPECT_EQ(capture.now(6000), 6000 - 120);
+
+    // A slower capture doesn't move it back.
+    capture.frame(8000, 400);
+    EXPECT_EQ(capture.now(9000), 9000 - 120);
+}
+
+} // namespace
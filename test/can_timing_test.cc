@@ -0,0 +1,71 @@
+#include <can_timing.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+
+namespace {
+
+TEST(CanTiming, MatchesOriginalConstants) {
+    // The hand-picked BTR values which were used with a 28 MHz APB1 clock.
+    constexpr auto timing_33_3 = can::make_bit_timing<28'000'000, 33'333, 867>();
+    constexpr auto timing_500 = can::make_bit_timing<28'000'000, 500'000, 857>();
+    constexpr auto timing_1000 = can::make_bit_timing<28'000'000, 1'000'000, 857>();
+    EXPECT_EQ(timing_33_3.btr(), 0x001b0037u);
+    EXPECT_EQ(timing_500.btr(), 0x001a0003u);
+    EXPECT_EQ(timing_1000.btr(), 0x001a0001u);
+
+    const auto table = can::timing_table(28'000'000);
+    EXPECT_EQ(table[static_cast<std::size_t>(can::Speed::_33_3)]->btr(), 0x001b0037u);
+    EXPECT_EQ(table[static_cast<std::size_t>(can::Speed::_500)]->btr(), 0x001a0003u);
+    EXPECT_EQ(table[static_cast<std::size_t>(can::Speed::_1000)]->btr(), 0x001a0001u);
+}
+
+TEST(CanTiming, AllSpeedsAchievable) {
+    for (const std::uint32_t clock : {8'000'000u, 28'000'000u}) {
+        const auto table = can::timing_table(clock);
+        for (std::size_t i = 0; i < table.size(); i++) {
+            const auto speed = static_cast<can::Speed>(i);
+            ASSERT_TRUE(table[i].has_value()) << clock << " " << i;
+
+            // Check the actual bitrate is within 0.1% and the sample point within 2.5%.
+            const auto &timing = *table[i];
+            const auto actual = clock / (timing.prescaler * timing.quanta_per_bit());
+            EXPECT_NEAR(actual, can::bitrate(speed), can::bitrate(speed) / 1000 + 1);
+            EXPECT_NEAR(timing.sample_point(), can::sample_point(speed), 25);
+        }
+    }
+}
+
+TEST(CanTiming, LowPowerClock) {
+    const auto timing = can::make_bit_timing<8'000'000, 500'000>();
+    EXPECT_EQ(timing.prescaler, 1);
+    EXPECT_EQ(timing.quanta_per_bit(), 16);
+    EXPECT_EQ(timing.sample_point(), 875);
+}
+
+TEST(CanTiming, SyncJumpWidth) {
+    const auto timing = can::make_bit_timing<28'000'000, 250'000, 750, 4>();
+    EXPECT_GE(timing.time_segment_2, 4);
+    EXPECT_EQ(timing.sync_jump_width, 4);
+    EXPECT_EQ((timing.btr() >> 24u) & 0b11u, 3u);
+}
+
+TEST(CanTiming, Impossible) {
+    // Bitrate too high for the clock.
+    EXPECT_EQ(can::compute_bit_timing(8'000'000, 4'000'000, 875), std::nullopt);
+
+    // Bitrate too low for the largest prescaler.
+    EXPECT_EQ(can::compute_bit_timing(28'000'000, 1'000, 875), std::nullopt);
+
+    // No integer prescaler within tolerance.
+    EXPECT_EQ(can::compute_bit_timing(8'000'000, 700'000, 875), std::nullopt);
+
+    // Invalid jump width.
+    EXPECT_EQ(can::compute_bit_timing(28'000'000, 500'000, 875, 5), std::nullopt);
+}
+
+} // namespace
@@ -0,0 +1,289 @@
+#include <can_virtual.hh>
+
+#include <can.hh>
+#include <can_filter.hh>
+#include <can_timing.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+std::vector<can::RawMessage> s_received;
+std::vector<std::uint32_t> s_timestamps;
+
+void record(const can::RawMessage &message, std::uint32_t timestamp) {
+    s_received.push_back(message);
+    s_timestamps.push_back(timestamp);
+}
+
+// Echoes every message back with the identifier incremented, from the receiving node.
+void echo(const can::RawMessage &message, std::uint32_t) {
+    can::transmit(can::RawMessage::standard(message.standard_id() + 1, message.data()));
+}
+
+can::RawMessage standard(std::uint16_t id, std::uint8_t tag = 0) {
+    return can::RawMessage::standard(id, std::to_array<std::uint8_t>({tag}));
+}
+
+// Initialises the node at 500 kbit/s, accepting every message into FIFO 0.
+void init(can::VirtualNode &node, const can::InitOptions &options = {}) {
+    node.select();
+    ASSERT_TRUE(can::init(can::Port::A, can::Speed::_500, options));
+    can::route_filter(0, 0, 0, 0);
+    can::set_fifo_callback(0, &record);
+}
+
+struct VirtualCan : testing::Test {
+    can::VirtualBus bus{500'000};
+    can::VirtualNode a{bus};
+    can::VirtualNode b{bus};
+    can::VirtualNode receiver{bus};
+
+    void SetUp() override {
+        s_received.clear();
+        s_timestamps.clear();
+        init(a);
+        init(b);
+        init(receiver);
+    }
+
+    std::vector<std::uint16_t> received_ids() const {
+        std::vector<std::uint16_t> ids;
+        for (const auto &message : s_received) {
+            ids.push_back(message.standard_id());
+        }
+        return ids;
+    }
+};
+
+TEST_F(VirtualCan, Arbitration) {
+    a.select();
+    can::transmit(standard(0x300));
+    can::transmit(standard(0x050));
+    b.select();
+    can::transmit(standard(0x100));
+    receiver.set_interrupts_enabled(false);
+    EXPECT_EQ(bus.run(100), 3);
+    receiver.set_interrupts_enabled(true);
+
+    // The lowest identifier wins. Nodes a and b receive each other's frames straight away, and the receiver's three
+    // frames are handled once its interrupts are enabled.
+    EXPECT_EQ(received_ids(), (std::vector<std::uint16_t>{0x050, 0x100, 0x300, 0x050, 0x100, 0x300}));
+    EXPECT_EQ(receiver.statistics().rx_count, 3);
+    EXPECT_EQ(a.statistics().tx_count, 2);
+    EXPECT_EQ(bus.time(), 3 * can::frame_bits(false, 1));
+}
+
+TEST_F(VirtualCan, MailboxesAndQueue) {
+    b.go_offline();
+    a.select();
+    for (std::uint16_t id = 0x105; id > 0x100; id--) {
+        EXPECT_TRUE(can::transmit(standard(id)));
+    }
+
+    // Three mailboxes are filled with the first messages; the rest wait in the software queue.
+    EXPECT_EQ(can::tx_statistics().queue_depth, 2);
+    ASSERT_TRUE(bus.step());
+    EXPECT_EQ(received_ids(), std::vector<std::uint16_t>{0x103});
+
+    // Each freed mailbox is refilled with the highest priority queued message, which then wins arbitration.
+    EXPECT_EQ(bus.run(100), 4);
+    EXPECT_EQ(received_ids(), (std::vector<std::uint16_t>{0x103, 0x101, 0x102, 0x104, 0x105}));
+}
+
+TEST_F(VirtualCan, OrderedMode) {
+    b.go_offline();
+    init(a, {.ordered = true});
+    s_received.clear();
+    s_timestamps.clear();
+    const auto messages = std::to_array({standard(0x300), standard(0x100), standard(0x200), standard(0x000)});
+    EXPECT_EQ(can::transmit(std::span<const can::RawMessage>(messages)), 4);
+    EXPECT_EQ(bus.run(100), 4);
+    EXPECT_EQ(received_ids(), (std::vector<std::uint16_t>{0x300, 0x100, 0x200, 0x000}));
+}
+
+TEST_F(VirtualCan, BatchStopsWhenQueueFull) {
+    b.go_offline();
+    a.select();
+
+    // Later messages have a higher priority, so pushing them into a full queue would evict earlier ones.
+    std::array<can::RawMessage, 21> messages{};
+    for (std::uint16_t i = 0; i < messages.size(); i++) {
+        messages[i] = standard(0x200 - i);
+    }
+    EXPECT_EQ(can::transmit(std::span<const can::RawMessage>(messages)), 19);
+    EXPECT_EQ(can::tx_statistics().queue_depth, 16);
+    EXPECT_EQ(can::tx_statistics().drop_count, 0);
+
+    // Every accepted message is sent.
+    EXPECT_EQ(bus.run(100), 19);
+    EXPECT_EQ(s_received.size(), 19);
+    EXPECT_EQ(can::transmit(std::span<const can::RawMessage>(messages).last(2)), 2);
+}
+
+TEST_F(VirtualCan, FifoOverrun) {
+    b.go_offline();
+    receiver.set_interrupts_enabled(false);
+    a.select();
+    for (std::uint8_t tag = 0; tag < 5; tag++) {
+        can::transmit(standard(0x100 + tag, tag));
+    }
+    EXPECT_EQ(bus.run(100), 5);
+    EXPECT_EQ(receiver.fifo_level(0), 3);
+    EXPECT_EQ(receiver.statistics().overrun_count[0], 2);
+    receiver.select();
+    EXPECT_EQ(can::health_statistics().fifo_overrun_count[0], 2);
+
+    // The last message in the FIFO is overwritten by each new one.
+    receiver.set_interrupts_enabled(true);
+    ASSERT_EQ(s_received.size(), 3);
+    EXPECT_EQ(s_received[0].byte(0), 0);
+    EXPECT_EQ(s_received[1].byte(0), 1);
+    EXPECT_EQ(s_received[2].byte(0), 4);
+}
+
+TEST_F(VirtualCan, Filters) {
+    b.go_offline();
+    receiver.select();
+    can::apply_filters(can::make_filter_plan<can::accept_standard(1, 0x123)>());
+    can::set_fifo_callback(1, &record);
+    a.select();
+    can::transmit(standard(0x122));
+    can::transmit(standard(0x123));
+    EXPECT_EQ(bus.run(100), 2);
+    EXPECT_EQ(received_ids(), std::vector<std::uint16_t>{0x123});
+    EXPECT_EQ(receiver.statistics().rx_count, 1);
+}
+
+TEST_F(VirtualCan, Acknowledgement) {
+    b.go_offline();
+    receiver.go_offline();
+    a.select();
+    can::transmit(standard(0x100));
+    EXPECT_FALSE(bus.step());
+
+    // Nodes with the wrong bit rate can't join the bus.
+    receiver.select();
+    EXPECT_FALSE(can::init(can::Port::A, can::Speed::_250));
+    EXPECT_FALSE(bus.step());
+    EXPECT_TRUE(can::init(can::Port::A, can::make_bit_timing<28'000'000, 500'000>()));
+    EXPECT_TRUE(bus.step());
+}
+
+TEST_F(VirtualCan, CallbacksRunOnTheirNode) {
+    b.select();
+    can::set_fifo_callback(0, &echo);
+    a.select();
+    can::transmit(standard(0x100));
+    EXPECT_EQ(bus.run(100), 2);
+    EXPECT_EQ(b.statistics().tx_count, 1);
+    EXPECT_EQ(received_ids(), (std::vector<std::uint16_t>{0x100, 0x101, 0x101}));
+}
+
+TEST_F(VirtualCan, RunFor) {
+    b.go_offline();
+    std::uint32_t tick_count = 0;
+    bus.run_for(3, [&] {
+        a.select();
+        can::transmit(standard(0x100 + tick_count++));
+    });
+
+    // Each tick's frame is sent straight away, and the rest of each millisecond is idle.
+    EXPECT_EQ(tick_count, 3);
+    EXPECT_EQ(received_ids(), (std::vector<std::uint16_t>{0x100, 0x101, 0x102}));
+    EXPECT_EQ(bus.time(), 3 * bus.bitrate() / 1000);
+    EXPECT_EQ(bus.now(), 3);
+}
+
+TEST_F(VirtualCan, DeferredAndTimestamps) {
+    b.go_offline();
+    init(receiver, {.timestamps = true});
+    can::set_fifo_deferred(0, true);
+    a.select();
+    can::transmit(standard(0x100));
+    can::transmit(standard(0x101));
+    EXPECT_EQ(bus.run(100), 2);
+    EXPECT_TRUE(s_received.empty());
+
+    receiver.select();
+    EXPECT_EQ(can::rx_statistics(0).ring_depth, 2);
+    EXPECT_EQ(can::drain_fifo(0, 8), 2);
+    ASSERT_EQ(s_received.size(), 2);
+    EXPECT_EQ(s_timestamps, (std::vector<std::uint32_t>{0, can::frame_bits(false, 1)}));
+    EXPECT_EQ(can::timestamp_to_us(500), 1000);
+}
+
+TEST_F(VirtualCan, MailboxTickets) {
+    b.go_offline();
+    a.select();
+    const auto ticket = can::transmit_mailbox(standard(0x100));
+    ASSERT_TRUE(ticket);
+    EXPECT_EQ(can::mailbox_status(*ticket), can::MailboxStatus::Pending);
+    EXPECT_EQ(can::abort_mailbox(*ticket), can::MailboxStatus::Aborted);
+    EXPECT_EQ(can::mailbox_status(*ticket), can::MailboxStatus::Aborted);
+    EXPECT_FALSE(bus.step());
+
+    // A sent message can't be aborted.
+    const auto sent = can::transmit_mailbox(standard(0x101));
+    ASSERT_TRUE(sent);
+    EXPECT_TRUE(bus.step());
+    EXPECT_EQ(can::mailbox_status(*sent), can::MailboxStatus::Sent);
+    EXPECT_EQ(can::abort_mailbox(*sent), can::MailboxStatus::Sent);
+}
+
+TEST_F(VirtualCan, ReservedMailbox) {
+    b.go_offline();
+    init(a, {.reserve_mailbox = true});
+    s_received.clear();
+    s_timestamps.clear();
+    for (std::uint16_t id = 0x200; id < 0x205; id++) {
+        EXPECT_TRUE(can::transmit(standard(id)));
+    }
+
+    // Queued messages only take two mailboxes, so a scheduled message still gets one during the burst.
+    EXPECT_EQ(can::tx_statistics().queue_depth, 3);
+    const auto ticket = can::transmit_mailbox(standard(0x300));
+    ASSERT_TRUE(ticket);
+    EXPECT_FALSE(can::transmit_mailbox(standard(0x301)));
+    EXPECT_EQ(bus.run(100), 6);
+    EXPECT_EQ(can::mailbox_status(*ticket), can::MailboxStatus::Sent);
+    EXPECT_EQ(received_ids().back(), 0x300);
+}
+
+// Three nodes send bursts while the receiver only services its interrupts every few frames, as if busy.
+TEST_F(VirtualCan, LoadTest) {
+    can::VirtualNode c(bus);
+    init(c);
+    constexpr std::size_t k_burst_size = 4;
+    constexpr std::size_t k_burst_count = 50;
+    constexpr std::size_t k_service_interval = 4;
+    receiver.set_interrupts_enabled(false);
+    std::size_t sent = 0;
+    for (std::size_t burst = 0; burst < k_burst_count; burst++) {
+        for (auto *node : {&a, &b, &c}) {
+            node->select();
+            for (std::size_t i = 0; i < k_burst_size; i++) {
+                can::transmit(standard(static_cast<std::uint16_t>(0x100 + i)));
+            }
+        }
+        while (bus.step()) {
+            if (++sent % k_service_interval == 0) {
+                receiver.service_interrupts();
+            }
+        }
+    }
+    receiver.service_interrupts();
+
+    // One in four frames arrives while the FIFO is full.
+    const auto &statistics = receiver.statistics();
+    EXPECT_EQ(sent, 3 * k_burst_size * k_burst_count);
+    EXPECT_EQ(statistics.rx_count, sent);
+    EXPECT_EQ(statistics.overrun_count[0], sent / k_service_interval);
+}
+
+} // namespace
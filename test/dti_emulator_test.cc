@@ -0,0 +1,237 @@
+#include <dti_emulator.hh>
+
+#include <can.hh>
+#include <can_load.hh>
+#include <can_virtual.hh>
+#include <dti.hh>
+#include <dti_state.hh>
+#include <test_node.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace {
+
+constexpr std::uint32_t k_bitrate = 500'000;
+constexpr std::uint8_t k_node_id = 0x05;
+
+// Runs the emulator alone for the given time, returning the number of frames it sent of each status packet.
+std::array<std::uint32_t, dti::k_status_packet_count> run(dti::Emulator &emulator, std::uint32_t &now,
+                                                          std::uint32_t ms) {
+    std::array<std::uint32_t, dti::k_status_packet_count> counts{};
+    std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+    for (std::uint32_t i = 0; i < ms; i++) {
+        for (const auto &frame : emulator.poll(now++, frames)) {
+            counts[dti::identifier_packet_id(frame.extended_id()) - dti::k_general_data_1_id]++;
+        }
+    }
+    return counts;
+}
+
+// Sends a command to the emulator as a received frame.
+bool command(dti::Emulator &emulator, const can::Message &message, std::uint32_t now) {
+    return emulator.on_frame(can::RawMessage::from_message(message), now);
+}
+
+TEST(DtiEmulator, Broadcast) {
+    dti::Emulator emulator({.node_id = k_node_id});
+    std::uint32_t now = 0;
+    const auto counts = run(emulator, now, 1000);
+    EXPECT_EQ(counts, (std::array<std::uint32_t, dti::k_status_packet_count>{100, 100, 10, 0, 10}));
+    EXPECT_EQ(emulator.statistics().broadcast_count, 220);
+
+    // The frames decode as a stationary motor on a full battery, padded to eight bytes.
+    std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+    const auto sent = emulator.poll(now + 1000, frames);
+    ASSERT_EQ(sent.size(), 4);
+    EXPECT_EQ(sent[0].extended_id(), dti::packet_identifier(dti::k_general_data_1_id, k_node_id));
+    const auto general_data_1 = std::get<dti::GeneralData1>(dti::parse_packet(sent[0].to_message()));
+    EXPECT_EQ(general_data_1.erpm, 0);
+    EXPECT_EQ(general_data_1.input_voltage, 400);
+    EXPECT_EQ(sent[2].length, 8);
+    EXPECT_EQ(sent[2].byte(5), 0xff);
+    const auto general_data_3 = std::get<dti::GeneralData3>(dti::parse_packet(sent[2].to_message()));
+    EXPECT_EQ(general_data_3.motor_temperature, 250);
+    EXPECT_EQ(general_data_3.fault_code, dti::FaultCode::NoFaults);
+    const auto general_data_5 = std::get<dti::GeneralData5>(dti::parse_packet(sent[3].to_message()));
+    EXPECT_TRUE(general_data_5.drive_enabled);
+    EXPECT_EQ(general_data_5.can_map_version, 24);
+
+    // Too small a buffer sends the lowest packet IDs first.
+    const auto first = emulator.poll(now + 2000, std::span(frames).first(1));
+    ASSERT_EQ(first.size(), 1);
+    EXPECT_EQ(dti::identifier_packet_id(first[0].extended_id()), dti::k_general_data_1_id);
+}
+
+TEST(DtiEmulator, Commands) {
+    dti::Emulator emulator({.node_id = k_node_id});
+    std::uint32_t now = 0;
+    run(emulator, now, 10);
+
+    // Half of the maximum current reaches its target within a few current loop time constants.
+    ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 500), now));
+    run(emulator, now, 50);
+    EXPECT_NEAR(emulator.state().ac_current, 100.0f, 1.0f);
+    EXPECT_GT(emulator.state().erpm, 0.0f);
+    EXPECT_GT(emulator.state().dc_current, 0.0f);
+    EXPECT_LT(emulator.state().input_voltage, 400.0f);
+    EXPECT_EQ(emulator.statistics().command_count, 1);
+
+    // Absolute current, and a brake which stops the motor without reversing it.
+    ASSERT_TRUE(command(emulator, dti::build_set_current(k_node_id, 1500), now));
+    run(emulator, now, 50);
+    EXPECT_NEAR(emulator.state().ac_current, 150.0f, 1.5f);
+    ASSERT_TRUE(command(emulator, dti::build_set_relative_brake_current(k_node_id, 1000), now));
+    run(emulator, now, 20);
+    EXPECT_LT(emulator.state().ac_current, 0.0f);
+    EXPECT_LT(emulator.state().dc_current, 0.0f);
+    EXPECT_LT(emulator.state().duty_cycle, 0.0f);
+    run(emulator, now, 500);
+    EXPECT_EQ(emulator.state().erpm, 0.0f);
+
+    // The speed loop reaches the commanded ERPM.
+    ASSERT_TRUE(command(emulator, dti::build_set_erpm(k_node_id, 2000), now));
+    run(emulator, now, 900);
+    EXPECT_NEAR(emulator.state().erpm, 2000.0f, 50.0f);
+
+    // Commands to other inverters, broadcast commands and unmodelled commands.
+    EXPECT_FALSE(command(emulator, dti::build_set_current(0x06, 0), now));
+    EXPECT_TRUE(command(emulator, dti::build_set_relative_current(dti::k_broadcast_node_id, 0), now));
+    EXPECT_TRUE(command(emulator, dti::build_set_position(k_node_id, 100), now));
+    EXPECT_EQ(emulator.statistics().command_count, 5);
+    EXPECT_EQ(emulator.statistics().ignored_count, 1);
+}
+
+TEST(DtiEmulator, Timeout) {
+    dti::Emulator emulator({.node_id = k_node_id, .command_timeout = 500, .require_drive_enable = true});
+    std::uint32_t now = 0;
+    run(emulator, now, 10);
+
+    // Nothing happens until the drive is enabled.
+    ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 1000), now));
+    run(emulator, now, 100);
+    EXPECT_EQ(emulator.state().ac_current, 0.0f);
+    EXPECT_FALSE(emulator.state().drive_enabled);
+    EXPECT_EQ(emulator.statistics().ignored_count, 1);
+
+    // Commands sent every 250 ms keep the drive alive.
+    ASSERT_TRUE(command(emulator, dti::build_set_drive_enabled(k_node_id, true), now));
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 1000), now));
+        run(emulator, now, 250);
+    }
+    EXPECT_TRUE(emulator.state().drive_enabled);
+    EXPECT_NEAR(emulator.state().ac_current, 200.0f, 1.0f);
+    EXPECT_EQ(emulator.statistics().timeout_count, 0);
+
+    // When they stop, the motor is left free-running and the drive must be enabled again.
+    run(emulator, now, 300);
+    EXPECT_EQ(emulator.statistics().timeout_count, 1);
+    EXPECT_FALSE(emulator.state().drive_enabled);
+    EXPECT_NEAR(emulator.state().ac_current, 0.0f, 0.1f);
+    EXPECT_GT(emulator.state().erpm, 0.0f);
+    ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 1000), now));
+    EXPECT_EQ(emulator.statistics().ignored_count, 2);
+}
+
+TEST(DtiEmulator, Overtemperature) {
+    dti::Emulator emulator({.node_id = k_node_id, .motor_heat_capacity = 10.0f, .motor_temperature_limit = 60.0f});
+    std::uint32_t now = 0;
+    run(emulator, now, 10);
+    ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 1000), now));
+
+    // The motor heats up past its limit, faults, cools down and recovers.
+    bool faulted = false;
+    bool recovered = false;
+    for (int i = 0; i < 100 && !recovered; i++) {
+        ASSERT_TRUE(command(emulator, dti::build_set_relative_current(k_node_id, 1000), now));
+        run(emulator, now, 100);
+        if (emulator.state().fault_code == dti::FaultCode::MotorOvertemperature) {
+            faulted = true;
+            EXPECT_NEAR(emulator.state().ac_current, 0.0f, 1.0f);
+        } else if (faulted) {
+            recovered = true;
+        }
+    }
+    EXPECT_TRUE(faulted);
+    EXPECT_TRUE(recovered);
+    EXPECT_LT(emulator.state().motor_temperature, 60.0f);
+}
+
+// A control node like the apps board, commanding an emulated inverter over a virtual bus every 10 ms and tracking its
+// state through an InverterTable.
+struct DtiClosedLoop : testing::Test {
+    static constexpr auto k_node_ids = std::to_array<std::uint8_t>({k_node_id});
+
+    can::VirtualBus bus{k_bitrate};
+    test::TestNode control_node{bus};
+    test::TestNode inverter_node{bus};
+    dti::Emulator emulator{{.node_id = k_node_id}};
+    dti::InverterTable table{k_node_ids, k_bitrate};
+    std::int16_t throttle{0};
+    std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+
+    void SetUp() override {
+        ASSERT_TRUE(control_node.start({.timestamps = true}));
+        control_node.receive_all([this](const can::RawMessage &message, std::uint32_t timestamp) {
+            table.update(message.to_message(), timestamp);
+        });
+        ASSERT_TRUE(inverter_node.start({.timestamps = true}));
+        inverter_node.receive_all([this](const can::RawMessage &message, std::uint32_t) {
+            emulator.on_frame(message, bus.now());
+        });
+    }
+
+    // Runs both nodes' 1 ms ticks for the given time.
+    void run(std::uint32_t ms) {
+        bus.run_for(ms, [this] {
+            const auto now = bus.now();
+            if (now % 10 == 0) {
+                control_node.select();
+                can::transmit(dti::build_set_relative_current(k_node_id, throttle));
+            }
+            inverter_node.select();
+            can::transmit(emulator.poll(now, frames));
+        });
+    }
+
+    std::uint32_t timestamp() const { return static_cast<std::uint32_t>(bus.time()); }
+};
+
+TEST_F(DtiClosedLoop, StepResponse) {
+    run(100);
+    ASSERT_TRUE(table[0].erpm(timestamp(), 20'000));
+    EXPECT_EQ(*table[0].erpm(timestamp(), 20'000), 0);
+
+    // Step the throttle to 50% and wait for the reported AC current to reach 90% of its target.
+    throttle = 500;
+    const auto start = bus.now();
+    std::optional<std::uint32_t> latency;
+    while (!latency && bus.now() - start < 200) {
+        run(1);
+        const auto current = table[0].ac_current(timestamp(), 20'000);
+        if (current && *current >= 900) {
+            latency = bus.now() - start;
+        }
+    }
+    ASSERT_TRUE(latency);
+    EXPECT_LE(*latency, 40u);
+    RecordProperty("response_latency_ms", std::to_string(*latency));
+
+    // The motor speeds up, and the status packets keep their period with the traffic using about a tenth of the bus.
+    run(1000);
+    EXPECT_GT(*table[0].erpm(timestamp(), 20'000), 1000);
+    EXPECT_EQ(emulator.statistics().ignored_count, 0);
+    EXPECT_LE(table[0].statistics(dti::k_general_data_1_id).max_interval, 11'000u);
+    const auto utilisation = 100.0 * static_cast<double>(can::frame_bits(true, 8)) * bus.frame_count() /
+                             static_cast<double>(bus.time());
+    EXPECT_LT(utilisation, 12.0);
+    RecordProperty("bus_utilisation_percent", std::to_string(utilisation));
+}
+
+} // namespace
@@ -0,0 +1,194 @@
+#include <dti_publisher.hh>
+
+#include <can.hh>
+#include <can_load.hh>
+#include <can_scheduler.hh>
+#include <dti.hh>
+#include <dti_emulator.hh>
+#include <dti_state.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::uint8_t k_node_id = 0x05;
+constexpr dti::PublisherConfig<std::int16_t> k_config{.threshold = 10, .keepalive_period = 250};
+
+std::int16_t sent_value(const can::RawMessage &message) {
+    return dti::SetRelativeCurrentCodec::decode(message);
+}
+
+// Sends every message at once, unless told to refuse the mailbox as if it were taken by other traffic.
+struct RefusingDriver {
+    bool refuse{false};
+    std::uint32_t sequence{0};
+    std::vector<can::RawMessage> sent;
+
+    std::optional<can::MailboxTicket> submit(const can::RawMessage &message) {
+        if (refuse) {
+            return std::nullopt;
+        }
+        sent.push_back(message);
+        return can::MailboxTicket{0, ++sequence};
+    }
+    can::MailboxStatus status(const can::MailboxTicket &) { return can::MailboxStatus::Sent; }
+    can::MailboxStatus abort(const can::MailboxTicket &) { return can::MailboxStatus::Sent; }
+};
+
+TEST(DtiPublisher, Change) {
+    dti::CommandPublisher<std::int16_t> publisher(&dti::build_set_relative_current, k_node_id, k_config);
+
+    // The first value is always sent.
+    const auto first = publisher.update(100, 0);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(*first, can::RawMessage::from_message(dti::build_set_relative_current(k_node_id, 100)));
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Change);
+
+    // Changes below the threshold are held back, and one at the threshold is sent.
+    EXPECT_FALSE(publisher.update(109, 10));
+    EXPECT_FALSE(publisher.update(91, 20));
+    const auto changed = publisher.update(110, 30);
+    ASSERT_TRUE(changed);
+    EXPECT_EQ(sent_value(*changed), 110);
+
+    // The threshold is measured from the last sent value, so a slow drift is still sent.
+    EXPECT_FALSE(publisher.update(115, 40));
+    ASSERT_TRUE(publisher.update(120, 50));
+
+    const auto &statistics = publisher.statistics();
+    EXPECT_EQ(statistics.change_count, 3);
+    EXPECT_EQ(statistics.suppressed_count, 3);
+    EXPECT_EQ(statistics.saved_bits, 3 * can::frame_bits(true, 2));
+}
+
+TEST(DtiPublisher, Safety) {
+    dti::CommandPublisher<std::int16_t> publisher(&dti::build_set_relative_current, k_node_id, k_config);
+    ASSERT_TRUE(publisher.update(5, 0));
+
+    // Going to zero and changing direction are sent however small the change.
+    const auto stop = publisher.update(0, 10);
+    ASSERT_TRUE(stop);
+    EXPECT_EQ(sent_value(*stop), 0);
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Safety);
+    EXPECT_FALSE(publisher.update(0, 20));
+    EXPECT_FALSE(publisher.update(4, 30));
+    ASSERT_TRUE(publisher.update(4, 300));
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Keepalive);
+    ASSERT_TRUE(publisher.update(-3, 310));
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Safety);
+    EXPECT_EQ(publisher.statistics().safety_count, 2);
+
+    // Unsigned commands only have zero.
+    dti::CommandPublisher<std::uint16_t> brake(&dti::build_set_relative_brake_current, k_node_id,
+                                               {.threshold = 50, .keepalive_period = 250});
+    ASSERT_TRUE(brake.update(20, 0));
+    EXPECT_FALSE(brake.update(30, 10));
+    ASSERT_TRUE(brake.update(0, 20));
+    EXPECT_EQ(brake.last_reason(), dti::SendReason::Safety);
+}
+
+TEST(DtiPublisher, Keepalive) {
+    dti::CommandPublisher<std::int16_t> publisher(&dti::build_set_relative_current, k_node_id, k_config);
+    std::uint32_t sent_count = 0;
+    for (std::uint32_t now = 0; now < 1000; now += 10) {
+        // A small drift is caught up with by the keepalive.
+        if (const auto message = publisher.update(static_cast<std::int16_t>(500 + now / 200), now)) {
+            EXPECT_EQ(now % 250, 0u);
+            EXPECT_EQ(sent_value(*message), 500 + now / 200);
+            sent_count++;
+        }
+    }
+    EXPECT_EQ(sent_count, 4);
+    EXPECT_EQ(publisher.statistics().keepalive_count, 3);
+    EXPECT_EQ(publisher.statistics().suppressed_count, 96);
+
+    // After a reset, the next value is sent at once.
+    publisher.reset();
+    EXPECT_TRUE(publisher.update(504, 1000));
+}
+
+// Sends commands through the deadline scheduler as on the apps board, which gives a command up at its deadline.
+TEST(DtiPublisher, ResendAfterMiss) {
+    RefusingDriver driver;
+    can::TxScheduler<RefusingDriver, 1> scheduler(driver, {{{.priority = 0, .period = 0, .deadline = 10}}}, 0);
+    dti::CommandPublisher<std::int16_t> publisher(&dti::build_set_relative_current, k_node_id, k_config);
+    const auto update = [&](std::int16_t value, std::uint32_t now) {
+        if (const auto message = publisher.update(value, now)) {
+            scheduler.release(0, *message, now);
+        }
+        scheduler.poll(now);
+        if (scheduler.take_missed(0)) {
+            publisher.resend();
+        }
+    };
+
+    update(100, 0);
+    ASSERT_EQ(driver.sent.size(), 1);
+
+    // The stop command never gets a mailbox and is given up at its deadline.
+    driver.refuse = true;
+    update(0, 10);
+    update(0, 20);
+    EXPECT_EQ(driver.sent.size(), 1);
+    EXPECT_EQ(scheduler.statistics(0).miss_count, 1);
+
+    // It is sent again on the next update rather than at the keepalive, and still counts as a safety send.
+    driver.refuse = false;
+    update(0, 30);
+    ASSERT_EQ(driver.sent.size(), 2);
+    EXPECT_EQ(sent_value(driver.sent.back()), 0);
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Safety);
+    EXPECT_EQ(publisher.statistics().safety_count, 2);
+
+    // Once sent, the unchanged value is held back again.
+    update(0, 40);
+    EXPECT_EQ(driver.sent.size(), 2);
+}
+
+// Drives an emulated inverter from a throttle which is held, moved and released, sampled every 10 ms as on the apps
+// board.
+TEST(DtiPublisher, Emulator) {
+    dti::Emulator emulator({.node_id = k_node_id, .command_timeout = 500});
+    dti::CommandPublisher<std::int16_t> publisher(&dti::build_set_relative_current, k_node_id, k_config);
+    std::array<can::RawMessage, dti::k_status_packet_count> frames{};
+    std::uint32_t update_count = 0;
+    const auto run = [&](std::uint32_t &now, std::uint32_t ms, std::int16_t throttle) {
+        for (const auto end = now + ms; now < end; now++) {
+            if (now % 10 == 0) {
+                update_count++;
+                if (const auto message = publisher.update(throttle, now)) {
+                    emulator.on_frame(*message, now);
+                }
+            }
+            emulator.poll(now, frames);
+        }
+    };
+
+    std::uint32_t now = 0;
+    run(now, 2000, 500);
+    EXPECT_EQ(emulator.statistics().timeout_count, 0);
+    EXPECT_NEAR(emulator.state().ac_current, 100.0f, 1.0f);
+
+    // Releasing the throttle reaches the inverter on the next update.
+    run(now, 10, 0);
+    EXPECT_EQ(emulator.statistics().command_count, publisher.statistics().change_count +
+                                                       publisher.statistics().safety_count +
+                                                       publisher.statistics().keepalive_count);
+    EXPECT_EQ(publisher.last_reason(), dti::SendReason::Safety);
+    run(now, 50, 0);
+    EXPECT_NEAR(emulator.state().ac_current, 0.0f, 1.0f);
+    EXPECT_EQ(emulator.statistics().timeout_count, 0);
+
+    // Sending every update would have taken one frame per update.
+    const auto saved = 100.0 * publisher.statistics().suppressed_count / update_count;
+    EXPECT_GT(saved, 90.0);
+    RecordProperty("frames_saved_percent", std::to_string(saved));
+}
+
+} // namespace
@@ -0,0 +1,131 @@
+#include <dti_state.hh>
+
+#include <can.hh>
+#include <dti.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace {
+
+constexpr std::uint32_t k_bitrate = 500'000;
+constexpr std::uint32_t k_ticks_per_ms = k_bitrate / 1000;
+
+can::Message status_message(std::uint32_t packet_id, std::uint8_t node_id = 0x22) {
+    return can::build_extended(dti::packet_identifier(packet_id, node_id),
+                               std::to_array<std::uint8_t>({0x00, 0x00, 0x24, 0x5e, 0x00, 0x71, 0x01, 0x86}));
+}
+
+TEST(DtiState, NeverReceived) {
+    dti::InverterState state(k_bitrate);
+    EXPECT_FALSE(state.erpm(0, UINT32_MAX));
+    EXPECT_FALSE(state.age(dti::k_general_data_1_id, 0));
+    EXPECT_FALSE(state.timestamp(dti::k_general_data_1_id));
+    EXPECT_EQ(state.statistics(dti::k_general_data_1_id).count, 0);
+}
+
+TEST(DtiState, Freshness) {
+    dti::InverterState state(k_bitrate);
+    ASSERT_TRUE(state.update(status_message(dti::k_general_data_1_id), 1000));
+    EXPECT_EQ(state.timestamp(dti::k_general_data_1_id), 1000u);
+
+    // 10 ms later, the ERPM is younger than 20 ms but not younger than 10 ms.
+    const auto now = 1000 + 10 * k_ticks_per_ms;
+    EXPECT_EQ(state.age(dti::k_general_data_1_id, now), 10'000u);
+    EXPECT_EQ(state.erpm(now, 20'000), 9310);
+    EXPECT_EQ(state.input_voltage(now, 20'000), 390);
+    EXPECT_FALSE(state.erpm(now, 10'000));
+
+    // Other packets have their own time stamps.
+    EXPECT_FALSE(state.ac_current(now, UINT32_MAX));
+    EXPECT_FALSE(state.controller_temperature(now, UINT32_MAX));
+    EXPECT_FALSE(state.is_drive_enabled(now, UINT32_MAX));
+    ASSERT_TRUE(state.update(status_message(dti::k_general_data_2_id), now));
+    EXPECT_EQ(state.ac_current(now, 1), 0);
+    EXPECT_EQ(state.dc_current(now, 1), 9310);
+    EXPECT_FALSE(state.erpm(now, 1));
+}
+
+TEST(DtiState, TimestampWrap) {
+    dti::InverterState state(k_bitrate);
+    ASSERT_TRUE(state.update(status_message(dti::k_general_data_3_id), 0xffffff00u));
+    EXPECT_EQ(state.age(dti::k_general_data_3_id, 0x100), 1024u);
+    EXPECT_TRUE(state.motor_temperature(0x100, 2000));
+    EXPECT_EQ(state.fault_code(0x100, 2000), dti::FaultCode::NoFaults);
+}
+
+TEST(DtiState, IgnoredMessages) {
+    dti::InverterState state(k_bitrate);
+    EXPECT_FALSE(state.update(status_message(0x40), 0));
+    EXPECT_FALSE(state.update(can::build_extended(dti::packet_identifier(dti::k_general_data_1_id, 0x22),
+                                                  std::to_array<std::uint8_t>({0x00, 0x00})),
+                              0));
+    EXPECT_FALSE(state.update(can::build_standard(0x20, std::to_array<std::uint8_t>({0x00})), 0));
+    EXPECT_FALSE(state.timestamp(dti::k_general_data_1_id));
+    EXPECT_FALSE(state.timestamp(0x40));
+}
+
+TEST(DtiState, Statistics) {
+    dti::InverterState state(k_bitrate);
+    const auto intervals = std::to_array<std::uint32_t>({10, 12, 8, 10});
+    std::uint32_t timestamp = 0;
+    ASSERT_TRUE(state.update(status_message(dti::k_general_data_5_id), timestamp));
+    for (const auto interval : intervals) {
+        timestamp += interval * k_ticks_per_ms;
+        ASSERT_TRUE(state.update(status_message(dti::k_general_data_5_id), timestamp));
+    }
+
+    const auto statistics = state.statistics(dti::k_general_data_5_id);
+    EXPECT_EQ(statistics.count, 5);
+    EXPECT_EQ(statistics.last_interval, 10'000u);
+    EXPECT_EQ(statistics.min_interval, 8'000u);
+    EXPECT_EQ(statistics.max_interval, 12'000u);
+    EXPECT_EQ(state.statistics(dti::k_general_data_1_id).count, 0);
+}
+
+TEST(DtiTable, Routing) {
+    const auto node_ids = std::to_array<std::uint8_t>({0x05, 0x06});
+    dti::InverterTable table(node_ids, k_bitrate);
+    ASSERT_EQ(table.size(), 2);
+    EXPECT_EQ(table.find(0x05), &table[0]);
+    EXPECT_EQ(table.find(0x06), &table[1]);
+    EXPECT_EQ(table.find(0x07), nullptr);
+
+    // Each frame updates only the inverter which sent it.
+    EXPECT_TRUE(table.update(status_message(dti::k_general_data_1_id, 0x06), 100));
+    EXPECT_FALSE(table[0].timestamp(dti::k_general_data_1_id));
+    EXPECT_EQ(table[1].timestamp(dti::k_general_data_1_id), 100u);
+    EXPECT_EQ(table.find(0x06)->erpm(100, 1), 9310);
+
+    EXPECT_TRUE(table.update(status_message(dti::k_general_data_1_id, 0x05), 200));
+    EXPECT_EQ(table[0].timestamp(dti::k_general_data_1_id), 200u);
+    EXPECT_EQ(table[1].timestamp(dti::k_general_data_1_id), 100u);
+
+    // Frames from other nodes and other messages are dropped.
+    EXPECT_FALSE(table.update(status_message(dti::k_general_data_1_id, 0x07), 300));
+    EXPECT_FALSE(table.update(status_message(0x40, 0x05), 300));
+    EXPECT_FALSE(table.update(can::build_standard(0x20, std::to_array<std::uint8_t>({0x00})), 300));
+    EXPECT_EQ(table[0].timestamp(dti::k_general_data_1_id), 200u);
+}
+
+TEST(DtiTable, BuildAll) {
+    const auto node_ids = std::to_array<std::uint8_t>({0x05, 0x06, 0x10});
+    dti::InverterTable table(node_ids, k_bitrate);
+    std::array<can::RawMessage, dti::k_max_inverter_count> messages{};
+    const auto built = table.build_all(&dti::build_set_relative_current, 100, messages);
+    ASSERT_EQ(built.size(), 3);
+    for (std::size_t i = 0; i < built.size(); i++) {
+        EXPECT_EQ(built[i], can::RawMessage::from_message(dti::build_set_relative_current(node_ids[i], 100)));
+    }
+
+    // Only as many as fit.
+    const auto disabled = table.build_all(&dti::build_set_drive_enabled, false, std::span(messages).first(2));
+    ASSERT_EQ(disabled.size(), 2);
+    EXPECT_EQ(disabled[1], can::RawMessage::from_message(dti::build_set_drive_enabled(0x06, false)));
+}
+
+} // namespace
@@ -4,7 +4,11 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <span>
+#include <utility>
 #include <variant>
 
 namespace {
@@ -84,6 +88,16 @@ TEST(DtiParse, GeneralData3) {
     EXPECT_EQ(gd3.fault_code, dti::FaultCode::Overcurrent);
 }
 
+TEST(DtiParse, GeneralData4) {
+    const auto message_bytes = std::to_array<std::uint8_t>({0x00, 0x00, 0x00, 0x64, 0xff, 0xff, 0xfd, 0x6e});
+    const auto packet = dti::parse_packet(can::build_extended(0x2322, message_bytes));
+    ASSERT_TRUE(std::holds_alternative<dti::GeneralData4>(packet));
+
+    const auto gd4 = std::get<dti::GeneralData4>(packet);
+    EXPECT_EQ(gd4.d_current, 100);
+    EXPECT_EQ(gd4.q_current, -658);
+}
+
 TEST(DtiParse, GeneralData5) {
     const auto message_bytes = std::to_array<std::uint8_t>({0x38, 0xd8, 0xaa, 0x01, 0xaa, 0x05, 0xff, 0x18});
     const auto packet = dti::parse_packet(can::build_extended(0x2422, message_bytes));
@@ -108,11 +122,52 @@ TEST(DtiParse, GeneralData5) {
     EXPECT_EQ(gd5.can_map_version, 24);
 }
 
+TEST(DtiParse, Padded) {
+    // The inverter fills unused bytes with 0xff.
+    const auto message_bytes = std::to_array<std::uint8_t>({0x00, 0x5c, 0x00, 0x11, 0xff, 0xff, 0xff, 0xff});
+    const auto packet = dti::parse_packet(can::build_extended(0x2122, message_bytes));
+    ASSERT_TRUE(std::holds_alternative<dti::GeneralData2>(packet));
+    EXPECT_EQ(std::get<dti::GeneralData2>(packet).ac_current, 92);
+    EXPECT_EQ(std::get<dti::GeneralData2>(packet).dc_current, 17);
+}
+
+TEST(DtiParse, InvalidLength) {
+    // Each status message one byte short of its last signal.
+    const auto message_bytes = std::to_array<std::uint8_t>({0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08});
+    const auto packets = std::to_array<std::pair<std::uint32_t, std::size_t>>({
+        {dti::k_general_data_1_id, 7},
+        {dti::k_general_data_2_id, 3},
+        {dti::k_general_data_3_id, 4},
+        {dti::k_general_data_4_id, 7},
+        {dti::k_general_data_5_id, 7},
+    });
+    for (const auto &[packet_id, length] : packets) {
+        const auto message = can::build_extended(dti::packet_identifier(packet_id, 0x22),
+                                                 std::span(message_bytes).first(length));
+        const auto packet = dti::parse_packet(message);
+        ASSERT_TRUE(std::holds_alternative<dti::InvalidLength>(packet)) << packet_id;
+        EXPECT_EQ(std::get<dti::InvalidLength>(packet).packet_id, packet_id);
+        EXPECT_EQ(std::get<dti::InvalidLength>(packet).length, length);
+
+        // One more byte is enough.
+        EXPECT_FALSE(std::holds_alternative<dti::InvalidLength>(dti::parse_packet(
+            can::build_extended(dti::packet_identifier(packet_id, 0x22), std::span(message_bytes).first(length + 1)))));
+    }
+}
+
 TEST(DtiParse, UnknownMessageType) {
     const auto message_bytes = std::to_array<std::uint8_t>({0x12, 0x34});
     const auto packet = dti::parse_packet(can::build_extended(0x4022, message_bytes));
     ASSERT_TRUE(std::holds_alternative<dti::UnknownMessageType>(packet));
     EXPECT_EQ(std::get<dti::UnknownMessageType>(packet).packet_id, 0x40);
+
+    // Packet IDs either side of the status messages.
+    for (const std::uint32_t packet_id : {0x00u, 0x1fu, 0x25u, 0x1fffffu}) {
+        const auto identifier = dti::packet_identifier(packet_id, 0x22);
+        const auto other = dti::parse_packet(can::build_extended(identifier, message_bytes));
+        ASSERT_TRUE(std::holds_alternative<dti::UnknownMessageType>(other));
+        EXPECT_EQ(std::get<dti::UnknownMessageType>(other).packet_id, packet_id);
+    }
 }
 
 } // namespace
@@ -0,0 +1,193 @@
+#include <heartbeat.hh>
+
+#include <can.hh>
+#include <can_virtual.hh>
+#include <test_node.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace {
+
+constexpr std::uint32_t k_bitrate = 500'000;
+constexpr std::uint8_t k_sender_id = 1;
+constexpr std::uint8_t k_other_id = 2;
+constexpr auto k_peers = std::to_array<heartbeat::PeerConfig>({
+    {.node_id = k_sender_id, .period = 100, .timeout = 250},
+    {.node_id = k_other_id, .period = 100, .timeout = 250},
+});
+
+TEST(HeartbeatCodec, RoundTrip) {
+    const heartbeat::Heartbeat heartbeat{
+        .node_id = 5,
+        .state = heartbeat::State::Fault,
+        .counter = 200,
+        .detail = 0x1234,
+        .uptime = 0xdeadbeef,
+    };
+    const auto frame = heartbeat::build_heartbeat(heartbeat);
+    EXPECT_EQ(frame.standard_id(), 0x705);
+    EXPECT_EQ(frame.length, 8);
+    EXPECT_EQ(frame.byte(0), 2);
+    EXPECT_EQ(frame.byte(2), 0x12);
+    EXPECT_EQ(frame.byte(4), 0xde);
+
+    const auto parsed = heartbeat::parse_heartbeat(frame);
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(parsed->node_id, 5);
+    EXPECT_EQ(parsed->state, heartbeat::State::Fault);
+    EXPECT_EQ(parsed->counter, 200);
+    EXPECT_EQ(parsed->detail, 0x1234);
+    EXPECT_EQ(parsed->uptime, 0xdeadbeef);
+
+    // Frames outside the heartbeat range or of the wrong length are rejected.
+    EXPECT_FALSE(heartbeat::parse_heartbeat(can::RawMessage::standard(0x6ff, frame.data())));
+    EXPECT_FALSE(heartbeat::parse_heartbeat(can::RawMessage::standard(0x780, frame.data())));
+    EXPECT_FALSE(heartbeat::parse_heartbeat(can::RawMessage::extended(0x705, frame.data())));
+    const auto data = frame.data();
+    EXPECT_FALSE(heartbeat::parse_heartbeat(can::RawMessage::standard(0x705, std::span(data).first(4))));
+}
+
+TEST(HeartbeatSender, Period) {
+    heartbeat::Sender sender(k_sender_id, 100);
+    const auto first = sender.poll(1000, heartbeat::State::Initialising);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(heartbeat::parse_heartbeat(*first)->uptime, 1000u);
+    EXPECT_FALSE(sender.poll(1099, heartbeat::State::Operational));
+
+    const auto second = sender.poll(1100, heartbeat::State::Operational, 7);
+    ASSERT_TRUE(second);
+    const auto parsed = heartbeat::parse_heartbeat(*second);
+    EXPECT_EQ(parsed->counter, 1);
+    EXPECT_EQ(parsed->state, heartbeat::State::Operational);
+    EXPECT_EQ(parsed->detail, 7);
+}
+
+// A node sending heartbeats at chosen times to a node monitoring it.
+struct Heartbeat : testing::Test {
+    can::VirtualBus bus{k_bitrate};
+    test::TestNode sender_node{bus};
+    test::TestNode monitor_node{bus};
+    heartbeat::Monitor monitor{k_peers, k_bitrate};
+    std::uint8_t counter{0};
+    std::uint32_t start{0};
+
+    void SetUp() override {
+        ASSERT_TRUE(sender_node.start({.timestamps = true}));
+        ASSERT_TRUE(monitor_node.start({.timestamps = true}));
+        monitor_node.receive_all([this](const can::RawMessage &message, std::uint32_t timestamp) {
+            monitor.on_frame(message, timestamp, bus.now());
+        });
+    }
+
+    // Runs the monitor's 1 ms tick for the given time, ending with a tick at the current time.
+    void run(std::uint32_t ms) {
+        bus.run_for(ms, [this] {
+            monitor.poll(bus.now());
+        });
+        monitor.poll(bus.now());
+    }
+
+    // Sends the next heartbeat, or skips it if lost is true.
+    void send(bool lost = false) {
+        const auto frame = heartbeat::build_heartbeat({
+            .node_id = k_sender_id,
+            .state = heartbeat::State::Operational,
+            .counter = counter++,
+            .detail = 0,
+            .uptime = bus.now() - start,
+        });
+        if (!lost) {
+            sender_node.select();
+            can::transmit(frame);
+        }
+    }
+
+    const heartbeat::PeerStatistics &statistics() const { return monitor.status(k_sender_id)->statistics; }
+};
+
+TEST_F(Heartbeat, Liveness) {
+    EXPECT_EQ(monitor.peer_count(), 2);
+    EXPECT_EQ(monitor.status(k_sender_id)->liveness, heartbeat::Liveness::Unknown);
+    EXPECT_EQ(monitor.status(3), nullptr);
+
+    for (int i = 0; i < 10; i++) {
+        send();
+        run(100);
+    }
+    EXPECT_EQ(monitor.status(k_sender_id)->liveness, heartbeat::Liveness::Alive);
+    EXPECT_EQ(monitor.status(k_other_id)->liveness, heartbeat::Liveness::Unknown);
+    EXPECT_FALSE(monitor.all_alive());
+    EXPECT_EQ(statistics().frame_count, 10);
+    EXPECT_EQ(statistics().lost_count, 0);
+    EXPECT_EQ(statistics().timeout_count, 0);
+    EXPECT_EQ(statistics().min_interval, 100'000u);
+    EXPECT_EQ(statistics().max_interval, 100'000u);
+    EXPECT_EQ(statistics().jitter, 0u);
+
+    // The sender stops, and is declared dead within one tick of its timeout.
+    run(300);
+    EXPECT_EQ(monitor.status(k_sender_id)->liveness, heartbeat::Liveness::Dead);
+    EXPECT_EQ(statistics().timeout_count, 1);
+    EXPECT_GE(statistics().max_detection_latency, k_peers[0].timeout);
+    EXPECT_LE(statistics().max_detection_latency, k_peers[0].timeout + 1);
+    RecordProperty("detection_latency_ms", std::to_string(statistics().max_detection_latency));
+
+    // It comes back, and the outage doesn't count towards the interval statistics.
+    send();
+    run(1);
+    EXPECT_EQ(monitor.status(k_sender_id)->liveness, heartbeat::Liveness::Alive);
+    EXPECT_EQ(statistics().max_interval, 100'000u);
+}
+
+TEST_F(Heartbeat, Jitter) {
+    // Alternate intervals of 95 and 105 ms, so that every interval differs from the last by 10 ms.
+    for (int i = 0; i < 100; i++) {
+        send();
+        run(i % 2 == 0 ? 95 : 105);
+    }
+    EXPECT_EQ(statistics().min_interval, 95'000u);
+    EXPECT_EQ(statistics().max_interval, 105'000u);
+    EXPECT_NEAR(statistics().jitter, 10'000.0, 100.0);
+    EXPECT_EQ(statistics().timeout_count, 0);
+    RecordProperty("jitter_us", std::to_string(statistics().jitter));
+}
+
+TEST_F(Heartbeat, LostFrames) {
+    for (int i = 0; i < 20; i++) {
+        // Lose two single frames and then two in a row, which is still within the timeout.
+        send(i == 5 || i == 10 || i == 15 || i == 16);
+        run(80);
+    }
+    EXPECT_EQ(statistics().frame_count, 16);
+    EXPECT_EQ(statistics().lost_count, 4);
+    EXPECT_EQ(statistics().timeout_count, 0);
+    EXPECT_EQ(statistics().max_interval, 80'000u);
+    EXPECT_EQ(monitor.status(k_sender_id)->liveness, heartbeat::Liveness::Alive);
+}
+
+TEST_F(Heartbeat, Restart) {
+    for (int i = 0; i < 5; i++) {
+        send();
+        run(100);
+    }
+
+    // The sender restarts with its counter and uptime reset, which isn't counted as lost frames.
+    counter = 0;
+    start = bus.now();
+    for (int i = 0; i < 5; i++) {
+        send();
+        run(100);
+    }
+    EXPECT_EQ(statistics().restart_count, 1);
+    EXPECT_EQ(statistics().lost_count, 0);
+    EXPECT_EQ(monitor.status(k_sender_id)->heartbeat.uptime, 400u);
+}
+
+} // namespace
@@ -0,0 +1,251 @@
+#include <isotp.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+constexpr isotp::Config k_client{.tx_id = 0x700, .rx_id = 0x708, .extended = false};
+constexpr isotp::Config k_server{.tx_id = 0x708, .rx_id = 0x700, .extended = false};
+
+std::vector<std::uint8_t> payload(std::size_t size) {
+    std::vector<std::uint8_t> bytes(size);
+    std::iota(bytes.begin(), bytes.end(), std::uint8_t(1));
+    return bytes;
+}
+
+// Two links connected back to back, with a log of every frame put on the bus.
+struct Loopback {
+    std::array<std::uint8_t, isotp::k_max_payload_size> client_rx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> client_tx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> server_rx{};
+    std::array<std::uint8_t, isotp::k_max_payload_size> server_tx{};
+    isotp::Link client;
+    isotp::Link server;
+    std::vector<can::RawMessage> frames;
+    std::uint32_t now{0};
+
+    explicit Loopback(const isotp::Config &client_config = k_client, const isotp::Config &server_config = k_server)
+        : client(client_config, client_rx, client_tx), server(server_config, server_rx, server_tx) {}
+
+    // Exchanges frames until both links are finished, advancing time by one millisecond whenever neither link has a
+    // frame to send.
+    void run(std::uint32_t max_rounds = 10000) {
+        for (std::uint32_t round = 0; round < max_rounds; round++) {
+            bool any = false;
+            while (const auto frame = client.poll(now)) {
+                frames.push_back(*frame);
+                server.on_frame(*frame, now);
+                any = true;
+            }
+            while (const auto frame = server.poll(now)) {
+                frames.push_back(*frame);
+                client.on_frame(*frame, now);
+                any = true;
+            }
+            if (!client.is_sending() && !server.is_sending()) {
+                return;
+            }
+            if (!any) {
+                now++;
+            }
+        }
+    }
+};
+
+TEST(IsoTp, SingleFrame) {
+    Loopback loopback;
+    const auto data = payload(7);
+    ASSERT_TRUE(loopback.client.send(data, 0));
+    loopback.run();
+
+    ASSERT_EQ(loopback.frames.size(), 1);
+    EXPECT_EQ(loopback.frames[0].standard_id(), 0x700);
+    EXPECT_EQ(loopback.frames[0].length, 8);
+    EXPECT_EQ(loopback.frames[0].data(), (std::array<std::uint8_t, 8>{0x07, 1, 2, 3, 4, 5, 6, 7}));
+
+    const auto received = loopback.server.received();
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(std::equal(received->begin(), received->end(), data.begin(), data.end()));
+    EXPECT_EQ(loopback.client.statistics().tx_complete_count, 1);
+}
+
+TEST(IsoTp, MultiFrame) {
+    Loopback loopback;
+    const auto data = payload(58);
+    ASSERT_TRUE(loopback.client.send(data, 0));
+    EXPECT_FALSE(loopback.client.send(data, 0));
+    loopback.run();
+
+    // First frame, flow control, then ceil(52 / 7) consecutive frames.
+    ASSERT_EQ(loopback.frames.size(), 1 + 1 + 8);
+    EXPECT_EQ(loopback.frames[0].data(), (std::array<std::uint8_t, 8>{0x10, 58, 1, 2, 3, 4, 5, 6}));
+    EXPECT_EQ(loopback.frames[1].standard_id(), 0x708);
+    EXPECT_EQ(loopback.frames[1].data(), (std::array<std::uint8_t, 8>{0x30, 0, 0, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc}));
+    EXPECT_EQ(loopback.frames[2].data(), (std::array<std::uint8_t, 8>{0x21, 7, 8, 9, 10, 11, 12, 13}));
+    EXPECT_EQ(loopback.frames[9].data(), (std::array<std::uint8_t, 8>{0x28, 56, 57, 58, 0xcc, 0xcc, 0xcc, 0xcc}));
+
+    const auto received = loopback.server.received();
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(std::equal(received->begin(), received->end(), data.begin(), data.end()));
+    EXPECT_FALSE(loopback.client.is_sending());
+}
+
+TEST(IsoTp, MaximumSizeAtFullRate) {
+    Loopback loopback;
+    const auto data = payload(isotp::k_max_payload_size);
+    ASSERT_TRUE(loopback.client.send(data, 0));
+    loopback.run();
+
+    // With no block size or separation time, every consecutive frame is available immediately after the single flow
+    // control frame, so the transfer is limited only by the bus.
+    EXPECT_EQ(loopback.frames.size(), 1 + 1 + (isotp::k_max_payload_size - 6 + 6) / 7);
+    EXPECT_EQ(loopback.now, 0);
+    const auto received = loopback.server.received();
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(std::equal(received->begin(), received->end(), data.begin(), data.end()));
+
+    // Sequence numbers wrap from 15 to 0.
+    EXPECT_EQ(loopback.frames[2 + 14].byte(0), 0x2f);
+    EXPECT_EQ(loopback.frames[2 + 15].byte(0), 0x20);
+}
+
+TEST(IsoTp, BlockSizeAndSeparationTime) {
+    auto server_config = k_server;
+    server_config.block_size = 4;
+    server_config.st_min = 5;
+    Loopback loopback(k_client, server_config);
+    const auto data = payload(100);
+    ASSERT_TRUE(loopback.client.send(data, 0));
+    loopback.run();
+
+    // 94 bytes in 14 consecutive frames, with a flow control frame after every fourth.
+    const auto flow_control_count = std::ranges::count_if(loopback.frames, [](const can::RawMessage &frame) {
+        return frame.standard_id() == 0x708;
+    });
+    EXPECT_EQ(flow_control_count, 4);
+    EXPECT_EQ(loopback.frames.size(), 1 + 4 + 14);
+
+    // The separation time applies within a block, but each flow control frame restarts the block immediately.
+    EXPECT_EQ(loopback.now, (14 - 4) * 5);
+
+    const auto received = loopback.server.received();
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(std::equal(received->begin(), received->end(), data.begin(), data.end()));
+}
+
+TEST(IsoTp, SeparationTime) {
+    auto server_config = k_server;
+    server_config.st_min = 2;
+    Loopback loopback(k_client, server_config);
+    ASSERT_TRUE(loopback.client.send(payload(20), 0));
+
+    // First frame and flow control.
+    loopback.server.on_frame(*loopback.client.poll(0), 0);
+    loopback.client.on_frame(*loopback.server.poll(0), 0);
+    EXPECT_TRUE(loopback.client.poll(0));
+    EXPECT_FALSE(loopback.client.poll(1));
+    EXPECT_TRUE(loopback.client.poll(2));
+    EXPECT_FALSE(loopback.client.is_sending());
+
+    EXPECT_EQ(isotp::decode_st_min(0xf1), 1);
+    EXPECT_EQ(isotp::decode_st_min(0x80), 0x7f);
+}
+
+TEST(IsoTp, Overflow) {
+    std::array<std::uint8_t, 32> small_rx{};
+    std::array<std::uint8_t, 64> tx{};
+    std::array<std::uint8_t, 64> unused{};
+    isotp::Link client(k_client, unused, tx);
+    isotp::Link server(k_server, small_rx, unused);
+
+    ASSERT_TRUE(client.send(payload(40), 0));
+    server.on_frame(*client.poll(0), 0);
+    const auto flow_control = server.poll(0);
+    ASSERT_TRUE(flow_control);
+    EXPECT_EQ(flow_control->byte(0), 0x32);
+    client.on_frame(*flow_control, 0);
+    EXPECT_FALSE(client.is_sending());
+    EXPECT_EQ(client.statistics().tx_error_count, 1);
+    EXPECT_EQ(server.statistics().rx_error_count, 1);
+
+    // Too large for the transmit buffer.
+    EXPECT_FALSE(client.send(payload(65), 0));
+}
+
+TEST(IsoTp, Timeouts) {
+    Loopback loopback;
+    ASSERT_TRUE(loopback.client.send(payload(20), 0));
+
+    // No flow control arrives.
+    loopback.server.on_frame(*loopback.client.poll(0), 0);
+    EXPECT_FALSE(loopback.client.poll(999));
+    EXPECT_TRUE(loopback.client.is_sending());
+    EXPECT_FALSE(loopback.client.poll(1000));
+    EXPECT_FALSE(loopback.client.is_sending());
+    EXPECT_EQ(loopback.client.statistics().tx_error_count, 1);
+
+    // The receiver gives up waiting for consecutive frames.
+    static_cast<void>(loopback.server.poll(0));
+    static_cast<void>(loopback.server.poll(1000));
+    EXPECT_EQ(loopback.server.statistics().rx_error_count, 1);
+    EXPECT_FALSE(loopback.server.received());
+}
+
+TEST(IsoTp, WrongSequence) {
+    Loopback loopback;
+    ASSERT_TRUE(loopback.client.send(payload(30), 0));
+    loopback.server.on_frame(*loopback.client.poll(0), 0);
+    loopback.client.on_frame(*loopback.server.poll(0), 0);
+
+    // Drop the first consecutive frame.
+    static_cast<void>(loopback.client.poll(0));
+    loopback.server.on_frame(*loopback.client.poll(0), 0);
+    EXPECT_EQ(loopback.server.statistics().rx_error_count, 1);
+    EXPECT_FALSE(loopback.server.received());
+}
+
+TEST(IsoTp, ReleaseAndIgnore) {
+    Loopback loopback;
+    ASSERT_TRUE(loopback.client.send(payload(3), 0));
+    loopback.run();
+    ASSERT_TRUE(loopback.server.received());
+
+    // A second message is rejected until the first is released.
+    ASSERT_TRUE(loopback.client.send(payload(4), 0));
+    loopback.run();
+    EXPECT_EQ(loopback.server.received()->size(), 3);
+    loopback.server.release();
+    EXPECT_FALSE(loopback.server.received());
+    ASSERT_TRUE(loopback.client.send(payload(5), 0));
+    loopback.run();
+    EXPECT_EQ(loopback.server.received()->size(), 5);
+
+    // Frames on other identifiers are ignored.
+    loopback.server.release();
+    loopback.server.on_frame(can::RawMessage::standard(0x123, std::to_array<std::uint8_t>({0x01, 0xff})), 0);
+    EXPECT_FALSE(loopback.server.received());
+}
+
+TEST(IsoTp, Extended) {
+    Loopback loopback({.tx_id = 0x18da10f1, .rx_id = 0x18daf110, .extended = true},
+                      {.tx_id = 0x18daf110, .rx_id = 0x18da10f1, .extended = true});
+    const auto data = payload(200);
+    ASSERT_TRUE(loopback.client.send(data, 0));
+    loopback.run();
+    EXPECT_TRUE(loopback.frames[0].is_extended());
+    EXPECT_EQ(loopback.frames[0].extended_id(), 0x18da10f1);
+    const auto received = loopback.server.received();
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(std::equal(received->begin(), received->end(), data.begin(), data.end()));
+}
+
+} // namespace
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <can.hh>
+#include <can_virtual.hh>
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace test {
+
+/**
+ * A virtual node which passes its received and sent frames to std::function handlers rather than capture-less
+ * callbacks, so that a test fixture can handle them with its own members.
+ */
+class TestNode : public can::VirtualNode {
+public:
+    using Handler = std::function<void(const can::RawMessage &message, std::uint32_t timestamp)>;
+
+private:
+    Handler m_receive;
+    Handler m_transmit;
+
+    // Callbacks run with their own node selected, and only a TestNode sets these callbacks.
+    static TestNode &selected() { return static_cast<TestNode &>(*can::VirtualNode::selected()); }
+
+public:
+    using can::VirtualNode::VirtualNode;
+
+    /**
+     * Selects the node and initialises it at the bit rate of its bus.
+     *
+     * @param options optional features to enable
+     * @return true if initialisation was successful; false otherwise
+     */
+    [[nodiscard]] bool start(const can::InitOptions &options = {}) {
+        select();
+        return init(bus().bitrate(), options);
+    }
+
+    /**
+     * Accepts every frame into FIFO 0 and passes it to the given handler.
+     */
+    void receive_all(Handler handler) {
+        route_filter(0, 0, 0, 0);
+        on_receive(std::move(handler));
+    }
+
+    /**
+     * Passes every frame received on FIFO 0 to the given handler, without changing the filters.
+     */
+    void on_receive(Handler handler) {
+        m_receive = std::move(handler);
+        set_fifo_callback(0, [](const can::RawMessage &message, std::uint32_t timestamp) {
+            selected().m_receive(message, timestamp);
+        });
+    }
+
+    /**
+     * Passes every sent frame to the given handler.
+     */
+    void on_transmit(Handler handler) {
+        m_transmit = std::move(handler);
+        set_tx_callback([](const can::RawMessage &message, std::uint32_t timestamp) {
+            selected().m_transmit(message, timestamp);
+        });
+    }
+};
+
+} // namespace test
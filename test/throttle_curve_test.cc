@@ -0,0 +1,95 @@
+#include <throttle_curve.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace {
+
+// Calibration of a typical pedal sensor, which reads highest with the pedal released.
+constexpr std::uint16_t k_pressed_reading = 1200;
+constexpr std::uint16_t k_released_reading = 3400;
+
+// The largest difference between the table and the float formula over every reading of the calibrated range.
+double max_error(const throttle::CurveShape &shape) {
+    const throttle::Curve curve(shape);
+    double error = 0.0;
+    for (std::uint16_t reading = k_pressed_reading; reading <= k_released_reading; reading++) {
+        const auto position = throttle::pedal_position(reading, k_pressed_reading, k_released_reading);
+        const auto normalised = static_cast<double>(k_released_reading - reading) /
+                                static_cast<double>(k_released_reading - k_pressed_reading);
+        const auto exact = throttle::k_max_current /
+                           (1.0 + std::exp(-shape.steepness * (normalised - static_cast<double>(shape.midpoint))));
+        error = std::max(error, std::abs(curve(position) - exact));
+    }
+    return error;
+}
+
+TEST(ThrottleCurve, Exp) {
+    for (double x = -40.0; x <= 40.0; x += 0.125) {
+        EXPECT_NEAR(throttle::detail::exp(x) / std::exp(x), 1.0, 1e-14) << x;
+    }
+}
+
+TEST(ThrottleCurve, PedalPosition) {
+    EXPECT_EQ(throttle::pedal_position(k_released_reading, k_pressed_reading, k_released_reading), 0u);
+    EXPECT_EQ(throttle::pedal_position(k_pressed_reading, k_pressed_reading, k_released_reading),
+              throttle::k_full_position);
+    EXPECT_EQ(throttle::pedal_position(2300, k_pressed_reading, k_released_reading), throttle::k_full_position / 2);
+
+    // Readings past the calibrated range are clamped, and a calibration without a range reads as released.
+    EXPECT_EQ(throttle::pedal_position(4095, k_pressed_reading, k_released_reading), 0u);
+    EXPECT_EQ(throttle::pedal_position(0, k_pressed_reading, k_released_reading), throttle::k_full_position);
+    EXPECT_EQ(throttle::pedal_position(1000, 2000, 2000), 0u);
+    EXPECT_EQ(throttle::pedal_position(1000, 0xffff, 0), 0u);
+}
+
+TEST(ThrottleCurve, Table) {
+    // The default curve is built at compile time.
+    constexpr throttle::Curve curve({.steepness = 10.0f, .midpoint = 0.5f});
+    static_assert(curve(0) == 7);
+    static_assert(curve(throttle::k_full_position / 2) == 500);
+    static_assert(curve(throttle::k_full_position) == 993);
+    static_assert(curve(std::numeric_limits<std::uint32_t>::max()) == 993);
+    EXPECT_TRUE(std::is_sorted(curve.table().begin(), curve.table().end()));
+
+    // Positions at the table's points give the points exactly.
+    for (std::uint32_t i = 0; i <= throttle::k_segment_count; i++) {
+        EXPECT_EQ(curve(i * throttle::k_full_position / throttle::k_segment_count), curve.table()[i]);
+    }
+
+    // A bad parameter gives no current rather than full current.
+    const throttle::Curve bad({.steepness = std::numeric_limits<float>::quiet_NaN(), .midpoint = 0.5f});
+    EXPECT_EQ(*std::max_element(bad.table().begin(), bad.table().end()), 0);
+}
+
+TEST(ThrottleCurve, ErrorAgainstFloat) {
+    // The default shape, within one unit of 0.1% of the exact curve.
+    const auto default_error = max_error({.steepness = 10.0f, .midpoint = 0.5f});
+    EXPECT_LT(default_error, 1.0);
+    RecordProperty("max_error", std::to_string(default_error));
+
+    // Any shape in the range that is useful for calibration stays close too.
+    for (const float steepness : {2.0f, 5.0f, 15.0f, 20.0f, -10.0f}) {
+        for (const float midpoint : {0.2f, 0.5f, 0.8f}) {
+            EXPECT_LT(max_error({.steepness = steepness, .midpoint = midpoint}), 2.0) << steepness << " " << midpoint;
+        }
+    }
+
+    // Against the float formula as it was computed on the target, which truncates.
+    const throttle::CurveShape shape{.steepness = 10.0f, .midpoint = 0.5f};
+    const throttle::Curve curve(shape);
+    for (std::uint16_t reading = k_pressed_reading; reading <= k_released_reading; reading++) {
+        const auto normalised = 1.0f - static_cast<float>(reading - k_pressed_reading) /
+                                           static_cast<float>(k_released_reading - k_pressed_reading);
+        const auto reference = throttle::reference_current(normalised, shape);
+        const auto current = curve(throttle::pedal_position(reading, k_pressed_reading, k_released_reading));
+        EXPECT_LE(std::abs(current - reference), 1) << reading;
+    }
+}
+
+} // namespace
@@ -0,0 +1,176 @@
+#include <time_sync.hh>
+
+#include <can.hh>
+#include <can_virtual.hh>
+#include <test_node.hh>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace {
+
+constexpr time_sync::Config k_config{};
+constexpr std::uint32_t k_bitrate = 500'000;
+constexpr std::uint32_t k_bits_per_ms = k_bitrate / 1000;
+
+// Converts a drift estimate into parts per million.
+double drift_ppm(std::int32_t drift) {
+    return static_cast<double>(drift) * 1e6 / 4294967296.0;
+}
+
+TEST(TimeSyncClock, Mapping) {
+    time_sync::Clock clock(k_bitrate);
+    EXPECT_FALSE(clock.time(0));
+
+    clock.publish(1000, 5'000'000, 0);
+    EXPECT_EQ(clock.time(1000), 5'000'000u);
+    EXPECT_EQ(clock.time(1500), 5'001'000u);
+    EXPECT_EQ(clock.time(500), 4'999'000u);
+
+    // The local time stamps wrap.
+    clock.publish(0xffffff00u, 5'000'000, 0);
+    EXPECT_EQ(clock.time(0x100), 5'001'024u);
+
+    // A clock running 1% slow.
+    clock.publish(0, 0, static_cast<std::int32_t>(-0.01 * 4294967296.0));
+    EXPECT_NEAR(static_cast<double>(*clock.time(500'000)), 990'000.0, 1.0);
+}
+
+// A master and two slaves whose CAN timers run off clocks with different offsets and errors.
+struct TimeSync : testing::Test {
+    can::VirtualBus bus{k_bitrate};
+    test::TestNode master_node{bus};
+    test::TestNode slave_node{bus};
+    test::TestNode other_node{bus};
+    time_sync::Master master{k_config};
+    time_sync::Slave slave{k_config};
+    time_sync::Slave other{k_config};
+
+    // Drops frames sent by the master, e.g. to lose a follow-up.
+    bool (*drop)(const can::RawMessage &){nullptr};
+
+    void SetUp() override {
+        master_node.set_clock(123'456, 0.0);
+        slave_node.set_clock(-987'654, 50.0);
+        other_node.set_clock(4'000'000'000, -30.0);
+
+        ASSERT_TRUE(master_node.start({.timestamps = true}));
+        master_node.on_transmit([this](const can::RawMessage &message, std::uint32_t timestamp) {
+            master.on_transmit(message, timestamp);
+        });
+        ASSERT_TRUE(slave_node.start({.timestamps = true}));
+        slave_node.receive_all([this](const can::RawMessage &message, std::uint32_t timestamp) {
+            slave.on_frame(message, timestamp);
+        });
+        ASSERT_TRUE(other_node.start({.timestamps = true}));
+        other_node.receive_all([this](const can::RawMessage &message, std::uint32_t timestamp) {
+            other.on_frame(message, timestamp);
+        });
+    }
+
+    // Runs the master's 1 ms tick for the given time.
+    void run(std::uint32_t ms) {
+        bus.run_for(ms, [this] {
+            master_node.select();
+            if (const auto frame = master.poll(bus.now())) {
+                if (drop == nullptr || !drop(*frame)) {
+                    can::transmit(*frame);
+                }
+            }
+        });
+    }
+
+    // Difference in microseconds between a slave's vehicle time and the master's at the current bus time.
+    double error(const time_sync::Slave &node, const can::VirtualNode &virtual_node, std::uint64_t extra = 0) const {
+        const auto time = bus.time() + extra;
+        const auto expected = master.time(master_node.local_time(time));
+        const auto actual = node.time(virtual_node.local_time(time));
+        EXPECT_TRUE(expected && actual);
+        return static_cast<double>(*actual) - static_cast<double>(*expected);
+    }
+};
+
+TEST_F(TimeSync, NotSynchronised) {
+    EXPECT_FALSE(master.time(0));
+    EXPECT_FALSE(slave.time(0));
+    EXPECT_FALSE(slave.is_synchronised(0));
+}
+
+TEST_F(TimeSync, Agreement) {
+    run(2000);
+    EXPECT_TRUE(slave.is_synchronised(slave_node.local_time(bus.time())));
+    EXPECT_EQ(slave.statistics().sync_count, 20);
+    EXPECT_EQ(slave.statistics().step_count, 1);
+
+    // The drift estimate is limited by the time stamp resolution of one bit time at each end of the history.
+    EXPECT_NEAR(drift_ppm(slave.statistics().drift), -50.0, 3.0);
+    EXPECT_NEAR(drift_ppm(other.statistics().drift), 30.0, 3.0);
+
+    // Check agreement throughout the following periods, not just at the synchronisation points. The limit allows for
+    // the time stamp resolution of one bit time on each node.
+    double max_error = 0.0;
+    for (std::uint32_t i = 0; i < 1000; i++) {
+        run(1);
+        for (std::uint64_t offset = 0; offset < k_bits_per_ms; offset += 50) {
+            max_error = std::max({max_error, std::abs(error(slave, slave_node, offset)),
+                                  std::abs(error(other, other_node, offset))});
+        }
+    }
+    EXPECT_LT(max_error, 6.0);
+    EXPECT_EQ(slave.statistics().step_count, 1);
+    RecordProperty("max_error_us", std::to_string(max_error));
+}
+
+TEST_F(TimeSync, Monotonic) {
+    run(500);
+    std::uint64_t last = 0;
+    for (std::uint32_t i = 0; i < 2000; i++) {
+        run(1);
+        for (std::uint64_t offset = 0; offset < k_bits_per_ms; offset += 10) {
+            const auto time = *slave.time(slave_node.local_time(bus.time() + offset));
+            ASSERT_GE(time, last);
+            last = time;
+        }
+    }
+}
+
+TEST_F(TimeSync, LostFollowUp) {
+    run(1000);
+    const auto sync_count = slave.statistics().sync_count;
+
+    // Without follow-ups, the slave keeps its last estimate, which stays accurate until it times out.
+    drop = [](const can::RawMessage &frame) {
+        return frame.standard_id() == k_config.follow_up_id;
+    };
+    run(300);
+    EXPECT_EQ(slave.statistics().sync_count, sync_count);
+    EXPECT_LT(std::abs(error(slave, slave_node)), 10.0);
+    EXPECT_TRUE(slave.is_synchronised(slave_node.local_time(bus.time())));
+    run(300);
+    EXPECT_FALSE(slave.is_synchronised(slave_node.local_time(bus.time())));
+
+    drop = nullptr;
+    run(200);
+    EXPECT_TRUE(slave.is_synchronised(slave_node.local_time(bus.time())));
+    EXPECT_LT(std::abs(error(slave, slave_node)), 6.0);
+}
+
+TEST_F(TimeSync, MasterRestart) {
+    run(1000);
+    std::destroy_at(&master);
+    std::construct_at(&master, k_config);
+    run(1000);
+
+    // Vehicle time restarted, so the slaves stepped back with it.
+    EXPECT_EQ(slave.statistics().step_count, 2);
+    EXPECT_LT(*slave.time(slave_node.local_time(bus.time())), 1'000'000u);
+    EXPECT_LT(std::abs(error(slave, slave_node)), 6.0);
+}
+
+} // namespace
@@ -14,6 +14,27 @@ TEST(Util, Clamp) {
     EXPECT_EQ(util::clamp(10000, -2000, 2000), 2000);
 }
 
+TEST(Util, SpscRing) {
+    util::SpscRing<std::uint32_t, 4> ring;
+    std::uint32_t value = 0;
+    EXPECT_TRUE(ring.empty());
+    EXPECT_FALSE(ring.pop(value));
+
+    for (std::uint32_t i = 0; i < 4; i++) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.push(4));
+    EXPECT_EQ(ring.size(), 4);
+
+    // Wrap around the end of the buffer.
+    for (std::uint32_t i = 0; i < 10; i++) {
+        ASSERT_TRUE(ring.pop(value));
+        EXPECT_EQ(value, i);
+        EXPECT_TRUE(ring.push(i + 4));
+    }
+    EXPECT_EQ(ring.size(), 4);
+}
+
 TEST(Util, ReadBe) {
     EXPECT_EQ(util::read_be<std::uint8_t>(std::to_array<std::uint8_t>({0xff})), 0xff);
     EXPECT_EQ(util::read_be<std::uint16_t>(std::to_array<std::uint8_t>({0x42, 0x68})), 17000);
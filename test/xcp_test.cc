@@ -0,0 +1,279 @@
+#include <xcp.hh>
+
+#include <can.hh>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace {
+
+constexpr xcp::Config k_config{};
+
+std::uint8_t s_flag = 0;
+std::int16_t s_temperature = 0;
+std::int32_t s_erpm = 0;
+std::atomic<std::uint32_t> s_uptime{0};
+float s_gain = 10.0f;
+std::uint16_t s_threshold = 20;
+
+const auto k_variables = std::to_array<xcp::Variable>({
+    xcp::measurement(s_flag),
+    xcp::measurement(s_temperature),
+    xcp::measurement(s_erpm),
+    xcp::measurement(s_uptime),
+    xcp::parameter(s_gain),
+    xcp::parameter(s_threshold),
+});
+
+struct Xcp : testing::Test {
+    xcp::Slave slave{k_config, k_variables};
+    xcp::Master master{k_config};
+    std::uint32_t now{0};
+
+    void SetUp() override {
+        s_flag = 1;
+        s_temperature = -40;
+        s_erpm = -123456;
+        s_uptime = 1000;
+        s_gain = 10.0f;
+        s_threshold = 20;
+        master.connect();
+        run();
+    }
+
+    // Sends the master's commands straight to the slave until the queue is empty.
+    void run() {
+        while (master.is_busy()) {
+            if (const auto command = master.poll(now)) {
+                if (const auto response = slave.on_frame(*command)) {
+                    master.on_frame(*response, now);
+                }
+            }
+            now++;
+        }
+    }
+
+    std::optional<double> read(std::uint16_t variable, xcp::Type type) {
+        master.read(variable, type);
+        run();
+        return master.value();
+    }
+
+    std::optional<can::RawMessage> send(std::span<const std::uint8_t> command) {
+        return slave.on_frame(can::RawMessage::standard(k_config.command_id, command));
+    }
+};
+
+TEST(XcpTypes, Packing) {
+    using enum xcp::Type;
+    EXPECT_EQ(xcp::odt_count({}), 0);
+    EXPECT_EQ(xcp::odt_count(std::to_array<xcp::Measurement>({{0, U32}, {1, U16}, {2, U8}})), 1);
+    EXPECT_EQ(xcp::odt_count(std::to_array<xcp::Measurement>({{0, U32}, {1, U16}, {2, U16}})), 2);
+    EXPECT_EQ(xcp::odt_count(std::to_array<xcp::Measurement>({{0, F32}, {1, F32}, {2, F32}})), 3);
+}
+
+TEST(XcpTypes, Values) {
+    EXPECT_EQ(xcp::to_value(xcp::Type::I8, 0xff), -1.0);
+    EXPECT_EQ(xcp::to_value(xcp::Type::I16, 0x8000), -32768.0);
+    EXPECT_EQ(xcp::to_value(xcp::Type::U32, 0xffffffffu), 4294967295.0);
+    EXPECT_EQ(xcp::to_value(xcp::Type::F32, xcp::from_value(xcp::Type::F32, 0.25)), 0.25);
+    EXPECT_EQ(xcp::from_value(xcp::Type::I16, -2.0), 0xfffeu);
+    EXPECT_EQ(xcp::from_value(xcp::Type::U8, 41.6), 42u);
+}
+
+TEST(XcpSlave, IgnoredUntilConnected) {
+    xcp::Slave other(k_config, k_variables);
+    const auto upload = std::to_array<std::uint8_t>({0xf4, 1, 0, 0, 0, 0, 0, 0});
+    EXPECT_FALSE(other.on_frame(can::RawMessage::standard(k_config.command_id, upload)));
+
+    const auto connect_command = std::to_array<std::uint8_t>({0xff, 0});
+    const auto connect = other.on_frame(can::RawMessage::standard(k_config.command_id, connect_command));
+    ASSERT_TRUE(connect);
+    EXPECT_EQ(connect->standard_id(), k_config.response_id);
+    EXPECT_EQ(connect->length, 8);
+    EXPECT_EQ(connect->byte(0), xcp::k_positive_response);
+    EXPECT_EQ(connect->byte(3), 8);
+    EXPECT_TRUE(other.is_connected());
+}
+
+TEST_F(Xcp, Read) {
+    EXPECT_EQ(read(0, xcp::Type::U8), 1.0);
+    EXPECT_EQ(read(1, xcp::Type::I16), -40.0);
+    EXPECT_EQ(read(2, xcp::Type::I32), -123456.0);
+    EXPECT_EQ(read(3, xcp::Type::U32), 1000.0);
+    EXPECT_EQ(read(4, xcp::Type::F32), 10.0);
+    EXPECT_FALSE(master.error());
+}
+
+TEST_F(Xcp, Write) {
+    master.write(4, xcp::Type::F32, 12.5);
+    master.write(5, xcp::Type::U16, 35);
+    run();
+    EXPECT_FALSE(master.error());
+    EXPECT_EQ(s_gain, 12.5f);
+    EXPECT_EQ(s_threshold, 35);
+}
+
+TEST_F(Xcp, WriteProtected) {
+    master.write(2, xcp::Type::I32, 5);
+    run();
+    EXPECT_EQ(master.error(), xcp::Error::WriteProtected);
+    EXPECT_EQ(s_erpm, -123456);
+}
+
+TEST_F(Xcp, OutOfRange) {
+    // Unknown variable.
+    EXPECT_FALSE(read(k_variables.size(), xcp::Type::U8));
+    EXPECT_EQ(master.error(), xcp::Error::OutOfRange);
+
+    // Wrong size.
+    read(3, xcp::Type::U16);
+    EXPECT_EQ(master.error(), xcp::Error::OutOfRange);
+
+    // A new command clears the error.
+    EXPECT_EQ(read(0, xcp::Type::U8), 1.0);
+    EXPECT_FALSE(master.error());
+}
+
+TEST_F(Xcp, UnknownCommand) {
+    const auto response = send(std::to_array<std::uint8_t>({0xc5}));
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->byte(0), xcp::k_error_response);
+    EXPECT_EQ(response->byte(1), static_cast<std::uint8_t>(xcp::Error::CmdUnknown));
+
+    const auto short_command = send(std::to_array<std::uint8_t>({0xf4, 1}));
+    ASSERT_TRUE(short_command);
+    EXPECT_EQ(short_command->byte(1), static_cast<std::uint8_t>(xcp::Error::CmdSyntax));
+    EXPECT_EQ(slave.statistics().error_count, 2);
+}
+
+TEST_F(Xcp, Timeout) {
+    xcp::Master other(k_config);
+    other.connect();
+    ASSERT_TRUE(other.poll(0));
+    EXPECT_FALSE(other.poll(k_config.timeout - 1));
+    EXPECT_FALSE(other.poll(k_config.timeout));
+    EXPECT_TRUE(other.is_timed_out());
+    EXPECT_FALSE(other.is_busy());
+}
+
+constexpr auto k_fast_measurements = std::to_array<xcp::Measurement>({
+    {2, xcp::Type::I32},
+    {1, xcp::Type::I16},
+    {0, xcp::Type::U8},
+    {3, xcp::Type::U32},
+});
+constexpr auto k_slow_measurements = std::to_array<xcp::Measurement>({
+    {4, xcp::Type::F32},
+    {5, xcp::Type::U16},
+});
+constexpr auto k_lists = std::to_array<xcp::DaqListConfig>({
+    {0, 1, k_fast_measurements},
+    {0, 5, k_slow_measurements},
+});
+
+TEST_F(Xcp, Daq) {
+    ASSERT_TRUE(master.start_daq(k_lists));
+    run();
+    ASSERT_FALSE(master.error());
+
+    std::array<can::RawMessage, 8> frames{};
+    std::array<xcp::Sample, xcp::k_odt_size> samples{};
+    for (std::uint32_t tick = 1; tick <= 10; tick++) {
+        s_uptime = tick;
+        const auto count = slave.sample(0, frames);
+
+        // The fast list packs into two ODTs and is sent every tick; the slow list packs into one every fifth tick.
+        ASSERT_EQ(count, tick % 5 == 0 ? 3 : 2);
+        EXPECT_EQ(frames[0].byte(0), 0);
+        EXPECT_EQ(frames[0].length, 8);
+        EXPECT_EQ(frames[1].byte(0), 1);
+        EXPECT_EQ(frames[1].length, 5);
+
+        ASSERT_EQ(master.decode(frames[0], samples), 3);
+        EXPECT_EQ(samples[0].list, 0);
+        EXPECT_EQ(samples[0].measurement, 0);
+        EXPECT_EQ(samples[0].value, -123456.0);
+        EXPECT_EQ(samples[1].value, -40.0);
+        EXPECT_EQ(samples[2].value, 1.0);
+        ASSERT_EQ(master.decode(frames[1], samples), 1);
+        EXPECT_EQ(samples[0].measurement, 3);
+        EXPECT_EQ(samples[0].value, tick);
+
+        if (count == 3) {
+            EXPECT_EQ(frames[2].byte(0), 2);
+            ASSERT_EQ(master.decode(frames[2], samples), 2);
+            EXPECT_EQ(samples[0].list, 1);
+            EXPECT_EQ(samples[0].value, 10.0);
+            EXPECT_EQ(samples[1].value, 20.0);
+        }
+    }
+
+    // Other events don't sample the lists.
+    EXPECT_EQ(slave.sample(1, frames), 0);
+
+    // Nothing is sent once stopped.
+    master.stop_daq();
+    run();
+    EXPECT_EQ(slave.sample(0, frames), 0);
+    EXPECT_EQ(slave.statistics().daq_frame_count, 22);
+}
+
+TEST_F(Xcp, CalibrateWhileRunning) {
+    ASSERT_TRUE(master.start_daq(k_lists));
+    run();
+
+    // Parameters can be written while DAQ is running, and the next sample sees the new value.
+    master.write(4, xcp::Type::F32, 2.5);
+    run();
+    std::array<can::RawMessage, 8> frames{};
+    std::array<xcp::Sample, xcp::k_odt_size> samples{};
+    for (int i = 0; i < 5; i++) {
+        slave.sample(0, frames);
+    }
+    ASSERT_EQ(master.decode(frames[2], samples), 2);
+    EXPECT_EQ(samples[0].value, 2.5);
+
+    // The configuration can't be changed.
+    const auto response = send(std::to_array<std::uint8_t>({0xd6}));
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->byte(1), static_cast<std::uint8_t>(xcp::Error::DaqActive));
+
+    // Reconfiguring stops the lists first.
+    ASSERT_TRUE(master.start_daq(std::span(k_lists).first(1)));
+    run();
+    EXPECT_FALSE(master.error());
+    EXPECT_EQ(slave.sample(0, frames), 2);
+}
+
+TEST_F(Xcp, Overflow) {
+    ASSERT_TRUE(master.start_daq(k_lists));
+    run();
+    std::array<can::RawMessage, 1> frames{};
+    EXPECT_EQ(slave.sample(0, frames), 1);
+    EXPECT_EQ(slave.statistics().overflow_count, 1);
+}
+
+TEST_F(Xcp, TooLarge) {
+    std::array<xcp::Measurement, xcp::k_max_odt_count + 1> measurements{};
+    measurements.fill({2, xcp::Type::I32});
+    const auto lists = std::to_array<xcp::DaqListConfig>({{0, 1, measurements}});
+    EXPECT_FALSE(master.start_daq(lists));
+    EXPECT_FALSE(master.is_busy());
+}
+
+TEST_F(Xcp, Disconnect) {
+    ASSERT_TRUE(master.start_daq(k_lists));
+    run();
+    ASSERT_TRUE(send(std::to_array<std::uint8_t>({0xfe})));
+    EXPECT_FALSE(slave.is_connected());
+    std::array<can::RawMessage, 8> frames{};
+    EXPECT_EQ(slave.sample(0, frames), 0);
+}
+
+} // namespace